@@ -0,0 +1,386 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "BinaryModel.hpp"
+
+namespace Vanga
+{
+  static_assert(
+    sizeof(BinaryModel::Header) == 24 &&
+    sizeof(BinaryModel::TreeHeader) == 32 &&
+    sizeof(CompiledDTree::Node) == 16 &&
+    sizeof(CompiledDTree::Branch) == 40,
+    "binary model structures shouldn't contain padding");
+
+  static_assert(
+    std::is_trivially_copyable<CompiledDTree::Node>::value &&
+    std::is_trivially_copyable<CompiledDTree::Branch>::value,
+    "binary model structures should be trivially copyable");
+
+  namespace
+  {
+    const unsigned long SECTION_ALIGN = 8;
+
+    uint64_t
+    align_section(uint64_t offset)
+    {
+      return (offset + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+    }
+  }
+
+  const char BinaryModel::MAGIC[8] = { 'V', 'A', 'N', 'G', 'A', 'B', 'M', 0 };
+  const uint32_t BinaryModel::VERSION;
+  const uint32_t BinaryModel::BYTE_ORDER_MARK;
+
+  // BinaryModel::SetVisitor: compiles DTrees of set
+  class BinaryModel::SetVisitor: public PredictorVisitor
+  {
+  public:
+    SetVisitor(TreeArray& trees)
+      : trees_(trees)
+    {}
+
+    virtual void
+    visit(const DTree* tree, double coef)
+    {
+      trees_.push_back(std::make_pair(CompiledDTree_var(new CompiledDTree(tree)), coef));
+    }
+
+    virtual void
+    visit(const PredictorSet* /*predictor_set*/, double /*coef*/)
+    {
+      throw Exception("BinaryModel: nested predictor sets aren't supported");
+    }
+
+    virtual void
+    visit_other(double /*coef*/)
+    {
+      throw Exception("BinaryModel: predictor set contains unsupported predictor");
+    }
+
+  protected:
+    TreeArray& trees_;
+  };
+
+  // BinaryModel
+  BinaryModel::BinaryModel(const DTree* tree)
+    : type_(PT_DTREE)
+  {
+    trees_.push_back(std::make_pair(CompiledDTree_var(new CompiledDTree(tree)), 1.0));
+  }
+
+  BinaryModel::BinaryModel(const PredictorSet* predictor_set)
+    : type_(PT_SET)
+  {
+    SetVisitor visitor(trees_);
+    predictor_set->visit(visitor);
+  }
+
+  BinaryModel::BinaryModel(const std::string& file_path)
+    : file_(new MappedFile(file_path))
+  {
+    const char* data = static_cast<const char*>(file_->data());
+    const uint64_t file_size = file_->size();
+
+    if(file_size < sizeof(Header) ||
+      ::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: '" << file_path << "' isn't binary model";
+      throw Exception(ostr.str());
+    }
+
+    const Header& header = *reinterpret_cast<const Header*>(data);
+
+    if(header.byte_order != BYTE_ORDER_MARK)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: '" << file_path << "' saved with other byte order";
+      throw Exception(ostr.str());
+    }
+
+    if(header.version != VERSION)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: '" << file_path << "' has unsupported version " <<
+        header.version;
+      throw Exception(ostr.str());
+    }
+
+    if((header.type != PT_DTREE || header.tree_count != 1) &&
+      header.type != PT_SET)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: '" << file_path << "' has invalid model type";
+      throw Exception(ostr.str());
+    }
+
+    type_ = static_cast<PredictorType>(header.type);
+
+    if(file_size < sizeof(Header) +
+      static_cast<uint64_t>(header.tree_count) * sizeof(TreeHeader))
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: '" << file_path << "' is truncated";
+      throw Exception(ostr.str());
+    }
+
+    const TreeHeader* tree_headers = reinterpret_cast<const TreeHeader*>(
+      data + sizeof(Header));
+
+    // tree sections can't overlap headers
+    const uint64_t sections_begin = sizeof(Header) +
+      static_cast<uint64_t>(header.tree_count) * sizeof(TreeHeader);
+
+    trees_.reserve(header.tree_count);
+
+    for(uint32_t tree_i = 0; tree_i < header.tree_count; ++tree_i)
+    {
+      const TreeHeader& tree_header = tree_headers[tree_i];
+
+      if(tree_header.offset % SECTION_ALIGN != 0 ||
+        tree_header.offset < sections_begin ||
+        tree_header.offset > file_size ||
+        section_size_(tree_header) > file_size - tree_header.offset)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "BinaryModel: '" << file_path << "' has invalid tree #" <<
+          tree_i << " section";
+        throw Exception(ostr.str());
+      }
+
+      uint64_t offset = tree_header.offset;
+      const ConstArrayRef<CompiledDTree::Node> nodes =
+        section_array_<CompiledDTree::Node>(data, offset, tree_header.node_count);
+      const ConstArrayRef<CompiledDTree::Branch> branches =
+        section_array_<CompiledDTree::Branch>(data, offset, tree_header.branch_count);
+      const ConstArrayRef<uint32_t> features =
+        section_array_<uint32_t>(data, offset, tree_header.feature_count);
+
+      try
+      {
+        trees_.push_back(std::make_pair(
+          CompiledDTree_var(new CompiledDTree(file_, nodes, branches, features)),
+          tree_header.coef));
+      }
+      catch(const CompiledDTree::Exception& ex)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "BinaryModel: '" << file_path << "' tree #" << tree_i <<
+          ": " << ex.what();
+        throw Exception(ostr.str());
+      }
+    }
+  }
+
+  bool
+  BinaryModel::is_binary(const std::string& file_path)
+  {
+    std::ifstream file(file_path.c_str(), std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    file.read(magic, sizeof(magic));
+    return !file.fail() && ::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+  }
+
+  Gears::IntrusivePtr<BinaryModel>
+  BinaryModel::load(const std::string& file_path)
+  {
+    if(is_binary(file_path))
+    {
+      return new BinaryModel(file_path);
+    }
+
+    std::ifstream model_file(file_path.c_str());
+    if(!model_file.is_open())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "BinaryModel: can't open '" << file_path << "'";
+      throw Exception(ostr.str());
+    }
+
+    const PredictorType predictor_type = PredictorLoader::load_type(model_file);
+
+    if(predictor_type == PT_DTREE)
+    {
+      DTree_var tree = DTree::load(model_file, false);
+      return new BinaryModel(tree.in());
+    }
+    else if(predictor_type == PT_SET)
+    {
+      PredictorSet_var predictor_set = PredictorSet::load(model_file, false);
+      return new BinaryModel(predictor_set.in());
+    }
+
+    Gears::ErrorStream ostr;
+    ostr << "BinaryModel: unknown model type in '" << file_path << "'";
+    throw Exception(ostr.str());
+  }
+
+  void
+  BinaryModel::save(std::ostream& ostr) const
+  {
+    Header header;
+    ::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.type = type_;
+    header.tree_count = trees_.size();
+
+    std::vector<TreeHeader> tree_headers(trees_.size());
+    uint64_t offset = sizeof(Header) + sizeof(TreeHeader) * trees_.size();
+
+    for(unsigned long tree_i = 0; tree_i < trees_.size(); ++tree_i)
+    {
+      const CompiledDTree* tree = trees_[tree_i].first;
+      TreeHeader& tree_header = tree_headers[tree_i];
+      tree_header.coef = trees_[tree_i].second;
+      tree_header.offset = offset;
+      tree_header.node_count = tree->nodes().size();
+      tree_header.branch_count = tree->branches().size();
+      tree_header.feature_count = tree->features().size();
+      tree_header.reserved = 0;
+      offset = align_section(offset + section_size_(tree_header));
+    }
+
+    ostr.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ostr.write(
+      reinterpret_cast<const char*>(tree_headers.data()),
+      sizeof(TreeHeader) * tree_headers.size());
+
+    const char PADDING[SECTION_ALIGN] = { 0 };
+
+    for(unsigned long tree_i = 0; tree_i < trees_.size(); ++tree_i)
+    {
+      const CompiledDTree* tree = trees_[tree_i].first;
+      const uint64_t section_size = section_size_(tree_headers[tree_i]);
+
+      ostr.write(
+        reinterpret_cast<const char*>(tree->nodes().data()),
+        sizeof(CompiledDTree::Node) * tree->nodes().size());
+      ostr.write(
+        reinterpret_cast<const char*>(tree->branches().data()),
+        sizeof(CompiledDTree::Branch) * tree->branches().size());
+      ostr.write(
+        reinterpret_cast<const char*>(tree->features().data()),
+        sizeof(uint32_t) * tree->features().size());
+      ostr.write(PADDING, align_section(section_size) - section_size);
+    }
+  }
+
+  void
+  BinaryModel::save_text(std::ostream& ostr) const
+  {
+    if(type_ == PT_DTREE)
+    {
+      trees_[0].first->tree()->save(ostr);
+    }
+    else
+    {
+      PredictorSet_var predictor_set = new PredictorSet();
+
+      for(auto tree_it = trees_.begin(); tree_it != trees_.end(); ++tree_it)
+      {
+        predictor_set->add(tree_it->first->tree().in(), tree_it->second);
+      }
+
+      predictor_set->save(ostr);
+    }
+  }
+
+  PredictorType
+  BinaryModel::type() const throw()
+  {
+    return type_;
+  }
+
+  unsigned long
+  BinaryModel::tree_count() const throw()
+  {
+    return trees_.size();
+  }
+
+  const CompiledDTree*
+  BinaryModel::tree(unsigned long tree_i) const throw()
+  {
+    return trees_[tree_i].first;
+  }
+
+  double
+  BinaryModel::coef(unsigned long tree_i) const throw()
+  {
+    return trees_[tree_i].second;
+  }
+
+  void
+  BinaryModel::numeric_features(NumericFeatureSet& features) const throw()
+  {
+    for(auto tree_it = trees_.begin(); tree_it != trees_.end(); ++tree_it)
+    {
+      tree_it->first->numeric_features(features);
+    }
+  }
+
+  void
+  BinaryModel::predict(
+    double* preds,
+    const FeatureArray* const* feature_sets,
+    unsigned long count)
+    const throw()
+  {
+    if(type_ == PT_DTREE)
+    {
+      trees_[0].first->predict(preds, feature_sets, count);
+      return;
+    }
+
+    Gears::IntrusivePtr<BufferPtr<double> > tree_preds_ptr =
+      BufferProvider<double>::instance().get(count);
+    std::vector<double>& tree_preds = tree_preds_ptr->buf();
+    tree_preds.resize(count);
+
+    std::fill(preds, preds + count, 0.0);
+
+    for(auto tree_it = trees_.begin(); tree_it != trees_.end(); ++tree_it)
+    {
+      tree_it->first->predict(tree_preds.data(), feature_sets, count);
+
+      for(unsigned long row_i = 0; row_i < count; ++row_i)
+      {
+        preds[row_i] += tree_it->second * static_cast<float>(tree_preds[row_i]);
+      }
+    }
+  }
+
+  uint64_t
+  BinaryModel::section_size_(const TreeHeader& tree_header) throw()
+  {
+    return sizeof(CompiledDTree::Node) * static_cast<uint64_t>(tree_header.node_count) +
+      sizeof(CompiledDTree::Branch) * static_cast<uint64_t>(tree_header.branch_count) +
+      sizeof(uint32_t) * static_cast<uint64_t>(tree_header.feature_count);
+  }
+}
@@ -0,0 +1,160 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef BINARYMODEL_HPP_
+#define BINARYMODEL_HPP_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+
+#include "DTree.hpp"
+#include "PredictorSet.hpp"
+#include "CompiledDTree.hpp"
+#include "MappedFile.hpp"
+
+namespace Vanga
+{
+  // BinaryModel: DTree or PredictorSet of DTrees in versioned binary format,
+  // trees are saved in CompiledDTree layout and mapped from file
+  // without parsing and per node allocations.
+  // File image (native byte order, sections aligned by 8 bytes):
+  //   Header
+  //   TreeHeader[tree_count]
+  //   tree sections: Node[node_count], Branch[branch_count], uint32_t[feature_count]
+  // predictions are equal to DTree::fpredict, PredictorSet::fpredict
+  class BinaryModel: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Predictor::Exception);
+
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+    static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Header
+    {
+      char magic[8];
+      uint32_t version;
+      uint32_t byte_order; // BYTE_ORDER_MARK
+      uint32_t type; // PT_DTREE or PT_SET
+      uint32_t tree_count;
+    };
+
+    struct TreeHeader
+    {
+      double coef; // 1.0 for PT_DTREE
+      uint64_t offset; // from file begin
+      uint32_t node_count;
+      uint32_t branch_count;
+      uint32_t feature_count;
+      uint32_t reserved;
+    };
+
+  public:
+    BinaryModel(const DTree* tree);
+
+    // nested sets and predictors of other types aren't supported
+    BinaryModel(const PredictorSet* predictor_set);
+
+    // map file
+    BinaryModel(const std::string& file_path);
+
+    // check that file starts with MAGIC
+    static bool
+    is_binary(const std::string& file_path);
+
+    // binary model is mapped, text model (DTree or PredictorSet) is compiled
+    static Gears::IntrusivePtr<BinaryModel>
+    load(const std::string& file_path);
+
+    // save binary image
+    void
+    save(std::ostream& ostr) const;
+
+    // save DTree or PredictorSet text format
+    void
+    save_text(std::ostream& ostr) const;
+
+    PredictorType
+    type() const throw();
+
+    unsigned long
+    tree_count() const throw();
+
+    const CompiledDTree*
+    tree(unsigned long tree_i) const throw();
+
+    double
+    coef(unsigned long tree_i) const throw();
+
+    void
+    numeric_features(NumericFeatureSet& features) const throw();
+
+    template<typename FeatureSetType>
+    double
+    fpredict(const FeatureSetType& feature_set) const throw();
+
+    // block prediction, see CompiledDTree::predict
+    void
+    predict(
+      double* preds,
+      const FeatureArray* const* feature_sets,
+      unsigned long count)
+      const throw();
+
+  protected:
+    class SetVisitor;
+
+    typedef std::vector<std::pair<CompiledDTree_var, double> > TreeArray;
+
+  protected:
+    virtual ~BinaryModel() throw() {}
+
+    static uint64_t
+    section_size_(const TreeHeader& tree_header) throw();
+
+    template<typename ValueType>
+    static ConstArrayRef<ValueType>
+    section_array_(
+      const char* data,
+      uint64_t& offset,
+      unsigned long size)
+      throw();
+
+  protected:
+    PredictorType type_;
+    TreeArray trees_;
+    MappedFile_var file_;
+  };
+
+  typedef Gears::IntrusivePtr<BinaryModel> BinaryModel_var;
+}
+
+#include "BinaryModel.tpp"
+
+#endif /*BINARYMODEL_HPP_*/
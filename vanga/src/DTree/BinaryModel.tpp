@@ -0,0 +1,58 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+namespace Vanga
+{
+  template<typename FeatureSetType>
+  double
+  BinaryModel::fpredict(const FeatureSetType& feature_set) const throw()
+  {
+    if(type_ == PT_DTREE)
+    {
+      return trees_[0].first->fpredict(feature_set);
+    }
+
+    // PredictorSet sums float predictions of trees
+    double sum = 0.0;
+    for(auto tree_it = trees_.begin(); tree_it != trees_.end(); ++tree_it)
+    {
+      sum += tree_it->second * static_cast<float>(
+        tree_it->first->fpredict(feature_set));
+    }
+
+    return sum;
+  }
+
+  template<typename ValueType>
+  ConstArrayRef<ValueType>
+  BinaryModel::section_array_(
+    const char* data,
+    uint64_t& offset,
+    unsigned long size)
+    throw()
+  {
+    ConstArrayRef<ValueType> res(
+      reinterpret_cast<const ValueType*>(data + offset), size);
+    offset += sizeof(ValueType) * size;
+    return res;
+  }
+}
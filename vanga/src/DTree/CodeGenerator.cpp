@@ -0,0 +1,331 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cctype>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "CodeGenerator.hpp"
+
+namespace Vanga
+{
+  // CodeGenerator::SetVisitor: writes predictors of set
+  class CodeGenerator::SetVisitor: public PredictorVisitor
+  {
+  public:
+    typedef std::vector<std::pair<std::string, double> > FunctionArray;
+
+  public:
+    SetVisitor(CodeGenerator& generator)
+      : generator_(generator)
+    {}
+
+    virtual void
+    visit(const DTree* tree, double coef)
+    {
+      functions.push_back(std::make_pair(generator_.write_tree_(tree), coef));
+    }
+
+    virtual void
+    visit(const PredictorSet* predictor_set, double coef)
+    {
+      functions.push_back(std::make_pair(generator_.write_set_(predictor_set), coef));
+    }
+
+    virtual void
+    visit_other(double /*coef*/)
+    {
+      throw Exception("CodeGenerator: predictor set contains unsupported predictor");
+    }
+
+  public:
+    FunctionArray functions;
+
+  protected:
+    CodeGenerator& generator_;
+  };
+
+  // CodeGenerator
+  CodeGenerator::CodeGenerator(std::ostream& out) throw()
+    : out_(out),
+      function_count_(0)
+  {}
+
+  void
+  CodeGenerator::generate(
+    std::ostream& out,
+    const DTree* tree,
+    const char* function_name)
+  {
+    CodeGenerator generator(out);
+    generator.write_head_(function_name);
+    generator.write_tail_(function_name, generator.write_tree_(tree));
+  }
+
+  void
+  CodeGenerator::generate(
+    std::ostream& out,
+    const PredictorSet* predictor_set,
+    const char* function_name)
+  {
+    CodeGenerator generator(out);
+    generator.write_head_(function_name);
+    generator.write_tail_(function_name, generator.write_set_(predictor_set));
+  }
+
+  void
+  CodeGenerator::write_head_(const char* function_name)
+  {
+    const std::string name(function_name);
+
+    bool valid_name = !name.empty() && !::isdigit(name[0]);
+    for(auto it = name.begin(); it != name.end(); ++it)
+    {
+      valid_name &= ::isalnum(*it) || *it == '_';
+    }
+
+    if(!valid_name)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "CodeGenerator: invalid function name '" << name << "'";
+      throw Exception(ostr.str());
+    }
+
+    out_ <<
+      "// generated by DTreeTrainer codegen: model prediction function\n"
+      "//   extern \"C\" double " << name <<
+        "(const vanga_feature* features, unsigned long count)\n"
+      "// features must be sorted by id, build as C++17 without -ffast-math\n"
+      "\n"
+      "#include <stdint.h>\n"
+      "#include <string.h>\n"
+      "\n"
+      "#ifndef VANGA_FEATURE_DEFINED\n"
+      "#define VANGA_FEATURE_DEFINED\n"
+      "extern \"C\"\n"
+      "{\n"
+      "  struct vanga_feature\n"
+      "  {\n"
+      "    uint32_t id;\n"
+      "    uint32_t value; // numeric feature value as float bits\n"
+      "  };\n"
+      "}\n"
+      "#endif\n"
+      "\n"
+      "namespace\n"
+      "{\n"
+      "  inline bool\n"
+      "  get_feature(\n"
+      "    uint32_t& value,\n"
+      "    const vanga_feature* features,\n"
+      "    unsigned long count,\n"
+      "    uint32_t id)\n"
+      "  {\n"
+      "    unsigned long left = 0;\n"
+      "    unsigned long right = count;\n"
+      "\n"
+      "    while(left < right)\n"
+      "    {\n"
+      "      const unsigned long middle = (left + right) / 2;\n"
+      "      if(features[middle].id < id)\n"
+      "      {\n"
+      "        left = middle + 1;\n"
+      "      }\n"
+      "      else\n"
+      "      {\n"
+      "        right = middle;\n"
+      "      }\n"
+      "    }\n"
+      "\n"
+      "    if(left < count && features[left].id == id)\n"
+      "    {\n"
+      "      value = features[left].value;\n"
+      "      return true;\n"
+      "    }\n"
+      "\n"
+      "    return false;\n"
+      "  }\n"
+      "\n"
+      "  inline float\n"
+      "  feature_float(uint32_t value)\n"
+      "  {\n"
+      "    float res;\n"
+      "    memcpy(&res, &value, sizeof(res));\n"
+      "    return res;\n"
+      "  }\n"
+      "}\n";
+  }
+
+  void
+  CodeGenerator::write_tail_(
+    const char* function_name,
+    const std::string& root_function)
+  {
+    out_ <<
+      "\n"
+      "extern \"C\" double\n" <<
+      function_name << "(const vanga_feature* features, unsigned long count)\n"
+      "{\n"
+      "  return " << root_function << "(features, count);\n"
+      "}\n";
+  }
+
+  std::string
+  CodeGenerator::write_tree_(const DTree* tree)
+  {
+    // function per node with branches (keeps functions small for compiler),
+    // subtree functions written before parent node function
+    const DTree::BranchArray& branches = tree->branches();
+
+    std::vector<std::pair<std::string, std::string> > branch_values;
+
+    for(auto branch_it = branches.begin(); branch_it != branches.end(); ++branch_it)
+    {
+      branch_values.push_back(std::make_pair(
+        subtree_value_(branch_it->yes_tree),
+        subtree_value_(branch_it->no_tree)));
+    }
+
+    // node value summed in DTree::fpredict order:
+    // delta_prob, then values of selected subtrees in branches order
+    const std::string name = next_function_name_("node_");
+
+    out_ <<
+      "\n"
+      "namespace\n"
+      "{\n"
+      "  double\n"
+      "  " << name << "(const vanga_feature* features, unsigned long count)\n"
+      "  {\n"
+      "    double res = " << double_literal_(tree->delta_prob) << ";\n";
+
+    if(!branches.empty())
+    {
+      out_ << "    uint32_t value;\n";
+    }
+
+    for(unsigned long branch_i = 0; branch_i < branches.size(); ++branch_i)
+    {
+      const DTree::Branch& branch = branches[branch_i];
+
+      out_ << "    res += get_feature(value, features, count, " <<
+        branch.feature_id << "u)";
+
+      if(branch.numeric)
+      {
+        out_ << " && feature_float(value) >= " << float_literal_(branch.threshold);
+      }
+
+      out_ << " ?\n"
+        "      " << branch_values[branch_i].first << " :\n"
+        "      " << branch_values[branch_i].second << ";\n";
+    }
+
+    out_ <<
+      "    return res;\n"
+      "  }\n"
+      "}\n";
+
+    return name;
+  }
+
+  std::string
+  CodeGenerator::subtree_value_(const DTree* tree)
+  {
+    if(!tree)
+    {
+      return "0.0";
+    }
+
+    if(tree->branches().empty())
+    {
+      // leaf value is delta_prob without additions
+      return double_literal_(tree->delta_prob);
+    }
+
+    return write_tree_(tree) + "(features, count)";
+  }
+
+  std::string
+  CodeGenerator::write_set_(const PredictorSet* predictor_set)
+  {
+    // PredictorSet::fpredict sums coef * float(predictor value)
+    SetVisitor visitor(*this);
+    predictor_set->visit(visitor);
+
+    const std::string name = next_function_name_("set_");
+
+    out_ <<
+      "\n"
+      "namespace\n"
+      "{\n"
+      "  double\n"
+      "  " << name << "(const vanga_feature* features, unsigned long count)\n"
+      "  {\n"
+      "    double res = 0.0;\n";
+
+    for(auto it = visitor.functions.begin(); it != visitor.functions.end(); ++it)
+    {
+      out_ << "    res += " << double_literal_(it->second) <<
+        " * static_cast<float>(" << it->first << "(features, count));\n";
+    }
+
+    out_ <<
+      "    return res;\n"
+      "  }\n"
+      "}\n";
+
+    return name;
+  }
+
+  std::string
+  CodeGenerator::next_function_name_(const char* prefix)
+  {
+    std::ostringstream ostr;
+    ostr << prefix << function_count_++;
+    return ostr.str();
+  }
+
+  std::string
+  CodeGenerator::double_literal_(double value)
+  {
+    if(!std::isfinite(value))
+    {
+      Gears::ErrorStream ostr;
+      ostr << "CodeGenerator: non finite model value " << value;
+      throw Exception(ostr.str());
+    }
+
+    std::ostringstream ostr;
+    ostr << std::hexfloat << value;
+    return ostr.str();
+  }
+
+  std::string
+  CodeGenerator::float_literal_(float value)
+  {
+    // float is exactly representable by double hex literal with f suffix
+    return double_literal_(value) + "f";
+  }
+}
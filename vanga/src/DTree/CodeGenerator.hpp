@@ -0,0 +1,98 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CODEGENERATOR_HPP_
+#define CODEGENERATOR_HPP_
+
+#include <iostream>
+#include <string>
+
+#include <Gears/Basic/Exception.hpp>
+
+#include "DTree.hpp"
+#include "PredictorSet.hpp"
+
+namespace Vanga
+{
+  // CodeGenerator: translates DTree or PredictorSet into self-contained
+  // C++ translation unit with C ABI function:
+  //   extern "C" double <function_name>(const vanga_feature* features, unsigned long count)
+  // features must be sorted by id (FeatureArray layout), function don't use heap.
+  // all constants written as hex float literals (C++17): result is equal
+  // to model fpredict if code compiled without -ffast-math (and FMA contraction)
+  class CodeGenerator
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Predictor::Exception);
+
+  public:
+    static void
+    generate(
+      std::ostream& out,
+      const DTree* tree,
+      const char* function_name);
+
+    static void
+    generate(
+      std::ostream& out,
+      const PredictorSet* predictor_set,
+      const char* function_name);
+
+  protected:
+    class SetVisitor;
+
+  protected:
+    CodeGenerator(std::ostream& out) throw();
+
+    void
+    write_head_(const char* function_name);
+
+    void
+    write_tail_(const char* function_name, const std::string& root_function);
+
+    // write functions of tree nodes, returns name of root node function
+    std::string
+    write_tree_(const DTree* tree);
+
+    // expression of subtree value (writes functions of subtree nodes)
+    std::string
+    subtree_value_(const DTree* tree);
+
+    // write functions of set and its predictors, returns function name
+    std::string
+    write_set_(const PredictorSet* predictor_set);
+
+    std::string
+    next_function_name_(const char* prefix);
+
+    static std::string
+    double_literal_(double value);
+
+    static std::string
+    float_literal_(float value);
+
+  protected:
+    std::ostream& out_;
+    unsigned long function_count_;
+  };
+}
+
+#endif /*CODEGENERATOR_HPP_*/
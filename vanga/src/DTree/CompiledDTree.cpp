@@ -0,0 +1,527 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "CompiledDTree.hpp"
+
+namespace Vanga
+{
+  const uint32_t CompiledDTree::NO_NODE;
+  const unsigned long CompiledDTree::BLOCK_SIZE;
+  const unsigned long CompiledDTree::MIN_BLOCK_ROWS;
+  const unsigned long CompiledDTree::LOCAL_FRAMES;
+
+  CompiledDTree::CompiledDTree(const DTree* tree)
+    : depth_(0)
+  {
+    node_buf_.reserve(tree->node_count());
+    add_node_(tree, 1);
+
+    for(auto branch_it = branch_buf_.begin(); branch_it != branch_buf_.end(); ++branch_it)
+    {
+      feature_buf_.push_back(branch_it->feature_id);
+    }
+
+    std::sort(feature_buf_.begin(), feature_buf_.end());
+    feature_buf_.erase(
+      std::unique(feature_buf_.begin(), feature_buf_.end()),
+      feature_buf_.end());
+
+    for(auto branch_it = branch_buf_.begin(); branch_it != branch_buf_.end(); ++branch_it)
+    {
+      branch_it->feature_column = std::lower_bound(
+        feature_buf_.begin(), feature_buf_.end(), branch_it->feature_id) -
+        feature_buf_.begin();
+    }
+
+    nodes_ = ConstArrayRef<Node>(node_buf_.data(), node_buf_.size());
+    branches_ = ConstArrayRef<Branch>(branch_buf_.data(), branch_buf_.size());
+    features_ = ConstArrayRef<uint32_t>(feature_buf_.data(), feature_buf_.size());
+  }
+
+  CompiledDTree::CompiledDTree(
+    MappedFile* file,
+    const ConstArrayRef<Node>& nodes,
+    const ConstArrayRef<Branch>& branches,
+    const ConstArrayRef<uint32_t>& features)
+    : file_(Gears::add_ref(file)),
+      nodes_(nodes),
+      branches_(branches),
+      features_(features),
+      depth_(0)
+  {
+    validate_();
+  }
+
+  unsigned long
+  CompiledDTree::node_count() const throw()
+  {
+    return nodes_.size();
+  }
+
+  unsigned long
+  CompiledDTree::depth() const throw()
+  {
+    return depth_;
+  }
+
+  const ConstArrayRef<CompiledDTree::Node>&
+  CompiledDTree::nodes() const throw()
+  {
+    return nodes_;
+  }
+
+  const ConstArrayRef<CompiledDTree::Branch>&
+  CompiledDTree::branches() const throw()
+  {
+    return branches_;
+  }
+
+  const ConstArrayRef<uint32_t>&
+  CompiledDTree::features() const throw()
+  {
+    return features_;
+  }
+
+  void
+  CompiledDTree::numeric_features(NumericFeatureSet& features) const throw()
+  {
+    for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
+    {
+      if(branch_it->numeric)
+      {
+        features.insert(branch_it->feature_id);
+      }
+    }
+  }
+
+  DTree_var
+  CompiledDTree::tree() const
+  {
+    unsigned long next_tree_id = 1;
+    return restore_node_(0, next_tree_id);
+  }
+
+  void
+  CompiledDTree::predict(
+    double* preds,
+    const FeatureArray* const* feature_sets,
+    unsigned long count)
+    const throw()
+  {
+    if(count < MIN_BLOCK_ROWS)
+    {
+      for(unsigned long row_i = 0; row_i < count; ++row_i)
+      {
+        preds[row_i] = fpredict(*feature_sets[row_i]);
+      }
+
+      return;
+    }
+
+    // scratch level L keeps rows and values of nodes at depth L + 1
+    // (and branch partitions of nodes at depth L)
+    const unsigned long scratch_size = (depth_ + 1) * BLOCK_SIZE;
+
+    Gears::IntrusivePtr<BufferPtr<uint32_t> > indexes_ptr =
+      BufferProvider<uint32_t>::instance().get(scratch_size);
+    std::vector<uint32_t>& indexes = indexes_ptr->buf();
+    indexes.resize(scratch_size);
+
+    Gears::IntrusivePtr<BufferPtr<double> > values_ptr =
+      BufferProvider<double>::instance().get(scratch_size);
+    std::vector<double>& values = values_ptr->buf();
+    values.resize(scratch_size);
+
+    // column of feature keeps values of block rows,
+    // for batches smaller than block columns are shortened
+    const unsigned long column_size = std::min(count, BLOCK_SIZE);
+
+    Gears::IntrusivePtr<BufferPtr<FeatureValue> > columns_ptr =
+      BufferProvider<FeatureValue>::instance().get(features_.size() * column_size);
+    std::vector<FeatureValue>& columns = columns_ptr->buf();
+    columns.resize(features_.size() * column_size);
+
+    for(unsigned long block_begin = 0; block_begin < count;
+      block_begin += BLOCK_SIZE)
+    {
+      const unsigned long block_size = std::min(count - block_begin, BLOCK_SIZE);
+
+      fill_columns_(
+        columns.data(),
+        column_size,
+        feature_sets + block_begin,
+        block_size);
+
+      for(unsigned long row_i = 0; row_i < block_size; ++row_i)
+      {
+        indexes[row_i] = row_i;
+      }
+
+      predict_node_(
+        0,
+        columns.data(),
+        column_size,
+        indexes.data(),
+        block_size,
+        preds + block_begin,
+        indexes.data() + BLOCK_SIZE,
+        values.data() + BLOCK_SIZE);
+    }
+  }
+
+  void
+  CompiledDTree::fill_columns_(
+    FeatureValue* columns,
+    unsigned long column_size,
+    const FeatureArray* const* feature_sets,
+    unsigned long count)
+    const throw()
+  {
+    // merge sorted row features with sorted tree features
+    const unsigned long column_count = features_.size();
+
+    for(unsigned long row_i = 0; row_i < count; ++row_i)
+    {
+      const FeatureArray& row_features = *feature_sets[row_i];
+      auto feature_it = row_features.begin();
+      unsigned long column_i = 0;
+
+      while(column_i < column_count)
+      {
+        while(feature_it != row_features.end() &&
+          feature_it->first < features_[column_i])
+        {
+          ++feature_it;
+        }
+
+        if(feature_it != row_features.end() &&
+          feature_it->first == features_[column_i])
+        {
+          columns[column_i * column_size + row_i] =
+            FeatureValue(true, feature_it->second);
+          ++feature_it;
+        }
+        else
+        {
+          columns[column_i * column_size + row_i] = FeatureValue(false, 0);
+        }
+
+        ++column_i;
+      }
+    }
+  }
+
+  void
+  CompiledDTree::predict_node_(
+    uint32_t node_i,
+    const FeatureValue* columns,
+    unsigned long column_size,
+    const uint32_t* indexes,
+    unsigned long count,
+    double* values,
+    uint32_t* index_scratch,
+    double* value_scratch)
+    const throw()
+  {
+    // values summed in fpredict order: delta_prob, then branches values
+    const Node& node = nodes_[node_i];
+
+    for(unsigned long i = 0; i < count; ++i)
+    {
+      values[indexes[i]] = node.delta_prob;
+    }
+
+    for(uint32_t branch_i = node.branches_begin; branch_i < node.branches_end;
+      ++branch_i)
+    {
+      const Branch& branch = branches_[branch_i];
+      const FeatureValue* column = columns + branch.feature_column * column_size;
+
+      // partition rows: yes rows from begin, no rows from end of scratch,
+      // rows that go to folded subtree get its value at once
+      uint32_t* yes_end = index_scratch;
+      uint32_t* no_begin = index_scratch + BLOCK_SIZE;
+
+      for(unsigned long i = 0; i < count; ++i)
+      {
+        const uint32_t row_i = indexes[i];
+        const FeatureValue& feature = column[row_i];
+
+        if(feature.first &&
+          (!branch.numeric || numeric_feature_float(feature.second) >= branch.threshold))
+        {
+          if(branch.yes_node != NO_NODE)
+          {
+            *yes_end++ = row_i;
+          }
+          else
+          {
+            values[row_i] += branch.yes_value;
+          }
+        }
+        else if(branch.no_node != NO_NODE)
+        {
+          *--no_begin = row_i;
+        }
+        else
+        {
+          values[row_i] += branch.no_value;
+        }
+      }
+
+      const uint32_t* child_indexes[] = { index_scratch, no_begin };
+      const unsigned long child_counts[] = {
+        static_cast<unsigned long>(yes_end - index_scratch),
+        static_cast<unsigned long>(index_scratch + BLOCK_SIZE - no_begin) };
+      const uint32_t child_nodes[] = { branch.yes_node, branch.no_node };
+
+      for(unsigned long child_i = 0; child_i < 2; ++child_i)
+      {
+        const uint32_t* child_rows = child_indexes[child_i];
+        const unsigned long child_count = child_counts[child_i];
+
+        if(child_count != 0)
+        {
+          predict_node_(
+            child_nodes[child_i],
+            columns,
+            column_size,
+            child_rows,
+            child_count,
+            value_scratch,
+            index_scratch + BLOCK_SIZE,
+            value_scratch + BLOCK_SIZE);
+
+          for(unsigned long i = 0; i < child_count; ++i)
+          {
+            values[child_rows[i]] += value_scratch[child_rows[i]];
+          }
+        }
+      }
+    }
+  }
+
+  uint32_t
+  CompiledDTree::add_node_(const DTree* tree, unsigned long depth)
+  {
+    if(node_buf_.size() >= NO_NODE)
+    {
+      throw Exception("CompiledDTree: too many nodes");
+    }
+
+    depth_ = std::max(depth_, depth);
+
+    const uint32_t node_i = node_buf_.size();
+    const DTree::BranchArray& tree_branches = tree->branches();
+
+    Node node;
+    node.delta_prob = tree->delta_prob;
+    node.branches_begin = branch_buf_.size();
+    node.branches_end = node.branches_begin + tree_branches.size();
+    node_buf_.push_back(node);
+
+    branch_buf_.resize(node.branches_end);
+
+    for(unsigned long branch_i = 0; branch_i < tree_branches.size(); ++branch_i)
+    {
+      const DTree::Branch& tree_branch = tree_branches[branch_i];
+
+      if(tree_branch.feature_id > 0xFFFFFFFF)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "CompiledDTree: feature id " << tree_branch.feature_id <<
+          " out of 32 bit range";
+        throw Exception(ostr.str());
+      }
+
+      // branch_buf_ can be reallocated by subtrees: fill by index
+      double yes_value;
+      const uint32_t yes_node = add_subtree_(
+        yes_value, tree_branch.yes_tree, depth + 1);
+      double no_value;
+      const uint32_t no_node = add_subtree_(
+        no_value, tree_branch.no_tree, depth + 1);
+
+      Branch& branch = branch_buf_[node.branches_begin + branch_i];
+      branch.yes_value = yes_value;
+      branch.no_value = no_value;
+      branch.feature_id = tree_branch.feature_id;
+      branch.threshold = tree_branch.threshold;
+      branch.numeric = tree_branch.numeric;
+      branch.yes_node = yes_node;
+      branch.no_node = no_node;
+      branch.yes_leaf = tree_branch.yes_tree && yes_node == NO_NODE;
+      branch.no_leaf = tree_branch.no_tree && no_node == NO_NODE;
+    }
+
+    return node_i;
+  }
+
+  uint32_t
+  CompiledDTree::add_subtree_(
+    double& value,
+    const DTree* tree,
+    unsigned long depth)
+  {
+    value = 0.0;
+
+    if(!tree)
+    {
+      return NO_NODE;
+    }
+
+    if(tree->branches().empty())
+    {
+      // leaf value is delta_prob without additions
+      value = tree->delta_prob;
+      return NO_NODE;
+    }
+
+    return add_node_(tree, depth);
+  }
+
+  void
+  CompiledDTree::validate_()
+  {
+    // fpredict and predict rely on: children placed after parent
+    // (no cycles), indexes in range, features sorted,
+    // depth_ is max depth of nodes
+    if(nodes_.empty())
+    {
+      throw Exception("CompiledDTree: tree without root node");
+    }
+
+    for(unsigned long feature_i = 1; feature_i < features_.size(); ++feature_i)
+    {
+      if(features_[feature_i - 1] >= features_[feature_i])
+      {
+        throw Exception("CompiledDTree: features aren't sorted");
+      }
+    }
+
+    std::vector<uint32_t> node_depths(nodes_.size(), 0);
+    node_depths[0] = 1;
+
+    for(uint32_t node_i = 0; node_i < nodes_.size(); ++node_i)
+    {
+      const Node& node = nodes_[node_i];
+
+      if(node.branches_begin > node.branches_end ||
+        node.branches_end > branches_.size())
+      {
+        Gears::ErrorStream ostr;
+        ostr << "CompiledDTree: node #" << node_i << " has invalid branches range";
+        throw Exception(ostr.str());
+      }
+
+      depth_ = std::max(depth_, static_cast<unsigned long>(node_depths[node_i]));
+
+      for(uint32_t branch_i = node.branches_begin; branch_i < node.branches_end;
+        ++branch_i)
+      {
+        const Branch& branch = branches_[branch_i];
+
+        if(branch.feature_column >= features_.size() ||
+          features_[branch.feature_column] != branch.feature_id)
+        {
+          Gears::ErrorStream ostr;
+          ostr << "CompiledDTree: branch #" << branch_i << " has invalid feature column";
+          throw Exception(ostr.str());
+        }
+
+        const uint32_t child_nodes[] = { branch.yes_node, branch.no_node };
+
+        for(unsigned long child_i = 0; child_i < 2; ++child_i)
+        {
+          const uint32_t child = child_nodes[child_i];
+
+          if(child != NO_NODE)
+          {
+            if(child <= node_i || child >= nodes_.size())
+            {
+              Gears::ErrorStream ostr;
+              ostr << "CompiledDTree: branch #" << branch_i << " has invalid child node";
+              throw Exception(ostr.str());
+            }
+
+            node_depths[child] = std::max(node_depths[child], node_depths[node_i] + 1);
+          }
+        }
+      }
+    }
+  }
+
+  DTree_var
+  CompiledDTree::restore_node_(uint32_t node_i, unsigned long& next_tree_id) const
+  {
+    const Node& node = nodes_[node_i];
+
+    DTree_var res = new DTree();
+    res->tree_id = next_tree_id++;
+    res->delta_prob = node.delta_prob;
+
+    for(uint32_t branch_i = node.branches_begin; branch_i < node.branches_end;
+      ++branch_i)
+    {
+      const Branch& branch = branches_[branch_i];
+
+      DTree::Branch tree_branch;
+      tree_branch.feature_id = branch.feature_id;
+      tree_branch.numeric = branch.numeric;
+      tree_branch.threshold = branch.threshold;
+      tree_branch.yes_tree = restore_subtree_(
+        branch.yes_node, branch.yes_leaf, branch.yes_value, next_tree_id);
+      tree_branch.no_tree = restore_subtree_(
+        branch.no_node, branch.no_leaf, branch.no_value, next_tree_id);
+      res->branches_.push_back(tree_branch);
+    }
+
+    return res;
+  }
+
+  DTree_var
+  CompiledDTree::restore_subtree_(
+    uint32_t node_i,
+    bool leaf,
+    double value,
+    unsigned long& next_tree_id)
+    const
+  {
+    if(node_i != NO_NODE)
+    {
+      return restore_node_(node_i, next_tree_id);
+    }
+
+    if(leaf)
+    {
+      DTree_var res = new DTree();
+      res->tree_id = next_tree_id++;
+      res->delta_prob = value;
+      return res;
+    }
+
+    return DTree_var();
+  }
+}
@@ -0,0 +1,255 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COMPILEDDTREE_HPP_
+#define COMPILEDDTREE_HPP_
+
+#include <vector>
+#include <cstdint>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+
+#include "DTree.hpp"
+#include "MappedFile.hpp"
+#include "PredBuffer.hpp"
+
+namespace Vanga
+{
+  // CompiledDTree: immutable DTree form for prediction,
+  // nodes and branches placed in arrays in depth first order
+  // (node branches, then yes and no subtrees of each branch),
+  // leafs folded into branches,
+  // evaluation is non recursive and sums values in DTree::fpredict order,
+  // so predictions are bit identical.
+  // Node and Branch have fixed layout without padding:
+  // arrays can be placed in mapped file as is (see BinaryModel)
+  class CompiledDTree: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Predictor::Exception);
+
+    static const uint32_t NO_NODE = 0xFFFFFFFF;
+
+    // rows evaluated together by predict
+    static const unsigned long BLOCK_SIZE = 256;
+
+    // smaller blocks predicted row by row: columns filling for all
+    // tree features isn't paid off by few rows
+    static const unsigned long MIN_BLOCK_ROWS = 16;
+
+    struct Node
+    {
+      double delta_prob;
+      uint32_t branches_begin;
+      uint32_t branches_end;
+    };
+
+    // subtrees without branches (leafs) aren't placed into nodes_:
+    // node index is NO_NODE and subtree value saved into yes_value, no_value
+    // (0.0 for absent subtree), yes_leaf, no_leaf distinguish leaf
+    // and absent subtree for DTree restoring
+    struct Branch
+    {
+      double yes_value;
+      double no_value;
+      uint32_t feature_id;
+      uint32_t feature_column; // index in features_
+      float threshold;
+      uint32_t yes_node;
+      uint32_t no_node;
+      uint8_t numeric;
+      uint8_t yes_leaf;
+      uint8_t no_leaf;
+      uint8_t reserved;
+    };
+
+  public:
+    CompiledDTree(const DTree* tree);
+
+    // tree arrays placed in file (file referenced while tree alive),
+    // throw Exception if arrays are inconsistent
+    CompiledDTree(
+      MappedFile* file,
+      const ConstArrayRef<Node>& nodes,
+      const ConstArrayRef<Branch>& branches,
+      const ConstArrayRef<uint32_t>& features);
+
+    template<typename FeatureSetType>
+    double
+    fpredict(const FeatureSetType& feature_set) const throw();
+
+    // predict block of rows: preds[i] = fpredict(*feature_sets[i]),
+    // features used by tree are resolved for all rows of block into columns,
+    // then tree walked node by node: node branch is checked for all rows
+    // of block before descending,
+    // less than MIN_BLOCK_ROWS rows predicted by fpredict
+    void
+    predict(
+      double* preds,
+      const FeatureArray* const* feature_sets,
+      unsigned long count)
+      const throw();
+
+    unsigned long
+    node_count() const throw();
+
+    unsigned long
+    depth() const throw();
+
+    const ConstArrayRef<Node>&
+    nodes() const throw();
+
+    const ConstArrayRef<Branch>&
+    branches() const throw();
+
+    // sorted ids of features used by tree
+    const ConstArrayRef<uint32_t>&
+    features() const throw();
+
+    // features used by numeric branches
+    void
+    numeric_features(NumericFeatureSet& features) const throw();
+
+    // restore DTree (node ids are assigned in depth first order)
+    DTree_var
+    tree() const;
+
+  protected:
+    typedef std::pair<bool, uint32_t> FeatureValue;
+
+    // frame of node evaluation: value of node with processed branches
+    struct Frame
+    {
+      uint32_t node;
+      uint32_t branch;
+      double value;
+    };
+
+    static const unsigned long LOCAL_FRAMES = 64;
+
+  protected:
+    virtual ~CompiledDTree() throw() {}
+
+    uint32_t
+    add_node_(const DTree* tree, unsigned long depth);
+
+    uint32_t
+    add_subtree_(double& value, const DTree* tree, unsigned long depth);
+
+    void
+    validate_();
+
+    DTree_var
+    restore_node_(uint32_t node_i, unsigned long& next_tree_id) const;
+
+    DTree_var
+    restore_subtree_(
+      uint32_t node_i,
+      bool leaf,
+      double value,
+      unsigned long& next_tree_id)
+      const;
+
+    template<typename FeatureSetType>
+    double
+    fpredict_(const FeatureSetType& feature_set, Frame* frames) const throw();
+
+    void
+    fill_columns_(
+      FeatureValue* columns,
+      unsigned long column_size,
+      const FeatureArray* const* feature_sets,
+      unsigned long count)
+      const throw();
+
+    // evaluate node for rows with block indexes [indexes, indexes + count),
+    // node value of row i saved into values[i],
+    // index_scratch and value_scratch contain BLOCK_SIZE elements
+    // for each next level
+    void
+    predict_node_(
+      uint32_t node_i,
+      const FeatureValue* columns,
+      unsigned long column_size,
+      const uint32_t* indexes,
+      unsigned long count,
+      double* values,
+      uint32_t* index_scratch,
+      double* value_scratch)
+      const throw();
+
+  protected:
+    // storage of tree compiled from DTree (empty for mapped tree)
+    std::vector<Node> node_buf_;
+    std::vector<Branch> branch_buf_;
+    std::vector<uint32_t> feature_buf_;
+    MappedFile_var file_;
+
+    ConstArrayRef<Node> nodes_;
+    ConstArrayRef<Branch> branches_;
+    ConstArrayRef<uint32_t> features_; // sorted ids of features used by tree
+    unsigned long depth_;
+  };
+
+  typedef Gears::IntrusivePtr<CompiledDTree> CompiledDTree_var;
+
+  // SVMBlockPredictor: iterates SVM rows (groups order, rows order inside group)
+  // by blocks of CompiledDTree::BLOCK_SIZE rows and predicts them,
+  // null tree predicts 0.0 for all rows
+  template<typename LabelType>
+  class SVMBlockPredictor
+  {
+  public:
+    SVMBlockPredictor(
+      const CompiledDTree* tree,
+      const SVM<LabelType>* svm)
+      throw();
+
+    // predict next block, returns false if all rows processed
+    bool
+    next() throw();
+
+    unsigned long
+    size() const throw();
+
+    const LabelType&
+    label(unsigned long row_i) const throw();
+
+    double
+    pred(unsigned long row_i) const throw();
+
+  protected:
+    const CompiledDTree* tree_;
+    const SVM<LabelType>* svm_;
+    typename SVM<LabelType>::PredictGroupArray::const_iterator group_it_;
+    unsigned long group_row_i_;
+    unsigned long size_;
+    const LabelType* labels_[CompiledDTree::BLOCK_SIZE];
+    const FeatureArray* features_[CompiledDTree::BLOCK_SIZE];
+    double preds_[CompiledDTree::BLOCK_SIZE];
+  };
+}
+
+#include "CompiledDTree.tpp"
+
+#endif /*COMPILEDDTREE_HPP_*/
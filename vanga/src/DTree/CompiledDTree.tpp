@@ -0,0 +1,162 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+namespace Vanga
+{
+  template<typename FeatureSetType>
+  double
+  CompiledDTree::fpredict(const FeatureSetType& feature_set) const throw()
+  {
+    if(depth_ <= LOCAL_FRAMES)
+    {
+      Frame frames[LOCAL_FRAMES];
+      return fpredict_(feature_set, frames);
+    }
+
+    std::vector<Frame> frames(depth_);
+    return fpredict_(feature_set, frames.data());
+  }
+
+  template<typename FeatureSetType>
+  double
+  CompiledDTree::fpredict_(
+    const FeatureSetType& feature_set,
+    Frame* frames)
+    const throw()
+  {
+    // node value is delta_prob + value of selected subtree of each branch
+    // (0.0 if subtree absent), subtree values added in branches order
+    Frame* frame = frames;
+    frame->node = 0;
+    frame->branch = nodes_[0].branches_begin;
+    frame->value = nodes_[0].delta_prob;
+
+    while(true)
+    {
+      if(frame->branch < nodes_[frame->node].branches_end)
+      {
+        const Branch& branch = branches_[frame->branch++];
+        const std::pair<bool, uint32_t> feature = feature_set.get(branch.feature_id);
+        const bool yes = feature.first &&
+          (!branch.numeric || numeric_feature_float(feature.second) >= branch.threshold);
+        const uint32_t child = yes ? branch.yes_node : branch.no_node;
+
+        if(child != NO_NODE)
+        {
+          ++frame;
+          frame->node = child;
+          frame->branch = nodes_[child].branches_begin;
+          frame->value = nodes_[child].delta_prob;
+        }
+        else
+        {
+          frame->value += yes ? branch.yes_value : branch.no_value;
+        }
+      }
+      else if(frame != frames)
+      {
+        const double value = frame->value;
+        --frame;
+        frame->value += value;
+      }
+      else
+      {
+        return frame->value;
+      }
+    }
+  }
+
+  // SVMBlockPredictor
+  template<typename LabelType>
+  SVMBlockPredictor<LabelType>::SVMBlockPredictor(
+    const CompiledDTree* tree,
+    const SVM<LabelType>* svm)
+    throw()
+    : tree_(tree),
+      svm_(svm),
+      group_it_(svm->grouped_rows.begin()),
+      group_row_i_(0),
+      size_(0)
+  {}
+
+  template<typename LabelType>
+  bool
+  SVMBlockPredictor<LabelType>::next() throw()
+  {
+    size_ = 0;
+
+    while(size_ < CompiledDTree::BLOCK_SIZE &&
+      group_it_ != svm_->grouped_rows.end())
+    {
+      const RowArray& rows = (*group_it_)->rows;
+
+      for(; group_row_i_ < rows.size() && size_ < CompiledDTree::BLOCK_SIZE;
+        ++group_row_i_, ++size_)
+      {
+        labels_[size_] = &(*group_it_)->label;
+        features_[size_] = &rows[group_row_i_]->features;
+      }
+
+      if(group_row_i_ == rows.size())
+      {
+        ++group_it_;
+        group_row_i_ = 0;
+      }
+    }
+
+    if(size_ == 0)
+    {
+      return false;
+    }
+
+    if(tree_)
+    {
+      tree_->predict(preds_, features_, size_);
+    }
+    else
+    {
+      std::fill(preds_, preds_ + size_, 0.0);
+    }
+
+    return true;
+  }
+
+  template<typename LabelType>
+  unsigned long
+  SVMBlockPredictor<LabelType>::size() const throw()
+  {
+    return size_;
+  }
+
+  template<typename LabelType>
+  const LabelType&
+  SVMBlockPredictor<LabelType>::label(unsigned long row_i) const throw()
+  {
+    return *labels_[row_i];
+  }
+
+  template<typename LabelType>
+  double
+  SVMBlockPredictor<LabelType>::pred(unsigned long row_i) const throw()
+  {
+    return preds_[row_i];
+  }
+}
@@ -19,6 +19,7 @@
  */
 
 #include <sstream>
+#include <cstdlib>
 
 //#include <LogCommons/LogCommons.hpp>
 //#include <LogCommons/LogCommons.ipp>
@@ -37,7 +38,14 @@ namespace Vanga
   {
     struct Branch
     {
+      Branch()
+        : numeric(false),
+          threshold(0.0)
+      {}
+
       unsigned long feature_id;
+      bool numeric;
+      float threshold;
       unsigned long yes_tree_id;
       unsigned long no_tree_id;
     };
@@ -84,7 +92,18 @@ namespace Vanga
     for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
     {
       ostr << (branch_it != branches_.begin() ? "|" : "") <<
-        branch_it->feature_id << ":" <<
+        branch_it->feature_id;
+
+      if(branch_it->numeric)
+      {
+        // numeric branch: feature_id>=threshold, 9 digits restore float exactly
+        std::ostringstream threshold_ostr;
+        threshold_ostr.precision(9);
+        threshold_ostr << branch_it->threshold;
+        ostr << ">=" << threshold_ostr.str();
+      }
+
+      ostr << ":" <<
         (branch_it->yes_tree ? branch_it->yes_tree->tree_id : 0) << ":" <<
         (branch_it->no_tree ? branch_it->no_tree->tree_id : 0);
     }
@@ -209,6 +228,28 @@ namespace Vanga
 
           DTreeLoadHelper::Branch branch;
 
+          Gears::SubString::SizeType threshold_pos = feature_id_str.find('>');
+          if(threshold_pos != Gears::SubString::NPOS)
+          {
+            // numeric branch: feature_id>=threshold
+            const std::string threshold_str =
+              feature_id_str.substr(threshold_pos + 1).str();
+            char* threshold_end = 0;
+            branch.numeric = true;
+            branch.threshold = threshold_str.empty() || threshold_str[0] != '=' ? 0.0 :
+              std::strtof(threshold_str.c_str() + 1, &threshold_end);
+
+            if(!threshold_end || threshold_end == threshold_str.c_str() + 1 ||
+              *threshold_end != 0)
+            {
+              std::ostringstream ostr;
+              ostr << "invalid 'threshold' value: '" << threshold_str << "'";
+              throw Exception(ostr.str());
+            }
+
+            feature_id_str = feature_id_str.substr(0, threshold_pos);
+          }
+
           if(!Gears::StringManip::str_to_int(feature_id_str, branch.feature_id))
           {
             std::ostringstream ostr;
@@ -272,6 +313,8 @@ namespace Vanga
       {
         DTree::Branch resolved_branch;
         resolved_branch.feature_id = branch_it->feature_id;
+        resolved_branch.numeric = branch_it->numeric;
+        resolved_branch.threshold = branch_it->threshold;
 
         if(branch_it->yes_tree_id)
         {
@@ -309,6 +352,104 @@ namespace Vanga
     return root_tree_it->second.resolved_tree;
   }
 
+  void
+  DTree::save_binary(std::ostream& ostr) const
+  {
+    const uint64_t tree_id_val = tree_id;
+    const uint64_t branches_number = branches_.size();
+
+    ostr.write(reinterpret_cast<const char*>(&tree_id_val), sizeof(tree_id_val));
+    ostr.write(reinterpret_cast<const char*>(&delta_prob), sizeof(delta_prob));
+    ostr.write(reinterpret_cast<const char*>(&branches_number), sizeof(branches_number));
+
+    for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
+    {
+      const uint64_t feature_id = branch_it->feature_id;
+      const uint8_t sub_trees = (branch_it->yes_tree ? 1 : 0) |
+        (branch_it->no_tree ? 2 : 0) |
+        (branch_it->numeric ? 4 : 0);
+
+      ostr.write(reinterpret_cast<const char*>(&feature_id), sizeof(feature_id));
+      ostr.write(reinterpret_cast<const char*>(&sub_trees), sizeof(sub_trees));
+
+      if(branch_it->numeric)
+      {
+        ostr.write(
+          reinterpret_cast<const char*>(&branch_it->threshold),
+          sizeof(branch_it->threshold));
+      }
+
+      if(branch_it->yes_tree)
+      {
+        branch_it->yes_tree->save_binary(ostr);
+      }
+
+      if(branch_it->no_tree)
+      {
+        branch_it->no_tree->save_binary(ostr);
+      }
+    }
+  }
+
+  template<typename ValueType>
+  void
+  DTree::read_binary_(std::istream& istr, ValueType& val)
+  {
+    istr.read(reinterpret_cast<char*>(&val), sizeof(val));
+
+    if(istr.fail())
+    {
+      throw Exception("DTree::load_binary(): unexpected end of tree image");
+    }
+  }
+
+  Gears::IntrusivePtr<DTree>
+  DTree::load_binary(std::istream& istr)
+  {
+    DTree_var res = new DTree();
+
+    uint64_t tree_id_val;
+    uint64_t branches_number;
+
+    read_binary_(istr, tree_id_val);
+    read_binary_(istr, res->delta_prob);
+    read_binary_(istr, branches_number);
+
+    res->tree_id = tree_id_val;
+
+    for(uint64_t branch_i = 0; branch_i < branches_number; ++branch_i)
+    {
+      uint64_t feature_id;
+      uint8_t sub_trees;
+
+      read_binary_(istr, feature_id);
+      read_binary_(istr, sub_trees);
+
+      Branch branch;
+      branch.feature_id = feature_id;
+
+      if(sub_trees & 4)
+      {
+        branch.numeric = true;
+        read_binary_(istr, branch.threshold);
+      }
+
+      if(sub_trees & 1)
+      {
+        branch.yes_tree = load_binary(istr);
+      }
+
+      if(sub_trees & 2)
+      {
+        branch.no_tree = load_binary(istr);
+      }
+
+      res->branches_.push_back(branch);
+    }
+
+    return res;
+  }
+
   /*
   double
   DTree::predict(const FeatureArray& features) const throw()
@@ -355,6 +496,11 @@ namespace Vanga
     for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
     {
       ostr << prefix << "+   feature #" << branch_it->feature_id;
+      if(branch_it->numeric)
+      {
+        ostr << " >= " << branch_it->threshold;
+      }
+
       if(dict)
       {
         auto dict_it = dict->find(branch_it->feature_id);
@@ -398,6 +544,8 @@ namespace Vanga
     {
       Branch branch;
       branch.feature_id = branch_it->feature_id;
+      branch.numeric = branch_it->numeric;
+      branch.threshold = branch_it->threshold;
       branch.yes_tree = branch_it->yes_tree ? branch_it->yes_tree->copy() : DTree_var();
       branch.no_tree = branch_it->no_tree ? branch_it->no_tree->copy() : DTree_var();
       res->branches_.push_back(branch);
@@ -406,6 +554,28 @@ namespace Vanga
     return res;
   }
 
+  void
+  DTree::numeric_features(NumericFeatureSet& features) const throw()
+  {
+    for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
+    {
+      if(branch_it->numeric)
+      {
+        features.insert(branch_it->feature_id);
+      }
+
+      if(branch_it->yes_tree)
+      {
+        branch_it->yes_tree->numeric_features(features);
+      }
+
+      if(branch_it->no_tree)
+      {
+        branch_it->no_tree->numeric_features(features);
+      }
+    }
+  }
+
   unsigned long
   DTree::node_count() const throw()
   {
@@ -62,9 +62,27 @@ namespace Vanga
 
     friend class DTreeBranch;
 
+    // Branch
+    //   yes tree selected if feature present,
+    //   for numeric branch its value should be >= threshold also
     struct Branch
     {
+      Branch()
+        : feature_id(0),
+          numeric(false),
+          threshold(0.0)
+      {}
+
+      bool
+      match(const std::pair<bool, uint32_t>& feature) const
+      {
+        return feature.first &&
+          (!numeric || numeric_feature_float(feature.second) >= threshold);
+      }
+
       unsigned long feature_id;
+      bool numeric;
+      float threshold;
       Gears::IntrusivePtr<DTree> yes_tree;
       Gears::IntrusivePtr<DTree> no_tree;
     };
@@ -81,6 +99,14 @@ namespace Vanga
     static Gears::IntrusivePtr<DTree>
     load(std::istream& istr, bool with_head = true);
 
+    // exact binary image of tree (native byte order), text format
+    // rounds delta_prob and can't be used for training state saving
+    void
+    save_binary(std::ostream& ostr) const;
+
+    static Gears::IntrusivePtr<DTree>
+    load_binary(std::istream& istr);
+
     // features should be sorted
     /*
     double
@@ -91,6 +117,10 @@ namespace Vanga
     double
     fpredict(const FeatureResolveFunType& fun) const throw();
 
+    // features used by numeric branches
+    void
+    numeric_features(NumericFeatureSet& features) const throw();
+
     const BranchArray&
     branches() const
     {
@@ -147,6 +177,18 @@ namespace Vanga
     void
     save_node_(std::ostream& ostr) const;
 
+    template<typename ValueType>
+    static void
+    read_binary_(std::istream& istr, ValueType& val);
+
+    template<typename LabelType>
+    static Gears::IntrusivePtr<SVM<LabelType> >
+    branch_svm_(
+      const SVM<LabelType>& svm,
+      const Branch& branch,
+      bool yes)
+      throw();
+
     template<typename LabelType>
     DTree_var
     filter_(
@@ -58,6 +58,11 @@ namespace Vanga
     {
       ostr << prefix << "+  feature #" << branch_it->feature_id;
 
+      if(branch_it->numeric)
+      {
+        ostr << " >= " << branch_it->threshold;
+      }
+
       if(dict)
       {
         auto dict_it = dict->find(branch_it->feature_id);
@@ -90,7 +95,7 @@ namespace Vanga
       {
         Gears::IntrusivePtr<SVM<LabelType> > yes_svm =
           svm ?
-          svm->by_feature(branch_it->feature_id, true) :
+          branch_svm_(*svm, *branch_it, true) :
           Gears::IntrusivePtr<SVM<LabelType> >();
 
         ostr << prefix << "+    yes =>" << std::endl <<
@@ -108,7 +113,7 @@ namespace Vanga
       {
         Gears::IntrusivePtr<SVM<LabelType> > no_svm =
           svm ?
-          svm->by_feature(branch_it->feature_id, false) :
+          branch_svm_(*svm, *branch_it, false) :
           Gears::IntrusivePtr<SVM<LabelType> >();
 
         ostr << prefix << "+    no =>" << std::endl <<
@@ -197,6 +202,34 @@ namespace Vanga
     return filter_(min_cover, svm, svm ? svm->size() : 0);
   }
 
+  template<typename LabelType>
+  Gears::IntrusivePtr<SVM<LabelType> >
+  DTree::branch_svm_(
+    const SVM<LabelType>& svm,
+    const Branch& branch,
+    bool yes)
+    throw()
+  {
+    Gears::IntrusivePtr<SVM<LabelType> > res = new SVM<LabelType>();
+
+    for(auto group_it = svm.grouped_rows.begin();
+      group_it != svm.grouped_rows.end(); ++group_it)
+    {
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it)
+      {
+        if(branch.match((*row_it)->features.get(branch.feature_id)) == yes)
+        {
+          res->add_row(*row_it, (*group_it)->label);
+        }
+      }
+    }
+
+    res->sort_();
+
+    return res;
+  }
+
   template<typename LabelType>
   DTree_var
   DTree::filter_(
@@ -221,7 +254,7 @@ namespace Vanga
       {
         Gears::IntrusivePtr<SVM<LabelType> > yes_svm =
           svm ?
-          svm->by_feature(branch_it->feature_id, true) :
+          branch_svm_(*svm, *branch_it, true) :
           Gears::IntrusivePtr<SVM<LabelType> >();
 
         branch.yes_tree = branch.yes_tree->filter_(min_cover, yes_svm.in(), full_size);
@@ -231,7 +264,7 @@ namespace Vanga
       {
         Gears::IntrusivePtr<SVM<LabelType> > no_svm =
           svm ?
-          svm->by_feature(branch_it->feature_id, false) :
+          branch_svm_(*svm, *branch_it, false) :
           Gears::IntrusivePtr<SVM<LabelType> >();
 
         branch.no_tree = branch.no_tree->filter_(min_cover, no_svm.in(), full_size);
@@ -253,7 +286,7 @@ namespace Vanga
 
     for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
     {
-      if(feature_set.get(branch_it->feature_id).first)
+      if(branch_it->match(feature_set.get(branch_it->feature_id)))
       {
         // yes tree
         res += branch_it->yes_tree ? branch_it->yes_tree->fpredict(feature_set) : 0.0;
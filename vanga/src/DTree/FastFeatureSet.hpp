@@ -22,100 +22,273 @@
 #define FASTFEATURESET_HPP_
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+#include "SVM.hpp"
+
 namespace Vanga
 {
+  // FastFeatureSet: set of features for repeated predictions with
+  // set(row) / fpredict / rollback(row) cycle.
+  // open addressing table (linear probing) keyed by full feature id,
+  // slot is used if its generation equal to current generation:
+  // clear() is O(1), rollback is O(rolled back features)
   class FastFeatureSet
   {
   public:
-    static const unsigned int SIZE = 0xFFFFF;
-
-    FastFeatureSet()
-      : eval_feature_indexes_(SIZE, 0)
-    {}
+    FastFeatureSet();
 
     bool
-    check(uint32_t value)
+    empty() const;
+
+    unsigned long
+    size() const;
+
+    void
+    set(uint32_t feature_id, uint32_t value);
+
+    void
+    set(const FeatureArray& features);
+
+    template<typename IteratorType>
+    void
+    set(const IteratorType& begin_it, const IteratorType& end_it);
+
+    void
+    rollback(uint32_t feature_id);
+
+    template<typename IteratorType>
+    void
+    rollback(const IteratorType& begin_it, const IteratorType& end_it);
+
+    void
+    rollback(const FeatureArray& features);
+
+    // remove all features
+    void
+    clear();
+
+    std::pair<bool, uint32_t>
+    get(uint32_t feature_id) const;
+
+  protected:
+    struct Slot
     {
-      for(auto feature_it = eval_feature_indexes_.begin();
-        feature_it != eval_feature_indexes_.end(); ++feature_it)
-      {
-        if(*feature_it != value)
-        {
-          return false;
-        }
-      }
+      uint32_t feature_id;
+      uint32_t value;
+      uint32_t generation;
+    };
 
-      return true;
-    }
+    typedef std::vector<Slot> SlotArray;
+
+    static const unsigned long INITIAL_CAPACITY = 64;
+
+  protected:
+    unsigned long
+    slot_index_(uint32_t feature_id) const;
 
     void
-    set(unsigned long feature_id, uint32_t value)
+    grow_();
+
+  protected:
+    SlotArray slots_; // capacity is power of 2
+    unsigned long mask_;
+    unsigned long shift_;
+    uint32_t generation_;
+    unsigned long size_;
+  };
+}
+
+namespace Vanga
+{
+  inline
+  FastFeatureSet::FastFeatureSet()
+    : slots_(INITIAL_CAPACITY, Slot{0, 0, 0}),
+      mask_(INITIAL_CAPACITY - 1),
+      shift_(32 - 6),
+      generation_(1),
+      size_(0)
+  {}
+
+  inline bool
+  FastFeatureSet::empty() const
+  {
+    return size_ == 0;
+  }
+
+  inline unsigned long
+  FastFeatureSet::size() const
+  {
+    return size_;
+  }
+
+  inline unsigned long
+  FastFeatureSet::slot_index_(uint32_t feature_id) const
+  {
+    // fibonacci hashing: high bits of product
+    return (static_cast<uint32_t>(feature_id * 2654435769u) >> shift_) & mask_;
+  }
+
+  inline void
+  FastFeatureSet::set(uint32_t feature_id, uint32_t value)
+  {
+    // load factor kept <= 1/2
+    if((size_ + 1) * 2 > slots_.size())
     {
-      eval_feature_indexes_[feature_id & SIZE] = value;
+      grow_();
     }
 
-    void
-    set(const FeatureArray& features)
+    unsigned long slot_i = slot_index_(feature_id);
+
+    while(slots_[slot_i].generation == generation_)
     {
-      for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+      if(slots_[slot_i].feature_id == feature_id)
       {
-        eval_feature_indexes_[feature_it->first & SIZE] = 1;
+        slots_[slot_i].value = value;
+        return;
       }
+
+      slot_i = (slot_i + 1) & mask_;
     }
 
-    template<typename IteratorType>
-    void
-    set(const IteratorType& begin_it, const IteratorType& end_it)
+    Slot& slot = slots_[slot_i];
+    slot.feature_id = feature_id;
+    slot.value = value;
+    slot.generation = generation_;
+    ++size_;
+  }
+
+  inline void
+  FastFeatureSet::set(const FeatureArray& features)
+  {
+    set(features.begin(), features.end());
+  }
+
+  template<typename IteratorType>
+  void
+  FastFeatureSet::set(const IteratorType& begin_it, const IteratorType& end_it)
+  {
+    for(auto feature_it = begin_it; feature_it != end_it; ++feature_it)
     {
-      for(auto feature_it = begin_it; feature_it != end_it; ++feature_it)
+      set(feature_it->first, feature_it->second);
+    }
+  }
+
+  inline void
+  FastFeatureSet::rollback(uint32_t feature_id)
+  {
+    unsigned long slot_i = slot_index_(feature_id);
+
+    while(slots_[slot_i].generation == generation_)
+    {
+      if(slots_[slot_i].feature_id == feature_id)
       {
-        eval_feature_indexes_[feature_it->first & SIZE] = 1;
+        break;
       }
+
+      slot_i = (slot_i + 1) & mask_;
     }
 
-    void
-    rollback(unsigned long feature_id)
+    if(slots_[slot_i].generation != generation_)
     {
-      eval_feature_indexes_[feature_id & SIZE] = 0;
+      return;
     }
 
-    template<typename IteratorType>
-    void
-    rollback(const IteratorType& begin_it, const IteratorType& end_it)
+    // backward shift deletion: move next slots of probe chain
+    // that can be placed into hole
+    unsigned long hole_i = slot_i;
+    unsigned long next_i = (hole_i + 1) & mask_;
+
+    while(slots_[next_i].generation == generation_)
     {
-      for(auto feature_it = begin_it; feature_it != end_it; ++feature_it)
+      const unsigned long home_i = slot_index_(slots_[next_i].feature_id);
+
+      // move if home of next slot isn't in (hole, next] (cyclic)
+      if(((next_i - home_i) & mask_) >= ((next_i - hole_i) & mask_))
       {
-        eval_feature_indexes_[feature_it->first & SIZE] = 0;
+        slots_[hole_i] = slots_[next_i];
+        hole_i = next_i;
       }
+
+      next_i = (next_i + 1) & mask_;
     }
 
-    void
-    rollback(const FeatureArray& features)
+    slots_[hole_i].generation = 0;
+    --size_;
+  }
+
+  template<typename IteratorType>
+  void
+  FastFeatureSet::rollback(const IteratorType& begin_it, const IteratorType& end_it)
+  {
+    for(auto feature_it = begin_it; feature_it != end_it; ++feature_it)
     {
-      for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+      rollback(feature_it->first);
+    }
+  }
+
+  inline void
+  FastFeatureSet::rollback(const FeatureArray& features)
+  {
+    rollback(features.begin(), features.end());
+  }
+
+  inline void
+  FastFeatureSet::clear()
+  {
+    size_ = 0;
+
+    if(++generation_ == 0)
+    {
+      // generation overflow: reset slots
+      for(auto slot_it = slots_.begin(); slot_it != slots_.end(); ++slot_it)
       {
-        eval_feature_indexes_[feature_it->first & SIZE] = 0;
+        slot_it->generation = 0;
       }
+
+      generation_ = 1;
     }
+  }
 
-    std::pair<bool, uint32_t>
-    get(uint32_t feature_id) const
+  inline std::pair<bool, uint32_t>
+  FastFeatureSet::get(uint32_t feature_id) const
+  {
+    unsigned long slot_i = slot_index_(feature_id);
+
+    while(slots_[slot_i].generation == generation_)
     {
-      if(eval_feature_indexes_[feature_id & SIZE])
+      if(slots_[slot_i].feature_id == feature_id)
       {
-        return std::make_pair(true, 1);
+        return std::make_pair(true, slots_[slot_i].value);
       }
-      else
+
+      slot_i = (slot_i + 1) & mask_;
+    }
+
+    return std::make_pair(false, 0);
+  }
+
+  inline void
+  FastFeatureSet::grow_()
+  {
+    SlotArray old_slots(slots_.size() * 2, Slot{0, 0, 0});
+    old_slots.swap(slots_);
+    mask_ = slots_.size() - 1;
+    --shift_;
+
+    const uint32_t old_generation = generation_;
+    generation_ = 1;
+    size_ = 0;
+
+    for(auto slot_it = old_slots.begin(); slot_it != old_slots.end(); ++slot_it)
+    {
+      if(slot_it->generation == old_generation)
       {
-        return std::make_pair(false, 0);
+        set(slot_it->feature_id, slot_it->value);
       }
     }
-
-  protected:
-    std::vector<uint32_t> eval_feature_indexes_;
-  };
+  }
 }
 
 #endif /*FASTFEATURESET_HPP_*/
@@ -53,9 +53,6 @@ namespace Vanga
       unsigned long count;
     };
 
-    typedef std::vector<Gears::IntrusivePtr<BufferPtr<Pred> > >
-      CollectGroupArray;
-
     typedef std::vector<VarGroup<Buffer<Pred>::const_iterator> >
       GroupArray;
 
@@ -77,9 +74,19 @@ namespace Vanga
     const GroupArray&
     groups() const;
 
+  protected:
+    typedef std::vector<unsigned long> GroupCountArray;
+
   protected:
     double add_delta_;
-    CollectGroupArray collect_groups_;
+
+    // preds collected in one buffer with group indexes and
+    // ordered by groups at fin_delta_eval,
+    // buffers taken from thread pool once and reused between evaluations
+    Gears::IntrusivePtr<BufferPtr<Pred> > collect_preds_;
+    Gears::IntrusivePtr<BufferPtr<uint64_t> > collect_pred_groups_;
+    Gears::IntrusivePtr<BufferPtr<Pred> > group_preds_;
+    GroupCountArray group_offsets_;
     GroupArray groups_;
   };
 
@@ -153,8 +160,18 @@ namespace Vanga
         std::endl;
     }
 
-    collect_groups_.clear();
-    collect_groups_.resize(1 << vars_number);
+    if(!collect_preds_.in())
+    {
+      collect_preds_ = BufferProvider<Pred>::instance().get();
+      collect_pred_groups_ = BufferProvider<uint64_t>::instance().get();
+      group_preds_ = BufferProvider<Pred>::instance().get();
+    }
+
+    collect_preds_->buf().clear();
+    collect_pred_groups_->buf().clear();
+
+    group_offsets_.clear();
+    group_offsets_.resize((1 << vars_number) + 1, 0);
 
     groups_.clear();
 
@@ -176,16 +193,11 @@ namespace Vanga
 
     uint64_t group_i = var_indexes.to_int();
 
-    assert(group_i < collect_groups_.size());
-    Gears::IntrusivePtr<BufferPtr<Pred> >& group = collect_groups_[group_i];
-
-    if(!group.in())
-    {
-      group = BufferProvider<Pred>::instance().get();
-    }
+    assert(group_i + 1 < group_offsets_.size());
+    ++group_offsets_[group_i + 1];
 
-    Buffer<Pred>& buf = group->buf();
-    buf.push_back(Pred(
+    collect_pred_groups_->buf().push_back(group_i);
+    collect_preds_->buf().push_back(Pred(
       PredictedBoolLabel(
         label.value,
         label.pred + add_delta_),
@@ -200,17 +212,38 @@ namespace Vanga
       std::cout << "pred_collector.fin_delta_eval" << std::endl;
     }
     
-    uint64_t index = 0;
-    for(auto buf_it = collect_groups_.begin();
-      buf_it != collect_groups_.end(); ++buf_it, ++index)
+    // counting sort of preds by group (keep adding order inside group)
+    for(auto offset_it = group_offsets_.begin() + 1;
+      offset_it != group_offsets_.end(); ++offset_it)
+    {
+      *offset_it += *(offset_it - 1);
+    }
+
+    const Buffer<Pred>& preds = collect_preds_->buf();
+    const Buffer<uint64_t>& pred_groups = collect_pred_groups_->buf();
+    Buffer<Pred>& group_preds = group_preds_->buf();
+    group_preds.resize(preds.size());
+
+    for(unsigned long pred_i = 0; pred_i < preds.size(); ++pred_i)
     {
-      if(buf_it->in())
+      group_preds[group_offsets_[pred_groups[pred_i]]++] = preds[pred_i];
+    }
+
+    // now group_offsets_[i] is end of group i
+    unsigned long group_begin = 0;
+    for(unsigned long group_i = 0; group_i + 1 < group_offsets_.size(); ++group_i)
+    {
+      const unsigned long group_end = group_offsets_[group_i];
+
+      if(group_begin != group_end)
       {
         groups_.push_back(VarGroup<Buffer<Pred>::const_iterator>(
-          VarIndexArray(index),
-          (*buf_it)->buf().begin(),
-          (*buf_it)->buf().end()));
+          VarIndexArray(group_i),
+          group_preds.begin() + group_begin,
+          group_preds.begin() + group_end));
       }
+
+      group_begin = group_end;
     }
   }
 
@@ -20,6 +20,7 @@
 
 #include <cmath>
 #include "PredBuffer.hpp"
+#include "Profiler.hpp"
 #include "VecUtils.hpp"
 
 namespace Vanga
@@ -604,6 +605,8 @@ namespace Vanga
     const FunType& fun)
     throw()
   {
+    ProfileScope profile_scope(Profiler::P_LBFGS);
+
     static const double LBFGS_EPSILON = 1e-5;
     static const int LBFGS_M = 6;
     static const int LBFGS_PAST = 0;
@@ -643,28 +646,28 @@ namespace Vanga
     }
 
     // Allocate working space.
-    Gears::IntrusivePtr<BufferPtr<double> > x_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > x_buf = BufferProvider<double>::instance().get(n);
     x_buf->buf().resize(n);
     double* x = &(x_buf->buf()[0]);
 
-    Gears::IntrusivePtr<BufferPtr<double> > xp_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > xp_buf = BufferProvider<double>::instance().get(n);
     xp_buf->buf().resize(n);
     double* prev_x = &(xp_buf->buf()[0]);
-    Gears::IntrusivePtr<BufferPtr<double> > g_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > g_buf = BufferProvider<double>::instance().get(n);
     g_buf->buf().resize(n);
     double* g = &(g_buf->buf()[0]);
-    Gears::IntrusivePtr<BufferPtr<double> > gp_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > gp_buf = BufferProvider<double>::instance().get(n);
     gp_buf->buf().resize(n);
     double* prev_g = &(gp_buf->buf()[0]);
-    Gears::IntrusivePtr<BufferPtr<double> > d_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > d_buf = BufferProvider<double>::instance().get(n);
     d_buf->buf().resize(n);
     double* d = &(d_buf->buf()[0]);
-    Gears::IntrusivePtr<BufferPtr<double> > w_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > w_buf = BufferProvider<double>::instance().get(n);
     w_buf->buf().resize(n);
     double* w = &(w_buf->buf()[0]);
 
     // Allocate limited memory storage.
-    Gears::IntrusivePtr<BufferPtr<double> > lm_buf = BufferProvider<double>::instance().get();
+    Gears::IntrusivePtr<BufferPtr<double> > lm_buf = BufferProvider<double>::instance().get(n);
     lm_buf->buf().resize(n);
     double* lm = &(lm_buf->buf()[0]);
 
@@ -676,7 +679,7 @@ namespace Vanga
     if(orthantwise_c != 0.)
     {
       // Allocate working space for OW-LQN.
-      pg_buf = BufferProvider<double>::instance().get();
+      pg_buf = BufferProvider<double>::instance().get(n);
       pg_buf->buf().resize(n);
       pg = &(pg_buf->buf()[0]);
     }
@@ -688,12 +691,12 @@ namespace Vanga
       it->alpha = 0;
       it->ys = 0;
 
-      Gears::IntrusivePtr<BufferPtr<double> > s_buf = BufferProvider<double>::instance().get();
+      Gears::IntrusivePtr<BufferPtr<double> > s_buf = BufferProvider<double>::instance().get(n);
       buf_holders.push_back(s_buf);
       s_buf->buf().resize(n);
       it->s = &(s_buf->buf()[0]);
 
-      Gears::IntrusivePtr<BufferPtr<double> > y_buf = BufferProvider<double>::instance().get();
+      Gears::IntrusivePtr<BufferPtr<double> > y_buf = BufferProvider<double>::instance().get(n);
       buf_holders.push_back(y_buf);
       y_buf->buf().resize(n);
       it->y = &(y_buf->buf()[0]);
@@ -705,7 +708,7 @@ namespace Vanga
 
     if(LBFGS_PAST > 0)
     {
-      pf_buf = BufferProvider<double>::instance().get();
+      pf_buf = BufferProvider<double>::instance().get(LBFGS_PAST);
       pf_buf->buf().resize(LBFGS_PAST);
       pf = &(pf_buf->buf()[0]);
     }
@@ -21,13 +21,25 @@
 #ifndef LABEL_HPP_
 #define LABEL_HPP_
 
+#include <cassert>
+#include <vector>
+
 #include <Gears/Basic/SubString.hpp>
 #include "Predictor.hpp"
+#include "Rand.hpp"
 
 namespace Vanga
 {
   DECLARE_GEARS_EXCEPTION(LabelException, Gears::DescriptiveException);
 
+  // type of stored prediction: float halves memory traffic of row scans,
+  // sums and gains are evaluated in double in both modes
+#ifdef VANGA_FLOAT_PREDS
+  typedef float PredValue;
+#else
+  typedef double PredValue;
+#endif
+
   struct BoolLabel
   {
     bool value;
@@ -58,7 +70,7 @@ namespace Vanga
 
   struct PredictedBoolLabel: public BoolLabel
   {
-    double pred;
+    PredValue pred;
 
     PredictedBoolLabel();
 
@@ -143,6 +155,34 @@ namespace Vanga
     Gears::IntrusivePtr<PredictorType> predictor_;
   };
 
+  // PredictedBoolLabelSetConverter: set preds saved in rows order of
+  // converted SVM (groups order, rows order inside group)
+  struct PredictedBoolLabelSetConverter
+  {
+  public:
+    typedef PredictedBoolLabel ResultType;
+
+  public:
+    PredictedBoolLabelSetConverter(const std::vector<PredValue>& preds)
+      : preds_(preds),
+        pos_(0)
+    {}
+
+    PredictedBoolLabel
+    operator()(const Row*, const PredictedBoolLabel& label) const
+    {
+      assert(pos_ < preds_.size());
+
+      PredictedBoolLabel converted_label = label;
+      converted_label.pred = preds_[pos_++];
+      return converted_label;
+    }
+
+  protected:
+    const std::vector<PredValue>& preds_;
+    mutable unsigned long pos_;
+  };
+
   struct PredictedBoolLabelAnnealer
   {
   public:
@@ -156,7 +196,7 @@ namespace Vanga
     operator()(const Row*, const PredictedBoolLabel& label) const
     {
       PredictedBoolLabel converted_label = label;
-      unsigned long val = Gears::safe_rand(10);
+      unsigned long val = ThreadRand::rand(10);
       double res_val = 0;
 
       if(val > 4)
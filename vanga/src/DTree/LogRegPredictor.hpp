@@ -36,10 +36,10 @@ namespace Vanga
     double
     fpredict(const FeatureResolveFunType& fun) const throw();
 
-    virtual void
+    void
     save(std::ostream& ostr) const;
 
-    virtual std::string
+    std::string
     to_string(
       const char* prefix,
       const FeatureDictionary* dict = 0,
@@ -0,0 +1,134 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Gears/Basic/Errno.hpp>
+
+#include "MappedFile.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    const unsigned long PAGE_SIZE_ = ::sysconf(_SC_PAGESIZE);
+
+    // page aligned range that covers [begin, end)
+    void
+    page_range(char*& range_begin, unsigned long& range_size,
+      const void* begin, const void* end)
+      throw()
+    {
+      const unsigned long begin_addr = reinterpret_cast<unsigned long>(begin);
+      const unsigned long end_addr = reinterpret_cast<unsigned long>(end);
+      const unsigned long aligned_begin = begin_addr - begin_addr % PAGE_SIZE_;
+      range_begin = reinterpret_cast<char*>(aligned_begin);
+      range_size = end_addr - aligned_begin;
+    }
+  }
+
+  MappedFile::MappedFile(const std::string& file_path)
+    : data_(0),
+      size_(0)
+  {
+    const int fd = ::open(file_path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+      Gears::throw_errno_exception<Exception>(
+        "MappedFile::MappedFile(): can't open '", file_path.c_str(), "'");
+    }
+
+    struct stat file_stat;
+    if(::fstat(fd, &file_stat) < 0)
+    {
+      ::close(fd);
+      Gears::throw_errno_exception<Exception>(
+        "MappedFile::MappedFile(): can't stat '", file_path.c_str(), "'");
+    }
+
+    size_ = file_stat.st_size;
+
+    if(size_ > 0)
+    {
+      data_ = ::mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if(data_ == MAP_FAILED)
+      {
+        data_ = 0;
+        ::close(fd);
+        Gears::throw_errno_exception<Exception>(
+          "MappedFile::MappedFile(): can't map '", file_path.c_str(), "'");
+      }
+
+      // access is sequential inside blocks, random between blocks
+      ::madvise(data_, size_, MADV_RANDOM);
+    }
+
+    ::close(fd);
+  }
+
+  MappedFile::~MappedFile() throw()
+  {
+    if(data_)
+    {
+      ::munmap(data_, size_);
+    }
+  }
+
+  const void*
+  MappedFile::data() const
+  {
+    return data_;
+  }
+
+  unsigned long
+  MappedFile::size() const
+  {
+    return size_;
+  }
+
+  void
+  MappedFile::will_need(const void* begin, const void* end) const throw()
+  {
+    if(begin != end)
+    {
+      char* range_begin;
+      unsigned long range_size;
+      page_range(range_begin, range_size, begin, end);
+      ::madvise(range_begin, range_size, MADV_SEQUENTIAL);
+      ::madvise(range_begin, range_size, MADV_WILLNEED);
+    }
+  }
+
+  void
+  MappedFile::dont_need(const void* begin, const void* end) const throw()
+  {
+    if(begin != end)
+    {
+      char* range_begin;
+      unsigned long range_size;
+      page_range(range_begin, range_size, begin, end);
+      ::madvise(range_begin, range_size, MADV_DONTNEED);
+    }
+  }
+}
@@ -0,0 +1,124 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MAPPEDFILE_HPP_
+#define MAPPEDFILE_HPP_
+
+#include <string>
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+
+namespace Vanga
+{
+  // ConstArrayRef: view of array placed in heap buffer or in mapped file
+  template<typename ValueType>
+  class ConstArrayRef
+  {
+  public:
+    typedef const ValueType* const_iterator;
+
+    ConstArrayRef()
+      : begin_(0),
+        end_(0)
+    {}
+
+    ConstArrayRef(const ValueType* begin_val, unsigned long size_val)
+      : begin_(begin_val),
+        end_(begin_val + size_val)
+    {}
+
+    const ValueType*
+    begin() const
+    {
+      return begin_;
+    }
+
+    const ValueType*
+    end() const
+    {
+      return end_;
+    }
+
+    const ValueType*
+    data() const
+    {
+      return begin_;
+    }
+
+    unsigned long
+    size() const
+    {
+      return end_ - begin_;
+    }
+
+    bool
+    empty() const
+    {
+      return begin_ == end_;
+    }
+
+    const ValueType&
+    operator[](unsigned long i) const
+    {
+      return begin_[i];
+    }
+
+  protected:
+    const ValueType* begin_;
+    const ValueType* end_;
+  };
+
+  // MappedFile: read only mapping of whole file
+  class MappedFile: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+  public:
+    MappedFile(const std::string& file_path);
+
+    const void*
+    data() const;
+
+    unsigned long
+    size() const;
+
+    // hint kernel to read range ahead (sequentially)
+    void
+    will_need(const void* begin, const void* end) const throw();
+
+    // release resident pages of range, they will be reread on next access
+    void
+    dont_need(const void* begin, const void* end) const throw();
+
+  protected:
+    virtual ~MappedFile() throw();
+
+  protected:
+    void* data_;
+    unsigned long size_;
+  };
+
+  typedef Gears::IntrusivePtr<MappedFile> MappedFile_var;
+}
+
+#endif /*MAPPEDFILE_HPP_*/
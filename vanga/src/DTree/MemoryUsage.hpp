@@ -0,0 +1,96 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MEMORYUSAGE_HPP_
+#define MEMORYUSAGE_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace Vanga
+{
+  // MemoryUsage: heap bytes used by data structures grouped by part,
+  // containers estimated by capacity, hash containers by buckets and
+  // nodes, objects shared by several owners counted once by caller
+  struct MemoryUsage
+  {
+    typedef std::map<std::string, unsigned long> PartMap;
+
+    void
+    add(const char* part, unsigned long bytes)
+    {
+      parts[part] += bytes;
+    }
+
+    unsigned long
+    total() const throw()
+    {
+      unsigned long res = 0;
+      for(auto it = parts.begin(); it != parts.end(); ++it)
+      {
+        res += it->second;
+      }
+      return res;
+    }
+
+    void
+    print(std::ostream& ostr, const char* prefix = "") const
+    {
+      for(auto it = parts.begin(); it != parts.end(); ++it)
+      {
+        ostr << prefix << it->first << ": " << it->second << std::endl;
+      }
+
+      ostr << prefix << "total: " << total() << std::endl;
+    }
+
+    template<typename ValueType>
+    static unsigned long
+    vector_bytes(const std::vector<ValueType>& vec) throw()
+    {
+      return vec.capacity() * sizeof(ValueType);
+    }
+
+    template<typename HashMapType>
+    static unsigned long
+    hash_map_bytes(const HashMapType& map) throw()
+    {
+      // node: next pointer, value and cached hash
+      return map.bucket_count() * sizeof(void*) + map.size() * (
+        sizeof(typename HashMapType::value_type) + 2 * sizeof(void*));
+    }
+
+    template<typename MapType>
+    static unsigned long
+    tree_map_bytes(const MapType& map) throw()
+    {
+      // node: color, parent, left and right links
+      return map.size() * (
+        sizeof(typename MapType::value_type) + 4 * sizeof(void*));
+    }
+
+    PartMap parts;
+  };
+}
+
+#endif /*MEMORYUSAGE_HPP_*/
@@ -37,9 +37,24 @@ namespace Vanga
       const PredictedBoolLabel& label,
       unsigned long count);
 
+    // row metric for pred given in double precision
+    // (it isn't rounded to stored pred type)
+    void
+    add_metric_eval(
+      bool value,
+      double pred,
+      unsigned long count);
+
     double
     metric_result() const;
 
+    // first and second derivatives of row metric by pred
+    static void
+    grad_hess(
+      double& grad,
+      double& hess,
+      const PredictedBoolLabel& label);
+
   protected:
     double result_metric_;
   };
@@ -59,8 +74,17 @@ namespace Vanga
     const PredictedBoolLabel& label,
     unsigned long count)
   {
-    //const double exp = std::exp(- label.pred);
-    const double exp = std::exp(- std::min(std::max(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
+    add_metric_eval(label.value, label.pred, count);
+  }
+
+  inline void
+  LogLossMetricEvaluator::add_metric_eval(
+    bool value,
+    double pred,
+    unsigned long count)
+  {
+    //const double exp = std::exp(- pred);
+    const double exp = std::exp(- std::min(std::max<double>(pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
 
     /*
     std::cout << "add_metric_eval: exp = " << exp << ", count = " << count << ", ";
@@ -69,7 +93,7 @@ namespace Vanga
     */
     double metric_delta;
 
-    if(label.value)
+    if(value)
     {
       metric_delta = (std::log(1.0 / (1.0 + exp)));
       //std::cout << "add_metric_eval: l1 = " << (1.0 / (1.0 + exp)) << std::endl;
@@ -94,6 +118,19 @@ namespace Vanga
   {
     return result_metric_;
   }
+
+  inline void
+  LogLossMetricEvaluator::grad_hess(
+    double& grad,
+    double& hess,
+    const PredictedBoolLabel& label)
+  {
+    const double exp = std::exp(- std::min(std::max<double>(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
+    const double p = 1.0 / (1.0 + exp);
+
+    grad = p - (label.value ? 1.0 : 0.0);
+    hess = p * (1.0 - p);
+  }
 }
 
 #endif
@@ -37,9 +37,24 @@ namespace Vanga
       const PredictedBoolLabel& label,
       unsigned long count);
 
+    // row metric for pred given in double precision
+    // (it isn't rounded to stored pred type)
+    void
+    add_metric_eval(
+      bool value,
+      double pred,
+      unsigned long count);
+
     double
     metric_result() const;
 
+    // first and second derivatives of row metric by pred
+    static void
+    grad_hess(
+      double& grad,
+      double& hess,
+      const PredictedBoolLabel& label);
+
   protected:
     double result_metric_;
   };
@@ -59,12 +74,21 @@ namespace Vanga
     const PredictedBoolLabel& label,
     unsigned long count)
   {
-    const double exp = std::exp(- std::min(std::max(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
+    add_metric_eval(label.value, label.pred, count);
+  }
+
+  inline void
+  SquareDiviationMetricEvaluator::add_metric_eval(
+    bool value,
+    double pred,
+    unsigned long count)
+  {
+    const double exp = std::exp(- std::min(std::max<double>(pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
 
     const double p = 1.0 / (1.0 + exp);
     double metric_delta;
 
-    if(label.value)
+    if(value)
     {
       metric_delta = (1.0 - p) * (1.0 - p);
     }
@@ -83,6 +107,21 @@ namespace Vanga
   {
     return result_metric_;
   }
+
+  inline void
+  SquareDiviationMetricEvaluator::grad_hess(
+    double& grad,
+    double& hess,
+    const PredictedBoolLabel& label)
+  {
+    const double exp = std::exp(- std::min(std::max<double>(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
+    const double p = 1.0 / (1.0 + exp);
+
+    // gauss-newton approximation of hessian
+    const double p_deriv = p * (1.0 - p);
+    grad = 2.0 * (p - (label.value ? 1.0 : 0.0)) * p_deriv;
+    hess = 2.0 * p_deriv * p_deriv;
+  }
 }
 
 #endif
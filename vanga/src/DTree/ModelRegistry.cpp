@@ -0,0 +1,201 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "ModelRegistry.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    const std::chrono::microseconds SYNCHRONIZE_CHECK_PERIOD(100);
+  }
+
+  // ModelRegistry::ReadGuard
+  ModelRegistry::ReadGuard::ReadGuard(
+    const ModelRegistry& registry,
+    unsigned long reader_i)
+    throw()
+    : registry_(registry),
+      reader_epoch_(registry.readers_[reader_i].epoch)
+  {
+    assert(reader_i < registry.readers_.size());
+    assert(reader_epoch_.load(std::memory_order_relaxed) == 0);
+
+    // seq_cst store: writer that swapped model after this store
+    // will see reader epoch, otherwise reader will see new model
+    reader_epoch_.store(
+      registry_.epoch_.load(std::memory_order_seq_cst),
+      std::memory_order_seq_cst);
+  }
+
+  ModelRegistry::ReadGuard::~ReadGuard() throw()
+  {
+    reader_epoch_.store(0, std::memory_order_release);
+  }
+
+  const ModelRegistry::Model*
+  ModelRegistry::ReadGuard::model(unsigned long model_i) const throw()
+  {
+    assert(model_i < registry_.models_.size());
+    return registry_.models_[model_i].model.load(std::memory_order_seq_cst);
+  }
+
+  // ModelRegistry
+  ModelRegistry::ModelRegistry(
+    unsigned long model_count,
+    unsigned long max_readers)
+    : epoch_(1),
+      models_(model_count),
+      readers_(max_readers)
+  {}
+
+  ModelRegistry::~ModelRegistry() throw()
+  {
+    for(auto model_it = models_.begin(); model_it != models_.end(); ++model_it)
+    {
+      delete model_it->model.load(std::memory_order_relaxed);
+    }
+  }
+
+  unsigned long
+  ModelRegistry::model_count() const throw()
+  {
+    return models_.size();
+  }
+
+  unsigned long
+  ModelRegistry::max_readers() const throw()
+  {
+    return readers_.size();
+  }
+
+  void
+  ModelRegistry::load(unsigned long model_i, const std::string& file_path)
+  {
+    if(model_i >= models_.size())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "ModelRegistry::load(): model index " << model_i <<
+        " out of range";
+      throw Exception(ostr.str());
+    }
+
+    // load and validate out of write lock: readers and other slots
+    // aren't blocked, load errors keep previous model
+    BinaryModel_var model = BinaryModel::load(file_path);
+    set(model_i, model, file_path);
+  }
+
+  void
+  ModelRegistry::reload(unsigned long model_i)
+  {
+    std::string file_path;
+
+    {
+      Gears::Mutex::WriteGuard guard(write_lock_);
+
+      const Model* model = model_i < models_.size() ?
+        models_[model_i].model.load(std::memory_order_relaxed) : 0;
+
+      if(!model)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "ModelRegistry::reload(): model #" << model_i <<
+          " isn't loaded";
+        throw Exception(ostr.str());
+      }
+
+      file_path = model->file_path;
+    }
+
+    load(model_i, file_path);
+  }
+
+  void
+  ModelRegistry::set(
+    unsigned long model_i,
+    BinaryModel* model,
+    const std::string& file_path)
+  {
+    if(model_i >= models_.size())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "ModelRegistry::set(): model index " << model_i <<
+        " out of range";
+      throw Exception(ostr.str());
+    }
+
+    Model* new_model = new Model();
+    new_model->model = Gears::add_ref(model);
+    model->numeric_features(new_model->numeric_features);
+    new_model->file_path = file_path;
+
+    const Model* old_model;
+
+    {
+      Gears::Mutex::WriteGuard guard(write_lock_);
+
+      const Model* cur_model = models_[model_i].model.load(
+        std::memory_order_relaxed);
+      new_model->version = cur_model ? cur_model->version + 1 : 1;
+
+      old_model = models_[model_i].model.exchange(
+        new_model, std::memory_order_seq_cst);
+    }
+
+    // wait readers out of write lock: slow reader delays only
+    // release of previous model, not publication by other writers
+    synchronize_();
+    delete old_model;
+  }
+
+  void
+  ModelRegistry::synchronize_() throw()
+  {
+    // readers with epoch < sync_epoch can use replaced model,
+    // readers entered later see only published model
+    const uint64_t sync_epoch =
+      epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    for(auto reader_it = readers_.begin(); reader_it != readers_.end();
+      ++reader_it)
+    {
+      while(true)
+      {
+        const uint64_t reader_epoch = reader_it->epoch.load(
+          std::memory_order_seq_cst);
+
+        if(reader_epoch == 0 || reader_epoch >= sync_epoch)
+        {
+          break;
+        }
+
+        std::this_thread::sleep_for(SYNCHRONIZE_CHECK_PERIOD);
+      }
+    }
+  }
+}
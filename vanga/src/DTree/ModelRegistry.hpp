@@ -0,0 +1,145 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MODELREGISTRY_HPP_
+#define MODELREGISTRY_HPP_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+#include <Gears/Basic/Lock.hpp>
+
+#include "SVM.hpp"
+#include "BinaryModel.hpp"
+
+namespace Vanga
+{
+  // ModelRegistry: fixed set of model slots, model of slot can be replaced
+  // while other threads predict with it (RCU-like scheme):
+  //   writer loads and prepares new model, publishes it by atomic pointer swap,
+  //   waits until readers that can see previous model leave read sections
+  //   and only then releases previous model.
+  // Reader section (ReadGuard) costs one atomic store on enter and exit,
+  // model access inside section is plain atomic load without locks and
+  // reference counting.
+  // Each reader thread should use own reader index (< max_readers),
+  // read sections of one reader can't be nested.
+  class ModelRegistry: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    // immutable published state of slot
+    struct Model
+    {
+      BinaryModel_var model;
+      NumericFeatureSet numeric_features;
+      std::string file_path;
+      unsigned long version; // number of slot publications
+    };
+
+    class ReadGuard
+    {
+    public:
+      ReadGuard(const ModelRegistry& registry, unsigned long reader_i) throw();
+
+      ~ReadGuard() throw();
+
+      // returns null if model isn't loaded,
+      // returned model is valid until guard destruction
+      const Model*
+      model(unsigned long model_i) const throw();
+
+    protected:
+      const ModelRegistry& registry_;
+      std::atomic<uint64_t>& reader_epoch_;
+    };
+
+  public:
+    ModelRegistry(unsigned long model_count, unsigned long max_readers);
+
+    unsigned long
+    model_count() const throw();
+
+    unsigned long
+    max_readers() const throw();
+
+    // load model file and publish it
+    void
+    load(unsigned long model_i, const std::string& file_path);
+
+    // load model again from last published file path
+    void
+    reload(unsigned long model_i);
+
+    // publish model, returns after release of previous model,
+    // concurrent publications don't wait each other readers
+    void
+    set(unsigned long model_i, BinaryModel* model, const std::string& file_path);
+
+  protected:
+    // reader epoch on own cache line: readers don't share written lines
+    struct alignas(64) ReaderSlot
+    {
+      ReaderSlot() throw()
+        : epoch(0)
+      {}
+
+      // 0 if reader is outside of read section
+      std::atomic<uint64_t> epoch;
+    };
+
+    struct alignas(64) ModelSlot
+    {
+      ModelSlot() throw()
+        : model(0)
+      {}
+
+      std::atomic<const Model*> model;
+    };
+
+  protected:
+    virtual
+    ~ModelRegistry() throw();
+
+    // wait until all readers that entered read section
+    // before epoch increment leave it
+    void
+    synchronize_() throw();
+
+  protected:
+    // serialize slot updates (synchronization is done out of lock)
+    Gears::Mutex write_lock_;
+
+    std::atomic<uint64_t> epoch_;
+    std::vector<ModelSlot> models_;
+    mutable std::vector<ReaderSlot> readers_;
+  };
+
+  typedef Gears::IntrusivePtr<ModelRegistry> ModelRegistry_var;
+}
+
+#endif /*MODELREGISTRY_HPP_*/
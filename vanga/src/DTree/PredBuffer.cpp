@@ -0,0 +1,87 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "PredBuffer.hpp"
+
+namespace Vanga
+{
+  std::atomic<unsigned long> BufferPools::all_retained_bytes_(0);
+  thread_local unsigned long BufferPools::thread_retained_bytes_ = 0;
+  thread_local BufferPools::BufferPoolArray BufferPools::thread_pools_;
+
+  unsigned long
+  BufferPools::all_retained_bytes() throw()
+  {
+    return all_retained_bytes_.load(std::memory_order_relaxed);
+  }
+
+  unsigned long
+  BufferPools::thread_retained_bytes() throw()
+  {
+    return thread_retained_bytes_;
+  }
+
+  void
+  BufferPools::trim_thread_pools() throw()
+  {
+    for(auto pool_it = thread_pools_.begin(); pool_it != thread_pools_.end();
+      ++pool_it)
+    {
+      (*pool_it)->trim();
+    }
+  }
+
+  void
+  BufferPools::add_thread_pool_(BufferPool* pool)
+  {
+    thread_pools_.push_back(Gears::add_ref(pool));
+  }
+
+  bool
+  BufferPools::retain_bytes_(unsigned long bytes) throw()
+  {
+    if(thread_retained_bytes_ + bytes > MAX_THREAD_RETAIN_BYTES)
+    {
+      return false;
+    }
+
+    if(all_retained_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes >
+      MAX_ALL_RETAIN_BYTES)
+    {
+      all_retained_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+      return false;
+    }
+
+    thread_retained_bytes_ += bytes;
+    return true;
+  }
+
+  void
+  BufferPools::unretain_bytes_(unsigned long bytes, bool thread_pool) throw()
+  {
+    all_retained_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+
+    if(thread_pool)
+    {
+      thread_retained_bytes_ -= bytes;
+    }
+  }
+}
@@ -21,19 +21,112 @@
 #ifndef PREDBUFFER_HPP_
 #define PREDBUFFER_HPP_
 
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <Gears/Basic/AtomicRefCountable.hpp>
 #include <Gears/Basic/IntrusivePtr.hpp>
-#include <Gears/Basic/Singleton.hpp>
-#include <Gears/Basic/Lock.hpp>
+
+#include "Profiler.hpp"
 
 namespace Vanga
 {
+  // BufferPool: pool of released buffers of one value type owned by one thread
+  class BufferPool: public Gears::AtomicRefCountable
+  {
+  public:
+    // release retained buffers that wasn't used after previous trim
+    virtual void
+    trim() throw() = 0;
+
+  protected:
+    virtual
+    ~BufferPool() throw()
+    {}
+  };
+
+  typedef Gears::IntrusivePtr<BufferPool> BufferPool_var;
+
+  // BufferPools: memory retained by buffer pools of all value types,
+  // retained bytes are bounded for each thread and for all threads.
+  // evaluation (check of feature bundle, prediction of batch) should be
+  // finished with trim_thread_pools() call (or be covered by EvaluationGuard):
+  // buffers that wasn't used in evaluation will be released
+  class BufferPools
+  {
+    template<typename>
+    friend class BufferProviderImpl;
+
+    template<typename>
+    friend class BufferProvider;
+
+  public:
+    // EvaluationGuard: trims pools of current thread at scope exit
+    class EvaluationGuard
+    {
+    public:
+      ~EvaluationGuard() throw()
+      {
+        trim_thread_pools();
+      }
+    };
+
+    // retained bytes of pools of all value types and threads
+    static unsigned long
+    all_retained_bytes() throw();
+
+    // retained bytes of pools of all value types of current thread
+    static unsigned long
+    thread_retained_bytes() throw();
+
+    // trim pools of all value types of current thread
+    static void
+    trim_thread_pools() throw();
+
+    // max retained bytes of pools of one thread
+    static const unsigned long MAX_THREAD_RETAIN_BYTES = 64 * 1024 * 1024;
+
+    // max retained bytes of pools of all threads
+    static const unsigned long MAX_ALL_RETAIN_BYTES = 1024 * 1024 * 1024;
+
+  protected:
+    typedef std::vector<BufferPool_var> BufferPoolArray;
+
+  protected:
+    // register pool of current thread: it will be trimmed by
+    // trim_thread_pools() and hold until thread exit
+    static void
+    add_thread_pool_(BufferPool* pool);
+
+    // count bytes of buffer that will be retained by current thread pool,
+    // returns false if it exceeds limits
+    static bool
+    retain_bytes_(unsigned long bytes) throw();
+
+    // count bytes of buffer that isn't retained by pool more,
+    // thread_pool is false if pool released after its thread exit
+    static void
+    unretain_bytes_(unsigned long bytes, bool thread_pool = true) throw();
+
+  protected:
+    static std::atomic<unsigned long> all_retained_bytes_;
+    static thread_local unsigned long thread_retained_bytes_;
+    static thread_local BufferPoolArray thread_pools_;
+  };
+
   // helpers for force buffers allocation
   template<typename ValueType>
   struct Buffer:
     public std::vector<ValueType>,
     public Gears::AtomicRefCountable
   {
+    Buffer()
+      : evaluation(0)
+    {}
+
+    // pool evaluation, when buffer was released
+    unsigned long evaluation;
+
   protected:
     virtual ~Buffer() throw()
     {}
@@ -69,82 +162,275 @@ namespace Vanga
     Gears::IntrusivePtr<Buffer<ValueType> > buffer_;
   };
 
+  // BufferProviderImpl: pool of released buffers owned by one thread,
+  // buffers grouped into size classes by capacity (power of 2),
+  // retained capacity is bounded (see BufferPools): buffers over limit
+  // returned to allocator.
+  // buffer must be released in thread that got it: buffers released
+  // in other thread returned to allocator
   template<typename ValueType>
-  class BufferProviderImpl: public Gears::AtomicRefCountable
+  class BufferProviderImpl: public BufferPool
   {
     friend class BufferPtr<ValueType>;
 
   public:
     BufferProviderImpl() throw();
 
+    // get buffer with capacity >= reserve_size (if pool contains it)
     Gears::IntrusivePtr<BufferPtr<ValueType> >
-    get();
+    get(unsigned long reserve_size = 0);
+
+    unsigned long
+    retained_size() const throw();
+
+    virtual void
+    trim() throw();
+
+    // retained size of pools of all threads
+    static unsigned long
+    all_retained_size() throw();
 
   protected:
-    typedef Gears::SpinLock SyncPolicy;
+    typedef std::vector<Gears::IntrusivePtr<Buffer<ValueType> > >
+      BufferArray;
+
+    static const unsigned long SIZE_CLASSES = 64;
+
+    // max buffers in one size class
+    static const unsigned long MAX_CLASS_BUFFERS = 16;
 
   protected:
     virtual ~BufferProviderImpl() throw()
-    {};
+    {
+      // pool destroyed after its thread exit
+      all_retained_size_.fetch_sub(retained_size_, std::memory_order_relaxed);
+      BufferPools::unretain_bytes_(retained_size_ * sizeof(ValueType), false);
+    };
+
+    static unsigned long
+    size_class_(unsigned long size) throw();
+
+    // take buffer retained in class
+    void
+    take_(
+      Gears::IntrusivePtr<Buffer<ValueType> >& buffer,
+      unsigned long class_i)
+      throw();
 
     void
     release_(Gears::IntrusivePtr<Buffer<ValueType> >& buffer);
 
   protected:
-    SyncPolicy lock_;
-    std::vector<Gears::IntrusivePtr<Buffer<ValueType> > > pred_buffers_;
+    static std::atomic<unsigned long> all_retained_size_;
+
+    const std::thread::id owner_;
+    BufferArray classes_[SIZE_CLASSES];
+    unsigned long retained_size_;
+    unsigned long evaluation_;
   };
 
+  // BufferProvider: thread local pools, access to pool don't require locking
   template<typename ValueType>
-  class BufferProvider:
-    public Gears::Singleton<
-      BufferProviderImpl<ValueType>,
-      Gears::IntrusivePtr<BufferProviderImpl<ValueType> > >
-  {};
+  class BufferProvider
+  {
+  public:
+    static BufferProviderImpl<ValueType>&
+    instance();
+
+  protected:
+    static BufferProviderImpl<ValueType>*
+    create_();
+  };
 }
 
 namespace Vanga
 {
+  template<typename ValueType>
+  std::atomic<unsigned long> BufferProviderImpl<ValueType>::all_retained_size_(0);
+
   template<typename ValueType>
   BufferProviderImpl<ValueType>::BufferProviderImpl() throw()
+    : owner_(std::this_thread::get_id()),
+      retained_size_(0),
+      evaluation_(0)
+  {}
+
+  template<typename ValueType>
+  unsigned long
+  BufferProviderImpl<ValueType>::size_class_(unsigned long size) throw()
   {
-    pred_buffers_.reserve(128);
+    // floor(log2(size)) + 1, 0 for empty buffers
+    unsigned long res = 0;
+    while(size)
+    {
+      size >>= 1;
+      ++res;
+    }
+
+    return res < SIZE_CLASSES ? res : SIZE_CLASSES - 1;
+  }
+
+  template<typename ValueType>
+  void
+  BufferProviderImpl<ValueType>::take_(
+    Gears::IntrusivePtr<Buffer<ValueType> >& buffer,
+    unsigned long class_i)
+    throw()
+  {
+    buffer.swap(classes_[class_i].back());
+    classes_[class_i].pop_back();
+
+    const unsigned long capacity = buffer->capacity();
+    retained_size_ -= capacity;
+    all_retained_size_.fetch_sub(capacity, std::memory_order_relaxed);
+    BufferPools::unretain_bytes_(capacity * sizeof(ValueType));
   }
 
   template<typename ValueType>
   Gears::IntrusivePtr<BufferPtr<ValueType> >
-  BufferProviderImpl<ValueType>::get()
+  BufferProviderImpl<ValueType>::get(unsigned long reserve_size)
   {
     Gears::IntrusivePtr<Buffer<ValueType> > res;
 
+    // buffers of class, that contains reserve_size, can be smaller:
+    // prefer next class, that guarantee enough capacity
+    unsigned long min_class = reserve_size ? size_class_(reserve_size - 1) + 1 : 0;
+    if(min_class >= SIZE_CLASSES)
+    {
+      min_class = SIZE_CLASSES - 1;
+    }
+
+    for(unsigned long class_i = min_class; class_i < SIZE_CLASSES; ++class_i)
+    {
+      if(!classes_[class_i].empty())
+      {
+        take_(res, class_i);
+        break;
+      }
+    }
+
+    if(!res)
     {
-      SyncPolicy::WriteGuard lock(lock_);
-      if(!pred_buffers_.empty())
+      // reuse any smaller buffer: it will grow on demand
+      for(unsigned long class_i = min_class; class_i > 0; --class_i)
       {
-        res.swap(pred_buffers_.back());
-        pred_buffers_.pop_back();
+        if(!classes_[class_i - 1].empty())
+        {
+          take_(res, class_i - 1);
+          break;
+        }
       }
     }
 
     if(!res)
     {
       res = new Buffer<ValueType>();
-      res->reserve(1024*1024);
+    }
+
+    if(reserve_size)
+    {
+      const unsigned long prev_capacity = res->capacity();
+      res->reserve(reserve_size);
+
+      if(res->capacity() > prev_capacity)
+      {
+        Profiler::add_buffer_bytes(
+          (res->capacity() - prev_capacity) * sizeof(ValueType));
+      }
     }
 
     return new BufferPtr<ValueType>(this, res);
   }
 
+  template<typename ValueType>
+  unsigned long
+  BufferProviderImpl<ValueType>::retained_size() const throw()
+  {
+    return retained_size_;
+  }
+
+  template<typename ValueType>
+  void
+  BufferProviderImpl<ValueType>::trim() throw()
+  {
+    // buffers released in finished evaluation are marked with evaluation_
+    for(unsigned long class_i = 0; class_i < SIZE_CLASSES; ++class_i)
+    {
+      BufferArray& class_buffers = classes_[class_i];
+      unsigned long keep_i = 0;
+
+      for(unsigned long buffer_i = 0; buffer_i < class_buffers.size(); ++buffer_i)
+      {
+        if(class_buffers[buffer_i]->evaluation == evaluation_)
+        {
+          class_buffers[keep_i++].swap(class_buffers[buffer_i]);
+        }
+        else
+        {
+          const unsigned long capacity = class_buffers[buffer_i]->capacity();
+          retained_size_ -= capacity;
+          all_retained_size_.fetch_sub(capacity, std::memory_order_relaxed);
+          BufferPools::unretain_bytes_(capacity * sizeof(ValueType));
+        }
+      }
+
+      class_buffers.resize(keep_i);
+    }
+
+    ++evaluation_;
+  }
+
+  template<typename ValueType>
+  unsigned long
+  BufferProviderImpl<ValueType>::all_retained_size() throw()
+  {
+    return all_retained_size_.load(std::memory_order_relaxed);
+  }
+
   template<typename ValueType>
   void
   BufferProviderImpl<ValueType>::release_(
     Gears::IntrusivePtr<Buffer<ValueType> >& buffer)
   {
-    buffer->clear();
+    const unsigned long capacity = buffer->capacity();
+    BufferArray& class_buffers = classes_[size_class_(capacity)];
+
+    if(std::this_thread::get_id() == owner_ &&
+      class_buffers.size() < MAX_CLASS_BUFFERS &&
+      BufferPools::retain_bytes_(capacity * sizeof(ValueType)))
+    {
+      buffer->clear();
+      buffer->evaluation = evaluation_;
+      retained_size_ += capacity;
+      all_retained_size_.fetch_add(capacity, std::memory_order_relaxed);
+      class_buffers.push_back(Gears::IntrusivePtr<Buffer<ValueType> >());
+      class_buffers.back().swap(buffer);
+    }
+    else
+    {
+      buffer = Gears::IntrusivePtr<Buffer<ValueType> >();
+    }
+  }
 
-    SyncPolicy::WriteGuard lock(lock_);
-    pred_buffers_.push_back(Gears::IntrusivePtr<Buffer<ValueType> >());
-    pred_buffers_.back().swap(buffer);
+  template<typename ValueType>
+  BufferProviderImpl<ValueType>&
+  BufferProvider<ValueType>::instance()
+  {
+    // provider is hold by thread pools list until thread exit,
+    // BufferPtr keep reference to provider, provider will be destroyed
+    // after thread exit and release of all its buffers
+    static thread_local BufferProviderImpl<ValueType>* provider = create_();
+    return *provider;
+  }
+
+  template<typename ValueType>
+  BufferProviderImpl<ValueType>*
+  BufferProvider<ValueType>::create_()
+  {
+    Gears::IntrusivePtr<BufferProviderImpl<ValueType> > provider(
+      new BufferProviderImpl<ValueType>());
+    BufferPools::add_thread_pool_(provider);
+    return provider.in();
   }
 
   template<typename ValueType>
@@ -0,0 +1,375 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <sstream>
+
+#include <Gears/Basic/Errno.hpp>
+#include <Gears/Basic/OutputMemoryStream.hpp>
+#include <Gears/Basic/StringManip.hpp>
+
+#include "Label.hpp"
+#include "PredictProtocol.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    const char UNIX_PREFIX[] = "unix:";
+    const char DEFAULT_HOST[] = "127.0.0.1";
+    const int LISTEN_BACKLOG = 128;
+  }
+
+  const uint32_t PredictProtocol::MAX_BODY_SIZE;
+
+  int
+  PredictProtocol::listen(const std::string& address)
+  {
+    return open_socket_(address, true);
+  }
+
+  int
+  PredictProtocol::connect(const std::string& address)
+  {
+    return open_socket_(address, false);
+  }
+
+  bool
+  PredictProtocol::read(int fd, void* buf, unsigned long size)
+  {
+    char* cur = static_cast<char*>(buf);
+    unsigned long left = size;
+
+    while(left > 0)
+    {
+      const ssize_t read_size = ::read(fd, cur, left);
+
+      if(read_size > 0)
+      {
+        cur += read_size;
+        left -= read_size;
+      }
+      else if(read_size == 0)
+      {
+        if(left == size)
+        {
+          return false;
+        }
+
+        throw Exception("PredictProtocol::read(): unexpected end of message");
+      }
+      else if(errno != EINTR)
+      {
+        Gears::throw_errno_exception<Exception>(
+          "PredictProtocol::read(): read failed");
+      }
+    }
+
+    return true;
+  }
+
+  void
+  PredictProtocol::write(int fd, const void* buf, unsigned long size)
+  {
+    const char* cur = static_cast<const char*>(buf);
+    unsigned long left = size;
+
+    while(left > 0)
+    {
+      const ssize_t write_size = ::send(fd, cur, left, MSG_NOSIGNAL);
+
+      if(write_size >= 0)
+      {
+        cur += write_size;
+        left -= write_size;
+      }
+      else if(errno != EINTR)
+      {
+        Gears::throw_errno_exception<Exception>(
+          "PredictProtocol::write(): write failed");
+      }
+    }
+  }
+
+  void
+  PredictProtocol::write_binary_row(
+    std::string& body,
+    const std::vector<std::pair<uint32_t, float> >& features)
+  {
+    const uint32_t features_number = features.size();
+    body.append(
+      reinterpret_cast<const char*>(&features_number),
+      sizeof(features_number));
+
+    for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+    {
+      body.append(
+        reinterpret_cast<const char*>(&feature_it->first),
+        sizeof(feature_it->first));
+      body.append(
+        reinterpret_cast<const char*>(&feature_it->second),
+        sizeof(feature_it->second));
+    }
+  }
+
+  void
+  PredictProtocol::read_rows(
+    std::vector<FeatureArray>& rows,
+    uint32_t type,
+    const std::string& body,
+    unsigned long rows_number,
+    const NumericFeatureSet& numeric_features)
+  {
+    // row takes at least one byte: don't allocate rows for invalid number
+    if(rows_number > body.size())
+    {
+      throw Exception("PredictProtocol::read_rows(): rows number exceeds body size");
+    }
+
+    rows.resize(rows_number);
+
+    if(type == RT_BINARY)
+    {
+      read_binary_rows_(rows, body, rows_number, numeric_features);
+      return;
+    }
+
+    if(type != RT_SVM)
+    {
+      throw Exception("PredictProtocol::read_rows(): unexpected request type");
+    }
+
+    std::istringstream body_istr(body);
+
+    for(unsigned long row_i = 0; row_i < rows_number; ++row_i)
+    {
+      Row_var row;
+
+      try
+      {
+        PredictedBoolLabel label;
+        row = SVM<PredictedBoolLabel>::load_line(body_istr, label, &numeric_features);
+      }
+      catch(const Gears::Exception& ex)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "PredictProtocol::read_rows(): invalid row #" << row_i <<
+          ": " << ex.what();
+        throw Exception(ostr.str());
+      }
+
+      if(!row)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "PredictProtocol::read_rows(): body contains " << row_i <<
+          " rows instead " << rows_number;
+        throw Exception(ostr.str());
+      }
+
+      rows[row_i].swap(row->features);
+    }
+
+    // only whitespaces allowed after rows (as for RT_BINARY body)
+    body_istr >> std::ws;
+
+    if(!body_istr.eof())
+    {
+      throw Exception("PredictProtocol::read_rows(): body contains extra data");
+    }
+  }
+
+  void
+  PredictProtocol::read_binary_rows_(
+    std::vector<FeatureArray>& rows,
+    const std::string& body,
+    unsigned long rows_number,
+    const NumericFeatureSet& numeric_features)
+  {
+    const char* cur = body.data();
+    const char* end = body.data() + body.size();
+
+    for(unsigned long row_i = 0; row_i < rows_number; ++row_i)
+    {
+      uint32_t features_number;
+
+      if(static_cast<unsigned long>(end - cur) < sizeof(features_number))
+      {
+        throw Exception("PredictProtocol::read_rows(): unexpected end of body");
+      }
+
+      ::memcpy(&features_number, cur, sizeof(features_number));
+      cur += sizeof(features_number);
+
+      const unsigned long feature_size = sizeof(uint32_t) + sizeof(float);
+
+      if(static_cast<unsigned long>(end - cur) / feature_size < features_number)
+      {
+        throw Exception("PredictProtocol::read_rows(): unexpected end of body");
+      }
+
+      FeatureArray& features = rows[row_i];
+      features.clear();
+      features.reserve(features_number);
+
+      for(uint32_t feature_i = 0; feature_i < features_number; ++feature_i)
+      {
+        uint32_t feature_id;
+        float value;
+        ::memcpy(&feature_id, cur, sizeof(feature_id));
+        ::memcpy(&value, cur + sizeof(feature_id), sizeof(value));
+        cur += feature_size;
+
+        // same conversion as in SVM::load_line
+        features.push_back(std::make_pair(
+          feature_id,
+          numeric_features.find(feature_id) != numeric_features.end() ?
+            numeric_feature_value(value) :
+            static_cast<uint32_t>(value > 0.0000001 ? 1 : 0)));
+      }
+
+      std::sort(features.begin(), features.end(), FirstLess());
+      features.erase(
+        std::unique(features.begin(), features.end(), FirstEqual()),
+        features.end());
+    }
+
+    if(cur != end)
+    {
+      throw Exception("PredictProtocol::read_rows(): body contains extra data");
+    }
+  }
+
+  int
+  PredictProtocol::open_socket_(
+    const std::string& address,
+    bool listen_socket)
+  {
+    const char* FUN = listen_socket ?
+      "PredictProtocol::listen()" : "PredictProtocol::connect()";
+
+    int fd;
+    int res;
+
+    if(address.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) == 0)
+    {
+      const std::string path = address.substr(sizeof(UNIX_PREFIX) - 1);
+
+      sockaddr_un addr;
+      ::memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+
+      if(path.empty() || path.size() >= sizeof(addr.sun_path))
+      {
+        Gears::ErrorStream ostr;
+        ostr << FUN << ": invalid unix socket path '" << path << "'";
+        throw Exception(ostr.str());
+      }
+
+      ::memcpy(addr.sun_path, path.data(), path.size());
+
+      fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if(fd < 0)
+      {
+        Gears::throw_errno_exception<Exception>(FUN, ": can't create socket");
+      }
+
+      if(listen_socket)
+      {
+        // remove socket of previous run
+        ::unlink(path.c_str());
+        res = ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+      }
+      else
+      {
+        res = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+      }
+    }
+    else
+    {
+      const std::string::size_type pos = address.rfind(':');
+      const std::string host = pos != std::string::npos ?
+        address.substr(0, pos) : std::string(DEFAULT_HOST);
+      const std::string port_str = pos != std::string::npos ?
+        address.substr(pos + 1) : address;
+
+      sockaddr_in addr;
+      ::memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+
+      unsigned long port;
+      if(!Gears::StringManip::str_to_int(port_str, port) ||
+        port == 0 || port > 0xFFFF ||
+        ::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+      {
+        Gears::ErrorStream ostr;
+        ostr << FUN << ": invalid address '" << address << "'";
+        throw Exception(ostr.str());
+      }
+
+      addr.sin_port = htons(port);
+
+      fd = ::socket(AF_INET, SOCK_STREAM, 0);
+      if(fd < 0)
+      {
+        Gears::throw_errno_exception<Exception>(FUN, ": can't create socket");
+      }
+
+      // requests are small: don't delay them
+      const int on = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+      if(listen_socket)
+      {
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        res = ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+      }
+      else
+      {
+        res = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+      }
+    }
+
+    if(res == 0 && listen_socket)
+    {
+      res = ::listen(fd, LISTEN_BACKLOG);
+    }
+
+    if(res < 0)
+    {
+      const int error = errno;
+      ::close(fd);
+      Gears::throw_errno_value_exception<Exception>(
+        error, FUN, ": can't ", (listen_socket ? "listen" : "connect"),
+        " '", address.c_str(), "'");
+    }
+
+    return fd;
+  }
+}
@@ -0,0 +1,130 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef PREDICTPROTOCOL_HPP_
+#define PREDICTPROTOCOL_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <Gears/Basic/Exception.hpp>
+
+#include "SVM.hpp"
+
+namespace Vanga
+{
+  // PredictProtocol: messages of vanga-predictd (local connections only,
+  // integers and floats in native byte order).
+  // Request: RequestHead, body of RequestHead::size bytes:
+  //   RT_SVM: rows lines in svm format (label is required by format and ignored)
+  //   RT_BINARY: for each row: uint32_t features number,
+  //     then features as (uint32_t id, float value) pairs
+  //   RT_STATS: empty body
+  // Response: ResponseHead with id of request, body of ResponseHead::size bytes:
+  //   S_OK: rows predictions (double, margin without sigmoid) or stats text
+  //     ("name value" lines) for RT_STATS
+  //   S_ERROR: error description
+  // connection can contain several requests in flight, responses of one
+  // connection can be reordered
+  struct PredictProtocol
+  {
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    enum RequestType
+    {
+      RT_SVM = 1,
+      RT_BINARY,
+      RT_STATS
+    };
+
+    enum Status
+    {
+      S_OK = 0,
+      S_ERROR
+    };
+
+    static const uint32_t MAX_BODY_SIZE = 64 * 1024 * 1024;
+
+    struct RequestHead
+    {
+      uint32_t type;
+      uint32_t id; // returned in response
+      uint32_t model; // model index in daemon command line
+      uint32_t rows;
+      uint32_t size;
+    };
+
+    struct ResponseHead
+    {
+      uint32_t status;
+      uint32_t id;
+      uint32_t rows;
+      uint32_t size;
+    };
+
+    // address: unix:<path> or [<ipv4 host>:]<port> (host is 127.0.0.1 by default)
+    static int
+    listen(const std::string& address);
+
+    static int
+    connect(const std::string& address);
+
+    // read size bytes, returns false on eof before first byte
+    static bool
+    read(int fd, void* buf, unsigned long size);
+
+    static void
+    write(int fd, const void* buf, unsigned long size);
+
+    // append row to RT_BINARY body (values as SVM::load_line reads them)
+    static void
+    write_binary_row(
+      std::string& body,
+      const std::vector<std::pair<uint32_t, float> >& features);
+
+    // parse RT_SVM or RT_BINARY body, throw Exception on invalid body.
+    // feature values converted as by SVM::load_line
+    static void
+    read_rows(
+      std::vector<FeatureArray>& rows,
+      uint32_t type,
+      const std::string& body,
+      unsigned long rows_number,
+      const NumericFeatureSet& numeric_features);
+
+  protected:
+    static void
+    read_binary_rows_(
+      std::vector<FeatureArray>& rows,
+      const std::string& body,
+      unsigned long rows_number,
+      const NumericFeatureSet& numeric_features);
+
+    static int
+    open_socket_(
+      const std::string& address,
+      bool listen_socket);
+  };
+}
+
+#endif /*PREDICTPROTOCOL_HPP_*/
@@ -23,6 +23,26 @@
 
 namespace Vanga
 {
+  class DTree;
+  class PredictorSet;
+
+  // PredictorVisitor: typed access to predictors of PredictorSet
+  struct PredictorVisitor
+  {
+    virtual
+    ~PredictorVisitor() throw() {}
+
+    virtual void
+    visit(const DTree* tree, double coef) = 0;
+
+    virtual void
+    visit(const PredictorSet* predictor_set, double coef) = 0;
+
+    // predictors of other types
+    virtual void
+    visit_other(double coef) = 0;
+  };
+
   // PredictorSet
   class PredictorSet: public Gears::AtomicRefCountable
   {
@@ -56,6 +76,10 @@ namespace Vanga
     static Gears::IntrusivePtr<PredictorSet>
     load(std::istream& istr, bool with_head = true);
 
+    // call visitor for each predictor in set order
+    void
+    visit(PredictorVisitor& visitor) const;
+
     /*
     const std::vector<std::pair<Predictor_var, double> >&
     predictors() const;
@@ -69,6 +93,9 @@ namespace Vanga
       virtual void
       save(std::ostream& ostr) const = 0;
 
+      virtual void
+      accept(PredictorVisitor& visitor, double coef) const = 0;
+
       virtual std::string
       to_string(
         const char* prefix,
@@ -100,6 +127,12 @@ namespace Vanga
         predictor_->save(ostr);
       }
 
+      void
+      accept(PredictorVisitor& visitor, double coef) const
+      {
+        accept_predictor_(visitor, predictor_.in(), coef);
+      }
+
       std::string
       to_string(
         const char* prefix,
@@ -121,6 +154,22 @@ namespace Vanga
     virtual
     ~PredictorSet() throw() {}
 
+    static void
+    accept_predictor_(PredictorVisitor& visitor, const DTree* tree, double coef);
+
+    static void
+    accept_predictor_(
+      PredictorVisitor& visitor,
+      const PredictorSet* predictor_set,
+      double coef);
+
+    template<typename PredictorType>
+    static void
+    accept_predictor_(
+      PredictorVisitor& visitor,
+      const PredictorType* predictor,
+      double coef);
+
   protected:
     std::vector<std::pair<PredictorDelegate_var, double> > predictors_;
   };
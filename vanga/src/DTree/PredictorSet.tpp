@@ -55,7 +55,7 @@ namespace Vanga
     return sum;
   }
 
-  void
+  inline void
   PredictorSet::save(std::ostream& ostr) const
   {
     ostr << PredictorLoader::UNION_MODEL_SUM_HEAD << std::endl;
@@ -70,7 +70,7 @@ namespace Vanga
     }
   }
 
-  Gears::IntrusivePtr<PredictorSet>
+  inline Gears::IntrusivePtr<PredictorSet>
   PredictorSet::load(std::istream& istr, bool with_head)
   {
     PredictorSet_var res = new PredictorSet();
@@ -95,27 +95,34 @@ namespace Vanga
       std::string line;
       std::getline(istr, line);
 
+      if(line.empty())
+      {
+        // predictors separator or end of file
+        continue;
+      }
+
       double coef;
-      std::istringstream istr(line.c_str());
-      istr >> coef;
+      std::istringstream coef_istr(line.c_str());
+      coef_istr >> coef;
 
-      if(!istr.eof() || istr.fail())
+      if(!coef_istr.eof() || coef_istr.fail())
       {
         std::ostringstream ostr;
         ostr << "invalid coef value: '" << line << "'";
         throw Exception(ostr.str());
       }
 
+      // head of predictor is read by load_type
       PredictorType predictor_type = PredictorLoader::load_type(istr);
 
       if(predictor_type == PT_DTREE)
       {
-        DTree_var sub_predictor = DTree::load(istr);
+        DTree_var sub_predictor = DTree::load(istr, false);
         res->add(sub_predictor.in(), coef);
       }
       else if(predictor_type == PT_SET)
       {
-        PredictorSet_var sub_predictor = PredictorSet::load(istr);
+        PredictorSet_var sub_predictor = PredictorSet::load(istr, false);
         res->add(sub_predictor.in(), coef);
       }
       else
@@ -129,7 +136,44 @@ namespace Vanga
     return res;
   }
 
-  std::string
+  inline void
+  PredictorSet::visit(PredictorVisitor& visitor) const
+  {
+    for(auto it = predictors_.begin(); it != predictors_.end(); ++it)
+    {
+      it->first->accept(visitor, it->second);
+    }
+  }
+
+  inline void
+  PredictorSet::accept_predictor_(
+    PredictorVisitor& visitor,
+    const DTree* tree,
+    double coef)
+  {
+    visitor.visit(tree, coef);
+  }
+
+  inline void
+  PredictorSet::accept_predictor_(
+    PredictorVisitor& visitor,
+    const PredictorSet* predictor_set,
+    double coef)
+  {
+    visitor.visit(predictor_set, coef);
+  }
+
+  template<typename PredictorType>
+  void
+  PredictorSet::accept_predictor_(
+    PredictorVisitor& visitor,
+    const PredictorType* /*predictor*/,
+    double coef)
+  {
+    visitor.visit_other(coef);
+  }
+
+  inline std::string
   PredictorSet::to_string(
     const char* prefix,
     const FeatureDictionary* dict,
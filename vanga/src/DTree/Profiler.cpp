@@ -0,0 +1,225 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#include <Gears/Basic/Errno.hpp>
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "Profiler.hpp"
+
+namespace Vanga
+{
+  const char* Profiler::PHASE_NAMES[P_PHASES_NUMBER] = {
+    "svm_load",
+    "fill_feature_rows",
+    "prepare_bags",
+    "get_best_feature",
+    "check_feature",
+    "lbfgs",
+    "div_bags",
+    "metric_eval"
+  };
+
+  std::atomic<bool> Profiler::enabled_(false);
+  std::atomic<unsigned long> Profiler::iteration_(0);
+  Gears::Mutex Profiler::lock_;
+  std::vector<Profiler::ThreadStat_var> Profiler::thread_stats_;
+  std::chrono::steady_clock::time_point Profiler::start_time_;
+
+  void
+  Profiler::enable() throw()
+  {
+    start_time_ = std::chrono::steady_clock::now();
+    enabled_.store(true, std::memory_order_relaxed);
+  }
+
+  Profiler::ThreadStat&
+  Profiler::thread_stat_() throw()
+  {
+    // stat is registered at first use in thread and outlives thread
+    static thread_local ThreadStat* thread_stat = 0;
+
+    if(!thread_stat)
+    {
+      ThreadStat_var new_thread_stat = new ThreadStat();
+
+      Gears::Mutex::WriteGuard guard(lock_);
+      new_thread_stat->thread_i = thread_stats_.size();
+      thread_stats_.push_back(new_thread_stat);
+      thread_stat = new_thread_stat;
+    }
+
+    return *thread_stat;
+  }
+
+  void
+  Profiler::add(Phase phase, uint64_t time_ns, uint64_t rows) throw()
+  {
+    Counter& counter = thread_stat_().counters[phase];
+    counter.time_ns.fetch_add(time_ns, std::memory_order_relaxed);
+    counter.calls.fetch_add(1, std::memory_order_relaxed);
+    counter.rows.fetch_add(rows, std::memory_order_relaxed);
+  }
+
+  void
+  Profiler::add_buffer_bytes(uint64_t bytes) throw()
+  {
+    if(enabled())
+    {
+      thread_stat_().buffer_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+  }
+
+  void
+  Profiler::save_counters_(
+    std::ostream& ostr,
+    const uint64_t (&values)[P_PHASES_NUMBER][3],
+    const char* prefix)
+  {
+    ostr << "{";
+
+    bool first = true;
+    for(unsigned long phase_i = 0; phase_i < P_PHASES_NUMBER; ++phase_i)
+    {
+      if(values[phase_i][1] == 0)
+      {
+        continue;
+      }
+
+      ostr << (first ? "" : ",") << std::endl <<
+        prefix << "  \"" << PHASE_NAMES[phase_i] << "\": {" <<
+        "\"time\": " << (static_cast<double>(values[phase_i][0]) / 1000000000) <<
+        ", \"calls\": " << values[phase_i][1] <<
+        ", \"rows\": " << values[phase_i][2] << "}";
+      first = false;
+    }
+
+    ostr << (first ? "" : "\n") << (first ? "" : prefix) << "}";
+  }
+
+  void
+  Profiler::save(std::ostream& ostr, bool final)
+  {
+    std::vector<ThreadStat_var> thread_stats;
+
+    {
+      Gears::Mutex::WriteGuard guard(lock_);
+      thread_stats = thread_stats_;
+    }
+
+    const double elapsed = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_time_).count()) / 1000000000;
+
+    uint64_t sum_values[P_PHASES_NUMBER][3] = {};
+    uint64_t sum_buffer_bytes = 0;
+
+    std::ostringstream threads_ostr;
+    threads_ostr.setf(std::ios::fixed, std::ios::floatfield);
+    threads_ostr.precision(6);
+
+    for(auto stat_it = thread_stats.begin(); stat_it != thread_stats.end(); ++stat_it)
+    {
+      uint64_t values[P_PHASES_NUMBER][3];
+
+      for(unsigned long phase_i = 0; phase_i < P_PHASES_NUMBER; ++phase_i)
+      {
+        const Counter& counter = (*stat_it)->counters[phase_i];
+        values[phase_i][0] = counter.time_ns.load(std::memory_order_relaxed);
+        values[phase_i][1] = counter.calls.load(std::memory_order_relaxed);
+        values[phase_i][2] = counter.rows.load(std::memory_order_relaxed);
+
+        for(unsigned long value_i = 0; value_i < 3; ++value_i)
+        {
+          sum_values[phase_i][value_i] += values[phase_i][value_i];
+        }
+      }
+
+      const uint64_t buffer_bytes =
+        (*stat_it)->buffer_bytes.load(std::memory_order_relaxed);
+      sum_buffer_bytes += buffer_bytes;
+
+      threads_ostr << (stat_it != thread_stats.begin() ? "," : "") << std::endl <<
+        "    {\"thread\": " << (*stat_it)->thread_i <<
+        ", \"buffer_bytes\": " << buffer_bytes <<
+        ", \"phases\": ";
+      save_counters_(threads_ostr, values, "    ");
+      threads_ostr << "}";
+    }
+
+    std::ios_base::fmtflags flags = ostr.flags();
+    std::streamsize precision = ostr.precision();
+    ostr.setf(std::ios::fixed, std::ios::floatfield);
+    ostr.precision(6);
+
+    ostr << "{" << std::endl <<
+      "  \"iteration\": " << iteration_.load() << "," << std::endl <<
+      "  \"final\": " << (final ? "true" : "false") << "," << std::endl <<
+      "  \"elapsed\": " << elapsed << "," << std::endl <<
+      "  \"buffer_bytes\": " << sum_buffer_bytes << "," << std::endl <<
+      "  \"phases\": ";
+    save_counters_(ostr, sum_values, "  ");
+    ostr << "," << std::endl <<
+      "  \"threads\": [" << threads_ostr.str() <<
+      (thread_stats.empty() ? "" : "\n  ") << "]" << std::endl <<
+      "}" << std::endl;
+
+    ostr.flags(flags);
+    ostr.precision(precision);
+  }
+
+  void
+  Profiler::save(const std::string& file, bool final)
+  {
+    const std::string tmp_file = file + ".tmp";
+
+    {
+      std::ofstream ostr(tmp_file.c_str(), std::ios::trunc);
+
+      if(!ostr.is_open())
+      {
+        Gears::ErrorStream err;
+        err << "Profiler::save(): can't open '" << tmp_file << "'";
+        throw Exception(err.str());
+      }
+
+      save(ostr, final);
+      ostr.close();
+
+      if(ostr.fail())
+      {
+        Gears::ErrorStream err;
+        err << "Profiler::save(): can't write '" << tmp_file << "'";
+        throw Exception(err.str());
+      }
+    }
+
+    if(::rename(tmp_file.c_str(), file.c_str()) < 0)
+    {
+      Gears::throw_errno_exception<Exception>(
+        "Profiler::save(): can't rename '", tmp_file.c_str(),
+        "' to '", file.c_str(), "'");
+    }
+  }
+}
@@ -0,0 +1,183 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+#include <Gears/Basic/Lock.hpp>
+
+namespace Vanga
+{
+  // Profiler: wall time, calls and touched rows of training phases
+  // collected per thread (phase time includes nested phases),
+  // disabled profiler costs one flag check per scope.
+  // counters of forked worker processes aren't collected
+  class Profiler
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    enum Phase
+    {
+      P_SVM_LOAD = 0,
+      P_FILL_FEATURE_ROWS,
+      P_PREPARE_BAGS,
+      P_GET_BEST_FEATURE,
+      P_CHECK_FEATURE,
+      P_LBFGS,
+      P_DIV_BAGS,
+      P_METRIC_EVAL,
+      P_PHASES_NUMBER
+    };
+
+    static void
+    enable() throw();
+
+    static bool
+    enabled() throw()
+    {
+      return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void
+    add(Phase phase, uint64_t time_ns, uint64_t rows) throw();
+
+    static void
+    add_buffer_bytes(uint64_t bytes) throw();
+
+    // last finished training iteration
+    static void
+    set_iteration(unsigned long iteration) throw()
+    {
+      iteration_.store(iteration, std::memory_order_relaxed);
+    }
+
+    // JSON: phases summary and per thread counters
+    static void
+    save(std::ostream& ostr, bool final);
+
+    // save to file over temporary file
+    static void
+    save(const std::string& file, bool final);
+
+  protected:
+    struct Counter
+    {
+      Counter()
+        : time_ns(0),
+          calls(0),
+          rows(0)
+      {}
+
+      std::atomic<uint64_t> time_ns;
+      std::atomic<uint64_t> calls;
+      std::atomic<uint64_t> rows;
+    };
+
+    // ThreadStat: changed only by owner thread, read by save
+    struct ThreadStat: public Gears::AtomicRefCountable
+    {
+      ThreadStat()
+        : thread_i(0),
+          buffer_bytes(0)
+      {}
+
+      unsigned long thread_i;
+      Counter counters[P_PHASES_NUMBER];
+      std::atomic<uint64_t> buffer_bytes;
+
+    protected:
+      virtual ~ThreadStat() throw() {}
+    };
+
+    typedef Gears::IntrusivePtr<ThreadStat> ThreadStat_var;
+
+  protected:
+    static ThreadStat&
+    thread_stat_() throw();
+
+    static void
+    save_counters_(
+      std::ostream& ostr,
+      const uint64_t (&values)[P_PHASES_NUMBER][3],
+      const char* prefix);
+
+  protected:
+    static const char* PHASE_NAMES[P_PHASES_NUMBER];
+
+    static std::atomic<bool> enabled_;
+    static std::atomic<unsigned long> iteration_;
+    static Gears::Mutex lock_;
+    static std::vector<ThreadStat_var> thread_stats_;
+    static std::chrono::steady_clock::time_point start_time_;
+  };
+
+  // ProfileScope: add scope wall time to phase counters
+  class ProfileScope
+  {
+  public:
+    ProfileScope(Profiler::Phase phase, uint64_t rows = 0) throw()
+      : phase_(phase),
+        rows_(rows),
+        enabled_(Profiler::enabled())
+    {
+      if(enabled_)
+      {
+        start_time_ = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~ProfileScope() throw()
+    {
+      if(enabled_)
+      {
+        Profiler::add(
+          phase_,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_time_).count(),
+          rows_);
+      }
+    }
+
+    void
+    add_rows(uint64_t rows) throw()
+    {
+      rows_ += rows;
+    }
+
+  protected:
+    const Profiler::Phase phase_;
+    uint64_t rows_;
+    const bool enabled_;
+    std::chrono::steady_clock::time_point start_time_;
+  };
+}
+
+#endif /*PROFILER_HPP_*/
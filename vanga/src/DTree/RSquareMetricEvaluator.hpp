@@ -67,7 +67,7 @@ namespace Vanga
     const PredictedBoolLabel& label,
     unsigned long count)
   {
-    const double exp = std::exp(- std::min(std::max(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
+    const double exp = std::exp(- std::min(std::max<double>(label.pred, LOGLOSS_EXP_MIN), LOGLOSS_EXP_MAX));
     const double p = 1.0 / (1.0 + exp);
 
     ss_res_ += (label.value - p) * (label.value - p) * count;
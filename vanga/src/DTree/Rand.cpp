@@ -0,0 +1,84 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <atomic>
+#include <Gears/Basic/Rand.hpp>
+
+#include "Rand.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    uint64_t
+    init_seed() throw()
+    {
+      return (static_cast<uint64_t>(Gears::safe_rand()) << 32) ^
+        Gears::safe_rand();
+    }
+
+    std::atomic<uint64_t> global_seed(init_seed());
+
+    // thread start order, used as stream of thread generator
+    std::atomic<uint64_t> thread_number(0);
+
+    Rand&
+    thread_rand() throw()
+    {
+      static thread_local Rand rand(
+        global_seed.load(),
+        thread_number.fetch_add(1));
+      return rand;
+    }
+  }
+
+  // ThreadRand::Guard
+  ThreadRand::Guard::Guard(uint64_t seed, uint64_t stream) throw()
+    : prev_rand_(thread_rand())
+  {
+    thread_rand() = Rand(seed, stream);
+  }
+
+  ThreadRand::Guard::~Guard() throw()
+  {
+    thread_rand() = prev_rand_;
+  }
+
+  // ThreadRand
+  void
+  ThreadRand::set_seed(uint64_t seed) throw()
+  {
+    global_seed = seed;
+    thread_rand() = Rand(seed, 0);
+  }
+
+  uint64_t
+  ThreadRand::seed() throw()
+  {
+    return global_seed.load();
+  }
+
+  Rand&
+  ThreadRand::get() throw()
+  {
+    return thread_rand();
+  }
+}
@@ -0,0 +1,158 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RAND_HPP_
+#define RAND_HPP_
+
+#include <cstdint>
+
+namespace Vanga
+{
+  // Rand: counter based generator, value is splitmix64 finalizer
+  // applied to (key, sequence number), so generators with different
+  // seed/stream pairs are independent and copy of generator is cheap
+  class Rand
+  {
+  public:
+    // generator position: restored generator continues sequence
+    struct State
+    {
+      uint64_t key;
+      uint64_t counter;
+    };
+
+  public:
+    explicit
+    Rand(uint64_t seed = 0, uint64_t stream = 0) throw();
+
+    uint64_t
+    next() throw();
+
+    // uniformly distributed value in [0, max_boundary - 1] range
+    uint32_t
+    operator()(uint32_t max_boundary) throw();
+
+    State
+    state() const throw();
+
+    void
+    set_state(const State& state) throw();
+
+  protected:
+    static uint64_t
+    mix_(uint64_t val) throw();
+
+  protected:
+    uint64_t key_;
+    uint64_t counter_;
+  };
+
+  // ThreadRand: generator of current thread, don't require locking.
+  // thread generators seeded by global seed and thread start order,
+  // for results independent of threads number task should
+  // fix own generator with Guard (seed, stream defined by task).
+  class ThreadRand
+  {
+  public:
+    class Guard
+    {
+    public:
+      Guard(uint64_t seed, uint64_t stream) throw();
+
+      ~Guard() throw();
+
+    protected:
+      Rand prev_rand_;
+    };
+
+  public:
+    // reset global seed and generator of current thread
+    static void
+    set_seed(uint64_t seed) throw();
+
+    static uint64_t
+    seed() throw();
+
+    static Rand&
+    get() throw();
+
+    static uint32_t
+    rand(uint32_t max_boundary) throw();
+  };
+}
+
+namespace Vanga
+{
+  // Rand
+  inline
+  Rand::Rand(uint64_t seed, uint64_t stream) throw()
+    : key_(mix_(seed) ^ mix_(stream + 0x632BE59BD9B4E019ULL)),
+      counter_(0)
+  {}
+
+  inline uint64_t
+  Rand::mix_(uint64_t val) throw()
+  {
+    val += 0x9E3779B97F4A7C15ULL;
+    val = (val ^ (val >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    val = (val ^ (val >> 27)) * 0x94D049BB133111EBULL;
+    return val ^ (val >> 31);
+  }
+
+  inline uint64_t
+  Rand::next() throw()
+  {
+    return mix_(key_ + 0x9E3779B97F4A7C15ULL * counter_++);
+  }
+
+  inline uint32_t
+  Rand::operator()(uint32_t max_boundary) throw()
+  {
+    // multiply-shift range reduction on high 32 bits
+    return static_cast<uint32_t>(
+      ((next() >> 32) * static_cast<uint64_t>(max_boundary)) >> 32);
+  }
+
+  inline Rand::State
+  Rand::state() const throw()
+  {
+    State res;
+    res.key = key_;
+    res.counter = counter_;
+    return res;
+  }
+
+  inline void
+  Rand::set_state(const State& state) throw()
+  {
+    key_ = state.key;
+    counter_ = state.counter;
+  }
+
+  // ThreadRand
+  inline uint32_t
+  ThreadRand::rand(uint32_t max_boundary) throw()
+  {
+    return get()(max_boundary);
+  }
+}
+
+#endif /*RAND_HPP_*/
@@ -23,13 +23,17 @@
 
 #include <vector>
 #include <deque>
+#include <set>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
 
 #include <Gears/Basic/Exception.hpp>
 #include <Gears/Basic/AtomicRefCountable.hpp>
 #include <Gears/Basic/IntrusivePtr.hpp>
 
+#include "MemoryUsage.hpp"
+
 namespace Vanga
 {
   struct FeatureLess
@@ -58,18 +62,40 @@ namespace Vanga
     }
   };
 
+  // numeric feature values kept in FeatureArray as float bits,
+  // values of other features are 0 or 1
+  typedef std::set<unsigned long> NumericFeatureSet;
+
+  inline uint32_t
+  numeric_feature_value(float value)
+  {
+    uint32_t res;
+    std::memcpy(&res, &value, sizeof(res));
+    return res;
+  }
+
+  inline float
+  numeric_feature_float(uint32_t value)
+  {
+    float res;
+    std::memcpy(&res, &value, sizeof(res));
+    return res;
+  }
+
   struct FeatureArray: public std::vector<std::pair<uint32_t, uint32_t> >
   {
     std::pair<bool, uint32_t>
     get(uint32_t feature_id) const
     {
-      if(std::binary_search(
+      auto it = std::lower_bound(
         this->begin(),
         this->end(),
         feature_id,
-        FeatureLess()))
+        FeatureLess());
+
+      if(it != this->end() && it->first == feature_id)
       {
-        return std::make_pair(true, 1);
+        return std::make_pair(true, it->second);
       }
       else
       {
@@ -82,6 +108,12 @@ namespace Vanga
 
   struct Row: public Gears::AtomicRefCountable
   {
+    Row(): index(0)
+    {}
+
+    // line index in loaded file: rows in label groups are ordered by it,
+    // so rows order (and bagging) doesn't depend on allocations
+    uint32_t index;
     FeatureArray features;
 
   protected:
@@ -90,6 +122,18 @@ namespace Vanga
 
   typedef Gears::IntrusivePtr<Row> Row_var;
 
+  // RowLess: rows order in label groups, rows of different files
+  // (equal indexes) ordered by address
+  struct RowLess
+  {
+    bool
+    operator()(const Row* left, const Row* right) const throw()
+    {
+      return left->index < right->index ||
+        (left->index == right->index && left < right);
+    }
+  };
+
   //typedef std::deque<Row_var> RowArray;
   typedef std::vector<Row_var> RowArray;
 
@@ -176,14 +220,27 @@ namespace Vanga
     print_labels(std::ostream& ostr)
       throw();
 
+    // svm_groups: svm and groups, rows: rows and their features
+    // (rows can be shared with other svm: with_rows = false)
+    void
+    memory_usage(MemoryUsage& usage, bool with_rows = true) const
+      throw();
+
+    // file_rows (if defined) filled by loaded rows in file order,
+    // values of numeric_features (if defined) are kept
     static Gears::IntrusivePtr<SVM<LabelType> >
-    load(std::istream& in, unsigned long lines = 0)
+    load(
+      std::istream& in,
+      unsigned long lines = 0,
+      RowArray* file_rows = 0,
+      const NumericFeatureSet* numeric_features = 0)
       /*throw(Exception)*/;
 
     static Row_var
     load_line(
       std::istream& in,
-      LabelType& label_value);
+      LabelType& label_value,
+      const NumericFeatureSet* numeric_features = 0);
 
     void
     save(std::ostream& out) const
@@ -224,7 +281,8 @@ namespace Vanga
     load_line_(
       std::istream& in,
       LabelType& label_value,
-      FeatureArray& features);
+      FeatureArray& features,
+      const NumericFeatureSet* numeric_features = 0);
 
   protected:
     Row_var
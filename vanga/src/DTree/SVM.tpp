@@ -20,13 +20,15 @@
 
 #include <sstream>
 
-#include <Gears/Basic/Rand.hpp>
 #include <Gears/Basic/OutputMemoryStream.hpp>
 #include <Gears/Basic/SubString.hpp>
 #include <Gears/Basic/StringManip.hpp>
 #include <Gears/String/AsciiStringManip.hpp>
 #include <Gears/String/Tokenizer.hpp>
 
+#include "Rand.hpp"
+#include "Profiler.hpp"
+
 namespace Vanga
 {
   struct FirstLess
@@ -149,7 +151,7 @@ namespace Vanga
       auto right_begin_it = right.begin();
       for(auto it = left.begin(); it != left.end(); ++it)
       {
-        right_begin_it = std::lower_bound(right_begin_it, right.end(), *it);
+        right_begin_it = std::lower_bound(right_begin_it, right.end(), *it, RowLess());
 
         if(right_begin_it == right.end())
         {
@@ -189,7 +191,8 @@ namespace Vanga
         left.end(),
         right.begin(),
         right.end(),
-        CountIterator());
+        CountIterator(),
+        RowLess());
       return counter.count();
     }
 
@@ -259,10 +262,11 @@ namespace Vanga
   Row_var
   SVM<LabelType>::load_line(
     std::istream& in,
-    LabelType& label_value)
+    LabelType& label_value,
+    const NumericFeatureSet* numeric_features)
   {
     FeatureArray features;
-    return load_line_(in, label_value, features);
+    return load_line_(in, label_value, features, numeric_features);
   }
 
   template<typename LabelType>
@@ -360,7 +364,8 @@ namespace Vanga
             (*left_group_it)->rows.end(),
             (*right_group_it)->rows.begin(),
             (*right_group_it)->rows.end(),
-            std::back_inserter(cross_group->rows));
+            std::back_inserter(cross_group->rows),
+            RowLess());
 
           if(!cross_group->rows.empty())
           {
@@ -381,7 +386,8 @@ namespace Vanga
               (*left_group_it)->rows.end(),
               (*right_group_it)->rows.begin(),
               (*right_group_it)->rows.end(),
-              std::back_inserter(diff_group->rows));
+              std::back_inserter(diff_group->rows),
+              RowLess());
           }
           else
           {
@@ -453,7 +459,8 @@ namespace Vanga
             (*left_group_it)->rows.end(),
             (*right_group_it)->rows.begin(),
             (*right_group_it)->rows.end(),
-            CountIterator());
+            CountIterator(),
+            RowLess());
 
           cross_count += counter.count();
 
@@ -462,7 +469,8 @@ namespace Vanga
             (*left_group_it)->rows.end(),
             (*right_group_it)->rows.begin(),
             (*right_group_it)->rows.end(),
-            CountIterator());
+            CountIterator(),
+            RowLess());
 
           left_diff_count += left_counter.count();
 
@@ -471,7 +479,8 @@ namespace Vanga
             (*right_group_it)->rows.end(),
             (*left_group_it)->rows.begin(),
             (*left_group_it)->rows.end(),
-            CountIterator());
+            CountIterator(),
+            RowLess());
 
           right_diff_count += right_counter.count();
         }
@@ -507,7 +516,7 @@ namespace Vanga
     {
       for(unsigned long i = 0; i < res_size; ++i)
       {
-        unsigned long pos = Gears::safe_rand(cur_size);
+        unsigned long pos = ThreadRand::rand(cur_size);
         LabelType label_value;
         Row_var row = get_row_(label_value, pos);
         res->add_row(row, label_value);
@@ -535,7 +544,7 @@ namespace Vanga
     {
       for(auto row_it = (*group_it)->rows.begin(); row_it != (*group_it)->rows.end(); ++row_it)
       {
-        unsigned long portion_i = Gears::safe_rand(portions_num);
+        unsigned long portion_i = ThreadRand::rand(portions_num);
         res[portion_i]->add_row(*row_it, (*group_it)->label);
       }
     }
@@ -555,7 +564,7 @@ namespace Vanga
     {
       for(auto row_it = (*group_it)->rows.begin(); row_it != (*group_it)->rows.end(); ++row_it)
       {
-        unsigned long pos = Gears::safe_rand(cur_size);
+        unsigned long pos = ThreadRand::rand(cur_size);
         if(pos < res_size)
         {
           res_first->add_row(*row_it, (*group_it)->label);
@@ -634,9 +643,15 @@ namespace Vanga
 
   template<typename LabelType>
   Gears::IntrusivePtr<SVM<LabelType> >
-  SVM<LabelType>::load(std::istream& in, unsigned long lines)
+  SVM<LabelType>::load(
+    std::istream& in,
+    unsigned long lines,
+    RowArray* file_rows,
+    const NumericFeatureSet* numeric_features)
     /*throw(Exception)*/
   {
+    ProfileScope profile_scope(Profiler::P_SVM_LOAD);
+
     unsigned long line_i = 0;
     Gears::IntrusivePtr<SVM<LabelType> > svm(new SVM<LabelType>());
     FeatureArray features;
@@ -645,11 +660,17 @@ namespace Vanga
     while(!in.eof() && (lines == 0 || line_i < lines))
     {
       LabelType label;
-      Row_var new_row = load_line_(in, label, features);
+      Row_var new_row = load_line_(in, label, features, numeric_features);
 
       if(new_row)
       {
+        new_row->index = line_i;
         svm->add_row(new_row, label);
+
+        if(file_rows)
+        {
+          file_rows->push_back(new_row);
+        }
       }
 
       ++line_i;
@@ -662,6 +683,8 @@ namespace Vanga
 
     std::cerr << "loading finished (" << line_i << " lines)" << std::endl;
 
+    profile_scope.add_rows(line_i);
+
     svm->sort_();
 
     std::cerr << "rows sorted" << std::endl;
@@ -673,6 +696,38 @@ namespace Vanga
     return svm;
   }
 
+  template<typename LabelType>
+  void
+  SVM<LabelType>::memory_usage(MemoryUsage& usage, bool with_rows) const
+    throw()
+  {
+    unsigned long groups_bytes = sizeof(*this) +
+      MemoryUsage::vector_bytes(grouped_rows);
+    unsigned long rows_bytes = 0;
+
+    for(auto group_it = grouped_rows.begin(); group_it != grouped_rows.end(); ++group_it)
+    {
+      groups_bytes += sizeof(PredictGroup<LabelType>) +
+        MemoryUsage::vector_bytes((*group_it)->rows);
+
+      if(with_rows)
+      {
+        for(auto row_it = (*group_it)->rows.begin();
+          row_it != (*group_it)->rows.end(); ++row_it)
+        {
+          rows_bytes += sizeof(Row) + MemoryUsage::vector_bytes((*row_it)->features);
+        }
+      }
+    }
+
+    usage.add("svm_groups", groups_bytes);
+
+    if(with_rows)
+    {
+      usage.add("rows", rows_bytes);
+    }
+  }
+
   template<typename LabelType>
   typename SVM<LabelType>::PredictGroup_var
   SVM<LabelType>::add_row(Row* row, const LabelType& label)
@@ -726,6 +781,7 @@ namespace Vanga
       for(auto row_it = (*group_it)->rows.begin(); row_it != (*group_it)->rows.end(); ++row_it)
       {
         Row_var row = new Row();
+        row->index = (*row_it)->index;
         FeatureArray filtered_features;
 
         for(auto it = row->features.begin(); it != row->features.end(); ++it)
@@ -812,7 +868,8 @@ namespace Vanga
   SVM<LabelType>::load_line_(
     std::istream& in,
     LabelType& label_value,
-    FeatureArray& features)
+    FeatureArray& features,
+    const NumericFeatureSet* numeric_features)
   {
     features.clear();
 
@@ -868,7 +925,21 @@ namespace Vanga
             ostr << "can't parse feature value '" << value_str << "'";
             throw Exception(ostr.str());
           }
-          value = (dvalue > 0.0000001 ? 1 : 0);
+
+          if(numeric_features &&
+            numeric_features->find(feature_value) != numeric_features->end())
+          {
+            value = numeric_feature_value(static_cast<float>(dvalue));
+          }
+          else
+          {
+            value = (dvalue > 0.0000001 ? 1 : 0);
+          }
+        }
+        else if(numeric_features &&
+          numeric_features->find(feature_value) != numeric_features->end())
+        {
+          value = numeric_feature_value(1.0);
         }
 
         features.push_back(std::make_pair(feature_value, value));
@@ -912,7 +983,7 @@ namespace Vanga
     for(auto group_it = grouped_rows.begin(); group_it != grouped_rows.end(); ++group_it)
     {
       assert(!(*group_it)->rows.empty());
-      std::sort((*group_it)->rows.begin(), (*group_it)->rows.end());
+      std::sort((*group_it)->rows.begin(), (*group_it)->rows.end(), RowLess());
     }
   }
 }
@@ -0,0 +1,291 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <sstream>
+#include <Gears/Basic/Errno.hpp>
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "ShardPool.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    std::atomic<unsigned long> segment_counter(0);
+
+    // period of workers liveness check while run() waits them
+    const long WORKERS_CHECK_PERIOD_NS = 100 * 1000 * 1000;
+  }
+
+  // SharedMemory
+  SharedMemory::SharedMemory(unsigned long size)
+    : data_(0),
+      size_(size)
+  {
+    std::ostringstream name_ostr;
+    name_ostr << "/vanga." << ::getpid() << "." << segment_counter.fetch_add(1);
+    const std::string name = name_ostr.str();
+
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0)
+    {
+      Gears::throw_errno_exception<Exception>(
+        "SharedMemory::SharedMemory(): can't open '", name.c_str(), "'");
+    }
+
+    // segment is unlinked at once: it live while mapped
+    ::shm_unlink(name.c_str());
+
+    if(::ftruncate(fd, size_) < 0)
+    {
+      ::close(fd);
+      Gears::throw_errno_exception<Exception>(
+        "SharedMemory::SharedMemory(): can't resize '", name.c_str(), "'");
+    }
+
+    data_ = ::mmap(0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if(data_ == MAP_FAILED)
+    {
+      data_ = 0;
+      Gears::throw_errno_exception<Exception>(
+        "SharedMemory::SharedMemory(): can't map '", name.c_str(), "'");
+    }
+  }
+
+  SharedMemory::~SharedMemory() throw()
+  {
+    if(data_)
+    {
+      ::munmap(data_, size_);
+    }
+  }
+
+  void*
+  SharedMemory::data() const
+  {
+    return data_;
+  }
+
+  unsigned long
+  SharedMemory::size() const
+  {
+    return size_;
+  }
+
+  // ShardPool
+  ShardPool::ShardPool(unsigned long workers_number, Job* job)
+    : control_memory_(new SharedMemory(
+        sizeof(Control) + workers_number * sizeof(sem_t))),
+      control_(static_cast<Control*>(control_memory_->data())),
+      broken_(false)
+  {
+    control_->stop = 0;
+    ::sem_init(&control_->done, 1, 0);
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      ::sem_init(&control_->start[worker_i], 1, 0);
+    }
+
+    const pid_t parent_pid = ::getpid();
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      const pid_t pid = ::fork();
+
+      if(pid < 0)
+      {
+        const int error = errno;
+        stop_();
+        Gears::throw_errno_value_exception<Exception>(
+          error, "ShardPool::ShardPool(): can't fork");
+      }
+      else if(pid == 0)
+      {
+        // worker shouldn't outlive parent
+        ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(::getppid() != parent_pid)
+        {
+          ::_exit(0);
+        }
+
+        work_(control_, worker_i, workers_number, job);
+      }
+
+      workers_.push_back(pid);
+    }
+  }
+
+  ShardPool::~ShardPool() throw()
+  {
+    stop_();
+  }
+
+  unsigned long
+  ShardPool::workers_number() const
+  {
+    return workers_.size();
+  }
+
+  void
+  ShardPool::run()
+  {
+    if(broken_)
+    {
+      throw Exception("ShardPool::run(): pool is broken by worker death");
+    }
+
+    for(unsigned long worker_i = 0; worker_i < workers_.size(); ++worker_i)
+    {
+      ::sem_post(&control_->start[worker_i]);
+    }
+
+    for(unsigned long worker_i = 0; worker_i < workers_.size(); ++worker_i)
+    {
+      // worker killed during processing never post done
+      while(!timed_wait_(&control_->done))
+      {
+        check_workers_();
+      }
+    }
+  }
+
+  void
+  ShardPool::check_workers_()
+  {
+    for(unsigned long worker_i = 0; worker_i < workers_.size(); ++worker_i)
+    {
+      int status = 0;
+
+      if(::waitpid(workers_[worker_i], &status, WNOHANG) == workers_[worker_i])
+      {
+        // dead worker is reaped: exclude it from stop_ wait
+        const pid_t pid = workers_[worker_i];
+        workers_.erase(workers_.begin() + worker_i);
+        broken_ = true;
+
+        Gears::ErrorStream ostr;
+        ostr << "ShardPool::run(): worker #" << worker_i << " (pid " << pid <<
+          ") died";
+
+        if(WIFSIGNALED(status))
+        {
+          ostr << " by signal " << WTERMSIG(status);
+        }
+        else if(WIFEXITED(status))
+        {
+          ostr << " with status " << WEXITSTATUS(status);
+        }
+
+        throw Exception(ostr.str());
+      }
+    }
+  }
+
+  void
+  ShardPool::stop_() throw()
+  {
+    control_->stop = 1;
+
+    for(unsigned long worker_i = 0; worker_i < workers_.size(); ++worker_i)
+    {
+      ::sem_post(&control_->start[worker_i]);
+    }
+
+    for(auto pid_it = workers_.begin(); pid_it != workers_.end(); ++pid_it)
+    {
+      while(::waitpid(*pid_it, 0, 0) < 0 && errno == EINTR)
+      {}
+    }
+
+    workers_.clear();
+  }
+
+  void
+  ShardPool::wait_(sem_t* sem) throw()
+  {
+    while(::sem_wait(sem) < 0 && errno == EINTR)
+    {}
+  }
+
+  bool
+  ShardPool::timed_wait_(sem_t* sem) throw()
+  {
+    timespec deadline;
+    ::clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += WORKERS_CHECK_PERIOD_NS;
+
+    if(deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    while(true)
+    {
+      if(::sem_timedwait(sem, &deadline) == 0)
+      {
+        return true;
+      }
+
+      if(errno != EINTR)
+      {
+        return false;
+      }
+    }
+  }
+
+  void
+  ShardPool::work_(
+    Control* control,
+    unsigned long worker_i,
+    unsigned long workers_number,
+    Job* job)
+    throw()
+  {
+    while(true)
+    {
+      wait_(&control->start[worker_i]);
+
+      if(control->stop)
+      {
+        // skip parent state destruction
+        ::_exit(0);
+      }
+
+      job->process(worker_i, workers_number);
+
+      ::sem_post(&control->done);
+    }
+  }
+}
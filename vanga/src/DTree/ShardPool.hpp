@@ -0,0 +1,134 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SHARDPOOL_HPP_
+#define SHARDPOOL_HPP_
+
+#include <vector>
+#include <sys/types.h>
+#include <semaphore.h>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+
+namespace Vanga
+{
+  // SharedMemory: POSIX shared memory segment,
+  // mapping is inherited by forked processes
+  class SharedMemory: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+  public:
+    SharedMemory(unsigned long size);
+
+    void*
+    data() const;
+
+    unsigned long
+    size() const;
+
+  protected:
+    virtual ~SharedMemory() throw();
+
+  protected:
+    void* data_;
+    unsigned long size_;
+  };
+
+  typedef Gears::IntrusivePtr<SharedMemory> SharedMemory_var;
+
+  // ShardPool: worker processes forked from current process,
+  // run() wakes all workers, worker i call job->process(i, workers number)
+  // and run() returns when all workers finished.
+  // run() throws Exception if worker process died, after that pool
+  // is broken and following run() calls throw at once.
+  // job and data it use must be prepared before pool creation,
+  // job get input and return results over shared memory
+  class ShardPool: public Gears::AtomicRefCountable
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    class Job
+    {
+    public:
+      virtual void
+      process(unsigned long shard_i, unsigned long shards_number)
+        throw() = 0;
+
+      virtual
+      ~Job() throw()
+      {}
+    };
+
+  public:
+    ShardPool(unsigned long workers_number, Job* job);
+
+    unsigned long
+    workers_number() const;
+
+    void
+    run();
+
+  protected:
+    struct Control
+    {
+      volatile int stop;
+      sem_t done;
+      sem_t start[1];
+    };
+
+  protected:
+    virtual ~ShardPool() throw();
+
+    void
+    stop_() throw();
+
+    static void
+    wait_(sem_t* sem) throw();
+
+    // returns false if semaphore isn't posted during check period
+    static bool
+    timed_wait_(sem_t* sem) throw();
+
+    // throw Exception if some worker process exited
+    void
+    check_workers_();
+
+    static void
+    work_(Control* control, unsigned long worker_i,
+      unsigned long workers_number, Job* job)
+      throw();
+
+  protected:
+    SharedMemory_var control_memory_;
+    Control* control_;
+    std::vector<pid_t> workers_;
+    bool broken_;
+  };
+
+  typedef Gears::IntrusivePtr<ShardPool> ShardPool_var;
+}
+
+#endif /*SHARDPOOL_HPP_*/
@@ -0,0 +1,483 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <Gears/Basic/Errno.hpp>
+#include <Gears/Basic/OutputMemoryStream.hpp>
+
+#include "SocketWorkers.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    // time to wait connection before check of workers state
+    const int ACCEPT_CHECK_PERIOD = 100; // ms
+
+    // NOT_EXITED: status of worker that isn't waited yet
+    const int NOT_EXITED = -1;
+  }
+
+  void
+  SocketWorkers::run(
+    ResultArray& results,
+    unsigned long workers_number,
+    Job* job,
+    const char* host)
+  {
+    results.assign(workers_number, Result());
+
+    FdArray fds;
+    PidArray workers;
+    std::vector<int> statuses(workers_number, NOT_EXITED);
+
+    if(host)
+    {
+      start_tcp_workers_(fds, workers, statuses, workers_number, job, host);
+    }
+    else
+    {
+      start_pair_workers_(fds, workers, workers_number, job);
+    }
+
+    // read all results: message is size (uint64_t) and data
+    std::vector<std::string> bufs(workers_number);
+    std::vector<pollfd> poll_fds(workers_number);
+    unsigned long opened = 0;
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      // poll ignores negative fds (workers that failed before connection)
+      poll_fds[worker_i].fd = fds[worker_i];
+      poll_fds[worker_i].events = POLLIN;
+
+      if(fds[worker_i] >= 0)
+      {
+        ++opened;
+      }
+    }
+
+    while(opened > 0)
+    {
+      if(::poll(poll_fds.data(), poll_fds.size(), -1) < 0)
+      {
+        if(errno == EINTR)
+        {
+          continue;
+        }
+
+        // stop reading: results of not finished workers will be marked as failed
+        break;
+      }
+
+      for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+      {
+        pollfd& poll_fd = poll_fds[worker_i];
+
+        if(poll_fd.fd < 0 || poll_fd.revents == 0)
+        {
+          continue;
+        }
+
+        char buf[64 * 1024];
+        const ssize_t read_size = ::read(poll_fd.fd, buf, sizeof(buf));
+
+        if(read_size > 0)
+        {
+          bufs[worker_i].append(buf, read_size);
+        }
+        else if(read_size == 0 || errno != EINTR)
+        {
+          // eof or error
+          poll_fd.fd = -1;
+          --opened;
+        }
+      }
+    }
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      if(fds[worker_i] >= 0)
+      {
+        ::close(fds[worker_i]);
+      }
+
+      int& status = statuses[worker_i];
+
+      if(status == NOT_EXITED)
+      {
+        while(::waitpid(workers[worker_i], &status, 0) < 0 && errno == EINTR)
+        {}
+      }
+
+      const std::string& buf = bufs[worker_i];
+      uint64_t size;
+
+      if(WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        buf.size() >= sizeof(size))
+      {
+        ::memcpy(&size, buf.data(), sizeof(size));
+
+        if(buf.size() == sizeof(size) + size)
+        {
+          results[worker_i].done = true;
+          results[worker_i].data.assign(buf, sizeof(size), size);
+        }
+      }
+    }
+  }
+
+  void
+  SocketWorkers::start_pair_workers_(
+    FdArray& fds,
+    PidArray& workers,
+    unsigned long workers_number,
+    Job* job)
+  {
+    const pid_t parent_pid = ::getpid();
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      int sv[2];
+      pid_t pid = -1;
+      int error = 0;
+
+      if(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      {
+        error = errno;
+      }
+      else if((pid = ::fork()) < 0)
+      {
+        error = errno;
+        ::close(sv[0]);
+        ::close(sv[1]);
+      }
+
+      if(error)
+      {
+        kill_workers_(fds, workers);
+
+        Gears::throw_errno_value_exception<Exception>(
+          error, "SocketWorkers::run(): can't start worker");
+      }
+
+      if(pid == 0)
+      {
+        init_worker_(parent_pid);
+
+        ::close(sv[0]);
+
+        for(auto fd_it = fds.begin(); fd_it != fds.end(); ++fd_it)
+        {
+          ::close(*fd_it);
+        }
+
+        work_(sv[1], worker_i, workers_number, job);
+      }
+
+      ::close(sv[1]);
+      fds.push_back(sv[0]);
+      workers.push_back(pid);
+    }
+  }
+
+  void
+  SocketWorkers::start_tcp_workers_(
+    FdArray& fds,
+    PidArray& workers,
+    std::vector<int>& statuses,
+    unsigned long workers_number,
+    Job* job,
+    const char* host)
+  {
+    static const char* FUN = "SocketWorkers::run()";
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0; // any free port
+
+    if(::inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+    {
+      Gears::ErrorStream ostr;
+      ostr << FUN << ": invalid host '" << host << "'";
+      throw Exception(ostr.str());
+    }
+
+    const int listen_fd = ::socket(
+      AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(listen_fd < 0)
+    {
+      Gears::throw_errno_exception<Exception>(FUN, ": can't create socket");
+    }
+
+    socklen_t addr_len = sizeof(addr);
+
+    if(::bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      ::listen(listen_fd, workers_number) < 0 ||
+      ::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) < 0)
+    {
+      const int error = errno;
+      ::close(listen_fd);
+      Gears::throw_errno_value_exception<Exception>(
+        error, FUN, ": can't listen on '", host, "'");
+    }
+
+    const pid_t parent_pid = ::getpid();
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      const pid_t pid = ::fork();
+
+      if(pid < 0)
+      {
+        const int error = errno;
+        kill_workers_(FdArray(), workers);
+        ::close(listen_fd);
+
+        Gears::throw_errno_value_exception<Exception>(
+          error, FUN, ": can't start worker");
+      }
+
+      if(pid == 0)
+      {
+        init_worker_(parent_pid);
+
+        ::close(listen_fd);
+
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0)
+        {
+          ::_exit(1);
+        }
+
+        int res;
+        while((res = ::connect(
+          fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr))) < 0 &&
+          errno == EINTR)
+        {}
+
+        const uint64_t index = worker_i;
+        if(res < 0 || !write_(fd, &index, sizeof(index)))
+        {
+          ::_exit(1);
+        }
+
+        work_(fd, worker_i, workers_number, job);
+      }
+
+      workers.push_back(pid);
+    }
+
+    // accept connections until all workers connected or exited
+    fds.assign(workers_number, -1);
+
+    while(true)
+    {
+      pollfd poll_fd;
+      poll_fd.fd = listen_fd;
+      poll_fd.events = POLLIN;
+
+      if(::poll(&poll_fd, 1, ACCEPT_CHECK_PERIOD) < 0 && errno != EINTR)
+      {
+        // stop accepting: not connected workers will be marked as failed
+        break;
+      }
+
+      // wait workers before accept: connection of exited worker
+      // (if it was established) is in listen queue already
+      for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+      {
+        if(fds[worker_i] < 0 && statuses[worker_i] == NOT_EXITED &&
+          ::waitpid(workers[worker_i], &statuses[worker_i], WNOHANG) <= 0)
+        {
+          statuses[worker_i] = NOT_EXITED;
+        }
+      }
+
+      accept_workers_(listen_fd, fds);
+
+      bool wait_connection = false;
+
+      for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+      {
+        if(fds[worker_i] < 0 && statuses[worker_i] == NOT_EXITED)
+        {
+          wait_connection = true;
+        }
+      }
+
+      if(!wait_connection)
+      {
+        break;
+      }
+    }
+
+    ::close(listen_fd);
+  }
+
+  void
+  SocketWorkers::accept_workers_(int listen_fd, FdArray& fds) throw()
+  {
+    while(true)
+    {
+      const int fd = ::accept4(listen_fd, 0, 0, SOCK_CLOEXEC);
+
+      if(fd < 0)
+      {
+        if(errno == EINTR)
+        {
+          continue;
+        }
+
+        // EAGAIN: listen queue is empty
+        return;
+      }
+
+      // worker send its index just after connection
+      uint64_t index;
+
+      if(read_(fd, &index, sizeof(index)) &&
+        index < fds.size() &&
+        fds[index] < 0)
+      {
+        fds[index] = fd;
+      }
+      else
+      {
+        ::close(fd);
+      }
+    }
+  }
+
+  void
+  SocketWorkers::kill_workers_(const FdArray& fds, const PidArray& workers)
+    throw()
+  {
+    for(unsigned long started_i = 0; started_i < workers.size(); ++started_i)
+    {
+      ::kill(workers[started_i], SIGKILL);
+
+      if(started_i < fds.size())
+      {
+        ::close(fds[started_i]);
+      }
+
+      while(::waitpid(workers[started_i], 0, 0) < 0 && errno == EINTR)
+      {}
+    }
+  }
+
+  void
+  SocketWorkers::init_worker_(pid_t parent_pid) throw()
+  {
+    // worker shouldn't outlive coordinator
+    ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if(::getppid() != parent_pid)
+    {
+      ::_exit(1);
+    }
+  }
+
+  void
+  SocketWorkers::work_(
+    int fd,
+    unsigned long worker_i,
+    unsigned long workers_number,
+    Job* job)
+    throw()
+  {
+    std::string result;
+    job->process(worker_i, workers_number, result);
+
+    const uint64_t size = result.size();
+
+    const bool sent = write_(fd, &size, sizeof(size)) &&
+      write_(fd, result.data(), result.size());
+
+    // skip coordinator state destruction
+    ::_exit(sent ? 0 : 1);
+  }
+
+  bool
+  SocketWorkers::write_(int fd, const void* buf, unsigned long size) throw()
+  {
+    const char* ptr = static_cast<const char*>(buf);
+
+    while(size > 0)
+    {
+      const ssize_t written = ::write(fd, ptr, size);
+
+      if(written < 0)
+      {
+        if(errno == EINTR)
+        {
+          continue;
+        }
+
+        return false;
+      }
+
+      ptr += written;
+      size -= written;
+    }
+
+    return true;
+  }
+
+  bool
+  SocketWorkers::read_(int fd, void* buf, unsigned long size) throw()
+  {
+    char* ptr = static_cast<char*>(buf);
+
+    while(size > 0)
+    {
+      const ssize_t read_size = ::read(fd, ptr, size);
+
+      if(read_size <= 0)
+      {
+        if(read_size < 0 && errno == EINTR)
+        {
+          continue;
+        }
+
+        return false;
+      }
+
+      ptr += read_size;
+      size -= read_size;
+    }
+
+    return true;
+  }
+}
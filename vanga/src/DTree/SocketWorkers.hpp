@@ -0,0 +1,124 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SOCKETWORKERS_HPP_
+#define SOCKETWORKERS_HPP_
+
+#include <string>
+#include <vector>
+
+#include <Gears/Basic/Exception.hpp>
+
+namespace Vanga
+{
+  // SocketWorkers: run job in processes forked from current process,
+  // worker i call job->process(i, workers number, result) and
+  // send result to coordinator (current process) over unix socket
+  // or, if host defined, over tcp connection to coordinator
+  // listening on host (ipv4 address, for example 127.0.0.1).
+  // workers see coordinator state at run() call (copy on write),
+  // job should use only current thread (other threads aren't forked)
+  class SocketWorkers
+  {
+  public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    class Job
+    {
+    public:
+      virtual void
+      process(
+        unsigned long worker_i,
+        unsigned long workers_number,
+        std::string& result)
+        throw() = 0;
+
+      virtual
+      ~Job() throw()
+      {}
+    };
+
+    // Result: done is false if worker failed before result sending
+    struct Result
+    {
+      Result()
+        : done(false)
+      {}
+
+      bool done;
+      std::string data;
+    };
+
+    typedef std::vector<Result> ResultArray;
+
+  public:
+    static void
+    run(
+      ResultArray& results,
+      unsigned long workers_number,
+      Job* job,
+      const char* host = 0);
+
+  protected:
+    typedef std::vector<int> FdArray;
+    typedef std::vector<pid_t> PidArray;
+
+    // start_pair_workers_: workers connected with socketpair
+    static void
+    start_pair_workers_(
+      FdArray& fds,
+      PidArray& workers,
+      unsigned long workers_number,
+      Job* job);
+
+    // start_tcp_workers_: workers connect to listen socket on host
+    // and send its index, fds[i] is -1 if worker i exited before connection
+    static void
+    start_tcp_workers_(
+      FdArray& fds,
+      PidArray& workers,
+      std::vector<int>& statuses,
+      unsigned long workers_number,
+      Job* job,
+      const char* host);
+
+    static void
+    accept_workers_(int listen_fd, FdArray& fds) throw();
+
+    static void
+    kill_workers_(const FdArray& fds, const PidArray& workers) throw();
+
+    static void
+    init_worker_(pid_t parent_pid) throw();
+
+    static void
+    work_(int fd, unsigned long worker_i, unsigned long workers_number, Job* job)
+      throw();
+
+    static bool
+    write_(int fd, const void* buf, unsigned long size) throw();
+
+    static bool
+    read_(int fd, void* buf, unsigned long size) throw();
+  };
+}
+
+#endif /*SOCKETWORKERS_HPP_*/
@@ -0,0 +1,242 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+
+#include "SparseDTree.hpp"
+
+namespace Vanga
+{
+  const uint32_t SparseDTree::NO_BRANCH;
+  const unsigned long SparseDTree::TouchedBuffer::LOCAL_SIZE;
+
+  SparseDTree::SparseDTree(const DTree* tree)
+    : CompiledDTree(tree)
+  {
+    // children placed after parent: fill all-absent values from the end,
+    // summation order is the same as in fpredict for row without features
+    absent_values_.resize(nodes_.size());
+    absent_no_values_.resize(branches_.size());
+
+    for(unsigned long node_i = nodes_.size(); node_i > 0; --node_i)
+    {
+      const Node& node = nodes_[node_i - 1];
+      double value = node.delta_prob;
+
+      for(uint32_t branch_i = node.branches_begin;
+        branch_i < node.branches_end; ++branch_i)
+      {
+        const Branch& branch = branches_[branch_i];
+        absent_no_values_[branch_i] = branch.no_node != NO_NODE ?
+          absent_values_[branch.no_node] : branch.no_value;
+        value += absent_no_values_[branch_i];
+      }
+
+      absent_values_[node_i - 1] = value;
+    }
+
+    parent_branches_.resize(branches_.size(), NO_BRANCH);
+
+    for(uint32_t branch_i = 0; branch_i < branches_.size(); ++branch_i)
+    {
+      const Branch& branch = branches_[branch_i];
+      const uint32_t child_nodes[] = { branch.yes_node, branch.no_node };
+
+      for(unsigned long child_i = 0; child_i < 2; ++child_i)
+      {
+        if(child_nodes[child_i] != NO_NODE)
+        {
+          const Node& child = nodes_[child_nodes[child_i]];
+
+          for(uint32_t child_branch_i = child.branches_begin;
+            child_branch_i < child.branches_end; ++child_branch_i)
+          {
+            parent_branches_[child_branch_i] = branch_i;
+          }
+        }
+      }
+    }
+
+    // reverse index by counting sort
+    feature_branch_offsets_.resize(features_.size() + 1, 0);
+
+    for(auto branch_it = branches_.begin(); branch_it != branches_.end(); ++branch_it)
+    {
+      ++feature_branch_offsets_[branch_it->feature_column + 1];
+    }
+
+    for(unsigned long feature_i = 0; feature_i < features_.size(); ++feature_i)
+    {
+      feature_branch_offsets_[feature_i + 1] += feature_branch_offsets_[feature_i];
+    }
+
+    std::vector<uint32_t> feature_ends(
+      feature_branch_offsets_.begin(), feature_branch_offsets_.end() - 1);
+    feature_branches_.resize(branches_.size());
+
+    for(uint32_t branch_i = 0; branch_i < branches_.size(); ++branch_i)
+    {
+      feature_branches_[feature_ends[branches_[branch_i].feature_column]++] = branch_i;
+    }
+  }
+
+  double
+  SparseDTree::absent_value() const throw()
+  {
+    return absent_values_[0];
+  }
+
+  double
+  SparseDTree::fpredict(const FeatureArray& features) const throw()
+  {
+    TouchedBuffer touched;
+
+    // search features of smaller set in other set
+    if(features_.size() < features.size())
+    {
+      for(unsigned long feature_i = 0; feature_i < features_.size(); ++feature_i)
+      {
+        if(features.get(features_[feature_i]).first)
+        {
+          touch_feature_(touched, feature_i);
+        }
+      }
+    }
+    else
+    {
+      for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+      {
+        auto index_it = std::lower_bound(
+          features_.begin(), features_.end(), feature_it->first);
+
+        if(index_it != features_.end() && *index_it == feature_it->first)
+        {
+          touch_feature_(touched, index_it - features_.begin());
+        }
+      }
+    }
+
+    if(touched.begin() == touched.end())
+    {
+      return absent_values_[0];
+    }
+
+    std::sort(touched.begin(), touched.end());
+
+    return eval_node_(
+      0,
+      features,
+      touched.begin(),
+      std::unique(touched.begin(), touched.end()));
+  }
+
+  void
+  SparseDTree::touch_feature_(
+    TouchedBuffer& touched,
+    unsigned long feature_i)
+    const
+  {
+    for(uint32_t i = feature_branch_offsets_[feature_i];
+      i < feature_branch_offsets_[feature_i + 1]; ++i)
+    {
+      for(uint32_t branch_i = feature_branches_[i]; branch_i != NO_BRANCH;
+        branch_i = parent_branches_[branch_i])
+      {
+        touched.push_back(branch_i);
+      }
+    }
+  }
+
+  double
+  SparseDTree::eval_node_(
+    uint32_t node_i,
+    const FeatureArray& features,
+    const uint32_t* touched_begin,
+    const uint32_t* touched_end)
+    const throw()
+  {
+    // untouched branches select no subtree with all-absent value
+    const Node& node = nodes_[node_i];
+    double res = absent_values_[node_i];
+
+    for(const uint32_t* touched_it = std::lower_bound(
+          touched_begin, touched_end, node.branches_begin);
+        touched_it != touched_end && *touched_it < node.branches_end;
+        ++touched_it)
+    {
+      const Branch& branch = branches_[*touched_it];
+      const std::pair<bool, uint32_t> feature = features.get(branch.feature_id);
+      double value;
+
+      if(feature.first &&
+        (!branch.numeric || numeric_feature_float(feature.second) >= branch.threshold))
+      {
+        value = branch.yes_node != NO_NODE ?
+          eval_node_(branch.yes_node, features, touched_it + 1, touched_end) :
+          branch.yes_value;
+      }
+      else
+      {
+        value = branch.no_node != NO_NODE ?
+          eval_node_(branch.no_node, features, touched_it + 1, touched_end) :
+          branch.no_value;
+      }
+
+      res += value - absent_no_values_[*touched_it];
+    }
+
+    return res;
+  }
+
+  // SparseDTree::TouchedBuffer
+  SparseDTree::TouchedBuffer::TouchedBuffer() throw()
+    : begin_(local_),
+      size_(0),
+      capacity_(LOCAL_SIZE)
+  {}
+
+  void
+  SparseDTree::TouchedBuffer::push_back(uint32_t branch_i)
+  {
+    if(size_ == capacity_)
+    {
+      std::vector<uint32_t> new_heap(capacity_ * 2);
+      std::copy(begin_, begin_ + size_, new_heap.begin());
+      heap_.swap(new_heap);
+      begin_ = heap_.data();
+      capacity_ = heap_.size();
+    }
+
+    begin_[size_++] = branch_i;
+  }
+
+  uint32_t*
+  SparseDTree::TouchedBuffer::begin() throw()
+  {
+    return begin_;
+  }
+
+  uint32_t*
+  SparseDTree::TouchedBuffer::end() throw()
+  {
+    return begin_ + size_;
+  }
+}
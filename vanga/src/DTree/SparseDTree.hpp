@@ -0,0 +1,114 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPARSEDTREE_HPP_
+#define SPARSEDTREE_HPP_
+
+#include <vector>
+#include <cstdint>
+
+#include <Gears/Basic/IntrusivePtr.hpp>
+
+#include "CompiledDTree.hpp"
+
+namespace Vanga
+{
+  // SparseDTree: CompiledDTree with prediction that visits only branches
+  // touched by present features (absent feature always selects no subtree).
+  // all-absent value of each node precomputed, row value is
+  // all-absent value plus corrections of touched branches:
+  // branches of present features (found by reverse index) and their ancestors.
+  // prediction cost depends on row features count, not model size,
+  // result equal to DTree::fpredict up to floating point rounding
+  class SparseDTree: public CompiledDTree
+  {
+  public:
+    static const uint32_t NO_BRANCH = 0xFFFFFFFF;
+
+  public:
+    SparseDTree(const DTree* tree);
+
+    // value of row without features
+    double
+    absent_value() const throw();
+
+    // sparse evaluation, hides CompiledDTree::fpredict
+    double
+    fpredict(const FeatureArray& features) const throw();
+
+  protected:
+    // TouchedBuffer: touched branches, kept on stack up to LOCAL_SIZE
+    class TouchedBuffer
+    {
+    public:
+      TouchedBuffer() throw();
+
+      void
+      push_back(uint32_t branch_i);
+
+      uint32_t*
+      begin() throw();
+
+      uint32_t*
+      end() throw();
+
+    protected:
+      static const unsigned long LOCAL_SIZE = 256;
+
+    protected:
+      uint32_t local_[LOCAL_SIZE];
+      std::vector<uint32_t> heap_;
+      uint32_t* begin_;
+      unsigned long size_;
+      unsigned long capacity_;
+    };
+
+  protected:
+    virtual ~SparseDTree() throw() {}
+
+    // add branches of features_[feature_i] and their ancestors
+    void
+    touch_feature_(TouchedBuffer& touched, unsigned long feature_i) const;
+
+    // touched_begin, touched_end: sorted unique touched branches
+    double
+    eval_node_(
+      uint32_t node_i,
+      const FeatureArray& features,
+      const uint32_t* touched_begin,
+      const uint32_t* touched_end)
+      const throw();
+
+  protected:
+    std::vector<double> absent_values_; // by node
+    std::vector<double> absent_no_values_; // by branch: all-absent value of no subtree
+    std::vector<uint32_t> parent_branches_; // by branch: NO_BRANCH for root branches
+
+    // reverse index: branches of features_[i] are
+    // feature_branches_[feature_branch_offsets_[i], feature_branch_offsets_[i + 1])
+    std::vector<uint32_t> feature_branch_offsets_;
+    std::vector<uint32_t> feature_branches_;
+  };
+
+  typedef Gears::IntrusivePtr<SparseDTree> SparseDTree_var;
+}
+
+#endif /*SPARSEDTREE_HPP_*/
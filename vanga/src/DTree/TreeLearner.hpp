@@ -37,6 +37,8 @@
 #include "SVM.hpp"
 #include "DTree.hpp"
 #include "Gain.hpp"
+#include "MappedFile.hpp"
+#include "ShardPool.hpp"
 
 namespace Vanga
 {
@@ -116,6 +118,8 @@ namespace Vanga
   class TreeLearner
   {
   public:
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
     typedef SVM<LabelType> SVMT;
     typedef LabelType LabelT;
     //typedef GainType GainT;
@@ -132,6 +136,41 @@ namespace Vanga
 
     typedef std::unordered_map<unsigned long, SVM_var> FeatureRowsMap;
 
+    typedef std::vector<uint32_t> RowIndexArray;
+
+    typedef ConstArrayRef<uint32_t> RowIndexRef;
+
+    typedef std::unordered_map<unsigned long, RowIndexRef> FeatureRowIndexMap;
+
+    typedef std::vector<std::pair<LabelType, unsigned long> > LabelCountArray;
+
+    // BagView: multiplicity of every row (by position in context svm) in bag
+    typedef std::vector<uint8_t> BagView;
+    typedef std::vector<BagView> BagViewArray;
+
+    // FeatureScreening
+    //   two stage feature selection: features that divide node rows scored
+    //   by newton gain on stratified sample of node rows (top = 0 - disabled,
+    //   rows = 0 - all node rows), only top features evaluated exactly;
+    //   validate mode also evaluates all features exactly and counts
+    //   node checks where exact best feature wasn't screened (misses)
+    struct FeatureScreening
+    {
+      FeatureScreening()
+        : top(0),
+          rows(0),
+          validate(false),
+          checks(0),
+          misses(0)
+      {}
+
+      unsigned long top;
+      unsigned long rows;
+      bool validate;
+      unsigned long checks;
+      unsigned long misses;
+    };
+
     class LearnTreeHolder;
     typedef Gears::IntrusivePtr<LearnTreeHolder> LearnTreeHolder_var;
 
@@ -148,12 +187,109 @@ namespace Vanga
 
     typedef std::multiset<GainTreeNodeDescrKey> GainToTreeNodeDescrMap;
 
+    typedef std::vector<uint64_t> CellCountArray;
+
+    // FeatureBundle
+    //   features with rarely intersecting rows, scanned together:
+    //   rows contains (row, feature index) pairs sorted by row,
+    //   numeric bundle contains threshold features of one numeric feature:
+    //   feature index k is threshold feature of bin k, row feature is
+    //   row bin and row is yes for all thresholds up to its bin
+    struct FeatureBundle
+    {
+      FeatureBundle()
+        : numeric(false)
+      {}
+
+      FeatureIdArray features;
+      RowIndexRef rows;
+      RowIndexRef row_features;
+      bool numeric;
+    };
+
+    typedef std::vector<FeatureBundle> FeatureBundleArray;
+
+    // feature indexes selected in every bundle
+    typedef std::vector<RowIndexArray> BundleFeaturesArray;
+
+    // ((feature index in bundle << 32) | cell, count of node rows)
+    typedef std::vector<std::pair<uint64_t, unsigned long> > YesCountArray;
+
+    // NumericFeature
+    //   numeric feature binned into quantile bins:
+    //   bin k contains values in [thresholds[k], thresholds[k + 1]),
+    //   threshold feature of bin k (value >= thresholds[k]) has
+    //   id (k << 32) | feature id, threshold feature of bin 0 is
+    //   feature itself (all rows with feature)
+    struct NumericFeature
+    {
+      unsigned long bundle_i;
+      std::vector<float> thresholds;
+    };
+
+    typedef std::unordered_map<unsigned long, NumericFeature> NumericFeatureMap;
+
+    // FeatureRows
+    //   rows of feature: rows with bin >= min_bin
+    //   (all rows if bins undefined)
+    struct FeatureRows
+    {
+      RowIndexRef rows;
+      const uint32_t* bins;
+      uint32_t min_bin;
+
+      bool
+      yes(const uint32_t* row_it) const
+      {
+        return !bins || bins[row_it - rows.begin()] >= min_bin;
+      }
+    };
+
+    class ShardCounter;
+    typedef Gears::IntrusivePtr<ShardCounter> ShardCounter_var;
+
+    // RowHolder
+    //   rows shared by all bags, indexed in grouped_rows order:
+    //   rows of group i have indexes [group_ends[i - 1], group_ends[i]),
+    //   feature rows and bundle arrays point into row_index_data or
+    //   into row_index_file if it spilled to work dir,
+    //   bundles [bundle_block_ends[i - 1], bundle_block_ends[i])
+    //   are checked together and placed sequentially,
+    //   shard_counter defined if yes counts evaluated by worker processes,
+    //   feature_processes > 1 if bundles checked by feature worker processes,
+    //   feature workers connect to coordinator on feature_host if it defined
+    struct RowHolder: public Gears::AtomicRefCountable
+    {
+      RowHolder()
+        : feature_processes(0)
+      {}
+
+      FeatureIdArray features;
+      FeatureRowIndexMap feature_rows;
+      FeatureBundleArray feature_bundles;
+      NumericFeatureMap numeric_features;
+      std::vector<unsigned long> bundle_block_ends;
+      RowIndexArray row_index_data;
+      MappedFile_var row_index_file;
+      ShardCounter_var shard_counter;
+      unsigned long feature_processes;
+      std::string feature_host;
+      std::vector<const Row*> rows;
+      std::vector<LabelType> labels;
+      RowIndexArray group_ends;
+      SVM_var svm;
+
+    protected:
+      virtual ~RowHolder() throw() {}
+    };
+
+    typedef Gears::IntrusivePtr<RowHolder> RowHolder_var;
+
     // BagHolder
     struct BagHolder: public Gears::AtomicRefCountable
     {
-      FeatureIdArray features;
-      FeatureRowsMap feature_rows;
-      SVM_var bag;
+      RowHolder_var row_holder;
+      BagView row_counts;
 
     protected:
       virtual ~BagHolder() throw() {}
@@ -162,19 +298,211 @@ namespace Vanga
     typedef Gears::IntrusivePtr<BagHolder> BagHolder_var;
     typedef std::vector<BagHolder_var> BagHolderArray;
 
+    // RowPermutation
+    //   row indexes of nodes produced by one split,
+    //   every node owns sorted contiguous range of it
+    struct RowPermutation: public Gears::AtomicRefCountable
+    {
+      RowIndexArray rows;
+
+    protected:
+      virtual ~RowPermutation() throw() {}
+    };
+
+    typedef Gears::IntrusivePtr<RowPermutation> RowPermutation_var;
+
     // BagPart
     struct BagPart: public Gears::AtomicRefCountable
     {
+      BagPart()
+        : begin(0),
+          end(0)
+      {}
+
+      const uint32_t*
+      rows_begin() const
+      {
+        return permutation->rows.data() + begin;
+      }
+
+      const uint32_t*
+      rows_end() const
+      {
+        return permutation->rows.data() + end;
+      }
+
+      unsigned long
+      size() const
+      {
+        return end - begin;
+      }
+
       BagHolder_var bag_holder;
-      SVM_var svm;
+      RowPermutation_var permutation;
+      unsigned long begin;
+      unsigned long end;
 
     protected:
       virtual ~BagPart() throw() {}
     };
 
     typedef Gears::IntrusivePtr<BagPart> BagPart_var;
+    typedef Gears::IntrusivePtr<const BagPart> ConstBagPart_var;
     typedef std::vector<BagPart_var> BagPartArray;
 
+    // GroupMaskCount
+    //   rows of one label group with equal mask of features
+    struct GroupMaskCount
+    {
+      GroupMaskCount(
+        unsigned long group_val,
+        uint64_t mask_val,
+        unsigned long count_val)
+        : group(group_val),
+          mask(mask_val),
+          count(count_val)
+      {}
+
+      unsigned long group;
+      uint64_t mask;
+      unsigned long count;
+    };
+
+    typedef std::vector<GroupMaskCount> GroupMaskCountArray;
+
+    // NodeStat
+    //   candidate independent statistics of bag part:
+    //   cells group node rows by label group and mask of
+    //   current tree branch features (features sorted),
+    //   row_cells contains cell index for each node row position
+    struct NodeStat: public Gears::AtomicRefCountable
+    {
+      FeatureIdArray features;
+      GroupMaskCountArray cells;
+      RowIndexArray row_cells;
+      double metric;
+
+    protected:
+      virtual ~NodeStat() throw() {}
+    };
+
+    typedef Gears::IntrusivePtr<NodeStat> NodeStat_var;
+    typedef std::vector<NodeStat_var> NodeStatArray;
+
+    // FeatureGain
+    // FeatureGain: gain of feature evaluated with base bag tree
+    struct FeatureGain
+    {
+      unsigned long feature_id;
+      double gain;
+      LearnTreeHolder_var tree;
+      unsigned long base_bag_i;
+    };
+
+    typedef std::vector<FeatureGain> FeatureGainArray;
+
+    // ShardCounter
+    //   yes counts of all bundles for node rows of bundle base bags evaluated
+    //   by worker processes: worker i scans rows of shard i
+    //   (rows [i * rows number / workers, (i + 1) * rows number / workers)),
+    //   base bag of bundle is selected as in local check (first
+    //   ThreadRand::rand(bags number) under Guard(rand seed, bundle index)),
+    //   node rows of base bags passed to workers and results returned
+    //   over shared memory, row holder index is shared with workers by fork.
+    //   If worker process died count fails and following counts
+    //   aren't tried: bundles are counted by trainer process
+    class ShardCounter:
+      public ShardPool::Job,
+      public Gears::AtomicRefCountable
+    {
+    public:
+      ShardCounter(
+        const RowHolder& row_holder,
+        unsigned long processes,
+        unsigned long bags_number);
+
+      // returns false if counts can't be evaluated by workers
+      bool
+      count(
+        const BagPartArray& bags,
+        const NodeStatArray& node_stats,
+        uint64_t rand_seed)
+        throw();
+
+      // base bag of bundle in last count
+      unsigned long
+      bundle_bag_i(unsigned long bundle_i) const;
+
+      void
+      get_yes_counts(
+        YesCountArray& yes_counts,
+        unsigned long bundle_i)
+        const throw();
+
+      virtual void
+      process(unsigned long shard_i, unsigned long shards_number)
+        throw();
+
+    protected:
+      virtual ~ShardCounter() throw();
+
+      unsigned long
+      shard_row_begin_(unsigned long shard_i) const;
+
+    protected:
+      const RowHolder& row_holder_;
+      const unsigned long shards_number_;
+      const unsigned long bags_number_;
+      SharedMemory_var memory_;
+      // filled by count(): base bags of bundles and
+      // node rows, their cells and counts of base bags
+      uint32_t* bundle_bags_;
+      unsigned long* node_rows_numbers_;
+      std::vector<uint32_t*> node_rows_;
+      std::vector<uint32_t*> node_row_cells_;
+      std::vector<uint8_t*> node_row_counts_;
+      // shard results: yes counts of bundle i placed in
+      // [bundle_offsets[i], bundle_offsets[i + 1])
+      std::vector<unsigned long*> shard_bundle_offsets_;
+      std::vector<std::pair<uint64_t, unsigned long>*> shard_yes_counts_;
+      bool failed_;
+      ShardPool_var pool_;
+    };
+
+    // ContextParams
+    //   work_dir: if defined feature row indexes spilled to file in it,
+    //   memory_limit: bytes of row indexes resident at once (0 - unlimited),
+    //   processes: number of worker processes that count split statistics
+    //     on row shards (0 - count in trainer process),
+    //   feature_processes: number of worker processes forked for each node
+    //     that check feature slices (0 - check in trainer process),
+    //   feature_host: feature workers send results over tcp connection
+    //     to coordinator listening on this address (empty - unix sockets),
+    //   numeric_features: features with numeric values (loaded with
+    //     numeric features set) split by thresholds of numeric_bins
+    //     quantile bins,
+    //   bundle_features: bundle rarely co-occurring features
+    //     (false - own bundle for every feature)
+    struct ContextParams
+    {
+      ContextParams()
+        : memory_limit(0),
+          processes(0),
+          feature_processes(0),
+          numeric_bins(255),
+          bundle_features(true)
+      {}
+
+      std::string work_dir;
+      unsigned long memory_limit;
+      unsigned long processes;
+      unsigned long feature_processes;
+      std::string feature_host;
+      NumericFeatureSet numeric_features;
+      unsigned long numeric_bins;
+      bool bundle_features;
+    };
+
     // LearnContext
     class LearnContext: public Gears::AtomicRefCountable
     {
@@ -195,7 +523,13 @@ namespace Vanga
         double alpha = 1.0,
         FeatureSelectionStrategy feature_selection_strategy = FSS_BEST,
         bool allow_negative_gain = false,
-        unsigned long gain_check_bags = 0);
+        unsigned long gain_check_bags = 0,
+        FeatureScreening* screening = 0);
+
+      // learn_tree: tree nodes,
+      // learn_tree_bag_parts: node bag parts and their row permutations
+      void
+      memory_usage(MemoryUsage& usage) const throw();
 
     protected:
       struct TreeReplace
@@ -250,7 +584,8 @@ namespace Vanga
         double alpha_coef,
         FeatureSelectionStrategy feature_selection_strategy,
         bool allow_negative_gain,
-        unsigned long gain_check_bags);
+        unsigned long gain_check_bags,
+        FeatureScreening* screening);
 
       DTree_var
       fill_dtree_(LearnTreeHolder* learn_tree_holder);
@@ -289,6 +624,10 @@ namespace Vanga
         const DTree* base_tree,
         Gears::TaskRunner* task_runner = 0);
 
+      // row holder parts, bags svm groups and bags
+      void
+      memory_usage(MemoryUsage& usage) const throw();
+
     protected:
       Context(const BagPartArray& bag_parts);
 
@@ -302,7 +641,22 @@ namespace Vanga
 
   public:
     static Context_var
-    create_context(const SVMArray& svm_array);
+    create_context(
+      SVM<LabelType>* svm,
+      const BagViewArray& bags,
+      const ContextParams& params = ContextParams());
+
+    static void
+    fill_portion_bags(
+      BagViewArray& bags,
+      unsigned long rows_number,
+      unsigned long portions_num);
+
+    static void
+    fill_part_bag(
+      BagView& bag,
+      unsigned long rows_number,
+      unsigned long part_size);
 
     static double
     eval_gain(
@@ -331,11 +685,10 @@ namespace Vanga
 
     static void
     div_rows_(
-      SVM_var& yes_svm,
-      SVM_var& no_svm,
+      BagPart_var& yes_bag_part,
+      BagPart_var& no_bag_part,
       unsigned long feature_id,
-      const SVM<LabelType>* svm,
-      const FeatureRowsMap& feature_rows);
+      const BagPart& bag_part);
 
     static void
     fill_feature_rows(
@@ -344,6 +697,25 @@ namespace Vanga
       const SVM<LabelType>& svm)
       throw();
 
+    template<typename GainType>
+    static void
+    check_bundle_(
+      FeatureGainArray& res_gains,
+      PredCollector& pred_collector,
+      GainType& gain_calc,
+      double top_pred,
+      const FeatureBundle& bundle,
+      unsigned long bundle_i,
+      const RowIndexArray* bundle_features,
+      const BagPartArray& bags,
+      const NodeStatArray& node_stats,
+      const ShardCounter* shard_counter,
+      unsigned long gain_check_bags,
+      LearnTreeHolder* cur_tree,
+      unsigned long check_depth,
+      double alpha_coef)
+      throw();
+
     template<typename GainType>
     static void
     check_feature_(
@@ -356,6 +728,9 @@ namespace Vanga
       //const FeatureRowsMap& feature_rows,
       //const SVM<LabelType>* feature_svm,
       const BagPartArray& bags,
+      const NodeStatArray& node_stats,
+      unsigned long base_bag_i,
+      const CellCountArray& yes_counts,
       unsigned long gain_check_bags,
       LearnTreeHolder* cur_tree,
       //const SVM<LabelType>* node_svm,
@@ -364,6 +739,134 @@ namespace Vanga
       throw();
 
   protected:
+    typedef std::set<const RowPermutation*> RowPermutationSet;
+
+    static void
+    row_holder_memory_usage_(
+      MemoryUsage& usage,
+      const RowHolder& row_holder)
+      throw();
+
+    // permutations: already counted permutations
+    static void
+    bag_parts_memory_usage_(
+      MemoryUsage& usage,
+      RowPermutationSet& permutations,
+      const char* part,
+      const BagPartArray& bag_parts)
+      throw();
+
+    static void
+    learn_tree_memory_usage_(
+      MemoryUsage& usage,
+      RowPermutationSet& permutations,
+      const LearnTreeHolder* tree)
+      throw();
+
+    // convert learn tree branch feature to DTree branch
+    // (numeric threshold feature to numeric branch) and back
+    static void
+    fill_dtree_branch_(
+      DTree::Branch& branch,
+      const RowHolder& row_holder,
+      unsigned long feature_id)
+      throw();
+
+    static unsigned long
+    learn_feature_id_(
+      const RowHolder& row_holder,
+      const DTree::Branch& branch)
+      throw();
+
+    static void
+    fill_row_holder_(
+      RowHolder& row_holder,
+      SVM<LabelType>* svm,
+      const ContextParams& params)
+      throw();
+
+    static void
+    fill_feature_bundles_(
+      RowHolder& row_holder,
+      const ContextParams& params)
+      throw();
+
+    static void
+    fill_numeric_bundle_(
+      FeatureBundle& bundle,
+      NumericFeature& numeric_feature,
+      uint32_t* bundle_data,
+      const RowHolder& row_holder,
+      unsigned long feature_id,
+      unsigned long bins)
+      throw();
+
+    static bool
+    find_feature_rows_(
+      FeatureRows& feature_rows,
+      const RowHolder& row_holder,
+      unsigned long feature_id)
+      throw();
+
+    static void
+    fill_bundle_blocks_(
+      RowHolder& row_holder,
+      unsigned long memory_limit)
+      throw();
+
+    static void
+    spill_row_holder_(
+      RowHolder& row_holder,
+      const std::string& work_dir);
+
+    static void
+    fill_bundle_yes_counts_(
+      YesCountArray& yes_counts,
+      const FeatureBundle& bundle,
+      const BagPart& bag_part,
+      const NodeStat& node_stat)
+      throw();
+
+    template<typename RowCountsType>
+    static void
+    fill_yes_counts_(
+      YesCountArray& yes_counts,
+      const FeatureBundle& bundle,
+      const uint32_t* rows_begin,
+      const uint32_t* rows_end,
+      const uint32_t* row_cells,
+      const RowCountsType& row_counts)
+      throw();
+
+    static const uint32_t*
+    group_end_(
+      unsigned long& group_i,
+      const RowHolder& row_holder,
+      const uint32_t* row_it,
+      const uint32_t* row_end_it)
+      throw();
+
+    static unsigned long
+    rows_count_(
+      const BagHolder& bag_holder,
+      const uint32_t* row_it,
+      const uint32_t* row_end_it)
+      throw();
+
+    static void
+    node_labels_(
+      LabelCountArray& labels,
+      const BagPart& bag_part)
+      throw();
+
+    template<typename LabelAdapterType>
+    static void
+    node_labels_(
+      LabelCountArray& labels,
+      const BagPart& bag_part,
+      const LabelAdapterType& label_adapter)
+      throw();
+
     // ProcessorType
     //   ContextType
     //   ResultType
@@ -385,7 +888,8 @@ namespace Vanga
       unsigned long max_depth,
       unsigned long check_depth,
       double alpha_coef,
-      bool allow_negative_gain)
+      bool allow_negative_gain,
+      FeatureScreening* screening)
       throw();
 
     template<typename GainType>
@@ -409,7 +913,32 @@ namespace Vanga
       unsigned long check_depth,
       bool top_eval,
       double alpha_coef,
-      bool allow_negative_gain)
+      bool allow_negative_gain,
+      FeatureScreening* screening)
+      throw();
+
+    template<typename GainType>
+    static void
+    screen_features_(
+      BundleFeaturesArray& bundle_features,
+      const FeatureScreening& screening,
+      const BagPart& bag_part)
+      throw();
+
+    static void
+    fill_sample_part_(
+      BagPart_var& sample_part,
+      const BagPart& bag_part,
+      unsigned long rows)
+      throw();
+
+    template<typename GainType>
+    static void
+    fill_node_stat_(
+      NodeStat& node_stat,
+      GainType& gain_calc,
+      const LearnTreeHolder* cur_tree,
+      const BagPart& bag_part)
       throw();
 
     template<typename GainType>
@@ -421,9 +950,9 @@ namespace Vanga
       double add_delta,
       const LearnTreeHolder* cur_tree,
       unsigned long add_feature_id,
-      //const OrderedFeatureArray& features,
-      const FeatureRowsMap& feature_rows,
-      const SVM<LabelType>* node_svm)
+      const BagPart& bag_part,
+      const NodeStat& node_stat,
+      const CellCountArray& yes_counts)
       throw();
 
     template<typename GainType>
@@ -446,6 +975,9 @@ namespace Vanga
       double add_delta,
       unsigned long feature_id,
       const BagPartArray& bags,
+      const NodeStatArray& node_stats,
+      unsigned long base_bag_i,
+      const CellCountArray& yes_counts,
       LearnTreeHolder* cur_tree,
       unsigned long gain_check_bags)
       throw();
@@ -457,35 +989,40 @@ namespace Vanga
       PredCollector& pred_collector,
       GainType& gain_calc,
       double top_pred,
-      const SVM<LabelType>* node_svm,
+      const LabelCountArray& node_labels,
       const LabelType& add_label,
       bool eval_delta)
       throw();
 
+    // eval_feature_gain_by_delta_: gain of new_tree on bag_part rows,
+    // if double_preds is true, row preds aren't rounded to PredValue
     template<typename GainType>
     static double
     eval_feature_gain_by_delta_(
       GainType& gain_calc,
       double add_delta,
       LearnTreeHolder* new_tree,
-      SVM<LabelType>* node_svm,
-      const FeatureRowsMap& feature_rows)
+      const BagPart& bag_part,
+      bool double_preds = false)
       throw();
 
-    static void
-    div_by_tree_(
-      std::vector<std::pair<SVM_var, double> >& svms,
+    // verify_gain_: gain of tree checked with base bag base_bag_i
+    // evaluated with double preds on the bags used for check
+    // (all bags except base bag or base bag if it is single)
+    template<typename GainType>
+    static double
+    verify_gain_(
+      double add_delta,
       LearnTreeHolder* tree,
-      const FeatureRowsMap& feature_rows)
+      const BagPartArray& bags,
+      unsigned long base_bag_i)
       throw();
 
     static void
-    div_group_(
-      typename SVM<LabelType>::PredictGroup_var& yes_group,
-      typename SVM<LabelType>::PredictGroup_var& no_group,
-      unsigned long feature_id,
-      const PredictGroup<LabelType>* div_group,
-      const FeatureRowsMap& feature_rows);
+    div_by_tree_(
+      std::vector<std::pair<ConstBagPart_var, double> >& bag_parts,
+      LearnTreeHolder* tree)
+      throw();
   };
 }
 
@@ -18,8 +18,17 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <limits>
+#include <fstream>
+#include <sstream>
 #include <unordered_map>
+#include <string.h>
+#include <unistd.h>
+
 #include "PredBuffer.hpp"
+#include "Profiler.hpp"
+#include "Rand.hpp"
+#include "SocketWorkers.hpp"
 #include "Utils.hpp"
 
 namespace Vanga
@@ -41,7 +50,49 @@ namespace Vanga
     const bool GAIN_TRACE = false;
     const bool SELF_CHECK_ = false;
 
+    // feature rows are searched in node rows instead of merge
+    // if node is SPARSE_SEARCH_FACTOR times larger
+    const unsigned long SPARSE_SEARCH_FACTOR = 16;
+
+    // feature bundling: feature can share bundle if it intersects with
+    // bundle rows on less then BUNDLE_CONFLICT_SHARE of own rows,
+    // only last BUNDLE_SEARCH_LIMIT bundles are checked
+    const double BUNDLE_CONFLICT_SHARE = 0.01;
+    const unsigned long BUNDLE_SEARCH_LIMIT = 32;
+
     const double DEPTH_PINALTY_STEP = 0.000001;
+
+    // row counts accessors for yes counts collecting:
+    // by row index (bag view) or by position in node rows
+    struct BagRowCounts
+    {
+      BagRowCounts(const std::vector<uint8_t>& counts_val)
+        : counts(counts_val)
+      {}
+
+      unsigned long
+      operator()(unsigned long /*pos*/, uint32_t row) const
+      {
+        return counts[row];
+      }
+
+      const std::vector<uint8_t>& counts;
+    };
+
+    struct NodeRowCounts
+    {
+      NodeRowCounts(const uint8_t* counts_val)
+        : counts(counts_val)
+      {}
+
+      unsigned long
+      operator()(unsigned long pos, uint32_t /*row*/) const
+      {
+        return counts[pos];
+      }
+
+      const uint8_t* counts;
+    };
   }
 
   template<typename LearnerType>
@@ -50,18 +101,26 @@ namespace Vanga
     struct BestChoose
     {
       BestChoose()
-        : gain(0.0)
+        : feature_id(0),
+          gain(0.0),
+          base_bag_i(0)
       {}
 
       BestChoose(
+        unsigned long feature_id_val,
         double gain_val,
-        typename LearnerType::LearnTreeHolder* tree_val)
-          : gain(gain_val),
-            tree(Gears::add_ref(tree_val))
+        typename LearnerType::LearnTreeHolder* tree_val,
+        unsigned long base_bag_i_val)
+          : feature_id(feature_id_val),
+            gain(gain_val),
+            tree(Gears::add_ref(tree_val)),
+            base_bag_i(base_bag_i_val)
       {}
 
+      unsigned long feature_id;
       double gain;
       typename LearnerType::LearnTreeHolder_var tree;
+      unsigned long base_bag_i;
     };
 
     typedef std::deque<BestChoose> BestChooseArray;
@@ -71,7 +130,8 @@ namespace Vanga
       bool allow_negative)
       : skip_null_features_(skip_null_features),
         best_gain(allow_negative ? 1000000.0 : -EPS),
-        tasks_in_progress(0)
+        tasks_in_progress(0),
+        init_best_gain_(best_gain)
     {}
 
     void
@@ -82,29 +142,40 @@ namespace Vanga
     }
 
     void
-    set(double gain, typename LearnerType::LearnTreeHolder* tree)
+    set(const typename LearnerType::FeatureGainArray& gains)
     {
-      //const double DELTA_EPS = 0.0001;
-
-      // ignore branches without modifications
       Gears::ConditionGuard guard(lock_, cond_);
 
-      if(gain < best_gain + EPS)
+      for(auto gain_it = gains.begin(); gain_it != gains.end(); ++gain_it)
       {
-        if(gain <= best_gain - EPS)
-        {
-          best_features.clear();
-        }
-
-        best_features.push_back(BestChoose(gain, tree));
-        best_gain = gain;
+        add_(
+          gain_it->feature_id,
+          gain_it->gain,
+          gain_it->tree,
+          gain_it->base_bag_i);
       }
 
-      assert(tasks_in_progress > 0);
+      finish_();
+    }
 
-      if(--tasks_in_progress == 0 || tasks_in_progress % 100 == 0)
+    // reset_gains: select best features again with gains[i] for
+    // best_features[i] (called after all tasks finish)
+    void
+    reset_gains(const std::vector<double>& gains)
+    {
+      Gears::ConditionGuard guard(lock_, cond_);
+
+      BestChooseArray features;
+      features.swap(best_features);
+      best_gain = init_best_gain_;
+
+      for(unsigned long feature_i = 0; feature_i < features.size(); ++feature_i)
       {
-        cond_.signal();
+        add_(
+          features[feature_i].feature_id,
+          gains[feature_i],
+          features[feature_i].tree,
+          features[feature_i].base_bag_i);
       }
     }
 
@@ -132,7 +203,9 @@ namespace Vanga
     {
       if(!best_features.empty())
       {
-        unsigned long i = Gears::safe_rand(best_features.size());
+        // best_features ordered by feature_id: choice don't depend on
+        // tasks completion order
+        unsigned long i = ThreadRand::rand(best_features.size());
         res = best_features[i];
         return true;
       }
@@ -140,6 +213,60 @@ namespace Vanga
       return false;
     }
 
+  protected:
+    // lock_ must be locked
+    void
+    add_(
+      unsigned long feature_id,
+      double gain,
+      typename LearnerType::LearnTreeHolder* tree,
+      unsigned long base_bag_i)
+    {
+      //const double DELTA_EPS = 0.0001;
+
+      // ignore branches without modifications,
+      // keep all features with gain in [best_gain, best_gain + EPS):
+      // result set don't depend on add_ calls order
+      if(gain < best_gain + EPS)
+      {
+        if(gain < best_gain)
+        {
+          best_gain = gain;
+
+          auto res_it = best_features.begin();
+          for(auto it = best_features.begin(); it != best_features.end(); ++it)
+          {
+            if(it->gain < best_gain + EPS)
+            {
+              *res_it++ = *it;
+            }
+          }
+
+          best_features.erase(res_it, best_features.end());
+        }
+
+        auto ins_it = best_features.begin();
+        while(ins_it != best_features.end() && ins_it->feature_id < feature_id)
+        {
+          ++ins_it;
+        }
+
+        best_features.insert(ins_it, BestChoose(feature_id, gain, tree, base_bag_i));
+      }
+    }
+
+    void
+    finish_()
+    {
+      assert(tasks_in_progress > 0);
+
+      if(--tasks_in_progress == 0 || tasks_in_progress % 100 == 0)
+      {
+        cond_.signal();
+      }
+    }
+
+  public:
     const FeatureSet* skip_null_features_;
     Gears::Mutex lock_;
     Gears::Condition cond_;
@@ -147,6 +274,9 @@ namespace Vanga
     double best_gain;
     unsigned long tasks_in_progress;
 
+  protected:
+    const double init_best_gain_;
+
   protected:
     virtual ~GetBestFeatureResult() throw() = default;
   };
@@ -158,12 +288,16 @@ namespace Vanga
     //const typename LearnerType::FeatureRowsMap* feature_rows;
     const FeatureSet* skip_null_features;
     const typename LearnerType::BagPartArray* bags;
+    const typename LearnerType::NodeStatArray* node_stats;
     unsigned long gain_check_bags;
     typename LearnerType::LearnTreeHolder* cur_tree;
     //typename LearnerType::ConstSVM_var node_svm;
     unsigned long check_depth;
     bool top_eval;
     double alpha_coef;
+    // seed of bundle check generators, bundle index used as stream
+    uint64_t rand_seed;
+    const typename LearnerType::ShardCounter* shard_counter;
   };
 
   template<typename LearnerType, typename GainType>
@@ -179,8 +313,9 @@ namespace Vanga
     GetBestFeatureTask(
       GetBestFeatureResult<LearnerType>* result,
       GetBestFeatureParams<LearnerType>* params,
-      unsigned long feature_id,
-      typename LearnerType::SVMT* feature_svm)
+      const typename LearnerType::FeatureBundle& bundle,
+      const typename LearnerType::RowIndexArray* bundle_features,
+      unsigned long bundle_i)
       throw();
 
     virtual void
@@ -193,8 +328,9 @@ namespace Vanga
   private:
     const GetBestFeatureResult_var result_;
     const GetBestFeatureParams_var params_;
-    const unsigned long feature_id_;
-    typename LearnerType::SVMT* feature_svm_;
+    const typename LearnerType::FeatureBundle& bundle_;
+    const typename LearnerType::RowIndexArray* bundle_features_;
+    const unsigned long bundle_i_;
   };
 
   // GetBestFeatureTask impl
@@ -202,13 +338,15 @@ namespace Vanga
   GetBestFeatureTask<LearnerType, GainType>::GetBestFeatureTask(
     GetBestFeatureResult<LearnerType>* result,
     GetBestFeatureParams<LearnerType>* params,
-    unsigned long feature_id,
-    typename LearnerType::SVMT* feature_svm)
+    const typename LearnerType::FeatureBundle& bundle,
+    const typename LearnerType::RowIndexArray* bundle_features,
+    unsigned long bundle_i)
     throw()
     : result_(Gears::add_ref(result)),
       params_(Gears::add_ref(params)),
-      feature_id_(feature_id),
-      feature_svm_(feature_svm)
+      bundle_(bundle),
+      bundle_features_(bundle_features),
+      bundle_i_(bundle_i)
   {
     result->inc();
   }
@@ -217,21 +355,26 @@ namespace Vanga
   void
   GetBestFeatureTask<LearnerType, GainType>::execute() throw()
   {
-    double gain;
-    typename LearnerType::LearnTreeHolder_var new_tree;
+    // release pooled buffers, that bundle check didn't use,
+    // after collector destruction
+    BufferPools::EvaluationGuard evaluation_guard;
+    ThreadRand::Guard rand_guard(params_->rand_seed, bundle_i_);
+
+    typename LearnerType::FeatureGainArray gains;
     GainType gain_calc;
     PredCollector pred_collector;
 
-    LearnerType::check_feature_(
-      gain,
-      new_tree,
+    LearnerType::check_bundle_(
+      gains,
       pred_collector,
       gain_calc,
       params_->top_pred,
-      feature_id_,
-      //*(params_->feature_rows),
-      //feature_svm_,
+      bundle_,
+      bundle_i_,
+      bundle_features_,
       *(params_->bags),
+      *(params_->node_stats),
+      params_->shard_counter,
       params_->gain_check_bags,
       params_->cur_tree,
       //params_->node_svm,
@@ -240,12 +383,382 @@ namespace Vanga
 
     if(GAIN_TRACE)
     {
-      Gears::ErrorStream ostr;
-      ostr << "GAIN FOR #" << feature_id_ << ": " << gain << std::endl;
-      std::cout << ostr.str() << std::endl;
+      for(auto gain_it = gains.begin(); gain_it != gains.end(); ++gain_it)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "GAIN FOR #" << gain_it->feature_id << ": " << gain_it->gain << std::endl;
+        std::cout << ostr.str() << std::endl;
+      }
+    }
+
+    result_->set(gains);
+  }
+
+  // check_bundle_task: run check of one bundle in task_runner (if it defined)
+  // or in current thread
+  template<typename LearnerType, typename GainType>
+  void
+  check_bundle_task(
+    unsigned long& bundles_number,
+    GetBestFeatureResult<LearnerType>* result,
+    GetBestFeatureParams<LearnerType>* params,
+    Gears::TaskRunner* task_runner,
+    const typename LearnerType::FeatureBundle& bundle,
+    unsigned long bundle_i,
+    const typename LearnerType::BundleFeaturesArray* bundle_features)
+  {
+    const typename LearnerType::RowIndexArray* cur_bundle_features =
+      bundle_features ? &(*bundle_features)[bundle_i] : 0;
+
+    if(cur_bundle_features && cur_bundle_features->empty())
+    {
+      return;
+    }
+
+    ++bundles_number;
+
+    if(task_runner)
+    {
+      Gears::Task_var task = new GetBestFeatureTask<LearnerType, GainType>(
+        result,
+        params,
+        bundle,
+        cur_bundle_features,
+        bundle_i);
+
+      task_runner->enqueue_task(task);
+    }
+    else
+    {
+      BufferPools::EvaluationGuard evaluation_guard;
+      ThreadRand::Guard rand_guard(params->rand_seed, bundle_i);
+
+      PredCollector pred_collector;
+      GainType gain_calc;
+
+      typename LearnerType::FeatureGainArray gains;
+
+      result->inc();
+
+      LearnerType::check_bundle_(
+        gains,
+        pred_collector,
+        gain_calc,
+        params->top_pred,
+        bundle,
+        bundle_i,
+        cur_bundle_features,
+        *(params->bags),
+        *(params->node_stats),
+        params->shard_counter,
+        params->gain_check_bags,
+        params->cur_tree,
+        params->check_depth,
+        params->alpha_coef);
+
+      if(GAIN_TRACE)
+      {
+        for(auto gain_it = gains.begin(); gain_it != gains.end(); ++gain_it)
+        {
+          Gears::ErrorStream ostr;
+          ostr << "GAIN FOR #" << gain_it->feature_id << ": " << gain_it->gain << std::endl;
+          std::cout << ostr.str() << std::endl;
+        }
+      }
+
+      //gain += (-gain * GAIN_SHARE_PENALTY) + GAIN_ABS_PENALTY;
+
+      result->set(gains);
+    }
+  }
+
+  // check_bundles: run feature bundle checks (in task_runner if it defined)
+  // and wait results, bundle_features (selected features by bundles) can be null.
+  // bundles checked by blocks: block row indexes read ahead before check
+  // and released after it, if they placed in mapped file
+  template<typename LearnerType, typename GainType>
+  void
+  check_bundles(
+    GetBestFeatureResult<LearnerType>* result,
+    GetBestFeatureParams<LearnerType>* params,
+    Gears::TaskRunner* task_runner,
+    const typename LearnerType::RowHolder& row_holder,
+    const typename LearnerType::BundleFeaturesArray* bundle_features)
+  {
+    const typename LearnerType::FeatureBundleArray& bundles =
+      row_holder.feature_bundles;
+    const MappedFile* row_index_file = row_holder.row_index_file.in();
+
+    unsigned long bundle_i = 0;
+
+    for(auto block_end_it = row_holder.bundle_block_ends.begin();
+      block_end_it != row_holder.bundle_block_ends.end(); ++block_end_it)
+    {
+      const unsigned long block_end = *block_end_it;
+      const void* block_data_begin = bundles[bundle_i].rows.begin();
+      const void* block_data_end = bundles[block_end - 1].row_features.end();
+
+      if(row_index_file)
+      {
+        row_index_file->will_need(block_data_begin, block_data_end);
+      }
+
+      unsigned long bundles_number = 0;
+
+      for(; bundle_i < block_end; ++bundle_i)
+      {
+        check_bundle_task<LearnerType, GainType>(
+          bundles_number,
+          result,
+          params,
+          task_runner,
+          bundles[bundle_i],
+          bundle_i,
+          bundle_features);
+      }
+
+      result->wait(bundles_number);
+
+      if(row_index_file)
+      {
+        row_index_file->dont_need(block_data_begin, block_data_end);
+      }
+    }
+  }
+
+  // CheckBundlesJob: check of bundles slice in feature worker,
+  // worker i checks bundles with index i modulo workers number and
+  // returns its best features as (bundle index, feature id, gain) records
+  template<typename LearnerType, typename GainType>
+  class CheckBundlesJob: public SocketWorkers::Job
+  {
+  public:
+    struct Record
+    {
+      uint64_t bundle_i;
+      uint64_t feature_id;
+      double gain;
+    };
+
+    CheckBundlesJob(
+      GetBestFeatureResult<LearnerType>* result,
+      GetBestFeatureParams<LearnerType>* params,
+      const typename LearnerType::RowHolder& row_holder,
+      const typename LearnerType::BundleFeaturesArray* bundle_features)
+      : result_(result),
+        params_(params),
+        row_holder_(row_holder),
+        bundle_features_(bundle_features)
+    {}
+
+    virtual void
+    process(
+      unsigned long worker_i,
+      unsigned long workers_number,
+      std::string& res)
+      throw()
+    {
+      // called in worker process: result_ is worker copy
+      const typename LearnerType::FeatureBundleArray& bundles =
+        row_holder_.feature_bundles;
+
+      typename LearnerType::BundleFeaturesArray slice_features(bundles.size());
+
+      for(unsigned long bundle_i = worker_i; bundle_i < bundles.size();
+        bundle_i += workers_number)
+      {
+        fill_bundle_features(slice_features[bundle_i], bundle_i);
+      }
+
+      check_bundles<LearnerType, GainType>(
+        result_,
+        params_,
+        0, // only current thread is forked
+        row_holder_,
+        &slice_features);
+
+      for(auto best_it = result_->best_features.begin();
+        best_it != result_->best_features.end(); ++best_it)
+      {
+        Record record;
+        record.bundle_i = find_bundle_(best_it->feature_id, worker_i, workers_number);
+        record.feature_id = best_it->feature_id;
+        record.gain = best_it->gain;
+        res.append(reinterpret_cast<const char*>(&record), sizeof(record));
+      }
+    }
+
+    void
+    fill_bundle_features(
+      typename LearnerType::RowIndexArray& features,
+      unsigned long bundle_i)
+      const
+    {
+      if(bundle_features_)
+      {
+        features = (*bundle_features_)[bundle_i];
+      }
+      else
+      {
+        features.resize(row_holder_.feature_bundles[bundle_i].features.size());
+
+        for(unsigned long feature_i = 0; feature_i < features.size(); ++feature_i)
+        {
+          features[feature_i] = feature_i;
+        }
+      }
+    }
+
+  protected:
+    unsigned long
+    find_bundle_(
+      unsigned long feature_id,
+      unsigned long worker_i,
+      unsigned long workers_number)
+      const
+    {
+      const typename LearnerType::FeatureBundleArray& bundles =
+        row_holder_.feature_bundles;
+
+      for(unsigned long bundle_i = worker_i; bundle_i < bundles.size();
+        bundle_i += workers_number)
+      {
+        const typename LearnerType::FeatureIdArray& features =
+          bundles[bundle_i].features;
+
+        if(std::find(features.begin(), features.end(), feature_id) != features.end())
+        {
+          return bundle_i;
+        }
+      }
+
+      assert(false);
+      return 0;
+    }
+
+  protected:
+    GetBestFeatureResult<LearnerType>* result_;
+    GetBestFeatureParams<LearnerType>* params_;
+    const typename LearnerType::RowHolder& row_holder_;
+    const typename LearnerType::BundleFeaturesArray* bundle_features_;
+  };
+
+  // check_bundles_on_workers: feature parallel check_bundles,
+  // bundle slices checked in row_holder.feature_processes forked workers
+  // (all rows and node state shared with coordinator), coordinator
+  // selects bundles that contain best features over all workers and
+  // rechecks them: it produce same result with local check and
+  // winning split trees don't need serialization.
+  // bundles of failed workers checked in coordinator
+  template<typename LearnerType, typename GainType>
+  void
+  check_bundles_on_workers(
+    GetBestFeatureResult<LearnerType>* result,
+    GetBestFeatureParams<LearnerType>* params,
+    Gears::TaskRunner* task_runner,
+    const typename LearnerType::RowHolder& row_holder,
+    const typename LearnerType::BundleFeaturesArray* bundle_features)
+  {
+    typedef CheckBundlesJob<LearnerType, GainType> Job;
+
+    const unsigned long workers_number = row_holder.feature_processes;
+
+    if(workers_number < 2)
+    {
+      check_bundles<LearnerType, GainType>(
+        result,
+        params,
+        task_runner,
+        row_holder,
+        bundle_features);
+
+      return;
+    }
+
+    const unsigned long bundles_number = row_holder.feature_bundles.size();
+    Job job(result, params, row_holder, bundle_features);
+    SocketWorkers::ResultArray worker_results;
+
+    try
+    {
+      SocketWorkers::run(
+        worker_results,
+        workers_number,
+        &job,
+        !row_holder.feature_host.empty() ? row_holder.feature_host.c_str() : 0);
+    }
+    catch(const Gears::Exception& ex)
+    {
+      std::cerr << "can't run feature workers: " << ex.what() << std::endl;
+      worker_results.assign(workers_number, SocketWorkers::Result());
+    }
+
+    std::vector<bool> recheck_bundles(bundles_number, false);
+    std::vector<typename Job::Record> records;
+
+    for(unsigned long worker_i = 0; worker_i < workers_number; ++worker_i)
+    {
+      const SocketWorkers::Result& worker_result = worker_results[worker_i];
+
+      if(worker_result.done &&
+        worker_result.data.size() % sizeof(typename Job::Record) == 0)
+      {
+        const unsigned long records_number =
+          worker_result.data.size() / sizeof(typename Job::Record);
+        const unsigned long offset = records.size();
+        records.resize(offset + records_number);
+
+        if(records_number > 0)
+        {
+          ::memcpy(
+            &records[offset],
+            worker_result.data.data(),
+            worker_result.data.size());
+        }
+      }
+      else
+      {
+        for(unsigned long bundle_i = worker_i; bundle_i < bundles_number;
+          bundle_i += workers_number)
+        {
+          recheck_bundles[bundle_i] = true;
+        }
+      }
+    }
+
+    // worker reports features with gain < worker best gain + EPS:
+    // it contains all features with gain < global best gain + EPS
+    double best_gain = std::numeric_limits<double>::max();
+
+    for(auto record_it = records.begin(); record_it != records.end(); ++record_it)
+    {
+      best_gain = std::min(best_gain, record_it->gain);
+    }
+
+    for(auto record_it = records.begin(); record_it != records.end(); ++record_it)
+    {
+      if(record_it->gain < best_gain + EPS && record_it->bundle_i < bundles_number)
+      {
+        recheck_bundles[record_it->bundle_i] = true;
+      }
+    }
+
+    typename LearnerType::BundleFeaturesArray recheck_features(bundles_number);
+
+    for(unsigned long bundle_i = 0; bundle_i < bundles_number; ++bundle_i)
+    {
+      if(recheck_bundles[bundle_i])
+      {
+        job.fill_bundle_features(recheck_features[bundle_i], bundle_i);
+      }
     }
 
-    result_->set(gain, new_tree);
+    check_bundles<LearnerType, GainType>(
+      result,
+      params,
+      task_runner,
+      row_holder,
+      &recheck_features);
   }
 
   template<typename LabelType>
@@ -550,28 +1063,309 @@ namespace Vanga
     }
   }
 
-  // TreeLearner::Context
+  // TreeLearner::ShardCounter
   template<typename LabelType>
-  TreeLearner<LabelType>::Context::Context(const BagPartArray& bag_parts)
-    : bag_parts_(bag_parts)
-  {}
+  TreeLearner<LabelType>::ShardCounter::ShardCounter(
+    const RowHolder& row_holder,
+    unsigned long processes,
+    unsigned long bags_number)
+    : row_holder_(row_holder),
+      shards_number_(processes),
+      bags_number_(bags_number),
+      failed_(false)
+  {
+    const unsigned long rows_number = row_holder_.rows.size();
+    const unsigned long bundles_number = row_holder_.feature_bundles.size();
 
-  template<typename LabelType>
-  TreeLearner<LabelType>::Context::~Context() throw()
-  {}
+    // shard can't return more yes counts then bundle rows inside it
+    std::vector<unsigned long> shard_capacities(shards_number_, 0);
 
-  template<typename LabelType>
-  typename TreeLearner<LabelType>::LearnContext_var
-  TreeLearner<LabelType>::Context::create_learner(
-    const DTree* base_tree,
-    Gears::TaskRunner* task_runner)
-  {
-    return new LearnContext(
+    for(auto bundle_it = row_holder_.feature_bundles.begin();
+      bundle_it != row_holder_.feature_bundles.end(); ++bundle_it)
+    {
+      for(unsigned long shard_i = 0; shard_i < shards_number_; ++shard_i)
+      {
+        shard_capacities[shard_i] +=
+          std::lower_bound(
+            bundle_it->rows.begin(),
+            bundle_it->rows.end(),
+            shard_row_begin_(shard_i + 1)) -
+          std::lower_bound(
+            bundle_it->rows.begin(),
+            bundle_it->rows.end(),
+            shard_row_begin_(shard_i));
+      }
+    }
+
+    const unsigned long ALIGN = sizeof(uint64_t);
+    const unsigned long bundle_bags_size =
+      (bundles_number * sizeof(uint32_t) + ALIGN - 1) / ALIGN * ALIGN;
+    const unsigned long rows_size =
+      (rows_number * sizeof(uint32_t) + ALIGN - 1) / ALIGN * ALIGN;
+    const unsigned long counts_size = (rows_number + ALIGN - 1) / ALIGN * ALIGN;
+
+    unsigned long memory_size = bags_number_ * sizeof(unsigned long) +
+      bundle_bags_size +
+      bags_number_ * (2 * rows_size + counts_size);
+
+    for(unsigned long shard_i = 0; shard_i < shards_number_; ++shard_i)
+    {
+      memory_size += (bundles_number + 1) * sizeof(unsigned long) +
+        shard_capacities[shard_i] * sizeof(std::pair<uint64_t, unsigned long>);
+    }
+
+    memory_ = new SharedMemory(memory_size);
+
+    char* ptr = static_cast<char*>(memory_->data());
+    node_rows_numbers_ = reinterpret_cast<unsigned long*>(ptr);
+    std::fill(node_rows_numbers_, node_rows_numbers_ + bags_number_, 0);
+    ptr += bags_number_ * sizeof(unsigned long);
+    bundle_bags_ = reinterpret_cast<uint32_t*>(ptr);
+    ptr += bundle_bags_size;
+
+    for(unsigned long bag_i = 0; bag_i < bags_number_; ++bag_i)
+    {
+      node_rows_.push_back(reinterpret_cast<uint32_t*>(ptr));
+      ptr += rows_size;
+      node_row_cells_.push_back(reinterpret_cast<uint32_t*>(ptr));
+      ptr += rows_size;
+      node_row_counts_.push_back(reinterpret_cast<uint8_t*>(ptr));
+      ptr += counts_size;
+    }
+
+    for(unsigned long shard_i = 0; shard_i < shards_number_; ++shard_i)
+    {
+      shard_bundle_offsets_.push_back(reinterpret_cast<unsigned long*>(ptr));
+      ptr += (bundles_number + 1) * sizeof(unsigned long);
+      shard_yes_counts_.push_back(
+        reinterpret_cast<std::pair<uint64_t, unsigned long>*>(ptr));
+      ptr += shard_capacities[shard_i] * sizeof(std::pair<uint64_t, unsigned long>);
+    }
+
+    pool_ = new ShardPool(shards_number_, this);
+  }
+
+  template<typename LabelType>
+  TreeLearner<LabelType>::ShardCounter::~ShardCounter() throw()
+  {
+    // stop workers before shared memory release
+    pool_ = ShardPool_var();
+  }
+
+  template<typename LabelType>
+  unsigned long
+  TreeLearner<LabelType>::ShardCounter::shard_row_begin_(
+    unsigned long shard_i) const
+  {
+    return static_cast<uint64_t>(row_holder_.rows.size()) * shard_i /
+      shards_number_;
+  }
+
+  template<typename LabelType>
+  bool
+  TreeLearner<LabelType>::ShardCounter::count(
+    const BagPartArray& bags,
+    const NodeStatArray& node_stats,
+    uint64_t rand_seed)
+    throw()
+  {
+    assert(bags.size() == bags_number_);
+
+    if(failed_)
+    {
+      return false;
+    }
+
+    std::vector<bool> used_bags(bags_number_, false);
+
+    for(unsigned long bundle_i = 0;
+      bundle_i < row_holder_.feature_bundles.size(); ++bundle_i)
+    {
+      ThreadRand::Guard rand_guard(rand_seed, bundle_i);
+      bundle_bags_[bundle_i] = ThreadRand::rand(bags.size());
+      used_bags[bundle_bags_[bundle_i]] = true;
+    }
+
+    for(unsigned long bag_i = 0; bag_i < bags_number_; ++bag_i)
+    {
+      if(!used_bags[bag_i])
+      {
+        node_rows_numbers_[bag_i] = 0;
+        continue;
+      }
+
+      const BagPart& bag_part = *bags[bag_i];
+      const uint32_t* rows_begin = bag_part.rows_begin();
+      const BagView& row_counts = bag_part.bag_holder->row_counts;
+      const NodeStat& node_stat = *node_stats[bag_i];
+      uint8_t* node_row_counts = node_row_counts_[bag_i];
+
+      node_rows_numbers_[bag_i] = bag_part.size();
+
+      std::copy(rows_begin, bag_part.rows_end(), node_rows_[bag_i]);
+      std::copy(
+        node_stat.row_cells.begin(),
+        node_stat.row_cells.end(),
+        node_row_cells_[bag_i]);
+
+      for(unsigned long row_i = 0; row_i < bag_part.size(); ++row_i)
+      {
+        node_row_counts[row_i] = row_counts[rows_begin[row_i]];
+      }
+    }
+
+    try
+    {
+      pool_->run();
+    }
+    catch(const Gears::Exception& ex)
+    {
+      std::cerr << "can't count on shard workers, count in trainer process: " <<
+        ex.what() << std::endl;
+      failed_ = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  template<typename LabelType>
+  unsigned long
+  TreeLearner<LabelType>::ShardCounter::bundle_bag_i(
+    unsigned long bundle_i) const
+  {
+    return bundle_bags_[bundle_i];
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::ShardCounter::get_yes_counts(
+    YesCountArray& yes_counts,
+    unsigned long bundle_i)
+    const throw()
+  {
+    for(unsigned long shard_i = 0; shard_i < shards_number_; ++shard_i)
+    {
+      const unsigned long* bundle_offsets = shard_bundle_offsets_[shard_i];
+      const std::pair<uint64_t, unsigned long>* shard_yes_counts =
+        shard_yes_counts_[shard_i];
+
+      yes_counts.insert(
+        yes_counts.end(),
+        shard_yes_counts + bundle_offsets[bundle_i],
+        shard_yes_counts + bundle_offsets[bundle_i + 1]);
+    }
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::ShardCounter::process(
+    unsigned long shard_i,
+    unsigned long /*shards_number*/)
+    throw()
+  {
+    // called in worker process,
+    // shard rows of base bags are found on first use
+    const unsigned long NOT_FOUND = static_cast<unsigned long>(-1);
+    std::vector<unsigned long> shard_rows_offsets(bags_number_, NOT_FOUND);
+    std::vector<unsigned long> shard_rows_sizes(bags_number_, 0);
+
+    unsigned long* bundle_offsets = shard_bundle_offsets_[shard_i];
+    std::pair<uint64_t, unsigned long>* shard_yes_counts = shard_yes_counts_[shard_i];
+
+    YesCountArray yes_counts;
+    unsigned long offset = 0;
+    unsigned long bundle_i = 0;
+
+    for(auto bundle_it = row_holder_.feature_bundles.begin();
+      bundle_it != row_holder_.feature_bundles.end(); ++bundle_it, ++bundle_i)
+    {
+      const unsigned long bag_i = bundle_bags_[bundle_i];
+      const uint32_t* rows_begin = node_rows_[bag_i];
+
+      if(shard_rows_offsets[bag_i] == NOT_FOUND)
+      {
+        const uint32_t* rows_end = rows_begin + node_rows_numbers_[bag_i];
+        const uint32_t* shard_rows_begin = std::lower_bound(
+          rows_begin, rows_end, shard_row_begin_(shard_i));
+        const uint32_t* shard_rows_end = std::lower_bound(
+          shard_rows_begin, rows_end, shard_row_begin_(shard_i + 1));
+        shard_rows_offsets[bag_i] = shard_rows_begin - rows_begin;
+        shard_rows_sizes[bag_i] = shard_rows_end - shard_rows_begin;
+      }
+
+      const unsigned long shard_rows_offset = shard_rows_offsets[bag_i];
+
+      bundle_offsets[bundle_i] = offset;
+
+      yes_counts.clear();
+
+      fill_yes_counts_(
+        yes_counts,
+        *bundle_it,
+        rows_begin + shard_rows_offset,
+        rows_begin + shard_rows_offset + shard_rows_sizes[bag_i],
+        node_row_cells_[bag_i] + shard_rows_offset,
+        NodeRowCounts(node_row_counts_[bag_i] + shard_rows_offset));
+
+      std::copy(yes_counts.begin(), yes_counts.end(), shard_yes_counts + offset);
+      offset += yes_counts.size();
+    }
+
+    bundle_offsets[bundle_i] = offset;
+  }
+
+  // TreeLearner::Context
+  template<typename LabelType>
+  TreeLearner<LabelType>::Context::Context(const BagPartArray& bag_parts)
+    : bag_parts_(bag_parts)
+  {}
+
+  template<typename LabelType>
+  TreeLearner<LabelType>::Context::~Context() throw()
+  {}
+
+  template<typename LabelType>
+  typename TreeLearner<LabelType>::LearnContext_var
+  TreeLearner<LabelType>::Context::create_learner(
+    const DTree* base_tree,
+    Gears::TaskRunner* task_runner)
+  {
+    return new LearnContext(
       task_runner,
       bag_parts_,
       base_tree);
   }
 
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::Context::memory_usage(MemoryUsage& usage) const
+    throw()
+  {
+    std::set<const RowHolder*> row_holders;
+    std::set<const BagHolder*> bag_holders;
+    RowPermutationSet permutations;
+
+    for(auto bag_it = bag_parts_.begin(); bag_it != bag_parts_.end(); ++bag_it)
+    {
+      const BagHolder* bag_holder = (*bag_it)->bag_holder.in();
+
+      if(bag_holders.insert(bag_holder).second)
+      {
+        usage.add(
+          "bags",
+          sizeof(BagHolder) + MemoryUsage::vector_bytes(bag_holder->row_counts));
+
+        if(row_holders.insert(bag_holder->row_holder.in()).second)
+        {
+          row_holder_memory_usage_(usage, *bag_holder->row_holder);
+        }
+      }
+    }
+
+    bag_parts_memory_usage_(usage, permutations, "bag_parts", bag_parts_);
+  }
+
   // TreeLearner::LearnContext
   template<typename LabelType>
   TreeLearner<LabelType>::LearnContext::LearnContext(
@@ -589,6 +1383,31 @@ namespace Vanga
   TreeLearner<LabelType>::LearnContext::~LearnContext() throw()
   {}
 
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::LearnContext::memory_usage(MemoryUsage& usage) const
+    throw()
+  {
+    // init bags are shared with context: their permutations counted there
+    RowPermutationSet permutations;
+
+    for(auto bag_it = init_bags_.begin(); bag_it != init_bags_.end(); ++bag_it)
+    {
+      permutations.insert((*bag_it)->permutation.in());
+    }
+
+    usage.add(
+      "learn_tree",
+      MemoryUsage::vector_bytes(bags) +
+      MemoryUsage::vector_bytes(init_bags_) +
+      MemoryUsage::tree_map_bytes(dig_cache_));
+
+    if(cur_tree_)
+    {
+      learn_tree_memory_usage_(usage, permutations, cur_tree_.in());
+    }
+  }
+
   template<typename LabelType>
   template<typename GainType>
   DTree_var
@@ -598,7 +1417,8 @@ namespace Vanga
     double alpha_coef,
     FeatureSelectionStrategy feature_selection_strategy,
     bool allow_negative_gain,
-    unsigned long gain_check_bags)
+    unsigned long gain_check_bags,
+    FeatureScreening* screening)
   {
     if(!cur_tree_.in())
     {
@@ -621,7 +1441,8 @@ namespace Vanga
       alpha_coef,
       feature_selection_strategy,
       allow_negative_gain,
-      gain_check_bags);
+      gain_check_bags,
+      screening);
 
     // apply node change
     if(!nodes.empty())
@@ -678,6 +1499,7 @@ namespace Vanga
   {
     ++max_tree_id_;
     tree->tree_id = max_tree_id_;
+    tree->bags = bags;
 
     for(auto branch_it = tree->branches.begin(); branch_it != tree->branches.end(); ++branch_it)
     {
@@ -688,28 +1510,7 @@ namespace Vanga
         BagPartArray yes_bag_parts;
         BagPartArray no_bag_parts;
 
-        for(auto bag_it = bags.begin(); bag_it != bags.end(); ++bag_it)
-        {
-          SVM_var yes_svm;
-          SVM_var no_svm;
-
-          div_rows_(
-            yes_svm,
-            no_svm,
-            branch_it->feature_id,
-            (*bag_it)->svm,
-            (*bag_it)->bag_holder->feature_rows);
-
-          BagPart_var yes_bag_part = new BagPart();
-          yes_bag_part->bag_holder = (*bag_it)->bag_holder;
-          yes_bag_part->svm = yes_svm;
-          yes_bag_parts.push_back(yes_bag_part);
-
-          BagPart_var no_bag_part = new BagPart();
-          no_bag_part->bag_holder = (*bag_it)->bag_holder;
-          no_bag_part->svm = no_svm;
-          no_bag_parts.push_back(no_bag_part);
-        }
+        TreeLearner::div_bags_(yes_bag_parts, no_bag_parts, bags, branch_it->feature_id);
 
         adapt_learn_tree_holder_(
           branch_it->yes_tree,
@@ -719,10 +1520,6 @@ namespace Vanga
           branch_it->no_tree,
           no_bag_parts);
       }
-      else
-      {
-        tree->bags = bags;
-      }
     }
   }
 
@@ -745,7 +1542,10 @@ namespace Vanga
         if(branch_it->yes_tree || branch_it->no_tree)
         {
           DTree::Branch branch;
-          branch.feature_id = branch_it->feature_id;
+          fill_dtree_branch_(
+            branch,
+            *init_bags_[0]->bag_holder->row_holder,
+            branch_it->feature_id);
           branch.yes_tree = fill_dtree_(branch_it->yes_tree);
           branch.no_tree = fill_dtree_(branch_it->no_tree);
           ///*
@@ -777,7 +1577,8 @@ namespace Vanga
     double alpha_coef,
     FeatureSelectionStrategy feature_selection_strategy,
     bool allow_negative_gain,
-    unsigned long gain_check_bags
+    unsigned long gain_check_bags,
+    FeatureScreening* screening
     )
   {
     for(auto branch_it = tree->branches.begin(); branch_it != tree->branches.end(); ++branch_it)
@@ -794,7 +1595,8 @@ namespace Vanga
         alpha_coef,
         feature_selection_strategy,
         allow_negative_gain,
-        gain_check_bags);
+        gain_check_bags,
+        screening);
 
       fetch_nodes_<GainType>(
         nodes,
@@ -806,7 +1608,8 @@ namespace Vanga
         alpha_coef,
         feature_selection_strategy,
         allow_negative_gain,
-        gain_check_bags);
+        gain_check_bags,
+        screening);
     }
 
     // search remove candidates
@@ -893,7 +1696,8 @@ namespace Vanga
       max_add_depth,
       check_depth,
       alpha_coef,
-      allow_negative_gain);
+      allow_negative_gain,
+      screening);
 
     add_tree->delta_gain += DEPTH_PINALTY_STEP * cur_depth; // depth pinalty
 
@@ -943,12 +1747,14 @@ namespace Vanga
         branch_it != tree->branches_.end(); ++branch_it)
       {
         typename LearnTreeHolder::Branch branch;
-        branch.feature_id = branch_it->feature_id;
+        branch.feature_id = learn_feature_id_(
+          *init_bags_[0]->bag_holder->row_holder,
+          *branch_it);
 
         BagPartArray yes_bag_parts;
         BagPartArray no_bag_parts;
 
-        TreeLearner::div_bags_(yes_bag_parts, no_bag_parts, bags, branch_it->feature_id);
+        TreeLearner::div_bags_(yes_bag_parts, no_bag_parts, bags, branch.feature_id);
 
         branch.yes_tree = fill_learn_tree_<GainType>(
           max_tree_id,
@@ -966,20 +1772,22 @@ namespace Vanga
     else
     {
       // init root node
-      unsigned long bag_i = Gears::safe_rand(bags.size());
+      unsigned long bag_i = ThreadRand::rand(bags.size());
       const BagPart& bag_part = *bags[bag_i];
 
       res->tree_id = 1;
 
       GainType gain_calc;
       PredCollector pred_collector;
+      LabelCountArray node_labels;
+      node_labels_(node_labels, bag_part);
 
       double gain = eval_init_delta_(
         res->delta_prob,
         pred_collector,
         gain_calc,
         0.0,
-        bag_part.svm,
+        node_labels,
         LabelType(),
         true // eval delta
         );
@@ -1007,65 +1815,53 @@ namespace Vanga
   template<typename LabelType>
   void
   TreeLearner<LabelType>::div_by_tree_(
-    std::vector<std::pair<SVM_var, double> >& svms,
-    LearnTreeHolder* tree,
-    const FeatureRowsMap& feature_rows)
+    std::vector<std::pair<ConstBagPart_var, double> >& bag_parts,
+    LearnTreeHolder* tree)
     throw()
   {
     if(tree)
     {
-      for(auto svm_it = svms.begin(); svm_it != svms.end(); ++svm_it)
+      for(auto part_it = bag_parts.begin(); part_it != bag_parts.end(); ++part_it)
       {
-        svm_it->second += tree->delta_prob;
+        part_it->second += tree->delta_prob;
       }
 
       for(auto branch_it = tree->branches.begin();
         branch_it != tree->branches.end(); ++branch_it)
       {
-        std::vector<std::pair<SVM_var, double> > yes_svms;
-        std::vector<std::pair<SVM_var, double> > no_svms;
+        std::vector<std::pair<ConstBagPart_var, double> > yes_parts;
+        std::vector<std::pair<ConstBagPart_var, double> > no_parts;
 
-        for(auto svm_it = svms.begin(); svm_it != svms.end(); ++svm_it)
+        for(auto part_it = bag_parts.begin(); part_it != bag_parts.end(); ++part_it)
         {
-          auto feature_it = feature_rows.find(branch_it->feature_id);
-          if(feature_it != feature_rows.end())
-          {
-            SVM_var yes_svm;
-            SVM_var no_svm;
+          BagPart_var yes_bag_part;
+          BagPart_var no_bag_part;
 
-            SVM<LabelType>::cross(yes_svm, no_svm, svm_it->first, feature_it->second);
+          div_rows_(yes_bag_part, no_bag_part, branch_it->feature_id, *(part_it->first));
 
-            yes_svms.push_back(
-              std::make_pair(
-                yes_svm,
-                svm_it->second /*+ (branch_it->yes_tree ? branch_it->yes_tree->delta_prob : 0.0)*/));
-
-            no_svms.push_back(
-              std::make_pair(
-                no_svm,
-                svm_it->second /*+ (branch_it->no_tree ? branch_it->no_tree->delta_prob : 0.0)*/));
+          if(yes_bag_part->size() > 0)
+          {
+            yes_parts.push_back(std::make_pair(yes_bag_part, part_it->second));
           }
-          else
+
+          if(no_bag_part->size() > 0)
           {
-            no_svms.push_back(
-              std::make_pair(
-                svm_it->first,
-                svm_it->second /*+ (branch_it->no_tree ? branch_it->no_tree->delta_prob : 0.0)*/));
+            no_parts.push_back(std::make_pair(no_bag_part, part_it->second));
           }
         }
 
         if(branch_it->yes_tree)
         {
-          div_by_tree_(yes_svms, branch_it->yes_tree, feature_rows);
+          div_by_tree_(yes_parts, branch_it->yes_tree);
         }
 
         if(branch_it->no_tree)
         {
-          div_by_tree_(no_svms, branch_it->no_tree, feature_rows);
+          div_by_tree_(no_parts, branch_it->no_tree);
         }
 
-        std::copy(no_svms.begin(), no_svms.end(), std::back_inserter(yes_svms));
-        svms.swap(yes_svms);
+        std::copy(no_parts.begin(), no_parts.end(), std::back_inserter(yes_parts));
+        bag_parts.swap(yes_parts);
       }
     }
   }
@@ -1077,23 +1873,31 @@ namespace Vanga
     GainType& gain_calc,
     double add_delta,
     LearnTreeHolder* new_tree,
-    SVM<LabelType>* node_svm,
-    const FeatureRowsMap& feature_rows)
+    const BagPart& bag_part,
+    bool double_preds)
     throw()
   {
+    const BagHolder& bag_holder = *bag_part.bag_holder;
+    const RowHolder& row_holder = *bag_holder.row_holder;
+
     double old_metric;
 
     {
       // eval current metric
       gain_calc.start_metric_eval();
 
-      for(auto node_group_it = node_svm->grouped_rows.begin();
-        node_group_it != node_svm->grouped_rows.end();
-        ++node_group_it)
+      const uint32_t* row_end_it = bag_part.rows_end();
+
+      for(const uint32_t* row_it = bag_part.rows_begin(); row_it != row_end_it; )
       {
+        unsigned long group_i;
+        const uint32_t* group_end_it = group_end_(group_i, row_holder, row_it, row_end_it);
+
         gain_calc.add_metric_eval(
-          (*node_group_it)->label,
-          (*node_group_it)->rows.size());
+          row_holder.labels[group_i],
+          rows_count_(bag_holder, row_it, group_end_it));
+
+        row_it = group_end_it;
       }
 
       old_metric = gain_calc.metric_result();
@@ -1102,109 +1906,82 @@ namespace Vanga
     double new_metric;
 
     {
-      std::vector<std::pair<SVM_var, double> > div_svms;
-      div_svms.push_back(std::make_pair(Gears::add_ref(node_svm), 0.0));
-
-      div_by_tree_(
-        div_svms,
-        new_tree,
-        feature_rows);
-
-      /*
-      if(!new_tree->branches.empty())
-      {
-        std::cerr << "F #" << new_tree->branches.begin()->feature_id <<
-          ": yes delta = " << (
-            new_tree->branches.begin()->yes_tree ? new_tree->branches.begin()->yes_tree->delta_prob : 0.0) <<
-          ", no delta = " << (
-            new_tree->branches.begin()->no_tree ? new_tree->branches.begin()->no_tree->delta_prob : 0.0) <<
-          std::endl;
-      }
-      else
-      {
-        std::cerr << "F: empty branches" <<
-          std::endl;
-      }
-
-      std::cerr << "DIV TREES(" << div_svms.size() << "):";
-      for(auto i = div_svms.begin(); i != div_svms.end(); ++i)
-      {
-        std::cerr << " " << i->second;
-      }
-      std::cerr << std::endl;
-      */
-
-      // for each group div it by tree with label
       // div rows by new tree and fetch
-      gain_calc.start_metric_eval();
-
-      for(auto cross_group_it = div_svms.begin();
-          cross_group_it != div_svms.end(); ++cross_group_it)
-      {
-        for(auto node_group_it = cross_group_it->first->grouped_rows.begin();
-          node_group_it != cross_group_it->first->grouped_rows.end();
-          ++node_group_it)
-        {
-          gain_calc.add_metric_eval(
-            GainType::add_delta((*node_group_it)->label, cross_group_it->second + add_delta),
-            (*node_group_it)->rows.size());
-        }
-      }
+      std::vector<std::pair<ConstBagPart_var, double> > div_parts;
+      div_parts.push_back(std::make_pair(Gears::add_ref(&bag_part), 0.0));
 
-      new_metric = gain_calc.metric_result();
+      div_by_tree_(div_parts, new_tree);
 
-      /*
-      // eval new metric
       gain_calc.start_metric_eval();
 
-      for(auto node_group_it = node_svm->grouped_rows.begin();
-        node_group_it != node_svm->grouped_rows.end();
-        ++node_group_it)
+      for(auto div_part_it = div_parts.begin();
+          div_part_it != div_parts.end(); ++div_part_it)
       {
-        double cur_pred = 0;
-        unsigned long cur_count = 0;
+        const uint32_t* row_end_it = div_part_it->first->rows_end();
 
-        for(auto row_it = (*node_group_it)->rows.begin();
-          row_it != (*node_group_it)->rows.end(); ++row_it)
+        for(const uint32_t* row_it = div_part_it->first->rows_begin(); row_it != row_end_it; )
         {
-          const double pred = new_tree->predict((*row_it)->features);
-          if(std::abs(cur_pred - pred) > EPS) // cur_pred != pred
-          {
-            if(cur_count > 0)
-            {
-              gain_calc.add_metric_eval(
-                GainT::add_delta((*node_group_it)->label, cur_pred + add_delta),
-                cur_count);
-            }
+          unsigned long group_i;
+          const uint32_t* group_end_it = group_end_(group_i, row_holder, row_it, row_end_it);
 
-            cur_pred = pred;
-            cur_count = 1;
+          const LabelType& label = row_holder.labels[group_i];
+          const double delta = div_part_it->second + add_delta;
+          const unsigned long count = rows_count_(bag_holder, row_it, group_end_it);
+
+          if(double_preds)
+          {
+            gain_calc.add_metric_eval(
+              label.orig(),
+              static_cast<double>(label.pred) + delta,
+              count);
           }
           else
           {
-            ++cur_count;
+            gain_calc.add_metric_eval(GainType::add_delta(label, delta), count);
           }
-        }
 
-        if(cur_count > 0)
-        {
-          gain_calc.add_metric_eval(
-            GainT::add_delta((*node_group_it)->label, cur_pred + add_delta),
-            cur_count);
+          row_it = group_end_it;
         }
       }
-      */
-    }
 
-    //double new_metric = gain_calc.metric_result();
+      new_metric = gain_calc.metric_result();
+    }
 
-    /*
-    std::cout << "TMP DEBUG eval_feature_gain_by_delta_: old_metric = " <<
-      old_metric << ", new_metric = " << new_metric << std::endl;
-    */
     return new_metric - old_metric;
   }
 
+  template<typename LabelType>
+  template<typename GainType>
+  double
+  TreeLearner<LabelType>::verify_gain_(
+    double add_delta,
+    LearnTreeHolder* tree,
+    const BagPartArray& bags,
+    unsigned long base_bag_i)
+    throw()
+  {
+    GainType gain_calc;
+
+    if(bags.size() == 1)
+    {
+      return eval_feature_gain_by_delta_(
+        gain_calc, add_delta, tree, *bags[base_bag_i], true);
+    }
+
+    double sum_gain = 0;
+
+    for(unsigned long bag_i = 0; bag_i < bags.size(); ++bag_i)
+    {
+      if(bag_i != base_bag_i)
+      {
+        sum_gain += eval_feature_gain_by_delta_(
+          gain_calc, add_delta, tree, *bags[bag_i], true);
+      }
+    }
+
+    return sum_gain / (bags.size() - 1);
+  }
+
   template<typename LabelType>
   template<typename GainType>
   double
@@ -1213,22 +1990,20 @@ namespace Vanga
     PredCollector& pred_collector,
     GainType& gain_calc,
     double top_pred,
-    const SVM<LabelType>* node_svm,
+    const LabelCountArray& node_labels,
     const LabelType& /*add_label*/,
     bool /*eval_delta*/)
     throw()
   {
     pred_collector.start_delta_eval(1, top_pred);
 
-    for(auto node_group_it = node_svm->grouped_rows.begin();
-      node_group_it != node_svm->grouped_rows.end(); ++node_group_it)
+    for(auto label_it = node_labels.begin(); label_it != node_labels.end(); ++label_it)
     {
-      pred_collector.add_delta_eval(0, (*node_group_it)->label, (*node_group_it)->rows.size());
+      pred_collector.add_delta_eval(0, label_it->first, label_it->second);
     }
 
     pred_collector.fin_delta_eval();
 
-    //std::cout << "top_pred: " << top_pred << std::endl;
     FloatArray yes_deltas(1, top_pred);
     FloatArray deltas(1, top_pred);
     gain_calc.delta_result(yes_deltas, deltas, pred_collector);
@@ -1236,12 +2011,11 @@ namespace Vanga
 
     gain_calc.start_metric_eval();
 
-    for(auto node_group_it = node_svm->grouped_rows.begin();
-      node_group_it != node_svm->grouped_rows.end(); ++node_group_it)
+    for(auto label_it = node_labels.begin(); label_it != node_labels.end(); ++label_it)
     {
       gain_calc.add_metric_eval(
-        GainType::add_delta((*node_group_it)->label, delta),
-        (*node_group_it)->rows.size());
+        GainType::add_delta(label_it->first, delta),
+        label_it->second);
     }
 
     assert(!std::isnan(delta));
@@ -1266,7 +2040,8 @@ namespace Vanga
     unsigned long max_depth,
     unsigned long check_depth,
     double alpha_coef,
-    bool allow_negative_gain)
+    bool allow_negative_gain,
+    FeatureScreening* screening)
     throw()
   {
     // select bag randomly
@@ -1293,7 +2068,8 @@ namespace Vanga
         check_depth,
         true,
         alpha_coef,
-        allow_negative_gain
+        allow_negative_gain,
+        screening
         ))
     {
       return processor.aggregate(
@@ -1365,16 +2141,18 @@ namespace Vanga
     unsigned long check_depth,
     bool top_eval,
     double alpha_coef,
-    bool allow_negative_gain)
+    bool allow_negative_gain,
+    FeatureScreening* screening)
     throw()
   {
     // process sub tree
-    unsigned long bag_i = Gears::safe_rand(bags.size());
+    unsigned long bag_i = ThreadRand::rand(bags.size());
     const BagPart& bag_part = *bags[bag_i];
-    const SVM<LabelType>* node_svm = bag_part.svm;
-    const FeatureRowsMap& feature_rows = bag_part.bag_holder->feature_rows;
+    ProfileScope profile_scope(Profiler::P_GET_BEST_FEATURE, bag_part.size());
+    const FeatureBundleArray& feature_bundles =
+      bag_part.bag_holder->row_holder->feature_bundles;
 
-    if(node_svm->grouped_rows.empty())
+    if(bag_part.size() == 0)
     {
       return false;
     }
@@ -1399,8 +2177,6 @@ namespace Vanga
     }
 
     // find best features (by gain)
-    unsigned long feature_i = 1;
-
     Gears::IntrusivePtr<GetBestFeatureResult<ThisType> > result =
       new GetBestFeatureResult<ThisType>(
         &skip_null_features,
@@ -1414,66 +2190,116 @@ namespace Vanga
     //params->node_svm = Gears::add_ref(node_svm);
     params->bags = &bags;
     params->gain_check_bags = gain_check_bags;
+    params->cur_tree = cur_tree;
     params->check_depth = check_depth;
     params->top_eval = top_eval;
     params->alpha_coef = alpha_coef;
+    params->rand_seed = ThreadRand::get().next();
+
+    // candidate independent statistics of bag parts
+    NodeStatArray node_stats;
+    node_stats.reserve(bags.size());
 
-    // check add features
-    for(auto feature_it = feature_rows.begin();
-      feature_it != feature_rows.end();
-      ++feature_it, ++feature_i)
     {
-      if(task_runner)
-      {
-        Gears::Task_var task = new GetBestFeatureTask<ThisType, GainType>(
-          result,
-          params,
-          feature_it->first,
-          feature_it->second);
+      GainType gain_calc;
 
-        task_runner->enqueue_task(task);
-      }
-      else
+      for(auto bag_it = bags.begin(); bag_it != bags.end(); ++bag_it)
       {
-        PredCollector pred_collector;
-        GainType gain_calc;
+        NodeStat_var node_stat = new NodeStat();
+        fill_node_stat_(*node_stat, gain_calc, cur_tree, **bag_it);
+        node_stats.push_back(node_stat);
+      }
+    }
 
-        double gain;
-        LearnTreeHolder_var new_tree;
+    params->node_stats = &node_stats;
 
-        result->inc();
+    // data parallel mode: yes counts of all bundles for their
+    // base bags evaluated by shard workers (base bags are selected
+    // as by local check: model don't depend on workers usage)
+    ShardCounter* shard_counter = bag_part.bag_holder->row_holder->shard_counter.in();
 
-        check_feature_(
-          gain,
-          new_tree,
-          pred_collector,
-          gain_calc,
-          params->top_pred,
-          feature_it->first,
-          //feature_rows,
-          //feature_it->second,
-          bags,
-          gain_check_bags,
-          cur_tree,
-          //node_svm,
-          check_depth,
-          alpha_coef);
+    if(shard_counter && !shard_counter->count(bags, node_stats, params->rand_seed))
+    {
+      shard_counter = 0;
+    }
 
-        if(GAIN_TRACE)
-        {
-          Gears::ErrorStream ostr;
-          ostr << "GAIN FOR #" << feature_it->first << ": " << gain << std::endl;
-          std::cout << ostr.str() << std::endl;
-        }
+    params->shard_counter = shard_counter;
 
-        //gain += (-gain * GAIN_SHARE_PENALTY) + GAIN_ABS_PENALTY;
+    // check add features: one task per features bundle
+    if(screening && screening->top > 0 &&
+      bag_part.bag_holder->row_holder->features.size() > screening->top)
+    {
+      BundleFeaturesArray bundle_features;
 
-        result->set(gain, new_tree);
-      }
-    }
+      screen_features_<GainType>(
+        bundle_features,
+        *screening,
+        bag_part);
 
-    // check exchange trees
-    if(cur_tree)
+      check_bundles_on_workers<ThisType, GainType>(
+        result,
+        params,
+        task_runner,
+        *bag_part.bag_holder->row_holder,
+        &bundle_features);
+
+      if(screening->validate)
+      {
+        Gears::IntrusivePtr<GetBestFeatureResult<ThisType> > full_result =
+          new GetBestFeatureResult<ThisType>(
+            &skip_null_features,
+            allow_negative_gain);
+
+        check_bundles_on_workers<ThisType, GainType>(
+          full_result,
+          params,
+          task_runner,
+          *bag_part.bag_holder->row_holder,
+          0);
+
+        typename GetBestFeatureResult<ThisType>::BestChoose full_best_choose;
+
+        if(full_result->get_result(full_best_choose))
+        {
+          bool screened = false;
+          auto bundle_it = feature_bundles.begin();
+
+          for(auto bundle_features_it = bundle_features.begin();
+            bundle_features_it != bundle_features.end() && !screened;
+            ++bundle_features_it, ++bundle_it)
+          {
+            for(auto feature_it = bundle_features_it->begin();
+              feature_it != bundle_features_it->end(); ++feature_it)
+            {
+              if(bundle_it->features[*feature_it] == full_best_choose.feature_id)
+              {
+                screened = true;
+                break;
+              }
+            }
+          }
+
+          ++screening->checks;
+
+          if(!screened)
+          {
+            ++screening->misses;
+          }
+        }
+      }
+    }
+    else
+    {
+      check_bundles_on_workers<ThisType, GainType>(
+        result,
+        params,
+        task_runner,
+        *bag_part.bag_holder->row_holder,
+        0);
+    }
+
+    // check exchange trees
+    if(cur_tree)
     {
       for(auto branch_it = cur_tree->branches.begin();
         branch_it != cur_tree->branches.end(); ++branch_it)
@@ -1481,7 +2307,27 @@ namespace Vanga
       }
     }
 
-    result->wait(feature_rows.size());
+    if(sizeof(PredValue) < sizeof(double) && !result->best_features.empty())
+    {
+      // gains evaluated with preds rounded to float can change sign
+      // or order of close candidates: verify best features gains with
+      // double preds, reject features that don't pass gain threshold
+      // and select best features by verified gains
+      std::vector<double> verified_gains;
+      verified_gains.reserve(result->best_features.size());
+
+      for(auto best_it = result->best_features.begin();
+        best_it != result->best_features.end(); ++best_it)
+      {
+        verified_gains.push_back(verify_gain_<GainType>(
+          top_pred,
+          best_it->tree,
+          bags,
+          best_it->base_bag_i));
+      }
+
+      result->reset_gains(verified_gains);
+    }
 
     typename GetBestFeatureResult<ThisType>::BestChoose best_choose;
     if(result->get_result(best_choose))
@@ -1535,6 +2381,325 @@ namespace Vanga
     return new_tree; //best_feature_id;
   }
 
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_sample_part_(
+    BagPart_var& sample_part,
+    const BagPart& bag_part,
+    unsigned long rows)
+    throw()
+  {
+    // stratified by label groups: evenly spaced rows of each group
+    const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+    const double share = static_cast<double>(rows) / bag_part.size();
+
+    sample_part = new BagPart();
+    sample_part->bag_holder = bag_part.bag_holder;
+    sample_part->permutation = new RowPermutation();
+
+    RowIndexArray& sample_rows = sample_part->permutation->rows;
+    sample_rows.reserve(rows);
+
+    const uint32_t* rows_end = bag_part.rows_end();
+
+    for(const uint32_t* row_it = bag_part.rows_begin(); row_it != rows_end; )
+    {
+      unsigned long group_i;
+      const uint32_t* group_end_it = group_end_(group_i, row_holder, row_it, rows_end);
+
+      const unsigned long group_size = group_end_it - row_it;
+      const unsigned long group_sample_size = std::min(
+        group_size,
+        std::max(1ul, static_cast<unsigned long>(group_size * share + 0.5)));
+
+      for(unsigned long i = 0; i < group_sample_size; ++i)
+      {
+        sample_rows.push_back(row_it[i * group_size / group_sample_size]);
+      }
+
+      row_it = group_end_it;
+    }
+
+    sample_part->begin = 0;
+    sample_part->end = sample_rows.size();
+  }
+
+  template<typename LabelType>
+  template<typename GainType>
+  void
+  TreeLearner<LabelType>::screen_features_(
+    BundleFeaturesArray& bundle_features,
+    const FeatureScreening& screening,
+    const BagPart& bag_part)
+    throw()
+  {
+    // score features by newton gain of one split:
+    //   G_yes^2 / H_yes + G_no^2 / H_no - G^2 / H
+    // where G, H - sums of metric derivatives of node rows
+    const double HESS_REG = 1.0;
+
+    const BagPart* sample_part = &bag_part;
+    BagPart_var sample_part_holder;
+
+    if(screening.rows > 0 && bag_part.size() > screening.rows)
+    {
+      fill_sample_part_(sample_part_holder, bag_part, screening.rows);
+      sample_part = sample_part_holder;
+    }
+
+    // cells without branch masks: one cell per label group
+    NodeStat_var sample_stat = new NodeStat();
+
+    {
+      GainType gain_calc;
+      fill_node_stat_(*sample_stat, gain_calc, 0, *sample_part);
+    }
+
+    const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+
+    std::vector<std::pair<double, double> > cell_grads;
+    cell_grads.reserve(sample_stat->cells.size());
+
+    double sum_grad = 0.0;
+    double sum_hess = 0.0;
+    unsigned long sum_count = 0;
+
+    for(auto cell_it = sample_stat->cells.begin();
+      cell_it != sample_stat->cells.end(); ++cell_it)
+    {
+      double grad;
+      double hess;
+      GainType::grad_hess(grad, hess, row_holder.labels[cell_it->group]);
+      cell_grads.push_back(std::make_pair(grad, hess));
+      sum_grad += grad * cell_it->count;
+      sum_hess += hess * cell_it->count;
+      sum_count += cell_it->count;
+    }
+
+    const double base_score = sum_grad * sum_grad / (sum_hess + HESS_REG);
+
+    // (score, (bundle index, feature index))
+    std::vector<std::pair<double, std::pair<uint32_t, uint32_t> > > feature_scores;
+    feature_scores.reserve(row_holder.features.size());
+
+    std::vector<std::pair<uint64_t, unsigned long> > bundle_yes_counts;
+    std::vector<std::pair<double, double> > feature_grads;
+    std::vector<unsigned long> feature_counts;
+    uint32_t bundle_i = 0;
+
+    for(auto bundle_it = row_holder.feature_bundles.begin();
+      bundle_it != row_holder.feature_bundles.end(); ++bundle_it, ++bundle_i)
+    {
+      bundle_yes_counts.clear();
+
+      fill_bundle_yes_counts_(
+        bundle_yes_counts,
+        *bundle_it,
+        *sample_part,
+        *sample_stat);
+
+      std::sort(bundle_yes_counts.begin(), bundle_yes_counts.end());
+
+      // (yes grad, yes hess) and yes rows of bundle features
+      feature_grads.assign(bundle_it->features.size(), std::make_pair(0.0, 0.0));
+      feature_counts.assign(bundle_it->features.size(), 0);
+
+      for(auto bundle_yes_count_it = bundle_yes_counts.begin();
+        bundle_yes_count_it != bundle_yes_counts.end(); ++bundle_yes_count_it)
+      {
+        const std::pair<double, double>& cell_grad =
+          cell_grads[bundle_yes_count_it->first & 0xFFFFFFFF];
+        std::pair<double, double>& feature_grad =
+          feature_grads[bundle_yes_count_it->first >> 32];
+        feature_grad.first += cell_grad.first * bundle_yes_count_it->second;
+        feature_grad.second += cell_grad.second * bundle_yes_count_it->second;
+        feature_counts[bundle_yes_count_it->first >> 32] += bundle_yes_count_it->second;
+      }
+
+      if(bundle_it->numeric)
+      {
+        // threshold feature contains rows of its bin and all upper bins
+        for(unsigned long feature_i = feature_grads.size() - 1; feature_i > 0; --feature_i)
+        {
+          feature_grads[feature_i - 1].first += feature_grads[feature_i].first;
+          feature_grads[feature_i - 1].second += feature_grads[feature_i].second;
+          feature_counts[feature_i - 1] += feature_counts[feature_i];
+        }
+      }
+
+      for(uint64_t feature_i = 0; feature_i < bundle_it->features.size(); ++feature_i)
+      {
+        if(feature_counts[feature_i] == 0 || feature_counts[feature_i] == sum_count)
+        {
+          // feature doesn't divide sample rows: its score (0) is above
+          // scores of real splits reduced by HESS_REG in almost pure nodes
+          continue;
+        }
+
+        const double yes_grad = feature_grads[feature_i].first;
+        const double yes_hess = feature_grads[feature_i].second;
+        const double no_grad = sum_grad - yes_grad;
+        const double no_hess = std::max(sum_hess - yes_hess, 0.0);
+
+        const double score = yes_grad * yes_grad / (yes_hess + HESS_REG) +
+          no_grad * no_grad / (no_hess + HESS_REG) - base_score;
+
+        feature_scores.push_back(std::make_pair(
+          score,
+          std::make_pair(bundle_i, static_cast<uint32_t>(feature_i))));
+      }
+    }
+
+    // select top features
+    const unsigned long top = std::min(
+      screening.top,
+      static_cast<unsigned long>(feature_scores.size()));
+
+    std::nth_element(
+      feature_scores.begin(),
+      feature_scores.begin() + top,
+      feature_scores.end(),
+      std::greater<std::pair<double, std::pair<uint32_t, uint32_t> > >());
+
+    bundle_features.resize(row_holder.feature_bundles.size());
+
+    for(auto score_it = feature_scores.begin();
+      score_it != feature_scores.begin() + top; ++score_it)
+    {
+      bundle_features[score_it->second.first].push_back(score_it->second.second);
+    }
+
+    for(auto bundle_features_it = bundle_features.begin();
+      bundle_features_it != bundle_features.end(); ++bundle_features_it)
+    {
+      std::sort(bundle_features_it->begin(), bundle_features_it->end());
+    }
+  }
+
+  template<typename LabelType>
+  template<typename GainType>
+  void
+  TreeLearner<LabelType>::check_bundle_(
+    FeatureGainArray& res_gains,
+    PredCollector& pred_collector,
+    GainType& gain_calc,
+    double top_pred,
+    const FeatureBundle& bundle,
+    unsigned long bundle_i,
+    const RowIndexArray* bundle_features,
+    const BagPartArray& bags,
+    const NodeStatArray& node_stats,
+    const ShardCounter* shard_counter,
+    unsigned long gain_check_bags,
+    LearnTreeHolder* cur_tree,
+    unsigned long check_depth,
+    double alpha_coef)
+    throw()
+  {
+    // base bag is selected once for all bundle features:
+    // bundle rows scanned once, gains evaluated per feature
+    // (yes counts already evaluated by shard workers if counter defined,
+    // for the same base bag)
+    const unsigned long base_bag_i = ThreadRand::rand(bags.size());
+    const NodeStat& base_node_stat = *node_stats[base_bag_i];
+
+    YesCountArray bundle_yes_counts;
+
+    if(shard_counter)
+    {
+      assert(shard_counter->bundle_bag_i(bundle_i) == base_bag_i);
+      shard_counter->get_yes_counts(bundle_yes_counts, bundle_i);
+    }
+    else
+    {
+      fill_bundle_yes_counts_(
+        bundle_yes_counts,
+        bundle,
+        *bags[base_bag_i],
+        base_node_stat);
+    }
+
+    std::sort(bundle_yes_counts.begin(), bundle_yes_counts.end());
+
+    Gears::IntrusivePtr<BufferPtr<uint64_t> > yes_counts_holder =
+      BufferProvider<uint64_t>::instance().get(base_node_stat.cells.size());
+
+    auto& yes_counts = yes_counts_holder->buf();
+
+    const unsigned long check_features_number = bundle_features ?
+      bundle_features->size() : bundle.features.size();
+
+    res_gains.resize(check_features_number);
+
+    auto bundle_yes_count_it = bundle_yes_counts.begin();
+
+    // threshold features of numeric bundle checked from last bin:
+    // yes counts accumulated over bins (histogram scan)
+    auto bundle_yes_count_rit = bundle_yes_counts.rbegin();
+
+    if(bundle.numeric)
+    {
+      yes_counts.assign(base_node_stat.cells.size(), 0);
+    }
+
+    for(unsigned long check_i = 0; check_i < check_features_number; ++check_i)
+    {
+      const unsigned long check_feature_i = bundle.numeric ?
+        check_features_number - check_i - 1 : check_i;
+      const uint64_t feature_i = bundle_features ?
+        (*bundle_features)[check_feature_i] : check_feature_i;
+
+      if(bundle.numeric)
+      {
+        for(; bundle_yes_count_rit != bundle_yes_counts.rend() &&
+          (bundle_yes_count_rit->first >> 32) >= feature_i;
+          ++bundle_yes_count_rit)
+        {
+          yes_counts[bundle_yes_count_rit->first & 0xFFFFFFFF] +=
+            bundle_yes_count_rit->second;
+        }
+      }
+      else
+      {
+        yes_counts.assign(base_node_stat.cells.size(), 0);
+
+        while(bundle_yes_count_it != bundle_yes_counts.end() &&
+          (bundle_yes_count_it->first >> 32) < feature_i)
+        {
+          ++bundle_yes_count_it;
+        }
+
+        for(; bundle_yes_count_it != bundle_yes_counts.end() &&
+          (bundle_yes_count_it->first >> 32) == feature_i;
+          ++bundle_yes_count_it)
+        {
+          yes_counts[bundle_yes_count_it->first & 0xFFFFFFFF] +=
+            bundle_yes_count_it->second;
+        }
+      }
+
+      FeatureGain& feature_gain = res_gains[check_feature_i];
+      feature_gain.feature_id = bundle.features[feature_i];
+      feature_gain.base_bag_i = base_bag_i;
+
+      check_feature_(
+        feature_gain.gain,
+        feature_gain.tree,
+        pred_collector,
+        gain_calc,
+        top_pred,
+        feature_gain.feature_id,
+        bags,
+        node_stats,
+        base_bag_i,
+        yes_counts,
+        gain_check_bags,
+        cur_tree,
+        check_depth,
+        alpha_coef);
+    }
+  }
+
   template<typename LabelType>
   template<typename GainType>
   void
@@ -1548,6 +2713,9 @@ namespace Vanga
     //const FeatureRowsMap& feature_rows,
     //const SVM<LabelType>* feature_svm,
     const BagPartArray& bags,
+    const NodeStatArray& node_stats,
+    unsigned long base_bag_i,
+    const CellCountArray& yes_counts,
     unsigned long gain_check_bags,
     LearnTreeHolder* cur_tree,
     //const SVM<LabelType>* node_svm,
@@ -1555,6 +2723,10 @@ namespace Vanga
     double /*alpha_coef*/)
     throw()
   {
+    ProfileScope profile_scope(
+      Profiler::P_CHECK_FEATURE,
+      bags[base_bag_i]->size());
+
     double sub_gain = eval_feature_gain_on_bags_(
       new_tree,
       pred_collector,
@@ -1562,6 +2734,9 @@ namespace Vanga
       top_pred,
       feature_id,
       bags,
+      node_stats,
+      base_bag_i,
+      yes_counts,
       cur_tree,
       gain_check_bags
       );
@@ -1586,23 +2761,6 @@ namespace Vanga
     //*/
   }
 
-  template<typename LabelType>
-  struct SVMIterate
-  {
-    unsigned int feature_index;
-    const SVM<LabelType>* svm;
-    typename SVM<LabelType>::PredictGroupArray::const_iterator it;
-  };
-
-  struct MaskPred
-  {
-    MaskPred(): count(0) 
-    {}
-
-    unsigned long count;
-    double pred;
-  };
-
   struct FeatureDelta
   {
     bool
@@ -1618,6 +2776,140 @@ namespace Vanga
 
   typedef std::vector<FeatureDelta> FeatureDeltaArray;
 
+  template<typename LabelType>
+  template<typename GainType>
+  void
+  TreeLearner<LabelType>::fill_node_stat_(
+    NodeStat& node_stat,
+    GainType& gain_calc,
+    const LearnTreeHolder* cur_tree,
+    const BagPart& bag_part)
+    throw()
+  {
+    if(cur_tree)
+    {
+      for(auto branch_it = cur_tree->branches.begin();
+        branch_it != cur_tree->branches.end(); ++branch_it)
+      {
+        node_stat.features.push_back(branch_it->feature_id);
+      }
+
+      std::sort(node_stat.features.begin(), node_stat.features.end());
+    }
+
+    const BagHolder& bag_holder = *bag_part.bag_holder;
+    const RowHolder& row_holder = *bag_holder.row_holder;
+    const uint32_t* rows_begin = bag_part.rows_begin();
+    const uint32_t* rows_end = bag_part.rows_end();
+
+    // fill node row masks: bit per branch feature
+    Gears::IntrusivePtr<BufferPtr<uint64_t> > row_masks =
+      BufferProvider<uint64_t>::instance().get(bag_part.size());
+
+    auto& mask_buf = row_masks->buf();
+    mask_buf.resize(bag_part.size(), 0);
+
+    if(rows_begin != rows_end)
+    {
+      unsigned int feature_index = 0;
+      for(auto feature_it = node_stat.features.begin();
+        feature_it != node_stat.features.end(); ++feature_it, ++feature_index)
+      {
+        FeatureRows feature_rows;
+        if(find_feature_rows_(feature_rows, row_holder, *feature_it))
+        {
+          const uint64_t feature_mask = static_cast<uint64_t>(1) << feature_index;
+          const RowIndexRef& cur_feature_rows = feature_rows.rows;
+
+          auto feature_row_it = std::lower_bound(
+            cur_feature_rows.begin(),
+            cur_feature_rows.end(),
+            *rows_begin);
+          const uint32_t* row_it = rows_begin;
+          auto mask_it = mask_buf.begin();
+
+          while(row_it != rows_end &&
+            feature_row_it != cur_feature_rows.end())
+          {
+            if(*row_it < *feature_row_it)
+            {
+              ++row_it;
+              ++mask_it;
+            }
+            else if(*feature_row_it < *row_it)
+            {
+              ++feature_row_it;
+            }
+            else
+            {
+              if(feature_rows.yes(feature_row_it))
+              {
+                *mask_it = *mask_it | feature_mask;
+              }
+
+              ++row_it;
+              ++mask_it;
+              ++feature_row_it;
+            }
+          }
+        }
+      }
+    }
+
+    // collapse masks to cells inside label groups
+    // and eval current metric
+    const uint64_t masks_number = static_cast<uint64_t>(1) << node_stat.features.size();
+    Gears::IntrusivePtr<BufferPtr<uint64_t> > mask_cells =
+      BufferProvider<uint64_t>::instance().get(masks_number);
+
+    // cell index + 1 by mask for current group
+    auto& mask_cell_buf = mask_cells->buf();
+    mask_cell_buf.resize(masks_number, 0);
+
+    node_stat.row_cells.resize(bag_part.size());
+
+    gain_calc.start_metric_eval();
+
+    for(const uint32_t* row_it = rows_begin; row_it != rows_end; )
+    {
+      unsigned long group_i;
+      const uint32_t* group_end_it = group_end_(group_i, row_holder, row_it, rows_end);
+      const unsigned long group_cells_begin = node_stat.cells.size();
+
+      auto mask_it = mask_buf.begin() + (row_it - rows_begin);
+      auto row_cell_it = node_stat.row_cells.begin() + (row_it - rows_begin);
+
+      for(const uint32_t* group_row_it = row_it; group_row_it != group_end_it;
+        ++group_row_it, ++mask_it, ++row_cell_it)
+      {
+        uint64_t& cell = mask_cell_buf[*mask_it];
+
+        if(cell == 0)
+        {
+          node_stat.cells.push_back(GroupMaskCount(group_i, *mask_it, 0));
+          cell = node_stat.cells.size();
+        }
+
+        node_stat.cells[cell - 1].count += bag_holder.row_counts[*group_row_it];
+        *row_cell_it = cell - 1;
+      }
+
+      for(auto cell_it = node_stat.cells.begin() + group_cells_begin;
+        cell_it != node_stat.cells.end(); ++cell_it)
+      {
+        mask_cell_buf[cell_it->mask] = 0;
+      }
+
+      gain_calc.add_metric_eval(
+        row_holder.labels[group_i],
+        rows_count_(bag_holder, row_it, group_end_it));
+
+      row_it = group_end_it;
+    }
+
+    node_stat.metric = gain_calc.metric_result();
+  }
+
   template<typename LabelType>
   template<typename GainType>
   double
@@ -1628,9 +2920,9 @@ namespace Vanga
     double add_delta,
     const LearnTreeHolder* cur_tree,
     unsigned long add_feature_id,
-    //const OrderedFeatureArray& features,
-    const FeatureRowsMap& feature_rows,
-    const SVM<LabelType>* node_svm)
+    const BagPart& bag_part,
+    const NodeStat& node_stat,
+    const CellCountArray& yes_counts)
     throw()
   {
     assert(!std::isnan(add_delta));
@@ -1689,145 +2981,70 @@ namespace Vanga
       features.begin()->yes_delta = EMPTY_DELTA + add_delta;
     }
 
-    std::sort(features.begin(), features.end());
+    // keep branch features in node_stat.features order,
+    // added feature placed before equal branch feature
+    std::sort(features.begin() + 1, features.end());
 
-    // p = SUM(label) / <rows number>
-    // eval p
-    // fetch feature rows & fetch node rows
-    double old_metric;
+    const unsigned long add_feature_index = std::lower_bound(
+      node_stat.features.begin(),
+      node_stat.features.end(),
+      add_feature_id) - node_stat.features.begin();
+
+    std::rotate(
+      features.begin(),
+      features.begin() + 1,
+      features.begin() + 1 + add_feature_index);
+
+    const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+
+    // yes side counted directly, no side is cell count minus yes side
+    GroupMaskCountArray group_mask_counts;
+    group_mask_counts.reserve(node_stat.cells.size() * 2);
 
     {
-      // eval current metric
-      gain_calc.start_metric_eval();
+      const uint64_t add_feature_mask = static_cast<uint64_t>(1) << add_feature_index;
+      const uint64_t low_mask = add_feature_mask - 1;
 
-      for(auto node_group_it = node_svm->grouped_rows.begin();
-        node_group_it != node_svm->grouped_rows.end();
-        ++node_group_it)
+      auto yes_count_it = yes_counts.begin();
+      for(auto cell_it = node_stat.cells.begin();
+        cell_it != node_stat.cells.end(); ++cell_it, ++yes_count_it)
       {
-        gain_calc.add_metric_eval(
-          (*node_group_it)->label,
-          (*node_group_it)->rows.size());
-      }
+        const uint64_t no_mask = (cell_it->mask & low_mask) |
+          ((cell_it->mask & ~low_mask) << 1);
 
-      old_metric = gain_calc.metric_result();
+        if(cell_it->count > *yes_count_it)
+        {
+          group_mask_counts.push_back(GroupMaskCount(
+            cell_it->group,
+            no_mask,
+            cell_it->count - *yes_count_it));
+        }
+
+        if(*yes_count_it > 0)
+        {
+          group_mask_counts.push_back(GroupMaskCount(
+            cell_it->group,
+            no_mask | add_feature_mask,
+            *yes_count_it));
+        }
+      }
     }
 
+    const double old_metric = node_stat.metric;
+
     pred_collector.start_delta_eval(features.size(), add_delta);
 
+    for(auto group_mask_it = group_mask_counts.begin();
+      group_mask_it != group_mask_counts.end(); ++group_mask_it)
     {
-      std::vector<SVMIterate<LabelType> > feature_svm_poses;
-      unsigned int feature_index = 0;
-      for(auto feature_it = features.begin();
-        feature_it != features.end(); ++feature_it, ++feature_index)
-      {
-        auto feature_rows_it = feature_rows.find(feature_it->feature_id);
-        if(feature_rows_it != feature_rows.end())
-        {
-          SVMIterate<LabelType> svm_it;
-          svm_it.feature_index = feature_index;
-          svm_it.svm = feature_rows_it->second;
-          svm_it.it = feature_rows_it->second->grouped_rows.begin();
-          feature_svm_poses.push_back(svm_it);
-        }
-      }
-
-      for(auto node_group_it = node_svm->grouped_rows.begin();
-        node_group_it != node_svm->grouped_rows.end();
-        ++node_group_it)
-      {
-        Gears::IntrusivePtr<BufferPtr<uint64_t> > row_masks =
-          BufferProvider<uint64_t>::instance().get();
-
-        row_masks->buf().resize((*node_group_it)->rows.size(), 0);
-
-        for(auto feature_pos_it = feature_svm_poses.begin();
-          feature_pos_it != feature_svm_poses.end();
-          ++feature_pos_it)
-        {
-          const uint64_t feature_mask =
-            static_cast<uint64_t>(1) << feature_pos_it->feature_index;
-
-          while(feature_pos_it->it != feature_pos_it->svm->grouped_rows.end() &&
-            (*feature_pos_it->it)->label < (*node_group_it)->label)
-          {
-            ++(feature_pos_it->it);
-          }
-
-          if(feature_pos_it->it != feature_pos_it->svm->grouped_rows.end() &&
-             !((*node_group_it)->label < (*feature_pos_it->it)->label))
-          {
-            // node_group_it->label == (*feature_pos_it)->it->label
-            // cross rows in this group for up bit in masks
-            const RowArray& cur_feature_rows = (*feature_pos_it->it)->rows;
-
-            auto row_it = (*node_group_it)->rows.begin();
-            auto row_end_it = (*node_group_it)->rows.end();
-            auto mask_it = row_masks->buf().begin();
-            auto feature_row_it = cur_feature_rows.begin();
-
-            while(row_it != row_end_it &&
-              feature_row_it != cur_feature_rows.end())
-            {
-              if(*row_it < *feature_row_it)
-              {
-                ++row_it;
-                ++mask_it;
-              }
-              else if(*feature_row_it < *row_it)
-              {
-                ++feature_row_it;
-              }
-              else
-              {
-                *mask_it = *mask_it | feature_mask;
-                ++row_it;
-                ++mask_it;
-                ++feature_row_it;
-              }
-            }
-          }
-        }
-
-        Gears::IntrusivePtr<BufferPtr<unsigned long> > mask_counts =
-          BufferProvider<uint64_t>::instance().get();
-
-        auto& mask_buf = row_masks->buf();
-        auto& mask_count_buf = mask_counts->buf();
-        mask_count_buf.resize(static_cast<uint64_t>(1) << features.size(), 0);
-
-        for(auto mask_it = mask_buf.begin(); mask_it != mask_buf.end(); ++mask_it)
-        {
-          mask_count_buf[*mask_it] += 1;
-        }
-
-        uint64_t mask_i = 0;
-        for(auto mask_count_it = mask_count_buf.begin();
-          mask_count_it != mask_count_buf.end();
-          ++mask_count_it, ++mask_i)
-        {
-          if(*mask_count_it > 0)
-          {
-            pred_collector.add_delta_eval(
-              mask_i,
-              (*node_group_it)->label,
-              *mask_count_it);
-          }
-        }
-      }
+      pred_collector.add_delta_eval(
+        group_mask_it->mask,
+        row_holder.labels[group_mask_it->group],
+        group_mask_it->count);
     }
 
     pred_collector.fin_delta_eval();
 
-    // eval new metrics
-    /*
-    FloatArray yes_deltas(features.size(), 0.0); //add_delta);
-    FloatArray no_deltas(features.size(), 0.0); //add_delta);
-    */
-
-    // use add_delta as start point of search
-    //FloatArray yes_deltas(features.size(), add_delta);
-    //FloatArray no_deltas(features.size(), add_delta);
-
     double min_gain = 100000000.0;
 
     for(int mode_i = 0; mode_i < 3; ++mode_i)
@@ -1842,8 +3059,8 @@ namespace Vanga
         const double MAX_NOISE = 8.0; // 1 / (1 + e(-8)) = 0.99966
         for(unsigned long i = 0; i < features.size(); ++i)
         {
-          yes_deltas[i] += MAX_NOISE * (Gears::safe_rand(200000) - 100000) / 200000;
-          no_deltas[i] += MAX_NOISE * (Gears::safe_rand(200000) - 100000) / 200000;
+          yes_deltas[i] += MAX_NOISE * (ThreadRand::rand(200000) - 100000) / 200000;
+          no_deltas[i] += MAX_NOISE * (ThreadRand::rand(200000) - 100000) / 200000;
         }
       }
 
@@ -1863,143 +3080,31 @@ namespace Vanga
 
       gain_calc.delta_result(yes_deltas, no_deltas, pred_collector);
 
-      /*
-      for(auto delta_it = yes_deltas.begin(); delta_it != yes_deltas.end(); ++delta_it)
-      {
-        *delta_it += add_delta;
-      }
-
-      for(auto delta_it = no_deltas.begin(); delta_it != no_deltas.end(); ++delta_it)
-      {
-        *delta_it += add_delta;
-      }
-      */
-
-      Gears::IntrusivePtr<BufferPtr<MaskPred> > mask_preds =
-        BufferProvider<MaskPred>::instance().get();
-
       gain_calc.start_metric_eval();
 
+      for(auto group_mask_it = group_mask_counts.begin();
+        group_mask_it != group_mask_counts.end(); ++group_mask_it)
       {
-        std::vector<SVMIterate<LabelType> > feature_svm_poses;
-        unsigned int feature_index = 0;
-        for(auto feature_it = features.begin();
-          feature_it != features.end(); ++feature_it, ++feature_index)
-        {
-          auto feature_rows_it = feature_rows.find(feature_it->feature_id);
-          if(feature_rows_it != feature_rows.end())
-          {
-            SVMIterate<LabelType> svm_it;
-            svm_it.feature_index = feature_index;
-            svm_it.svm = feature_rows_it->second;
-            svm_it.it = feature_rows_it->second->grouped_rows.begin();
-            feature_svm_poses.push_back(svm_it);
-          }
-        }
-
-        for(auto node_group_it = node_svm->grouped_rows.begin();
-          node_group_it != node_svm->grouped_rows.end();
-          ++node_group_it)
+        double cur_pred = add_delta;
+        uint64_t mask = group_mask_it->mask;
+        for(unsigned long feature_index = 0;
+          feature_index < features.size(); ++feature_index)
         {
-          Gears::IntrusivePtr<BufferPtr<uint64_t> > row_masks =
-            BufferProvider<uint64_t>::instance().get();
-
-          auto& mask_buf = row_masks->buf();
-          mask_buf.resize((*node_group_it)->rows.size(), 0);
-
-          for(auto feature_pos_it = feature_svm_poses.begin();
-            feature_pos_it != feature_svm_poses.end();
-            ++feature_pos_it)
+          if(mask & 1)
           {
-            const uint64_t feature_mask =
-              static_cast<uint64_t>(1) << feature_pos_it->feature_index;
-
-            while(feature_pos_it->it != feature_pos_it->svm->grouped_rows.end() &&
-              (*feature_pos_it->it)->label < (*node_group_it)->label)
-            {
-              ++(feature_pos_it->it);
-            }
-
-            if(feature_pos_it->it != feature_pos_it->svm->grouped_rows.end() &&
-               !((*node_group_it)->label < (*feature_pos_it->it)->label))
-            {
-              // node_group_it->label == (*feature_pos_it)->it->label
-              // cross rows in this group for up bit in masks
-              const RowArray& cur_feature_rows = (*feature_pos_it->it)->rows;
-
-              auto row_it = (*node_group_it)->rows.begin();
-              auto mask_it = mask_buf.begin();
-              auto feature_row_it = cur_feature_rows.begin();
-
-              while(row_it != (*node_group_it)->rows.end() &&
-                feature_row_it != cur_feature_rows.end())
-              {
-                if(*row_it < *feature_row_it)
-                {
-                  ++row_it;
-                  ++mask_it;
-                }
-                else if(*feature_row_it < *row_it)
-                {
-                  ++feature_row_it;
-                }
-                else
-                {
-                  *mask_it = *mask_it | feature_mask;
-                  ++row_it;
-                  ++mask_it;
-                  ++feature_row_it;
-                }
-              }
-            }
+            cur_pred += yes_deltas[feature_index];
           }
-
-          Gears::IntrusivePtr<BufferPtr<MaskPred> > mask_preds =
-            BufferProvider<MaskPred>::instance().get();
-
-          auto& mask_pred_buf = mask_preds->buf();
-          mask_pred_buf.resize(static_cast<uint64_t>(1) << features.size());
-
-          for(auto mask_it = mask_buf.begin(); mask_it != mask_buf.end(); ++mask_it)
+          else
           {
-            if(mask_pred_buf[*mask_it].count == 0)
-            {
-              // eval pred
-              double cur_pred = add_delta;
-              uint64_t mask = *mask_it;
-              for(unsigned long feature_index = 0;
-                feature_index < features.size(); ++feature_index)
-              {
-                if(mask & 1)
-                {
-                  cur_pred += yes_deltas[feature_index];
-                }
-                else
-                {
-                  cur_pred += no_deltas[feature_index];
-                }
-
-                mask = mask >> 1;
-              }
-
-              mask_pred_buf[*mask_it].pred = cur_pred;
-            }
-
-            mask_pred_buf[*mask_it].count += 1;
+            cur_pred += no_deltas[feature_index];
           }
 
-          uint64_t mask_i = 0;
-          for(auto mask_pred_it = mask_pred_buf.begin(); mask_pred_it != mask_pred_buf.end();
-            ++mask_pred_it, ++mask_i)
-          {
-            if(mask_pred_it->count > 0)
-            {
-              gain_calc.add_metric_eval(
-                GainType::add_delta((*node_group_it)->label, mask_pred_it->pred),
-                mask_pred_it->count);
-            }
-          }
+          mask = mask >> 1;
         }
+
+        gain_calc.add_metric_eval(
+          GainType::add_delta(row_holder.labels[group_mask_it->group], cur_pred),
+          group_mask_it->count);
       }
 
       const double new_metric = gain_calc.metric_result();
@@ -2097,28 +3202,33 @@ namespace Vanga
     const typename LearnTreeHolder::Branch& branch)
     throw()
   {
-    unsigned long base_bag_i = Gears::safe_rand(bags.size());
+    const LearnRevertPredictor<TreeLearner<LabelType>, GainType> revert_predictor(branch);
+
+    unsigned long base_bag_i = ThreadRand::rand(bags.size());
     const BagPart& base_bag_part = *bags[base_bag_i];
 
+    LabelCountArray node_labels;
+    node_labels_(node_labels, base_bag_part);
+
     double unused_delta;
     double base_gain = eval_init_delta_(
       unused_delta,
       pred_collector,
       gain_calc,
       add_delta,
-      base_bag_part.svm,
+      node_labels,
       LabelType(),
       false);
 
-    SVM_var rem_svm = base_bag_part.svm->copy_pred(
-      LearnRevertPredictor<TreeLearner<LabelType>, GainType>(branch));
+    LabelCountArray rem_labels;
+    node_labels_(rem_labels, base_bag_part, revert_predictor);
 
     double rem_gain = eval_init_delta_(
       delta,
       pred_collector,
       gain_calc,
       add_delta,
-      rem_svm,
+      rem_labels,
       LabelType(),
       true);
 
@@ -2132,24 +3242,27 @@ namespace Vanga
 
     for(auto bag_it = bags.begin(); bag_it != bags.end(); ++bag_it, ++bag_i)
     {
+      node_labels.clear();
+      node_labels_(node_labels, **bag_it);
+
       base_gain = eval_init_delta_(
         unused_delta,
         pred_collector,
         gain_calc,
         add_delta,
-        (*bag_it)->svm,
+        node_labels,
         LabelType(),
         false);
 
-      rem_svm = (*bag_it)->svm->copy_pred(
-        LearnRevertPredictor<TreeLearner<LabelType>, GainType>(branch));
+      rem_labels.clear();
+      node_labels_(rem_labels, **bag_it, revert_predictor);
 
       rem_gain = eval_init_delta_(
         unused_delta,
         pred_collector,
         gain_calc,
         add_delta + delta,
-        rem_svm,
+        rem_labels,
         LabelType(),
         true);
 
@@ -2169,36 +3282,19 @@ namespace Vanga
     double add_delta,
     unsigned long feature_id,
     const BagPartArray& bags, // bags already labeled by cur_tree ?
+    const NodeStatArray& node_stats,
+    unsigned long base_bag_i,
+    const CellCountArray& yes_counts,
     LearnTreeHolder* cur_tree,
     unsigned long gain_check_bags)
     throw()
   {
     // eval feature gain for optimal node direct childs delta search
-    // if new node with feature_id added
+    // if new node with feature_id added,
+    // yes_counts: feature rows by cells of base bag
     //
-    unsigned long base_bag_i = Gears::safe_rand(bags.size());
     const BagPart& base_bag_part = *bags[base_bag_i];
 
-    auto feature_it = base_bag_part.bag_holder->feature_rows.find(feature_id);
-    if(feature_it == base_bag_part.bag_holder->feature_rows.end())
-    {
-      return 0.0;
-    }
-
-    OrderedFeatureArray eval_features;
-
-    eval_features.push_back(feature_id);
-    if(cur_tree)
-    {
-      for(auto branch_it = cur_tree->branches.begin();
-        branch_it != cur_tree->branches.end(); ++branch_it)
-      {
-        eval_features.push_back(branch_it->feature_id);
-      }
-    }
-
-    std::sort(eval_features.begin(), eval_features.end());
-
     double base_gain = eval_feature_gain_(
       new_tree,
       pred_collector,
@@ -2206,9 +3302,9 @@ namespace Vanga
       add_delta,
       cur_tree,
       feature_id,
-      //eval_features,
-      base_bag_part.bag_holder->feature_rows,
-      base_bag_part.svm);
+      base_bag_part,
+      *node_stats[base_bag_i],
+      yes_counts);
 
     //std::cerr << "base_gain = " << base_gain << std::endl;
     if(bags.size() == 1)
@@ -2230,7 +3326,7 @@ namespace Vanga
 
       for(unsigned long i = 0; i < gain_check_bags && !choose_bags.empty(); ++i)
       {
-        unsigned long check_bag_i = Gears::safe_rand(choose_bags.size());
+        unsigned long check_bag_i = ThreadRand::rand(choose_bags.size());
         check_bags_holder.push_back(Gears::add_ref(choose_bags[check_bag_i]));
         choose_bags.erase(choose_bags.begin() + check_bag_i);
       }
@@ -2245,20 +3341,15 @@ namespace Vanga
     {
       if(bag_i != base_bag_i)
       {
-        feature_it = (*bag_it)->bag_holder->feature_rows.find(feature_id);
-        if(feature_it != (*bag_it)->bag_holder->feature_rows.end())
-        {
-          const double local_gain = eval_feature_gain_by_delta_(
-            gain_calc,
-            add_delta,
-            new_tree,
-            (*bag_it)->svm,
-            (*bag_it)->bag_holder->feature_rows);
+        const double local_gain = eval_feature_gain_by_delta_(
+          gain_calc,
+          add_delta,
+          new_tree,
+          **bag_it);
 
-          //std::cerr << "GAIN bag #" << bag_i << " = " << local_gain << std::endl;
+        //std::cerr << "GAIN bag #" << bag_i << " = " << local_gain << std::endl;
 
-          sum_gain += local_gain;
-        }
+        sum_gain += local_gain;
       }
       else if(SELF_CHECK_)
       {
@@ -2266,8 +3357,7 @@ namespace Vanga
           gain_calc,
           add_delta,
           new_tree,
-          (*bag_it)->svm,
-          (*bag_it)->bag_holder->feature_rows);
+          **bag_it);
 
         //std::cerr << "GAIN CHECK, base_gain = " << base_gain << ", local_gain = " << local_gain << std::endl;
         assert(std::abs(local_gain - base_gain) < 0.01);
@@ -2287,6 +3377,8 @@ namespace Vanga
     const SVM<LabelType>& svm)
     throw()
   {
+    ProfileScope profile_scope(Profiler::P_FILL_FEATURE_ROWS);
+
     std::deque<unsigned long> features_queue;
 
     unsigned long row_i = 0;
@@ -2331,139 +3423,1057 @@ namespace Vanga
 
     features.reserve(features_queue.size());
     std::copy(features_queue.begin(), features_queue.end(), std::back_inserter(features));
+
+    profile_scope.add_rows(row_i);
   }
 
   template<typename LabelType>
-  typename TreeLearner<LabelType>::Context_var
-  TreeLearner<LabelType>::create_context(const SVMArray& svm_array)
+  void
+  TreeLearner<LabelType>::row_holder_memory_usage_(
+    MemoryUsage& usage,
+    const RowHolder& row_holder)
+    throw()
   {
-    BagPartArray bag_parts;
-    for(auto svm_it = svm_array.begin(); svm_it != svm_array.end(); ++svm_it)
+    usage.add(
+      "feature_rows",
+      sizeof(RowHolder) +
+      MemoryUsage::vector_bytes(row_holder.features) +
+      MemoryUsage::hash_map_bytes(row_holder.feature_rows));
+
+    usage.add(
+      "row_index_data",
+      MemoryUsage::vector_bytes(row_holder.row_index_data));
+
+    if(row_holder.row_index_file)
     {
-      BagHolder_var new_bag_holder = new BagHolder();
-      new_bag_holder->bag = *svm_it;
-      TreeLearner::fill_feature_rows(
-        new_bag_holder->features,
-        new_bag_holder->feature_rows,
-        **svm_it);
+      // mapped, resident part is bounded by memory limit
+      usage.add("row_index_file", row_holder.row_index_file->size());
+    }
 
-      BagPart_var new_bag_part = new BagPart();
-      new_bag_part->bag_holder = new_bag_holder;
-      new_bag_part->svm = (*svm_it)->copy();
-      bag_parts.push_back(new_bag_part);
+    unsigned long bundles_bytes =
+      MemoryUsage::vector_bytes(row_holder.feature_bundles) +
+      MemoryUsage::vector_bytes(row_holder.bundle_block_ends) +
+      MemoryUsage::hash_map_bytes(row_holder.numeric_features);
+
+    for(auto bundle_it = row_holder.feature_bundles.begin();
+      bundle_it != row_holder.feature_bundles.end(); ++bundle_it)
+    {
+      bundles_bytes += MemoryUsage::vector_bytes(bundle_it->features);
     }
 
-    return new Context(bag_parts);
+    for(auto numeric_it = row_holder.numeric_features.begin();
+      numeric_it != row_holder.numeric_features.end(); ++numeric_it)
+    {
+      bundles_bytes += MemoryUsage::vector_bytes(numeric_it->second.thresholds);
+    }
+
+    usage.add("feature_bundles", bundles_bytes);
+
+    usage.add(
+      "row_holder_rows",
+      MemoryUsage::vector_bytes(row_holder.rows) +
+      MemoryUsage::vector_bytes(row_holder.labels) +
+      MemoryUsage::vector_bytes(row_holder.group_ends));
+
+    if(row_holder.svm)
+    {
+      // rows are shared with source svm
+      row_holder.svm->memory_usage(usage, false);
+    }
   }
 
-  /*
-  template<typename LabelType, typename GainType>
+  template<typename LabelType>
   void
-  TreeLearner<LabelType, GainType>::revert_bags_pred_(
-    BagPartArray& res_bag_parts,
-    const BagPartArray& bag_parts,
-    const typename LearnTreeHolder::Branch& branch)
+  TreeLearner<LabelType>::bag_parts_memory_usage_(
+    MemoryUsage& usage,
+    RowPermutationSet& permutations,
+    const char* part,
+    const BagPartArray& bag_parts)
+    throw()
   {
+    unsigned long bytes = bag_parts.size() * sizeof(BagPart);
+
     for(auto bag_it = bag_parts.begin(); bag_it != bag_parts.end(); ++bag_it)
     {
-      SVM_var res_svm = (*bag_it)->copy(LearnRevertPredictor(branch));
+      const RowPermutation* permutation = (*bag_it)->permutation.in();
 
-      BagPart_var bag_part = new BagPart();
-      bag_part->bag_holder = (*bag_it)->bag_holder;
-      bag_part->svm = res_svm;
-      res_bag_parts.push_back(bag_part);
+      if(permutation && permutations.insert(permutation).second)
+      {
+        bytes += sizeof(RowPermutation) +
+          MemoryUsage::vector_bytes(permutation->rows);
+      }
     }
+
+    usage.add(part, bytes);
   }
-  */
 
   template<typename LabelType>
   void
-  TreeLearner<LabelType>::div_bags_(
-    BagPartArray& yes_bag_parts,
-    BagPartArray& no_bag_parts,
-    const BagPartArray& bag_parts,
-    unsigned long feature_id)
+  TreeLearner<LabelType>::learn_tree_memory_usage_(
+    MemoryUsage& usage,
+    RowPermutationSet& permutations,
+    const LearnTreeHolder* tree)
+    throw()
   {
-    for(auto bag_it = bag_parts.begin(); bag_it != bag_parts.end(); ++bag_it)
+    usage.add(
+      "learn_tree",
+      sizeof(LearnTreeHolder) +
+      MemoryUsage::vector_bytes(tree->branches) +
+      MemoryUsage::vector_bytes(tree->bags));
+
+    bag_parts_memory_usage_(
+      usage,
+      permutations,
+      "learn_tree_bag_parts",
+      tree->bags);
+
+    for(auto branch_it = tree->branches.begin();
+      branch_it != tree->branches.end(); ++branch_it)
     {
-      SVM_var yes_svm;
-      SVM_var no_svm;
-      
-      div_rows_(
-        yes_svm,
-        no_svm,
-        feature_id,
-        (*bag_it)->svm,
-        (*bag_it)->bag_holder->feature_rows);
-
-      BagPart_var yes_bag_part = new BagPart();
-      yes_bag_part->bag_holder = (*bag_it)->bag_holder;
-      yes_bag_part->svm = yes_svm;
-      yes_bag_parts.push_back(yes_bag_part);
+      if(branch_it->yes_tree)
+      {
+        learn_tree_memory_usage_(usage, permutations, branch_it->yes_tree.in());
+      }
 
-      BagPart_var no_bag_part = new BagPart();
-      no_bag_part->bag_holder = (*bag_it)->bag_holder;
-      no_bag_part->svm = no_svm;
-      no_bag_parts.push_back(no_bag_part);
+      if(branch_it->no_tree)
+      {
+        learn_tree_memory_usage_(usage, permutations, branch_it->no_tree.in());
+      }
     }
   }
 
   template<typename LabelType>
   void
-  TreeLearner<LabelType>::div_rows_(
-    SVM_var& yes_svm,
-    SVM_var& no_svm,
-    unsigned long feature_id,
-    const SVM<LabelType>* div_svm,
-    const FeatureRowsMap& feature_rows)
+  TreeLearner<LabelType>::fill_row_holder_(
+    RowHolder& row_holder,
+    SVM<LabelType>* svm,
+    const ContextParams& params)
+    throw()
   {
-    auto feature_it = feature_rows.find(feature_id);
-    if(feature_it != feature_rows.end())
+    ProfileScope profile_scope(Profiler::P_FILL_FEATURE_ROWS);
+
+    std::deque<unsigned long> features_queue;
+    std::unordered_map<unsigned long, unsigned long> feature_offsets;
+
+    row_holder.svm = Gears::add_ref(svm);
+    row_holder.rows.reserve(svm->size());
+    row_holder.labels.reserve(svm->grouped_rows.size());
+    row_holder.group_ends.reserve(svm->grouped_rows.size());
+
+    // count feature rows: all row indexes placed in one array,
+    // first feature rows then bundle rows and bundle row features
+    unsigned long feature_rows_size = 0;
+
+    for(auto group_it = svm->grouped_rows.begin(); group_it != svm->grouped_rows.end(); ++group_it)
+    {
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it)
+      {
+        for(auto feature_it = (*row_it)->features.begin();
+          feature_it != (*row_it)->features.end(); ++feature_it)
+        {
+          auto ins = feature_offsets.insert(std::make_pair(feature_it->first, 0));
+          if(ins.second)
+          {
+            features_queue.push_back(feature_it->first);
+          }
+
+          ++ins.first->second;
+          ++feature_rows_size;
+        }
+      }
+    }
+
+    row_holder.row_index_data.resize(feature_rows_size * 3);
+
+    unsigned long offset = 0;
+    for(auto feature_it = features_queue.begin();
+      feature_it != features_queue.end(); ++feature_it)
     {
-      const SVM<LabelType>* feature_svm = feature_it->second;
-      SVM<LabelType>::cross(yes_svm, no_svm, div_svm, feature_svm);
-      assert(yes_svm->size() + no_svm->size() == div_svm->size());
+      unsigned long& feature_offset = feature_offsets[*feature_it];
+      const unsigned long feature_size = feature_offset;
+      row_holder.feature_rows[*feature_it] = RowIndexRef(
+        row_holder.row_index_data.data() + offset,
+        feature_size);
+      feature_offset = offset;
+      offset += feature_size;
     }
-    else
+
+    uint32_t row_i = 0;
+    for(auto group_it = svm->grouped_rows.begin(); group_it != svm->grouped_rows.end(); ++group_it)
     {
-      yes_svm = new SVM<LabelType>();
-      no_svm = div_svm->copy();
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it, ++row_i)
+      {
+        for(auto feature_it = (*row_it)->features.begin();
+          feature_it != (*row_it)->features.end(); ++feature_it)
+        {
+          row_holder.row_index_data[feature_offsets[feature_it->first]++] = row_i;
+        }
+
+        row_holder.rows.push_back(*row_it);
+
+        if(row_i > 0 && row_i % 100000 == 0)
+        {
+          std::cerr << row_i << " rows processed" << std::endl;
+        }
+      }
+
+      row_holder.labels.push_back((*group_it)->label);
+      row_holder.group_ends.push_back(row_i);
     }
+
+    row_holder.features.reserve(features_queue.size());
+    std::copy(
+      features_queue.begin(),
+      features_queue.end(),
+      std::back_inserter(row_holder.features));
+
+    fill_feature_bundles_(row_holder, params);
+
+    profile_scope.add_rows(row_holder.rows.size());
   }
 
   template<typename LabelType>
   void
-  TreeLearner<LabelType>::div_group_(
-    typename SVM<LabelType>::PredictGroup_var& yes_group,
-    typename SVM<LabelType>::PredictGroup_var& no_group,
-    unsigned long feature_id,
-    const PredictGroup<LabelType>* div_group,
-    const FeatureRowsMap& feature_rows)
+  TreeLearner<LabelType>::fill_feature_bundles_(
+    RowHolder& row_holder,
+    const ContextParams& params)
+    throw()
   {
-    auto feature_it = feature_rows.find(feature_id);
-    if(feature_it != feature_rows.end())
-    {
-      yes_group = new PredictGroup<LabelType>();
-      no_group = new PredictGroup<LabelType>();
+    // greedy bundling (features with larger support first)
+    // into bundles with rarely intersecting rows,
+    // numeric features get own bundles after it
+    std::vector<std::pair<unsigned long, unsigned long> > support_features;
+    support_features.reserve(row_holder.feature_rows.size());
 
-      std::set_intersection(
-        div_group->rows.begin(),
-        div_group->rows.end(),
-        feature_it->second.all_rows.begin(),
-        feature_it->second.all_rows.end(),
-        std::back_inserter(yes_group->rows));
+    FeatureIdArray numeric_features;
+
+    for(auto feature_it = row_holder.features.begin();
+      feature_it != row_holder.features.end(); ++feature_it)
+    {
+      if(params.numeric_features.find(*feature_it) != params.numeric_features.end())
+      {
+        numeric_features.push_back(*feature_it);
+        continue;
+      }
 
-      std::set_difference(
-        div_group->rows.begin(),
-        div_group->rows.end(),
-        feature_it->second.all_rows.begin(),
-        feature_it->second.all_rows.end(),
-        std::back_inserter(no_group->rows));
+      support_features.push_back(std::make_pair(
+        row_holder.feature_rows.find(*feature_it)->second.size(),
+        *feature_it));
     }
-    else
+
+    std::sort(support_features.begin(), support_features.end(),
+      std::greater<std::pair<unsigned long, unsigned long> >());
+
+    const unsigned long rows_number = row_holder.rows.size();
+
+    // rows mask and number of (row, feature) pairs of last bundles
+    struct OpenBundle
+    {
+      unsigned long bundle_i;
+      unsigned long size;
+      std::vector<bool> rows;
+    };
+
+    std::deque<OpenBundle> open_bundles;
+    std::vector<FeatureIdArray> bundle_features;
+
+    for(auto feature_it = support_features.begin();
+      feature_it != support_features.end(); ++feature_it)
     {
-      yes_group = SVM<LabelType>::PredictGroup_var();
-      no_group = Gears::add_ref(div_group);
+      const RowIndexRef& feature_rows =
+        row_holder.feature_rows.find(feature_it->second)->second;
+      const unsigned long max_conflicts = static_cast<unsigned long>(
+        BUNDLE_CONFLICT_SHARE * feature_rows.size());
+
+      OpenBundle* target_bundle = 0;
+
+      for(auto bundle_it = open_bundles.begin();
+        params.bundle_features && bundle_it != open_bundles.end() && !target_bundle;
+        ++bundle_it)
+      {
+        if(bundle_it->size + feature_rows.size() <= rows_number)
+        {
+          unsigned long conflicts = 0;
+
+          for(auto row_it = feature_rows.begin();
+            row_it != feature_rows.end() && conflicts <= max_conflicts; ++row_it)
+          {
+            if(bundle_it->rows[*row_it])
+            {
+              ++conflicts;
+            }
+          }
+
+          if(conflicts <= max_conflicts)
+          {
+            target_bundle = &*bundle_it;
+          }
+        }
+      }
+
+      if(!target_bundle)
+      {
+        if(open_bundles.size() >= BUNDLE_SEARCH_LIMIT)
+        {
+          open_bundles.pop_front();
+        }
+
+        open_bundles.push_back(OpenBundle());
+        target_bundle = &open_bundles.back();
+        target_bundle->bundle_i = bundle_features.size();
+        target_bundle->size = 0;
+        target_bundle->rows.resize(rows_number, false);
+        bundle_features.push_back(FeatureIdArray());
+      }
+
+      for(auto row_it = feature_rows.begin(); row_it != feature_rows.end(); ++row_it)
+      {
+        target_bundle->rows[*row_it] = true;
+      }
+
+      target_bundle->size += feature_rows.size();
+      bundle_features[target_bundle->bundle_i].push_back(feature_it->second);
     }
+
+    open_bundles.clear();
+
+    // fill (row, feature index) pairs ordered by row
+    row_holder.feature_bundles.resize(bundle_features.size() + numeric_features.size());
+
+    // bundle (rows, row features) placed after feature rows
+    uint32_t* bundle_data = row_holder.row_index_data.data() +
+      row_holder.row_index_data.size() / 3;
+
+    std::vector<uint64_t> bundle_rows;
+    auto res_bundle_it = row_holder.feature_bundles.begin();
+
+    for(auto bundle_it = bundle_features.begin();
+      bundle_it != bundle_features.end(); ++bundle_it, ++res_bundle_it)
+    {
+      bundle_rows.clear();
+
+      uint64_t feature_i = 0;
+      for(auto feature_it = bundle_it->begin(); feature_it != bundle_it->end();
+        ++feature_it, ++feature_i)
+      {
+        const RowIndexRef& feature_rows = row_holder.feature_rows.find(*feature_it)->second;
+
+        for(auto row_it = feature_rows.begin(); row_it != feature_rows.end(); ++row_it)
+        {
+          bundle_rows.push_back((static_cast<uint64_t>(*row_it) << 32) | feature_i);
+        }
+      }
+
+      std::sort(bundle_rows.begin(), bundle_rows.end());
+
+      res_bundle_it->features.swap(*bundle_it);
+      res_bundle_it->rows = RowIndexRef(bundle_data, bundle_rows.size());
+      res_bundle_it->row_features = RowIndexRef(
+        bundle_data + bundle_rows.size(),
+        bundle_rows.size());
+
+      for(auto row_it = bundle_rows.begin(); row_it != bundle_rows.end(); ++row_it)
+      {
+        bundle_data[row_it - bundle_rows.begin()] = *row_it >> 32;
+        bundle_data[bundle_rows.size() + (row_it - bundle_rows.begin())] =
+          *row_it & 0xFFFFFFFF;
+      }
+
+      bundle_data += 2 * bundle_rows.size();
+    }
+
+    for(auto feature_it = numeric_features.begin();
+      feature_it != numeric_features.end(); ++feature_it, ++res_bundle_it)
+    {
+      NumericFeature& numeric_feature = row_holder.numeric_features[*feature_it];
+      numeric_feature.bundle_i = res_bundle_it - row_holder.feature_bundles.begin();
+
+      fill_numeric_bundle_(
+        *res_bundle_it,
+        numeric_feature,
+        bundle_data,
+        row_holder,
+        *feature_it,
+        params.numeric_bins);
+
+      bundle_data += 2 * res_bundle_it->rows.size();
+    }
+
+    std::cerr << row_holder.features.size() << " features bundled into " <<
+      row_holder.feature_bundles.size() << " bundles";
+
+    if(!numeric_features.empty())
+    {
+      std::cerr << " (" << numeric_features.size() << " numeric)";
+    }
+
+    std::cerr << std::endl;
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_numeric_bundle_(
+    FeatureBundle& bundle,
+    NumericFeature& numeric_feature,
+    uint32_t* bundle_data,
+    const RowHolder& row_holder,
+    unsigned long feature_id,
+    unsigned long bins)
+    throw()
+  {
+    // bin bounds are values at quantile positions of sorted feature values
+    // (all distinct values if feature rows number less than bins)
+    const RowIndexRef& feature_rows = row_holder.feature_rows.find(feature_id)->second;
+
+    std::vector<float> values;
+    values.reserve(feature_rows.size());
+
+    for(auto row_it = feature_rows.begin(); row_it != feature_rows.end(); ++row_it)
+    {
+      values.push_back(numeric_feature_float(
+        row_holder.rows[*row_it]->features.get(feature_id).second));
+    }
+
+    std::vector<float> sorted_values(values);
+    std::sort(sorted_values.begin(), sorted_values.end());
+
+    std::vector<float>& thresholds = numeric_feature.thresholds;
+
+    for(unsigned long bin_i = 0; bin_i < bins; ++bin_i)
+    {
+      const float threshold = sorted_values[bin_i * sorted_values.size() / bins];
+
+      if(thresholds.empty() || thresholds.back() < threshold)
+      {
+        thresholds.push_back(threshold);
+      }
+    }
+
+    bundle.numeric = true;
+    bundle.features.reserve(thresholds.size());
+
+    for(uint64_t bin_i = 0; bin_i < thresholds.size(); ++bin_i)
+    {
+      bundle.features.push_back((bin_i << 32) | feature_id);
+    }
+
+    // feature rows sorted by row already
+    bundle.rows = RowIndexRef(bundle_data, feature_rows.size());
+    bundle.row_features = RowIndexRef(
+      bundle_data + feature_rows.size(),
+      feature_rows.size());
+
+    std::copy(feature_rows.begin(), feature_rows.end(), bundle_data);
+
+    for(auto value_it = values.begin(); value_it != values.end(); ++value_it)
+    {
+      bundle_data[feature_rows.size() + (value_it - values.begin())] =
+        std::upper_bound(thresholds.begin(), thresholds.end(), *value_it) -
+        thresholds.begin() - 1;
+    }
+  }
+
+  template<typename LabelType>
+  bool
+  TreeLearner<LabelType>::find_feature_rows_(
+    FeatureRows& feature_rows,
+    const RowHolder& row_holder,
+    unsigned long feature_id)
+    throw()
+  {
+    if(feature_id >> 32)
+    {
+      // threshold feature: rows of numeric bundle with bin >= threshold bin
+      auto numeric_it = row_holder.numeric_features.find(feature_id & 0xFFFFFFFF);
+
+      if(numeric_it == row_holder.numeric_features.end())
+      {
+        return false;
+      }
+
+      const FeatureBundle& bundle = row_holder.feature_bundles[numeric_it->second.bundle_i];
+      feature_rows.rows = bundle.rows;
+      feature_rows.bins = bundle.row_features.begin();
+      feature_rows.min_bin = feature_id >> 32;
+      return true;
+    }
+
+    auto feature_it = row_holder.feature_rows.find(feature_id);
+
+    if(feature_it == row_holder.feature_rows.end())
+    {
+      return false;
+    }
+
+    feature_rows.rows = feature_it->second;
+    feature_rows.bins = 0;
+    feature_rows.min_bin = 0;
+    return true;
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_dtree_branch_(
+    DTree::Branch& branch,
+    const RowHolder& row_holder,
+    unsigned long feature_id)
+    throw()
+  {
+    branch.feature_id = feature_id & 0xFFFFFFFF;
+
+    if(feature_id >> 32)
+    {
+      auto numeric_it = row_holder.numeric_features.find(branch.feature_id);
+      assert(numeric_it != row_holder.numeric_features.end());
+
+      const std::vector<float>& thresholds = numeric_it->second.thresholds;
+      branch.numeric = true;
+      branch.threshold = (feature_id >> 32) < thresholds.size() ?
+        thresholds[feature_id >> 32] :
+        std::numeric_limits<float>::infinity();
+    }
+  }
+
+  template<typename LabelType>
+  unsigned long
+  TreeLearner<LabelType>::learn_feature_id_(
+    const RowHolder& row_holder,
+    const DTree::Branch& branch)
+    throw()
+  {
+    // threshold that isn't bin bound replaced with next bin bound,
+    // numeric branch by not numeric feature checks feature presence
+    auto numeric_it = branch.numeric ?
+      row_holder.numeric_features.find(branch.feature_id) :
+      row_holder.numeric_features.end();
+
+    if(numeric_it == row_holder.numeric_features.end())
+    {
+      return branch.feature_id;
+    }
+
+    const std::vector<float>& thresholds = numeric_it->second.thresholds;
+    const uint64_t bin_i = std::lower_bound(
+      thresholds.begin(),
+      thresholds.end(),
+      branch.threshold) - thresholds.begin();
+
+    return (bin_i << 32) | branch.feature_id;
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_bundle_yes_counts_(
+    YesCountArray& yes_counts,
+    const FeatureBundle& bundle,
+    const BagPart& bag_part,
+    const NodeStat& node_stat)
+    throw()
+  {
+    fill_yes_counts_(
+      yes_counts,
+      bundle,
+      bag_part.rows_begin(),
+      bag_part.rows_end(),
+      node_stat.row_cells.data(),
+      BagRowCounts(bag_part.bag_holder->row_counts));
+  }
+
+  template<typename LabelType>
+  template<typename RowCountsType>
+  void
+  TreeLearner<LabelType>::fill_yes_counts_(
+    YesCountArray& yes_counts,
+    const FeatureBundle& bundle,
+    const uint32_t* rows_begin,
+    const uint32_t* rows_end,
+    const uint32_t* row_cells,
+    const RowCountsType& row_counts)
+    throw()
+  {
+    // collect (feature index, cell) => count of node rows that
+    // contain bundle features, only bundle rows inside node rows range
+    // are visited
+    if(rows_begin == rows_end)
+    {
+      return;
+    }
+
+    auto bundle_row_it = std::lower_bound(
+      bundle.rows.begin(),
+      bundle.rows.end(),
+      *rows_begin);
+    auto bundle_row_end_it = std::upper_bound(
+      bundle_row_it,
+      bundle.rows.end(),
+      *(rows_end - 1));
+    auto row_feature_it = bundle.row_features.begin() +
+      (bundle_row_it - bundle.rows.begin());
+
+    const uint32_t* row_it = rows_begin;
+
+    if(static_cast<unsigned long>(bundle_row_end_it - bundle_row_it) *
+      SPARSE_SEARCH_FACTOR < static_cast<unsigned long>(rows_end - rows_begin))
+    {
+      for(; bundle_row_it != bundle_row_end_it; ++bundle_row_it, ++row_feature_it)
+      {
+        row_it = std::lower_bound(row_it, rows_end, *bundle_row_it);
+
+        if(*row_it == *bundle_row_it)
+        {
+          yes_counts.push_back(std::make_pair(
+            (static_cast<uint64_t>(*row_feature_it) << 32) |
+              row_cells[row_it - rows_begin],
+            row_counts(row_it - rows_begin, *row_it)));
+        }
+      }
+    }
+    else
+    {
+      while(row_it != rows_end && bundle_row_it != bundle_row_end_it)
+      {
+        if(*row_it < *bundle_row_it)
+        {
+          ++row_it;
+        }
+        else if(*bundle_row_it < *row_it)
+        {
+          ++bundle_row_it;
+          ++row_feature_it;
+        }
+        else
+        {
+          // row can be repeated in bundle for conflicting features
+          yes_counts.push_back(std::make_pair(
+            (static_cast<uint64_t>(*row_feature_it) << 32) |
+              row_cells[row_it - rows_begin],
+            row_counts(row_it - rows_begin, *row_it)));
+          ++bundle_row_it;
+          ++row_feature_it;
+        }
+      }
+    }
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_bundle_blocks_(
+    RowHolder& row_holder,
+    unsigned long memory_limit)
+    throw()
+  {
+    // bundle row indexes of block fit into memory_limit
+    // (block contains one bundle at least)
+    unsigned long block_size = 0;
+    unsigned long bundle_i = 0;
+
+    for(auto bundle_it = row_holder.feature_bundles.begin();
+      bundle_it != row_holder.feature_bundles.end(); ++bundle_it, ++bundle_i)
+    {
+      const unsigned long bundle_size = 2 * bundle_it->rows.size() * sizeof(uint32_t);
+
+      if(memory_limit > 0 && block_size > 0 && block_size + bundle_size > memory_limit)
+      {
+        row_holder.bundle_block_ends.push_back(bundle_i);
+        block_size = 0;
+      }
+
+      block_size += bundle_size;
+    }
+
+    if(bundle_i > 0)
+    {
+      row_holder.bundle_block_ends.push_back(bundle_i);
+    }
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::spill_row_holder_(
+    RowHolder& row_holder,
+    const std::string& work_dir)
+  {
+    // write row indexes to file, map it and rebase references to mapping,
+    // file is unlinked after mapping: it will be removed on unmap
+    std::ostringstream file_path_ostr;
+    file_path_ostr << work_dir << "/vanga.row_index." << ::getpid() <<
+      "." << static_cast<const void*>(&row_holder);
+    const std::string file_path = file_path_ostr.str();
+
+    {
+      std::ofstream file(file_path.c_str(), std::ios::binary | std::ios::trunc);
+      if(!file.is_open())
+      {
+        Gears::ErrorStream ostr;
+        ostr << "can't open work file '" << file_path << "'";
+        throw Exception(ostr.str());
+      }
+
+      file.write(
+        reinterpret_cast<const char*>(row_holder.row_index_data.data()),
+        row_holder.row_index_data.size() * sizeof(uint32_t));
+      file.close();
+
+      if(!file)
+      {
+        ::unlink(file_path.c_str());
+        Gears::ErrorStream ostr;
+        ostr << "can't write work file '" << file_path << "'";
+        throw Exception(ostr.str());
+      }
+    }
+
+    MappedFile_var row_index_file;
+
+    try
+    {
+      row_index_file = new MappedFile(file_path);
+    }
+    catch(...)
+    {
+      ::unlink(file_path.c_str());
+      throw;
+    }
+
+    ::unlink(file_path.c_str());
+
+    const uint32_t* old_base = row_holder.row_index_data.data();
+    const uint32_t* new_base = static_cast<const uint32_t*>(row_index_file->data());
+
+    for(auto feature_it = row_holder.feature_rows.begin();
+      feature_it != row_holder.feature_rows.end(); ++feature_it)
+    {
+      feature_it->second = RowIndexRef(
+        new_base + (feature_it->second.data() - old_base),
+        feature_it->second.size());
+    }
+
+    for(auto bundle_it = row_holder.feature_bundles.begin();
+      bundle_it != row_holder.feature_bundles.end(); ++bundle_it)
+    {
+      bundle_it->rows = RowIndexRef(
+        new_base + (bundle_it->rows.data() - old_base),
+        bundle_it->rows.size());
+      bundle_it->row_features = RowIndexRef(
+        new_base + (bundle_it->row_features.data() - old_base),
+        bundle_it->row_features.size());
+    }
+
+    row_holder.row_index_file = row_index_file;
+    RowIndexArray().swap(row_holder.row_index_data);
+  }
+
+  template<typename LabelType>
+  typename TreeLearner<LabelType>::Context_var
+  TreeLearner<LabelType>::create_context(
+    SVM<LabelType>* svm,
+    const BagViewArray& bags,
+    const ContextParams& params)
+  {
+    RowHolder_var row_holder = new RowHolder();
+    fill_row_holder_(*row_holder, svm, params);
+    fill_bundle_blocks_(*row_holder, params.memory_limit);
+
+    if(!params.work_dir.empty())
+    {
+      spill_row_holder_(*row_holder, params.work_dir);
+    }
+
+    if(params.processes > 0)
+    {
+      // fork workers when row index is ready
+      row_holder->shard_counter = new ShardCounter(
+        *row_holder, params.processes, bags.size());
+    }
+
+    row_holder->feature_processes = params.feature_processes;
+    row_holder->feature_host = params.feature_host;
+
+    BagPartArray bag_parts;
+    for(auto bag_it = bags.begin(); bag_it != bags.end(); ++bag_it)
+    {
+      assert(bag_it->size() == row_holder->rows.size());
+
+      BagHolder_var new_bag_holder = new BagHolder();
+      new_bag_holder->row_holder = row_holder;
+      new_bag_holder->row_counts = *bag_it;
+
+      BagPart_var new_bag_part = new BagPart();
+      new_bag_part->bag_holder = new_bag_holder;
+      new_bag_part->permutation = new RowPermutation();
+
+      for(uint32_t row_i = 0; row_i < bag_it->size(); ++row_i)
+      {
+        if((*bag_it)[row_i] > 0)
+        {
+          new_bag_part->permutation->rows.push_back(row_i);
+        }
+      }
+
+      new_bag_part->begin = 0;
+      new_bag_part->end = new_bag_part->permutation->rows.size();
+      bag_parts.push_back(new_bag_part);
+    }
+
+    return new Context(bag_parts);
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_portion_bags(
+    BagViewArray& bags,
+    unsigned long rows_number,
+    unsigned long portions_num)
+  {
+    const unsigned long first_bag_i = bags.size();
+    bags.resize(first_bag_i + portions_num, BagView(rows_number, 0));
+
+    for(unsigned long row_i = 0; row_i < rows_number; ++row_i)
+    {
+      unsigned long portion_i = ThreadRand::rand(portions_num);
+      bags[first_bag_i + portion_i][row_i] = 1;
+    }
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::fill_part_bag(
+    BagView& bag,
+    unsigned long rows_number,
+    unsigned long part_size)
+  {
+    // sampling with replacement, multiplicity is saturated by BagView value limit
+    bag.assign(rows_number, 0);
+
+    if(rows_number > 0)
+    {
+      for(unsigned long i = 0; i < part_size; ++i)
+      {
+        uint8_t& count = bag[ThreadRand::rand(rows_number)];
+        if(count < std::numeric_limits<uint8_t>::max())
+        {
+          ++count;
+        }
+      }
+    }
+  }
+
+  template<typename LabelType>
+  const uint32_t*
+  TreeLearner<LabelType>::group_end_(
+    unsigned long& group_i,
+    const RowHolder& row_holder,
+    const uint32_t* row_it,
+    const uint32_t* row_end_it)
+    throw()
+  {
+    // rows range is sorted : rows of one label group are neighbours
+    auto group_end_it = std::upper_bound(
+      row_holder.group_ends.begin(),
+      row_holder.group_ends.end(),
+      *row_it);
+
+    assert(group_end_it != row_holder.group_ends.end());
+
+    group_i = group_end_it - row_holder.group_ends.begin();
+    return std::lower_bound(row_it, row_end_it, *group_end_it);
+  }
+
+  template<typename LabelType>
+  unsigned long
+  TreeLearner<LabelType>::rows_count_(
+    const BagHolder& bag_holder,
+    const uint32_t* row_it,
+    const uint32_t* row_end_it)
+    throw()
+  {
+    unsigned long res = 0;
+    for(; row_it != row_end_it; ++row_it)
+    {
+      res += bag_holder.row_counts[*row_it];
+    }
+
+    return res;
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::node_labels_(
+    LabelCountArray& labels,
+    const BagPart& bag_part)
+    throw()
+  {
+    const uint32_t* row_end_it = bag_part.rows_end();
+
+    for(const uint32_t* row_it = bag_part.rows_begin(); row_it != row_end_it; )
+    {
+      unsigned long group_i;
+      const uint32_t* group_end_it = group_end_(
+        group_i, *bag_part.bag_holder->row_holder, row_it, row_end_it);
+
+      labels.push_back(std::make_pair(
+        bag_part.bag_holder->row_holder->labels[group_i],
+        rows_count_(*bag_part.bag_holder, row_it, group_end_it)));
+
+      row_it = group_end_it;
+    }
+  }
+
+  template<typename LabelType>
+  template<typename LabelAdapterType>
+  void
+  TreeLearner<LabelType>::node_labels_(
+    LabelCountArray& labels,
+    const BagPart& bag_part,
+    const LabelAdapterType& label_adapter)
+    throw()
+  {
+    const BagHolder& bag_holder = *bag_part.bag_holder;
+    const RowHolder& row_holder = *bag_holder.row_holder;
+    const uint32_t* row_end_it = bag_part.rows_end();
+
+    for(const uint32_t* row_it = bag_part.rows_begin(); row_it != row_end_it; )
+    {
+      unsigned long group_i;
+      const uint32_t* group_end_it = group_end_(
+        group_i, row_holder, row_it, row_end_it);
+
+      for(; row_it != group_end_it; ++row_it)
+      {
+        labels.push_back(std::make_pair(
+          label_adapter(row_holder.rows[*row_it], row_holder.labels[group_i]),
+          static_cast<unsigned long>(bag_holder.row_counts[*row_it])));
+      }
+    }
+  }
+
+  /*
+  template<typename LabelType, typename GainType>
+  void
+  TreeLearner<LabelType, GainType>::revert_bags_pred_(
+    BagPartArray& res_bag_parts,
+    const BagPartArray& bag_parts,
+    const typename LearnTreeHolder::Branch& branch)
+  {
+    for(auto bag_it = bag_parts.begin(); bag_it != bag_parts.end(); ++bag_it)
+    {
+      SVM_var res_svm = (*bag_it)->copy(LearnRevertPredictor(branch));
+
+      BagPart_var bag_part = new BagPart();
+      bag_part->bag_holder = (*bag_it)->bag_holder;
+      bag_part->svm = res_svm;
+      res_bag_parts.push_back(bag_part);
+    }
+  }
+  */
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::div_bags_(
+    BagPartArray& yes_bag_parts,
+    BagPartArray& no_bag_parts,
+    const BagPartArray& bag_parts,
+    unsigned long feature_id)
+  {
+    ProfileScope profile_scope(Profiler::P_DIV_BAGS);
+
+    for(auto bag_it = bag_parts.begin(); bag_it != bag_parts.end(); ++bag_it)
+    {
+      BagPart_var yes_bag_part;
+      BagPart_var no_bag_part;
+
+      profile_scope.add_rows((*bag_it)->size());
+
+      div_rows_(
+        yes_bag_part,
+        no_bag_part,
+        feature_id,
+        **bag_it);
+
+      yes_bag_parts.push_back(yes_bag_part);
+      no_bag_parts.push_back(no_bag_part);
+    }
+  }
+
+  template<typename LabelType>
+  void
+  TreeLearner<LabelType>::div_rows_(
+    BagPart_var& yes_bag_part,
+    BagPart_var& no_bag_part,
+    unsigned long feature_id,
+    const BagPart& bag_part)
+  {
+    yes_bag_part = new BagPart();
+    yes_bag_part->bag_holder = bag_part.bag_holder;
+
+    no_bag_part = new BagPart();
+    no_bag_part->bag_holder = bag_part.bag_holder;
+
+    FeatureRows feature_rows;
+
+    if(!find_feature_rows_(feature_rows, *bag_part.bag_holder->row_holder, feature_id) ||
+      bag_part.size() == 0)
+    {
+      // all rows at no side : share parent range
+      yes_bag_part->permutation = bag_part.permutation;
+      yes_bag_part->begin = bag_part.begin;
+      yes_bag_part->end = bag_part.begin;
+
+      no_bag_part->permutation = bag_part.permutation;
+      no_bag_part->begin = bag_part.begin;
+      no_bag_part->end = bag_part.end;
+      return;
+    }
+
+    // stable partition of parent range: yes rows are filled from the begin,
+    // no rows from the end in reverse order
+    RowPermutation_var permutation = new RowPermutation();
+    permutation->rows.resize(bag_part.size());
+
+    const RowIndexRef& cur_feature_rows = feature_rows.rows;
+    const uint32_t* row_it = bag_part.rows_begin();
+    const uint32_t* row_end_it = bag_part.rows_end();
+    auto feature_row_it = std::lower_bound(
+      cur_feature_rows.begin(),
+      cur_feature_rows.end(),
+      *row_it);
+    auto yes_it = permutation->rows.begin();
+    auto no_it = permutation->rows.rbegin();
+
+    while(row_it != row_end_it)
+    {
+      while(feature_row_it != cur_feature_rows.end() &&
+        *feature_row_it < *row_it)
+      {
+        ++feature_row_it;
+      }
+
+      if(feature_row_it != cur_feature_rows.end() &&
+        *feature_row_it == *row_it &&
+        feature_rows.yes(feature_row_it))
+      {
+        *yes_it++ = *row_it;
+        ++feature_row_it;
+      }
+      else
+      {
+        *no_it++ = *row_it;
+      }
+
+      ++row_it;
+    }
+
+    const unsigned long yes_size = yes_it - permutation->rows.begin();
+    std::reverse(permutation->rows.begin() + yes_size, permutation->rows.end());
+
+    yes_bag_part->permutation = permutation;
+    yes_bag_part->begin = 0;
+    yes_bag_part->end = yes_size;
+
+    no_bag_part->permutation = permutation;
+    no_bag_part->begin = yes_size;
+    no_bag_part->end = permutation->rows.size();
   }
 }
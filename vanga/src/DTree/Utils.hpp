@@ -32,6 +32,8 @@
 #include "VecUtils.hpp"
 #include "LBFGS.hpp"
 #include "Label.hpp"
+#include "Profiler.hpp"
+#include "CompiledDTree.hpp"
 
 namespace Vanga
 {
@@ -41,10 +43,17 @@ namespace Vanga
     double
     logloss(PredictorType* tree, const SVM<LabelType>* svm);
 
+    // log_reg_* functions evaluate predictor row by row with fpredict,
+    // DTree overloads evaluate tree over svm rows by blocks
+    // with CompiledDTree::predict
     template<typename PredictorType, typename LabelType>
     double
     log_reg_logloss(PredictorType* tree, const SVM<LabelType>* svm);
 
+    template<typename LabelType>
+    double
+    log_reg_logloss(DTree* tree, const SVM<LabelType>* svm);
+
     template<typename PredictorType, typename LabelType>
     double
     absloss(PredictorType* tree, const SVM<LabelType>* svm);
@@ -53,6 +62,10 @@ namespace Vanga
     double
     log_reg_absloss(PredictorType* tree, const SVM<LabelType>* svm);
 
+    template<typename LabelType>
+    double
+    log_reg_absloss(DTree* tree, const SVM<LabelType>* svm);
+
     template<typename LabelType>
     PredArrayHolder_var
     labels(const SVM<LabelType>* svm);
@@ -121,6 +134,8 @@ namespace Utils
   double
   logloss(PredictorType* predictor, const SVM<LabelType>* svm)
   {
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
+
     double loss = 0;
     unsigned long rows = 0;
     //PredictedBoolLabelAddConverter label_conv(predictor);
@@ -144,40 +159,91 @@ namespace Utils
       }
     }
 
+    profile_scope.add_rows(rows);
+
     return rows > 0 ? loss / rows : 0.0;
   }
 
+  // logloss of row with label and predictor margin
+  template<typename LabelType>
+  double
+  log_reg_row_logloss_(const LabelType& label, double predictor_pred)
+  {
+    const double DOUBLE_ONE = 1.0;
+
+    const double label_pred = label.pred + predictor_pred;
+    const double pred = DOUBLE_ONE / (DOUBLE_ONE + std::exp(-label_pred));
+
+    if(label.orig())
+    {
+      return -::log(std::max(pred, LOGLOSS_EPS));
+    }
+
+    return -::log(1 - std::min(pred, 1 - LOGLOSS_EPS));
+  }
+
+  template<typename LabelType>
+  double
+  log_reg_row_absloss_(const LabelType& label, double predictor_pred)
+  {
+    const double DOUBLE_ONE = 1.0;
+
+    const double label_pred = label.pred + predictor_pred;
+    const double pred = DOUBLE_ONE / (DOUBLE_ONE + std::exp(-label_pred));
+    return std::fabs(label.to_float() - pred);
+  }
+
   template<typename PredictorType, typename LabelType>
   double
   log_reg_logloss(PredictorType* predictor, const SVM<LabelType>* svm)
   {
-    const double DOUBLE_ONE = 1.0;
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
 
     double loss = 0;
     unsigned long rows = 0;
-    //PredictedBoolLabelAddConverter label_conv(predictor);
 
     for(auto it = svm->grouped_rows.begin(); it != svm->grouped_rows.end(); ++it)
     {
       for(auto row_it = (*it)->rows.begin(); row_it != (*it)->rows.end(); ++row_it)
       {
-        double label_pred = (*it)->label.pred + (
+        loss += log_reg_row_logloss_(
+          (*it)->label,
           predictor ? predictor->fpredict((*row_it)->features) : 0.0);
-        double pred = DOUBLE_ONE / (DOUBLE_ONE + std::exp(-label_pred));
+        ++rows;
+      }
+    }
 
-        if((*it)->label.orig())
-        {
-          loss -= ::log(std::max(pred, LOGLOSS_EPS));
-        }
-        else
-        {
-          loss -= ::log(1 - std::min(pred, 1 - LOGLOSS_EPS));
-        }
+    profile_scope.add_rows(rows);
+
+    return rows > 0 ? loss / rows : 0.0;
+  }
+
+  template<typename LabelType>
+  double
+  log_reg_logloss(DTree* predictor, const SVM<LabelType>* svm)
+  {
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
+
+    double loss = 0;
+    unsigned long rows = 0;
+
+    CompiledDTree_var compiled_tree = predictor ?
+      CompiledDTree_var(new CompiledDTree(predictor)) : CompiledDTree_var();
+    SVMBlockPredictor<LabelType> block_predictor(compiled_tree, svm);
 
+    while(block_predictor.next())
+    {
+      for(unsigned long row_i = 0; row_i < block_predictor.size(); ++row_i)
+      {
+        loss += log_reg_row_logloss_(
+          block_predictor.label(row_i),
+          block_predictor.pred(row_i));
         ++rows;
       }
     }
 
+    profile_scope.add_rows(rows);
+
     return rows > 0 ? loss / rows : 0.0;
   }
 
@@ -185,6 +251,8 @@ namespace Utils
   double
   logloss_by_pred(const SVM<LabelType>* svm)
   {
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
+
     const double DOUBLE_ONE = 1.0;
 
     double loss = 0;
@@ -206,6 +274,8 @@ namespace Utils
       rows += (*it)->rows.size();
     }
 
+    profile_scope.add_rows(rows);
+
     return rows > 0 ? loss / rows : 0.0;
   }
 
@@ -213,6 +283,8 @@ namespace Utils
   double
   absloss(PredictorType* predictor, const SVM<LabelType>* svm)
   {
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
+
     double loss = 0;
     unsigned long rows = 0;
 
@@ -226,6 +298,8 @@ namespace Utils
       }
     }
 
+    profile_scope.add_rows(rows);
+
     return rows > 0 ? loss / rows : 0.0;
   }
 
@@ -233,25 +307,53 @@ namespace Utils
   double
   log_reg_absloss(PredictorType* predictor, const SVM<LabelType>* svm)
   {
-    const double DOUBLE_ONE = 1.0;
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
 
     double loss = 0;
     unsigned long rows = 0;
-    //PredictedBoolLabelAddConverter label_conv(predictor);
 
     for(auto it = svm->grouped_rows.begin(); it != svm->grouped_rows.end(); ++it)
     {
       for(auto row_it = (*it)->rows.begin(); row_it != (*it)->rows.end(); ++row_it)
       {
-        double label_pred = (*it)->label.pred + (
+        loss += log_reg_row_absloss_(
+          (*it)->label,
           predictor ? predictor->fpredict((*row_it)->features) : 0.0);
-        //PredictedBoolLabel label = label_conv(*row_it, (*it)->label);
-        double pred = DOUBLE_ONE / (DOUBLE_ONE + std::exp(-label_pred));
-        loss += std::fabs((*it)->label.to_float() - pred);
         ++rows;
       }
     }
 
+    profile_scope.add_rows(rows);
+
+    return rows > 0 ? loss / rows : 0.0;
+  }
+
+  template<typename LabelType>
+  double
+  log_reg_absloss(DTree* predictor, const SVM<LabelType>* svm)
+  {
+    ProfileScope profile_scope(Profiler::P_METRIC_EVAL);
+
+    double loss = 0;
+    unsigned long rows = 0;
+
+    CompiledDTree_var compiled_tree = predictor ?
+      CompiledDTree_var(new CompiledDTree(predictor)) : CompiledDTree_var();
+    SVMBlockPredictor<LabelType> block_predictor(compiled_tree, svm);
+
+    while(block_predictor.next())
+    {
+      for(unsigned long row_i = 0; row_i < block_predictor.size(); ++row_i)
+      {
+        loss += log_reg_row_absloss_(
+          block_predictor.label(row_i),
+          block_predictor.pred(row_i));
+        ++rows;
+      }
+    }
+
+    profile_scope.add_rows(rows);
+
     return rows > 0 ? loss / rows : 0.0;
   }
 
@@ -404,6 +506,8 @@ namespace Utils
     FloatArray& no_res,
     const FunType& fun)
   {
+    ProfileScope profile_scope(Profiler::P_LBFGS);
+
     // find min of RegLogLoss(x, lambda) = LogLoss(x) + lambda^2 * ||x||, where x = (yes_res, no_res)
 
     const bool USE_LINESEARCH = true;
@@ -25,11 +25,13 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <numeric>
 #include <fstream>
 //#include <cmath>
 #include <unordered_set>
+#include <unistd.h>
+#include <signal.h>
 
-#include <Gears/Basic/Rand.hpp>
 #include <Gears/Basic/AppUtils.hpp>
 #include <Gears/Basic/FileManip.hpp>
 #include <Gears/String/Csv.hpp>
@@ -40,9 +42,12 @@
 #include <DTree/DTree.hpp>
 #include <DTree/PredictorSet.hpp>
 #include <DTree/LogRegPredictor.hpp>
+#include <DTree/CompiledDTree.hpp>
+#include <DTree/CodeGenerator.hpp>
 
 #include <DTree/Utils.hpp>
 #include <DTree/Gain.hpp>
+#include <DTree/Rand.hpp>
 #include <DTree/EvalMetricPrinter.hpp>
 //#include <DTree/LogLossMetricEvaluator.hpp>
 #include <DTree/RSquareMetricEvaluator.hpp>
@@ -54,6 +59,8 @@
 #include <DTree/PredAbsLossMetricEvaluator.hpp>
 
 #include <DTree/FastFeatureSet.hpp>
+#include <DTree/Profiler.hpp>
+#include <DTree/PredBuffer.hpp>
 
 #include "Application.hpp"
 
@@ -63,7 +70,12 @@ namespace
 {
   const char USAGE[] =
     "\nUsage: \n"
-    "DTreeTrainer [train|train-add|train-trees|print|predict|ensemble]\n";
+    "DTreeTrainer [train|train-add|train-trees|print|predict|ensemble|codegen|convert]\n"
+    "  predict <model file> <svm file>: text or binary model\n"
+    "  codegen <model file> <output cpp file> [function name]: generate C++ source\n"
+    "    of model prediction function with C ABI (vanga_predict by default)\n"
+    "  convert <model file> <output model file>: convert text model to binary\n"
+    "    (mapped without parsing) or binary model to text\n";
 
   class Callback:
     public Gears::ActiveObjectCallback
@@ -84,8 +96,42 @@ namespace
     }
   };
 
+  // memory report requested by SIGUSR1, printed after next train step
+  volatile sig_atomic_t memory_report_requested = 0;
+
+  void
+  memory_report_handler(int)
+  {
+    memory_report_requested = 1;
+  }
+
   typedef LogRegPredictor<DTree> LogRegDTreePredictor;
   typedef Gears::IntrusivePtr<LogRegDTreePredictor> LogRegDTreePredictor_var;
+
+  // RowMarginConverter: set base margins loaded from sidecar file
+  struct RowMarginConverter
+  {
+  public:
+    typedef PredictedBoolLabel ResultType;
+
+  public:
+    RowMarginConverter(const Application_::RowMarginMap& margins)
+      : margins_(margins)
+    {}
+
+    PredictedBoolLabel
+    operator()(const Row* row, const PredictedBoolLabel& label) const
+    {
+      PredictedBoolLabel converted_label = label;
+      auto margin_it = margins_.find(row);
+      assert(margin_it != margins_.end());
+      converted_label.pred = margin_it->second;
+      return converted_label;
+    }
+
+  protected:
+    const Application_::RowMarginMap& margins_;
+  };
 }
 
 // Application
@@ -220,6 +266,7 @@ Application_::main(int& argc, char** argv)
   Gears::AppUtils::Option<unsigned long> opt_super_iterations(10);
   Gears::AppUtils::Option<unsigned long> opt_num_trees(10);
   Gears::AppUtils::Option<unsigned long> opt_threads(1);
+  Gears::AppUtils::Option<unsigned long> opt_seed(0);
   Gears::AppUtils::Option<unsigned long> opt_train_bags_number(10);
   Gears::AppUtils::Option<unsigned long> opt_test_bags_number(3);
   //Gears::AppUtils::Option<double> opt_add_tree_coef(1.0);
@@ -233,14 +280,36 @@ Application_::main(int& argc, char** argv)
   Gears::AppUtils::CheckOption opt_anneal;
   Gears::AppUtils::CheckOption opt_allow_negative_gain;
   Gears::AppUtils::Option<unsigned long> opt_gain_check_bags_number(0);
+  Gears::AppUtils::Option<unsigned long> opt_screen_top(0);
+  Gears::AppUtils::Option<unsigned long> opt_screen_rows(10000);
+  Gears::AppUtils::CheckOption opt_screen_validate;
+  Gears::AppUtils::StringOption opt_work_dir;
+  Gears::AppUtils::Option<unsigned long> opt_memory_limit(0);
+  Gears::AppUtils::Option<unsigned long> opt_processes(0);
+  Gears::AppUtils::Option<unsigned long> opt_feature_processes(0);
+  Gears::AppUtils::StringOption opt_feature_host;
+  Gears::AppUtils::StringOption opt_checkpoint;
+  Gears::AppUtils::Option<unsigned long> opt_checkpoint_period(1);
+  Gears::AppUtils::StringOption opt_resume;
+  Gears::AppUtils::StringOption opt_profile_out;
+  Gears::AppUtils::Option<unsigned long> opt_profile_period(1);
+  Gears::AppUtils::CheckOption opt_memory_report;
   Gears::AppUtils::Option<double> opt_min_cover(0.0001);
   Gears::AppUtils::StringOption opt_save_best_model_file;
 
   Gears::AppUtils::Option<unsigned long> opt_square_diviation_choose_prob(1);
   Gears::AppUtils::Option<unsigned long> opt_logloss_choose_prob(1);
 
+  // base margins sidecar files: float per row in file order,
+  // test files defined by comma separated list in test files order
   Gears::AppUtils::Option<std::string> opt_train_pred_x;
   Gears::AppUtils::Option<std::string> opt_test_pred_x;
+  Gears::AppUtils::Option<std::string> opt_train_pred_out;
+  Gears::AppUtils::Option<std::string> opt_test_pred_out;
+
+  // numeric features: values kept at load and split by quantile bins thresholds
+  Gears::AppUtils::StringOption opt_numeric_features;
+  Gears::AppUtils::Option<unsigned long> opt_numeric_bins(255);
 
   // RAM ~ O(opt_max_top_element ^ opt_depth)
   // RAM ~ 100000 by default
@@ -293,12 +362,75 @@ Application_::main(int& argc, char** argv)
     Gears::AppUtils::equal_name("threads") ||
     Gears::AppUtils::short_name("t"),
     opt_threads);
+  args.add(
+    Gears::AppUtils::equal_name("seed"),
+    opt_seed);
   args.add(
     Gears::AppUtils::equal_name("train-bags"),
     opt_train_bags_number);
   args.add(
     Gears::AppUtils::equal_name("gain-check-bags"),
     opt_gain_check_bags_number);
+  args.add(
+    Gears::AppUtils::equal_name("screen-top"),
+    opt_screen_top);
+  args.add(
+    Gears::AppUtils::equal_name("screen-rows"),
+    opt_screen_rows);
+  args.add(
+    Gears::AppUtils::equal_name("screen-validate"),
+    opt_screen_validate);
+  args.add(
+    Gears::AppUtils::equal_name("work-dir"),
+    opt_work_dir);
+  args.add(
+    Gears::AppUtils::equal_name("memory-limit"),
+    opt_memory_limit);
+  args.add(
+    Gears::AppUtils::equal_name("processes"),
+    opt_processes);
+  args.add(
+    Gears::AppUtils::equal_name("feature-processes"),
+    opt_feature_processes);
+  args.add(
+    Gears::AppUtils::equal_name("feature-host"),
+    opt_feature_host);
+  args.add(
+    Gears::AppUtils::equal_name("checkpoint"),
+    opt_checkpoint);
+  args.add(
+    Gears::AppUtils::equal_name("checkpoint-period"),
+    opt_checkpoint_period);
+  args.add(
+    Gears::AppUtils::equal_name("resume"),
+    opt_resume);
+  args.add(
+    Gears::AppUtils::equal_name("profile-out"),
+    opt_profile_out);
+  args.add(
+    Gears::AppUtils::equal_name("profile-period"),
+    opt_profile_period);
+  args.add(
+    Gears::AppUtils::equal_name("memory-report"),
+    opt_memory_report);
+  args.add(
+    Gears::AppUtils::equal_name("train-pred-x"),
+    opt_train_pred_x);
+  args.add(
+    Gears::AppUtils::equal_name("test-pred-x"),
+    opt_test_pred_x);
+  args.add(
+    Gears::AppUtils::equal_name("train-pred-out"),
+    opt_train_pred_out);
+  args.add(
+    Gears::AppUtils::equal_name("test-pred-out"),
+    opt_test_pred_out);
+  args.add(
+    Gears::AppUtils::equal_name("numeric-features"),
+    opt_numeric_features);
+  args.add(
+    Gears::AppUtils::equal_name("numeric-bins"),
+    opt_numeric_bins);
   args.add(
     Gears::AppUtils::equal_name("test-bags"),
     opt_test_bags_number);
@@ -356,6 +488,17 @@ Application_::main(int& argc, char** argv)
     return;
   }
 
+  if(opt_seed.installed())
+  {
+    // results don't depend on threads number with fixed seed
+    ThreadRand::set_seed(*opt_seed);
+  }
+
+  if(!opt_profile_out->empty())
+  {
+    Profiler::enable();
+  }
+
   auto command_it = commands.begin();
   std::string command = *command_it;
   ++command_it;
@@ -381,6 +524,32 @@ Application_::main(int& argc, char** argv)
     }
   }
 
+  NumericFeatureSet numeric_features;
+
+  if(!opt_numeric_features->empty())
+  {
+    Gears::CategoryRepeatableTokenizer<
+      Gears::Ascii::SepComma> tokenizer(*opt_numeric_features);
+    Gears::SubString token;
+    while(tokenizer.get_token(token))
+    {
+      uint32_t val;
+      if(!Gears::StringManip::str_to_int(token, val))
+      {
+        Gears::ErrorStream ostr;
+        ostr << "invalid numeric feature value '" <<
+          *opt_numeric_features << "'";
+        throw Exception(ostr.str());
+      }
+      numeric_features.insert(val);
+    }
+  }
+
+  if(*opt_numeric_bins == 0)
+  {
+    throw Exception("numeric bins number should be positive");
+  }
+
   if(command == "train" || command == "train-add" || command == "train-trees")
   {
     if(command_it == commands.end())
@@ -407,7 +576,37 @@ Application_::main(int& argc, char** argv)
       return;
     }
 
-    SVMImpl_var train_svm = SVMImpl::load(train_file);
+    const std::vector<std::string> test_pred_x_files = split_files_(*opt_test_pred_x);
+    const std::vector<std::string> test_pred_out_files = split_files_(*opt_test_pred_out);
+
+    if(!filter_features.empty() &&
+      (!opt_train_pred_out->empty() || !test_pred_out_files.empty()))
+    {
+      // filtered rows lose file order
+      throw Exception("margins output can't be used with features filtering");
+    }
+
+    // rows in file order collected only if margins used
+    // (label groups keep rows in file order inside group only)
+    const bool use_margins = !opt_train_pred_x->empty() ||
+      !opt_train_pred_out->empty() ||
+      !test_pred_x_files.empty() ||
+      !test_pred_out_files.empty();
+
+    const NumericFeatureSet* load_numeric_features =
+      numeric_features.empty() ? 0 : &numeric_features;
+
+    RowArray train_rows;
+    SVMImpl_var train_svm = SVMImpl::load(
+      train_file,
+      0,
+      use_margins ? &train_rows : 0,
+      load_numeric_features);
+
+    if(!opt_train_pred_x->empty())
+    {
+      train_svm = set_margins_(train_svm, train_rows, *opt_train_pred_x);
+    }
 
     if(!filter_features.empty())
     {
@@ -416,6 +615,7 @@ Application_::main(int& argc, char** argv)
 
     // load test files
     std::list<SVMImpl_var> test_svms;
+    std::vector<RowArray> test_rows;
 
     for(++command_it; command_it != commands.end(); ++command_it)
     {
@@ -427,7 +627,20 @@ Application_::main(int& argc, char** argv)
         return;
       }
 
-      SVMImpl_var test_svm = SVMImpl::load(test_file);
+      test_rows.push_back(RowArray());
+      SVMImpl_var test_svm = SVMImpl::load(
+        test_file,
+        0,
+        use_margins ? &test_rows.back() : 0,
+        load_numeric_features);
+
+      if(test_svms.size() < test_pred_x_files.size())
+      {
+        test_svm = set_margins_(
+          test_svm,
+          test_rows.back(),
+          test_pred_x_files[test_svms.size()]);
+      }
 
       if(!filter_features.empty())
       {
@@ -495,6 +708,65 @@ Application_::main(int& argc, char** argv)
       metric_selection.sqd = *opt_square_diviation_choose_prob;
       metric_selection.logloss = *opt_logloss_choose_prob;
 
+      FeatureScreening screening;
+      screening.top = *opt_screen_top;
+      screening.rows = *opt_screen_rows;
+      screening.validate = opt_screen_validate.enabled();
+
+      // row indexes spilled at bags preparation: check work dir early
+      if(!opt_work_dir->empty() && ::access(opt_work_dir->c_str(), W_OK | X_OK) != 0)
+      {
+        Gears::ErrorStream ostr;
+        ostr << "work dir '" << *opt_work_dir << "' isn't writable";
+        throw Exception(ostr.str());
+      }
+
+      ContextParams context_params;
+      context_params.work_dir = *opt_work_dir;
+      context_params.memory_limit = *opt_memory_limit * 1024 * 1024;
+      context_params.processes = *opt_processes;
+      context_params.feature_processes = *opt_feature_processes;
+      context_params.feature_host = *opt_feature_host;
+      context_params.numeric_features = numeric_features;
+      context_params.numeric_bins = *opt_numeric_bins;
+
+      CheckpointParams checkpoint_params;
+      checkpoint_params.file = *opt_checkpoint;
+      checkpoint_params.period = std::max(*opt_checkpoint_period, 1ul);
+
+      ProfileParams profile_params;
+      profile_params.file = *opt_profile_out;
+      profile_params.period = std::max(*opt_profile_period, 1ul);
+      profile_params.memory_report = opt_memory_report.enabled();
+
+      ::signal(SIGUSR1, memory_report_handler);
+
+      TrainCheckpoint_var resume_checkpoint;
+
+      if(!opt_resume->empty())
+      {
+        resume_checkpoint = TrainCheckpoint::load(*opt_resume);
+
+        if(resume_checkpoint->train_margins.size() != train_svm->size())
+        {
+          Gears::ErrorStream ostr;
+          ostr << "checkpoint '" << *opt_resume << "' saved for other train set: " <<
+            resume_checkpoint->train_margins.size() << " rows instead " <<
+            train_svm->size();
+          throw Exception(ostr.str());
+        }
+
+        // margins are saved in rows order of train SVM
+        if(resume_checkpoint->train_checksum !=
+          TrainCheckpoint::rows_checksum(train_svm))
+        {
+          Gears::ErrorStream ostr;
+          ostr << "checkpoint '" << *opt_resume << "' saved for other train set: "
+            "rows or their order differ";
+          throw Exception(ostr.str());
+        }
+      }
+
       DTree_var best_tree;
       DTree_var new_tree;
       double best_test0_logloss;
@@ -516,12 +788,34 @@ Application_::main(int& argc, char** argv)
         *opt_threads,
         opt_anneal.enabled(),
         opt_allow_negative_gain.enabled(),
-        metric_selection
+        metric_selection,
+        screening,
+        context_params,
+        checkpoint_params,
+        profile_params,
+        resume_checkpoint
         );
 
       std::ofstream result_file(result_file_path.c_str());
       new_tree->save(result_file);
 
+      // margins with trained model for next warm started runs
+      if(!opt_train_pred_out->empty())
+      {
+        save_margins_(*opt_train_pred_out, train_svm, train_rows, new_tree);
+      }
+
+      auto test_svm_it = test_svms.begin();
+      for(unsigned long test_svm_i = 0; test_svm_i < test_pred_out_files.size() &&
+        test_svm_it != test_svms.end(); ++test_svm_i, ++test_svm_it)
+      {
+        save_margins_(
+          test_pred_out_files[test_svm_i],
+          *test_svm_it,
+          test_rows[test_svm_i],
+          new_tree);
+      }
+
       if(!opt_save_best_model_file->empty() && best_tree.in())
       {
         std::ofstream best_result_file(opt_save_best_model_file->c_str());
@@ -547,13 +841,25 @@ Application_::main(int& argc, char** argv)
 
     ++command_it;
 
+    std::ifstream result_file(result_file_path.c_str());
+    if(!result_file.is_open())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "can't open '" << result_file_path << "'";
+      throw Exception(ostr.str());
+    }
+
+    DTree_var loaded_predictor = DTree::load(result_file);
+
     SVMImpl_var cover_svm;
 
     if(command_it != commands.end())
     {
-      // cover file
+      // cover file: values of model numeric features are kept
+      loaded_predictor->numeric_features(numeric_features);
+
       std::ifstream cover_file(command_it->c_str());
-      cover_svm = SVMImpl::load(cover_file);
+      cover_svm = SVMImpl::load(cover_file, 0, 0, &numeric_features);
     }
 
     FeatureDictionary feature_dictionary;
@@ -570,16 +876,6 @@ Application_::main(int& argc, char** argv)
       load_name_dictionary_(feature_name_dictionary, opt_feature_name_dictionary->c_str());
     }
 
-    std::ifstream result_file(result_file_path.c_str());
-    if(!result_file.is_open())
-    {
-      Gears::ErrorStream ostr;
-      ostr << "can't open '" << result_file_path << "'";
-      throw Exception(ostr.str());
-    }
-
-    DTree_var loaded_predictor = DTree::load(result_file);
-
     deep_print_(
       std::cout,
       loaded_predictor,
@@ -616,8 +912,6 @@ Application_::main(int& argc, char** argv)
 
     const std::string svm_file_path = *command_it;
 
-    std::ifstream result_file(result_file_path.c_str());
-
     std::ifstream svm_file(svm_file_path.c_str());
 
     std::cout.setf(std::ios::fixed, std::ios::floatfield);
@@ -625,42 +919,67 @@ Application_::main(int& argc, char** argv)
 
     if(command == "predict")
     {
-      DTree_var tree = DTree::load(result_file);
-      Gears::IntrusivePtr<LogRegPredictor<DTree> > predictor =
-        new LogRegPredictor<DTree>(tree);
+      const double DOUBLE_ONE = 1.0;
 
-      FastFeatureSet fast_feature_set;
+      BinaryModel_var model = BinaryModel::load(result_file_path);
 
-      while(!svm_file.eof())
+      model->numeric_features(numeric_features);
+
+      // rows predicted by blocks
+      std::vector<Row_var> rows;
+      rows.reserve(CompiledDTree::BLOCK_SIZE);
+      std::vector<const FeatureArray*> features;
+      features.reserve(CompiledDTree::BLOCK_SIZE);
+      std::vector<double> preds(CompiledDTree::BLOCK_SIZE);
+
+      bool eof = false;
+
+      while(!eof)
       {
-        PredictedBoolLabel label_value;
-        Row_var row = SVMImpl::load_line(svm_file, label_value);
-        if(!row)
+        while(rows.size() < CompiledDTree::BLOCK_SIZE)
         {
-          break;
+          PredictedBoolLabel label_value;
+          Row_var row;
+
+          if(!svm_file.eof())
+          {
+            row = SVMImpl::load_line(svm_file, label_value, &numeric_features);
+          }
+
+          if(!row)
+          {
+            eof = true;
+            break;
+          }
+
+          features.push_back(&row->features);
+          rows.push_back(row);
         }
 
-        double predicted_value = predictor->fpredict(row->features);
-        /*
-        fast_feature_set.set(row->features);
-        double predicted_value = predictor->fpredict(fast_feature_set);
-        fast_feature_set.rollback(row->features);
-        */
+        model->predict(preds.data(), features.data(), features.size());
+
+        for(unsigned long row_i = 0; row_i < rows.size(); ++row_i)
+        {
+          std::cout << DOUBLE_ONE / (DOUBLE_ONE + std::exp(-preds[row_i])) << std::endl;
+        }
 
-        std::cout << predicted_value << std::endl;
+        rows.clear();
+        features.clear();
       }
     }
     else // predict-perf
     {
-      DTree_var tree = DTree::load(result_file);
-      //predictor = new LogRegPredictor(predictor);
-      LogRegDTreePredictor_var predictor = new LogRegDTreePredictor(tree);
+      BinaryModel_var model = BinaryModel::load(result_file_path);
+      Gears::IntrusivePtr<LogRegPredictor<BinaryModel> > predictor =
+        new LogRegPredictor<BinaryModel>(model);
+
+      model->numeric_features(numeric_features);
 
       std::deque<Row_var> rows;
       while(!svm_file.eof())
       {
         PredictedBoolLabel label_value;
-        Row_var row = SVMImpl::load_line(svm_file, label_value);
+        Row_var row = SVMImpl::load_line(svm_file, label_value, &numeric_features);
         if(!row)
         {
           break;
@@ -686,7 +1005,7 @@ Application_::main(int& argc, char** argv)
         fast_feature_set.set((*row_it)->features);
         //tree->fpredict(fast_feature_set);
         predictor->fpredict(fast_feature_set);
-        fast_feature_set.rollback((*row_it)->features);
+        fast_feature_set.clear();
       }
 
       Gears::Time end_time = Gears::Time::get_time_of_day();
@@ -727,8 +1046,11 @@ Application_::main(int& argc, char** argv)
     std::ifstream predictor2_file(predictor2_file_path.c_str());
     DTree_var tree2 = DTree::load(predictor2_file);
 
+    tree1->numeric_features(numeric_features);
+    tree2->numeric_features(numeric_features);
+
     std::ifstream svm_file(svm_file_path.c_str());
-    SVMImpl_var svm = SVMImpl::load(svm_file);
+    SVMImpl_var svm = SVMImpl::load(svm_file, 0, 0, &numeric_features);
 
     double coef1;
     double coef2;
@@ -747,6 +1069,111 @@ Application_::main(int& argc, char** argv)
       "min_logloss = " << min_logloss << std::endl
       ;
   }
+  else if(command == "codegen")
+  {
+    if(command_it == commands.end())
+    {
+      std::cerr << "model file not defined" << std::endl;
+      return;
+    }
+
+    const std::string model_file_path = *command_it;
+
+    ++command_it;
+    if(command_it == commands.end())
+    {
+      std::cerr << "output file not defined" << std::endl;
+      return;
+    }
+
+    const std::string output_file_path = *command_it;
+
+    ++command_it;
+    const std::string function_name = command_it != commands.end() ?
+      *command_it : std::string("vanga_predict");
+
+    std::ifstream model_file(model_file_path.c_str());
+    if(!model_file.is_open())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "can't open '" << model_file_path << "'";
+      throw Exception(ostr.str());
+    }
+
+    std::ostringstream code;
+    const PredictorType predictor_type = PredictorLoader::load_type(model_file);
+
+    if(predictor_type == PT_DTREE)
+    {
+      DTree_var tree = DTree::load(model_file, false);
+      CodeGenerator::generate(code, tree, function_name.c_str());
+    }
+    else if(predictor_type == PT_SET)
+    {
+      PredictorSet_var predictor_set = PredictorSet::load(model_file, false);
+      CodeGenerator::generate(code, predictor_set, function_name.c_str());
+    }
+    else
+    {
+      Gears::ErrorStream ostr;
+      ostr << "unknown model type in '" << model_file_path << "'";
+      throw Exception(ostr.str());
+    }
+
+    std::ofstream output_file(output_file_path.c_str(), std::ios::trunc);
+    output_file << code.str();
+
+    if(output_file.fail())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "can't write '" << output_file_path << "'";
+      throw Exception(ostr.str());
+    }
+  }
+  else if(command == "convert")
+  {
+    if(command_it == commands.end())
+    {
+      std::cerr << "model file not defined" << std::endl;
+      return;
+    }
+
+    const std::string model_file_path = *command_it;
+
+    ++command_it;
+    if(command_it == commands.end())
+    {
+      std::cerr << "output file not defined" << std::endl;
+      return;
+    }
+
+    const std::string output_file_path = *command_it;
+
+    const bool binary_input = BinaryModel::is_binary(model_file_path);
+    BinaryModel_var model = BinaryModel::load(model_file_path);
+
+    std::ofstream output_file(
+      output_file_path.c_str(),
+      binary_input ? std::ios::trunc : std::ios::binary | std::ios::trunc);
+
+    if(binary_input)
+    {
+      model->save_text(output_file);
+    }
+    else
+    {
+      model->save(output_file);
+    }
+
+    output_file.close();
+
+    if(output_file.fail())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "can't write '" << output_file_path << "'";
+      throw Exception(ostr.str());
+    }
+  }
   else if(command == "filter")
   {
     if(command_it == commands.end())
@@ -765,7 +1192,7 @@ Application_::main(int& argc, char** argv)
     {
       // cover file
       std::ifstream cover_file(command_it->c_str());
-      cover_svm = SVMImpl::load(cover_file);
+      cover_svm = SVMImpl::load(cover_file, 0, 0, &numeric_features);
     }
 
     DTree_var tree;
@@ -808,6 +1235,11 @@ Application_::main(int& argc, char** argv)
       "see help for more info" << std::endl;
     throw Exception(ostr.str());
   }
+
+  if(!opt_profile_out->empty())
+  {
+    Profiler::save(*opt_profile_out, true);
+  }
 }
 
 void
@@ -896,27 +1328,131 @@ Application_::load_name_dictionary_(
 }
 
 void
-Application_::init_bags_(
-  SVMImplArray& bags,
-  SVMImpl_var& test_svm,
-  SVMImpl_var& train_svm,
-  SVMImpl* ext_train_svm,
-  unsigned long train_bags)
+Application_::print_memory_usage_(
+  std::ostream& ostr,
+  const SVMImpl* train_svm,
+  const std::list<SVMImpl_var>& test_svms,
+  const TreeLearner<PredictedBoolLabel>::Context* context,
+  const TreeLearner<PredictedBoolLabel>::LearnContext* learn_context)
 {
-  static const Fold FOLDS[] = {
-    //{ 1.0, 10 },
-    //{ 0.9, 5 },
-    // annealing
-    //{ 0.8, 5 },
-    { 0.5, 2 },
-    { 0.3, 2 }
-    //{ 0.1, 1 }
-  };
+  MemoryUsage usage;
 
-  (void)FOLDS;
+  train_svm->memory_usage(usage);
 
-  //static const Fold FOLDS[] = { { 0.0, 3 }, { 1.0, 3 }, { 0.9, 10 }, { 0.5, 10 }, { 0.3, 10 }, { 0.1, 10 }, { 0.05, 10 } };
+  for(auto test_svm_it = test_svms.begin(); test_svm_it != test_svms.end();
+    ++test_svm_it)
+  {
+    (*test_svm_it)->memory_usage(usage);
+  }
+
+  context->memory_usage(usage);
+  learn_context->memory_usage(usage);
+
+  usage.add("buffer_pools", BufferPools::all_retained_bytes());
+
+  ostr << "[MEMORY]: (" << Gears::Time::get_time_of_day().gm_ft() << ")" <<
+    std::endl;
+  usage.print(ostr, "  ");
+}
+
+std::vector<std::string>
+Application_::split_files_(const std::string& files)
+{
+  std::vector<std::string> res;
+
+  Gears::CategoryRepeatableTokenizer<Gears::Ascii::SepComma> tokenizer(files);
+  Gears::SubString token;
+  while(tokenizer.get_token(token))
+  {
+    res.push_back(token.str());
+  }
+
+  return res;
+}
+
+Application_::SVMImpl_var
+Application_::set_margins_(
+  const SVMImpl* svm,
+  const RowArray& rows,
+  const std::string& file)
+{
+  std::ifstream istr(file.c_str(), std::ios::binary);
+  if(!istr.is_open())
+  {
+    Gears::ErrorStream ostr;
+    ostr << "can't open margins file '" << file << "'";
+    throw Exception(ostr.str());
+  }
+
+  std::vector<float> margins(rows.size());
+  istr.read(reinterpret_cast<char*>(margins.data()), margins.size() * sizeof(float));
+
+  if(istr.fail() || istr.peek() != std::ifstream::traits_type::eof())
+  {
+    Gears::ErrorStream ostr;
+    ostr << "margins file '" << file << "' size don't match " <<
+      rows.size() << " rows";
+    throw Exception(ostr.str());
+  }
+
+  RowMarginMap row_margins;
+  row_margins.reserve(rows.size());
+
+  for(unsigned long row_i = 0; row_i < rows.size(); ++row_i)
+  {
+    row_margins[rows[row_i].in()] = margins[row_i];
+  }
 
+  return svm->copy(RowMarginConverter(row_margins));
+}
+
+void
+Application_::save_margins_(
+  const std::string& file,
+  const SVMImpl* svm,
+  const RowArray& rows,
+  const DTree* tree)
+{
+  RowMarginMap row_margins;
+  row_margins.reserve(rows.size());
+
+  for(auto group_it = svm->grouped_rows.begin();
+    group_it != svm->grouped_rows.end(); ++group_it)
+  {
+    for(auto row_it = (*group_it)->rows.begin();
+      row_it != (*group_it)->rows.end(); ++row_it)
+    {
+      row_margins[row_it->in()] = (*group_it)->label.pred;
+    }
+  }
+
+  std::vector<float> margins;
+  margins.reserve(rows.size());
+
+  for(auto row_it = rows.begin(); row_it != rows.end(); ++row_it)
+  {
+    margins.push_back(row_margins[row_it->in()] +
+      (tree ? tree->fpredict((*row_it)->features) : 0.0));
+  }
+
+  std::ofstream ostr(file.c_str(), std::ios::binary | std::ios::trunc);
+  ostr.write(reinterpret_cast<const char*>(margins.data()), margins.size() * sizeof(float));
+  ostr.close();
+
+  if(ostr.fail())
+  {
+    Gears::ErrorStream err;
+    err << "can't write margins file '" << file << "'";
+    throw Exception(err.str());
+  }
+}
+
+void
+Application_::init_train_svm_(
+  SVMImpl_var& test_svm,
+  SVMImpl_var& train_svm,
+  SVMImpl* ext_train_svm)
+{
   /*
   if(out_of_bag_validate)
   {
@@ -933,41 +1469,67 @@ Application_::init_bags_(
 
   train_svm = Gears::add_ref(ext_train_svm);
   test_svm = SVMImpl_var();
-
-  bags.clear();
-
-  if(train_bags > 0)
-  {
-    div_bags_(bags, train_bags, train_svm);
-    //std::cerr << "bags: " << bags.size() << std::endl;
-    //fill_bags_(bags, FOLDS, train_bags, train_svm);
-  }
-  else
-  {
-    bags.push_back(train_svm->copy());
-  }
 }
 
 void
 Application_::prepare_bags_(
   TreeLearner<PredictedBoolLabel>::Context_var& context,
-  SVMImplArray& bags,
+  BagViewArray& bags,
+  SVMImpl* train_svm,
   DTree* predictor,
-  bool anneal)
+  bool anneal,
+  unsigned long train_bags,
+  const ContextParams& context_params,
+  const std::vector<PredValue>* train_margins)
 {
+  ProfileScope profile_scope(Profiler::P_PREPARE_BAGS);
+
+  static const Fold FOLDS[] = {
+    //{ 1.0, 10 },
+    //{ 0.9, 5 },
+    // annealing
+    //{ 0.8, 5 },
+    { 0.5, 2 },
+    { 0.3, 2 }
+    //{ 0.1, 1 }
+  };
+
+  (void)FOLDS;
+
+  //static const Fold FOLDS[] = { { 0.0, 3 }, { 1.0, 3 }, { 0.9, 10 }, { 0.5, 10 }, { 0.3, 10 }, { 0.1, 10 }, { 0.05, 10 } };
+
   std::cout << "to prepare bags" << std::endl;
 
-  for(auto bag_it = bags.begin(); bag_it != bags.end(); ++bag_it)
+  // all bags are views over one labeled copy of train set,
+  // margins of predictor can be restored from checkpoint
+  SVMImpl_var bags_svm = train_margins ?
+    train_svm->copy(PredictedBoolLabelSetConverter(*train_margins)) :
+    train_svm->copy(PredictedBoolLabelAddConverter<DTree>(predictor));
+
+  if(anneal)
   {
-    *bag_it = (*bag_it)->copy(PredictedBoolLabelAddConverter<DTree>(predictor));
+    bags_svm = bags_svm->copy(PredictedBoolLabelAnnealer());
+  }
 
-    if(anneal)
-    {
-      *bag_it = (*bag_it)->copy(PredictedBoolLabelAnnealer());
-    }
+  bags.clear();
+
+  if(train_bags > 0)
+  {
+    div_bags_(bags, train_bags, bags_svm);
+    //std::cerr << "bags: " << bags.size() << std::endl;
+    //fill_bags_(bags, FOLDS, train_bags, bags_svm);
+  }
+  else
+  {
+    bags.push_back(BagView(bags_svm->size(), 1));
   }
 
-  context = TreeLearner<PredictedBoolLabel>::create_context(bags);
+  context = TreeLearner<PredictedBoolLabel>::create_context(
+    bags_svm,
+    bags,
+    context_params);
+
+  profile_scope.add_rows(bags_svm->size());
 
   /*
   std::cout << "bags prepared (" << bags.size() << "): ";
@@ -1052,7 +1614,12 @@ Application_::train_dtree_set_(
   unsigned long threads,
   bool anneal,
   bool allow_negative_gain,
-  const MetricSelection& metric_selection)
+  const MetricSelection& metric_selection,
+  FeatureScreening& screening,
+  const ContextParams& context_params,
+  const CheckpointParams& checkpoint_params,
+  const ProfileParams& profile_params,
+  TrainCheckpoint* resume_checkpoint)
   throw()
 {
   //const bool USE_NEGATIVE_GAIN = true;
@@ -1074,7 +1641,7 @@ Application_::train_dtree_set_(
 
   // prepare bags
   TreeLearner<PredictedBoolLabel>::Context_var context;
-  SVMImplArray bags;
+  BagViewArray bags;
   SVMImpl_var test_svm;
   SVMImpl_var train_svm;
 
@@ -1084,6 +1651,28 @@ Application_::train_dtree_set_(
   best_test0_logloss = 1000000.0;
   best_dtree = cur_dtree ? cur_dtree->copy() : DTree_var();
 
+  // margins of cur_dtree restored from checkpoint
+  std::vector<PredValue> train_margins;
+  unsigned long start_gi = 0;
+
+  if(resume_checkpoint)
+  {
+    start_gi = resume_checkpoint->iteration;
+    cur_dtree = resume_checkpoint->cur_dtree;
+    best_dtree = resume_checkpoint->best_dtree;
+    best_test0_logloss = resume_checkpoint->best_test0_logloss;
+    screening.checks = resume_checkpoint->screen_checks;
+    screening.misses = resume_checkpoint->screen_misses;
+    train_margins.swap(resume_checkpoint->train_margins);
+
+    ThreadRand::set_seed(resume_checkpoint->rand_seed);
+    ThreadRand::get().set_state(resume_checkpoint->rand_state);
+
+    std::cout << "[RESUME]: iteration = " << start_gi <<
+      ", nodes count = " << (cur_dtree ? cur_dtree->node_count() : 0) <<
+      " (" << Gears::Time::get_time_of_day().gm_ft() << ")" << std::endl;
+  }
+  else
   {
     // print init state
     DTree_var tree = cur_dtree ? cur_dtree : DTree_var(new DTree());
@@ -1109,22 +1698,32 @@ Application_::train_dtree_set_(
       "(" << Gears::Time::get_time_of_day().gm_ft() << ")" <<
       std::endl;
   }
-  
-  for(unsigned long gi = 0; gi < max_global_iterations; ++gi)
-  {
-    bags.clear();
 
+  CheckpointWriter_var checkpoint_writer = !checkpoint_params.file.empty() ?
+    new CheckpointWriter(checkpoint_params.file, ext_train_svm) :
+    0;
+
+  for(unsigned long gi = start_gi; gi < max_global_iterations; ++gi)
+  {
     SVMImpl_var add_test_svm;
 
-    init_bags_(
-      bags,
+    init_train_svm_(
       add_test_svm,
       train_svm,
-      ext_train_svm,
-      train_bags);
+      ext_train_svm);
 
     //double base_test_logloss = eval_reg_logloss_(cur_dtree, test_svm);
-    prepare_bags_(context, bags, cur_dtree, anneal);
+    prepare_bags_(
+      context,
+      bags,
+      train_svm,
+      cur_dtree,
+      anneal,
+      train_bags,
+      context_params,
+      train_margins.empty() ? 0 : &train_margins);
+
+    train_margins.clear();
 
     // try extend existing trees
     // TODO: SVM for node
@@ -1149,7 +1748,9 @@ Application_::train_dtree_set_(
       false,
       allow_negative_gain,
       task_runner,
-      metric_selection);
+      metric_selection,
+      screening,
+      profile_params.memory_report);
 
     //const double gain = base_test_logloss - cur_logloss;
     cur_dtree = modified_dtree;
@@ -1193,9 +1794,17 @@ Application_::train_dtree_set_(
 
       const double train_logloss = Utils::log_reg_logloss(cur_dtree.in(), train_svm.in());
 
+      std::ostringstream screen_ostr;
+      if(screening.validate)
+      {
+        screen_ostr << ", screen-misses = " << screening.misses <<
+          "/" << screening.checks;
+      }
+
       std::cout << "[" << gi << "]: " <<
         "train-ll(" << train_svm->size() << "," << train_svm->grouped_rows.size() << ") = " << train_logloss <<
         test_ostr.str() <<
+        screen_ostr.str() <<
         ", nodes count = " << cur_dtree->node_count() <<
         ", metric = " << selected_metric <<
         " (" << Gears::Time::get_time_of_day().gm_ft() << ")" << (optimized ? " *" : "") <<
@@ -1203,9 +1812,45 @@ Application_::train_dtree_set_(
         cur_dtree->to_string("  ") << std::endl;
     }
 
+    if(checkpoint_writer &&
+      ((gi + 1) % checkpoint_params.period == 0 || gi + 1 == max_global_iterations))
+    {
+      // state at start of next iteration: train margins evaluated by writer
+      TrainCheckpoint_var checkpoint = new TrainCheckpoint();
+      checkpoint->iteration = gi + 1;
+      checkpoint->rand_seed = ThreadRand::seed();
+      checkpoint->rand_state = ThreadRand::get().state();
+      checkpoint->best_test0_logloss = best_test0_logloss;
+      checkpoint->screen_checks = screening.checks;
+      checkpoint->screen_misses = screening.misses;
+      checkpoint->cur_dtree = cur_dtree->copy();
+      checkpoint->best_dtree = best_dtree ? best_dtree->copy() : DTree_var();
+      checkpoint_writer->write(checkpoint);
+    }
+
+    Profiler::set_iteration(gi + 1);
+
+    if(!profile_params.file.empty() &&
+      (gi + 1) % profile_params.period == 0)
+    {
+      try
+      {
+        Profiler::save(profile_params.file, false);
+      }
+      catch(const Gears::Exception& ex)
+      {
+        std::cerr << "can't save profile: " << ex.what() << std::endl;
+      }
+    }
+
     //prev_logloss = test_logloss;
   }
 
+  if(checkpoint_writer)
+  {
+    checkpoint_writer->wait();
+  }
+
   if(task_runner)
   {
     task_runner->deactivate_object();
@@ -1230,7 +1875,9 @@ Application_::train_on_bags_(
   bool print_trace,
   bool allow_negative_gain,
   Gears::TaskRunner* task_runner,
-  const MetricSelection& metric_selection)
+  const MetricSelection& metric_selection,
+  FeatureScreening& screening,
+  bool memory_report)
 {
   TreeLearner<PredictedBoolLabel>::Context_var context =
     Gears::add_ref(ext_context);
@@ -1251,7 +1898,7 @@ Application_::train_on_bags_(
   //std::cout << "==============" << std::endl;
 
   // select metric
-  unsigned long metric_i = Gears::safe_rand(
+  unsigned long metric_i = ThreadRand::rand(
     metric_selection.sqd + metric_selection.logloss);
 
   if(metric_i < metric_selection.sqd)
@@ -1273,7 +1920,8 @@ Application_::train_on_bags_(
         alpha_coef,
         TreeLearner<PredictedBoolLabel>::LearnContext::FSS_BEST,
         allow_negative_gain,
-        gain_check_bags);
+        gain_check_bags,
+        &screening);
     }
     else
     {
@@ -1283,7 +1931,14 @@ Application_::train_on_bags_(
         alpha_coef,
         TreeLearner<PredictedBoolLabel>::LearnContext::FSS_BEST,
         allow_negative_gain,
-        gain_check_bags);
+        gain_check_bags,
+        &screening);
+    }
+
+    if(memory_report || memory_report_requested)
+    {
+      memory_report_requested = 0;
+      print_memory_usage_(std::cout, train_svm, test_svms, context, learn_context);
     }
 
     std::vector<DTree_var> prev_dtrees;
@@ -1345,7 +2000,7 @@ Application_::DTreeProp_var
 Application_::fill_dtree_prop_(
   unsigned long step_depth,
   unsigned long best_iteration,
-  const SVMImplArray& bags,
+  const BagViewArray& bags,
   unsigned long train_size)
 {
   DTreeProp_var res = new DTreeProp();
@@ -1370,7 +2025,8 @@ Application_::fill_dtree_prop_(
       {
         ss << ",";
       }
-      ss << (static_cast<double>((*bag_it)->size()) / train_size);
+      ss << (static_cast<double>(
+        std::accumulate(bag_it->begin(), bag_it->end(), 0ul)) / train_size);
     }
     res->props["bags"] = ss.str();
   }
@@ -1380,11 +2036,11 @@ Application_::fill_dtree_prop_(
 
 void
 Application_::div_bags_(
-  SVMImplArray& bags,
+  BagViewArray& bags,
   unsigned long bag_number,
   SVMImpl* svm)
 {
-  svm->portions_div(bags, bag_number);
+  TreeLearner<PredictedBoolLabel>::fill_portion_bags(bags, svm->size(), bag_number);
 
   std::cout << "bags filled: " << bag_number << std::endl;
 }
@@ -1392,7 +2048,7 @@ Application_::div_bags_(
 template<int FOLD_SIZE>
 void
 Application_::fill_bags_(
-  SVMImplArray& bags,
+  BagViewArray& bags,
   const Fold (&folds)[FOLD_SIZE],
   unsigned long bag_number,
   SVMImpl* svm)
@@ -1409,7 +2065,7 @@ Application_::fill_bags_(
   {
     // select folds randomly
     unsigned long fold_index = 0;
-    unsigned long c_fold = Gears::safe_rand(fold_sum);
+    unsigned long c_fold = ThreadRand::rand(fold_sum);
     unsigned long cur_fold_sum = 0;
 
     for(unsigned long i = 0; i < FOLD_SIZE; ++i)
@@ -1424,38 +2080,16 @@ Application_::fill_bags_(
 
     unsigned long part_size = static_cast<unsigned long>(folds[fold_index].portion * svm->size());
 
-    SVMImpl_var part_svm;
-
-    /*
-    for(auto row_it = svm->grouped_rows.begin(); row_it != svm->grouped_rows.end(); ++row_it)
-    {
-      std::cout << "X>> label = " << (*row_it)->label.orig() <<
-        ", pred = " << (*row_it)->label.pred <<
-        ": " << (*row_it)->rows.size() << std::endl;
-    }
-    */
+    bags.push_back(BagView());
 
     if(part_size > 0)
     {
-      part_svm = svm->part(part_size);
+      TreeLearner<PredictedBoolLabel>::fill_part_bag(bags.back(), svm->size(), part_size);
     }
     else
     {
-      part_svm = Gears::add_ref(svm);
-    }
-
-    /*
-    for(auto row_it = part_svm->grouped_rows.begin(); row_it != part_svm->grouped_rows.end(); ++row_it)
-    {
-      std::cout << "P>> label = " << (*row_it)->label.orig() <<
-        ", pred = " << (*row_it)->label.pred <<
-        ": " << (*row_it)->rows.size() << std::endl;
+      bags.back().assign(svm->size(), 1);
     }
-
-    std::cout << std::endl;
-    */
-
-    bags.push_back(part_svm);
   }
 
   std::cout << "bags filled" << std::endl;
@@ -1479,7 +2113,7 @@ Application_::fill_bags_(
   {
     // select folds randomly
     unsigned long fold_index = 0;
-    unsigned long c_fold = Gears::safe_rand(fold_sum);
+    unsigned long c_fold = ThreadRand::rand(fold_sum);
     unsigned long cur_fold_sum = 0;
 
     for(auto fold_it = folds.begin(); fold_it != folds.end(); ++fold_it)
@@ -22,6 +22,7 @@
 #define UTILS_DTREETRAINER_APPLICATION_HPP_
 
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <vector>
 
@@ -33,6 +34,9 @@
 
 #include <DTree/TreeLearner.hpp>
 #include <DTree/Label.hpp>
+#include <DTree/BinaryModel.hpp>
+
+#include "Checkpoint.hpp"
 
 using namespace Vanga;
 
@@ -55,10 +59,41 @@ public:
     unsigned long logloss;    
   };
 
+  // CheckpointParams
+  //   file: checkpoint saved after each period global iterations
+  //     if defined
+  struct CheckpointParams
+  {
+    CheckpointParams()
+      : period(1)
+    {}
+
+    std::string file;
+    unsigned long period;
+  };
+
+  // ProfileParams
+  //   file: phases profile saved after each period global iterations
+  //     and at end of run if defined,
+  //   memory_report: print memory usage after each train step
+  //     (also printed on SIGUSR1)
+  struct ProfileParams
+  {
+    ProfileParams()
+      : period(1),
+        memory_report(false)
+    {}
+
+    std::string file;
+    unsigned long period;
+    bool memory_report;
+  };
+
   DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
 
   typedef PredictedLogLossGain UseLogLossGain;
   //typedef LogLossGain UseLogLossGain;
+  typedef TreeLearner<PredictedBoolLabel>::ContextParams ContextParams;
 
   struct Fold
   {
@@ -96,6 +131,14 @@ public:
 
   typedef std::vector<SVMImpl_var> SVMImplArray;
 
+  typedef TreeLearner<PredictedBoolLabel>::BagView BagView;
+
+  typedef TreeLearner<PredictedBoolLabel>::BagViewArray BagViewArray;
+
+  typedef TreeLearner<PredictedBoolLabel>::FeatureScreening FeatureScreening;
+
+  typedef std::unordered_map<const Row*, float> RowMarginMap;
+
 public:
   Application_() throw();
 
@@ -131,7 +174,12 @@ protected:
     unsigned long threads,
     bool anneal,
     bool allow_negative_gain,
-    const MetricSelection& metric_selection)
+    const MetricSelection& metric_selection,
+    FeatureScreening& screening,
+    const ContextParams& context_params,
+    const CheckpointParams& checkpoint_params,
+    const ProfileParams& profile_params,
+    TrainCheckpoint* resume_checkpoint)
     throw();
 
   double
@@ -149,22 +197,52 @@ protected:
     bool print_trace,
     bool allow_negative_gain,
     Gears::TaskRunner* task_runner,
-    const MetricSelection& metric_selection);
+    const MetricSelection& metric_selection,
+    FeatureScreening& screening,
+    bool memory_report);
+
+  // memory usage of train and test sets, learner structures and buffer pools
+  static void
+  print_memory_usage_(
+    std::ostream& ostr,
+    const SVMImpl* train_svm,
+    const std::list<SVMImpl_var>& test_svms,
+    const TreeLearner<PredictedBoolLabel>::Context* context,
+    const TreeLearner<PredictedBoolLabel>::LearnContext* learn_context);
+
+  static std::vector<std::string>
+  split_files_(const std::string& files);
+
+  // base margins: float per row (rows in file order)
+  static SVMImpl_var
+  set_margins_(
+    const SVMImpl* svm,
+    const RowArray& rows,
+    const std::string& file);
+
+  static void
+  save_margins_(
+    const std::string& file,
+    const SVMImpl* svm,
+    const RowArray& rows,
+    const DTree* tree);
 
   void
-  init_bags_(
-    SVMImplArray& bags,
+  init_train_svm_(
     SVMImpl_var& test_svm,
     SVMImpl_var& train_svm,
-    SVMImpl* ext_train_svm,
-    unsigned long train_bags);
+    SVMImpl* ext_train_svm);
 
   void
   prepare_bags_(
     TreeLearner<PredictedBoolLabel>::Context_var& context,
-    SVMImplArray& bags,
+    BagViewArray& bags,
+    SVMImpl* train_svm,
     DTree* predictor,
-    bool anneal);
+    bool anneal,
+    unsigned long train_bags,
+    const ContextParams& context_params,
+    const std::vector<PredValue>* train_margins);
 
   void
   select_best_forest_(
@@ -175,14 +253,14 @@ protected:
 
   void
   div_bags_(
-    SVMImplArray& bags,
+    BagViewArray& bags,
     unsigned long bag_number,
     SVMImpl* svm);
 
   template<int FOLD_SIZE>
   void
   fill_bags_(
-    SVMImplArray& bags,
+    BagViewArray& bags,
     const Fold (&folds)[FOLD_SIZE],
     unsigned long bag_number,
     SVMImpl* svm);
@@ -191,7 +269,7 @@ protected:
   fill_dtree_prop_(
     unsigned long step_depth,
     unsigned long best_iteration,
-    const SVMImplArray& bags,
+    const BagViewArray& bags,
     unsigned long train_size);
 
   void
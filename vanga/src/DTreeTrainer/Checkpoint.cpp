@@ -0,0 +1,371 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+
+#include <Gears/Basic/Errno.hpp>
+#include <Gears/Basic/Hash.hpp>
+
+#include "Checkpoint.hpp"
+
+namespace Vanga
+{
+  namespace
+  {
+    const char CHECKPOINT_HEAD[8] = { 'V', 'N', 'G', 'C', 'K', 'P', 'T', '2' };
+
+    class Callback: public Gears::ActiveObjectCallback
+    {
+    public:
+      void report_error(
+        Gears::ActiveObjectCallback::Severity severity,
+        const Gears::SubString& description,
+        const Gears::SubString& error_code = Gears::SubString())
+        throw()
+      {
+        try
+        {
+          std::cerr << severity << "(" << error_code << "): " <<
+            description << std::endl;
+        }
+        catch (...) {}
+      }
+    };
+
+    template<typename ValueType>
+    void
+    write_value(std::ostream& ostr, const ValueType& val)
+    {
+      ostr.write(reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+
+    template<typename ValueType>
+    void
+    read_value(std::istream& istr, ValueType& val)
+    {
+      istr.read(reinterpret_cast<char*>(&val), sizeof(val));
+
+      if(istr.fail())
+      {
+        throw TrainCheckpoint::Exception(
+          "TrainCheckpoint::load(): unexpected end of checkpoint");
+      }
+    }
+  }
+
+  // CheckpointWriter::WriteTask
+  // writer isn't referenced by task: writer destructor waits tasks,
+  // and the last reference released by task would destroy writer
+  // (and join task runner) in task runner thread
+  class CheckpointWriter::WriteTask: public Gears::Task
+  {
+  public:
+    WriteTask(CheckpointWriter* writer, TrainCheckpoint* checkpoint)
+      : writer_(writer),
+        checkpoint_(Gears::add_ref(checkpoint))
+    {}
+
+    virtual void
+    execute() throw()
+    {
+      writer_->write_(checkpoint_);
+    }
+
+  protected:
+    virtual ~WriteTask() throw() = default;
+
+  protected:
+    CheckpointWriter* const writer_;
+    const TrainCheckpoint_var checkpoint_;
+  };
+
+  // TrainCheckpoint
+  TrainCheckpoint::TrainCheckpoint()
+    : iteration(0),
+      rand_seed(0),
+      best_test0_logloss(0.0),
+      screen_checks(0),
+      screen_misses(0),
+      train_checksum(0)
+  {
+    rand_state.key = 0;
+    rand_state.counter = 0;
+  }
+
+  void
+  TrainCheckpoint::save(const std::string& file) const
+  {
+    const std::string tmp_file = file + ".tmp";
+
+    {
+      std::ofstream ostr(tmp_file.c_str(), std::ios::binary | std::ios::trunc);
+
+      if(!ostr.is_open())
+      {
+        Gears::ErrorStream err;
+        err << "TrainCheckpoint::save(): can't open '" << tmp_file << "'";
+        throw Exception(err.str());
+      }
+
+      const uint32_t pred_size = sizeof(PredValue);
+      const uint64_t iteration_val = iteration;
+      const uint64_t screen_checks_val = screen_checks;
+      const uint64_t screen_misses_val = screen_misses;
+      const uint8_t trees = (cur_dtree ? 1 : 0) | (best_dtree ? 2 : 0);
+      const uint64_t margins_number = train_margins.size();
+
+      ostr.write(CHECKPOINT_HEAD, sizeof(CHECKPOINT_HEAD));
+      write_value(ostr, pred_size);
+      write_value(ostr, iteration_val);
+      write_value(ostr, rand_seed);
+      write_value(ostr, rand_state.key);
+      write_value(ostr, rand_state.counter);
+      write_value(ostr, best_test0_logloss);
+      write_value(ostr, screen_checks_val);
+      write_value(ostr, screen_misses_val);
+      write_value(ostr, trees);
+
+      if(cur_dtree)
+      {
+        cur_dtree->save_binary(ostr);
+      }
+
+      if(best_dtree)
+      {
+        best_dtree->save_binary(ostr);
+      }
+
+      write_value(ostr, train_checksum);
+      write_value(ostr, margins_number);
+      ostr.write(
+        reinterpret_cast<const char*>(train_margins.data()),
+        train_margins.size() * sizeof(PredValue));
+
+      ostr.close();
+
+      if(ostr.fail())
+      {
+        Gears::ErrorStream err;
+        err << "TrainCheckpoint::save(): can't write '" << tmp_file << "'";
+        throw Exception(err.str());
+      }
+    }
+
+    if(::rename(tmp_file.c_str(), file.c_str()) < 0)
+    {
+      Gears::throw_errno_exception<Exception>(
+        "TrainCheckpoint::save(): can't rename '", tmp_file.c_str(),
+        "' to '", file.c_str(), "'");
+    }
+  }
+
+  TrainCheckpoint_var
+  TrainCheckpoint::load(const std::string& file)
+  {
+    std::ifstream istr(file.c_str(), std::ios::binary);
+
+    if(!istr.is_open())
+    {
+      Gears::ErrorStream err;
+      err << "TrainCheckpoint::load(): can't open '" << file << "'";
+      throw Exception(err.str());
+    }
+
+    char head[sizeof(CHECKPOINT_HEAD)];
+    istr.read(head, sizeof(head));
+
+    if(istr.fail() || ::memcmp(head, CHECKPOINT_HEAD, sizeof(head)) != 0)
+    {
+      Gears::ErrorStream err;
+      err << "TrainCheckpoint::load(): '" << file << "' isn't checkpoint";
+      throw Exception(err.str());
+    }
+
+    uint32_t pred_size;
+    read_value(istr, pred_size);
+
+    if(pred_size != sizeof(PredValue))
+    {
+      Gears::ErrorStream err;
+      err << "TrainCheckpoint::load(): '" << file <<
+        "' saved with other prediction type (VANGA_FLOAT_PREDS)";
+      throw Exception(err.str());
+    }
+
+    TrainCheckpoint_var res = new TrainCheckpoint();
+
+    uint64_t iteration_val;
+    uint64_t screen_checks_val;
+    uint64_t screen_misses_val;
+    uint8_t trees;
+    uint64_t margins_number;
+
+    read_value(istr, iteration_val);
+    read_value(istr, res->rand_seed);
+    read_value(istr, res->rand_state.key);
+    read_value(istr, res->rand_state.counter);
+    read_value(istr, res->best_test0_logloss);
+    read_value(istr, screen_checks_val);
+    read_value(istr, screen_misses_val);
+    read_value(istr, trees);
+
+    res->iteration = iteration_val;
+    res->screen_checks = screen_checks_val;
+    res->screen_misses = screen_misses_val;
+
+    if(trees & 1)
+    {
+      res->cur_dtree = DTree::load_binary(istr);
+    }
+
+    if(trees & 2)
+    {
+      res->best_dtree = DTree::load_binary(istr);
+    }
+
+    read_value(istr, res->train_checksum);
+    read_value(istr, margins_number);
+
+    res->train_margins.resize(margins_number);
+    istr.read(
+      reinterpret_cast<char*>(res->train_margins.data()),
+      margins_number * sizeof(PredValue));
+
+    if(istr.fail())
+    {
+      throw Exception("TrainCheckpoint::load(): unexpected end of checkpoint");
+    }
+
+    return res;
+  }
+
+  uint64_t
+  TrainCheckpoint::rows_checksum(const SVM<PredictedBoolLabel>* svm) throw()
+  {
+    Gears::Murmur64Hasher hasher(0);
+
+    for(auto group_it = svm->grouped_rows.begin();
+      group_it != svm->grouped_rows.end(); ++group_it)
+    {
+      const uint8_t label = (*group_it)->label.value ? 1 : 0;
+
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it)
+      {
+        const FeatureArray& features = (*row_it)->features;
+        const uint64_t features_number = features.size();
+
+        hasher.add(&label, sizeof(label));
+        hasher.add(&features_number, sizeof(features_number));
+        hasher.add(
+          features.data(),
+          features.size() * sizeof(FeatureArray::value_type));
+      }
+    }
+
+    return hasher.finalize();
+  }
+
+  // CheckpointWriter
+  CheckpointWriter::CheckpointWriter(
+    const std::string& file,
+    const SVM<PredictedBoolLabel>* train_svm)
+    : file_(file),
+      train_svm_(Gears::add_ref(train_svm)),
+      train_checksum_(TrainCheckpoint::rows_checksum(train_svm)),
+      writes_in_progress_(0)
+  {
+    Gears::ActiveObjectCallback_var callback(new Callback());
+    task_runner_ = new Gears::TaskRunner(callback, 1);
+    task_runner_->activate_object();
+  }
+
+  CheckpointWriter::~CheckpointWriter() throw()
+  {
+    wait();
+
+    task_runner_->deactivate_object();
+    task_runner_->wait_object();
+  }
+
+  void
+  CheckpointWriter::write(TrainCheckpoint* checkpoint) throw()
+  {
+    {
+      Gears::ConditionGuard guard(lock_, cond_);
+      ++writes_in_progress_;
+    }
+
+    task_runner_->enqueue_task(Gears::Task_var(new WriteTask(this, checkpoint)));
+  }
+
+  void
+  CheckpointWriter::wait() throw()
+  {
+    Gears::ConditionGuard guard(lock_, cond_);
+
+    while(writes_in_progress_ > 0)
+    {
+      guard.wait();
+    }
+  }
+
+  void
+  CheckpointWriter::write_(TrainCheckpoint* checkpoint) throw()
+  {
+    // margins are evaluated here: they are needed only for resume
+    PredictedBoolLabelAddConverter<DTree> add_converter(checkpoint->cur_dtree);
+
+    checkpoint->train_checksum = train_checksum_;
+    checkpoint->train_margins.clear();
+    checkpoint->train_margins.reserve(train_svm_->size());
+
+    for(auto group_it = train_svm_->grouped_rows.begin();
+      group_it != train_svm_->grouped_rows.end(); ++group_it)
+    {
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it)
+      {
+        checkpoint->train_margins.push_back(
+          add_converter(*row_it, (*group_it)->label).pred);
+      }
+    }
+
+    try
+    {
+      checkpoint->save(file_);
+    }
+    catch(const Gears::Exception& ex)
+    {
+      std::cerr << "can't save checkpoint: " << ex.what() << std::endl;
+    }
+
+    Gears::ConditionGuard guard(lock_, cond_);
+
+    if(--writes_in_progress_ == 0)
+    {
+      cond_.signal();
+    }
+  }
+}
@@ -0,0 +1,120 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <string>
+#include <vector>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+#include <Gears/Threading/TaskRunner.hpp>
+
+#include <DTree/DTree.hpp>
+#include <DTree/Label.hpp>
+#include <DTree/Rand.hpp>
+#include <DTree/SVM.hpp>
+
+namespace Vanga
+{
+  // TrainCheckpoint: train-trees state between global iterations,
+  // learner context is recreated at each global iteration from
+  // current tree and train margins
+  struct TrainCheckpoint: public Gears::AtomicRefCountable
+  {
+    DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+    TrainCheckpoint();
+
+    // saved over temporary file and renamed:
+    // previous checkpoint is kept if save interrupted
+    void
+    save(const std::string& file) const;
+
+    static Gears::IntrusivePtr<TrainCheckpoint>
+    load(const std::string& file);
+
+    // checksum of train rows (labels and features) in train_margins order
+    static uint64_t
+    rows_checksum(const SVM<PredictedBoolLabel>* svm) throw();
+
+    // next global iteration
+    unsigned long iteration;
+    uint64_t rand_seed;
+    Rand::State rand_state;
+    double best_test0_logloss;
+    unsigned long screen_checks;
+    unsigned long screen_misses;
+    DTree_var cur_dtree;
+    DTree_var best_dtree;
+    // margins of cur_dtree in rows order of train SVM,
+    // resume is allowed only for train SVM with equal rows_checksum
+    uint64_t train_checksum;
+    std::vector<PredValue> train_margins;
+
+  protected:
+    virtual ~TrainCheckpoint() throw() {}
+  };
+
+  typedef Gears::IntrusivePtr<TrainCheckpoint> TrainCheckpoint_var;
+
+  // CheckpointWriter: save checkpoints in background thread,
+  // checkpoint train margins evaluated by writer
+  class CheckpointWriter: public Gears::AtomicRefCountable
+  {
+  public:
+    CheckpointWriter(
+      const std::string& file,
+      const SVM<PredictedBoolLabel>* train_svm);
+
+    // checkpoint shouldn't be changed after call
+    void
+    write(TrainCheckpoint* checkpoint) throw();
+
+    // wait all enqueued checkpoints
+    void
+    wait() throw();
+
+  protected:
+    class WriteTask;
+
+  protected:
+    virtual ~CheckpointWriter() throw();
+
+    void
+    write_(TrainCheckpoint* checkpoint) throw();
+
+  protected:
+    const std::string file_;
+    const Gears::IntrusivePtr<const SVM<PredictedBoolLabel> > train_svm_;
+    const uint64_t train_checksum_;
+    Gears::TaskRunner_var task_runner_;
+    Gears::Mutex lock_;
+    Gears::Condition cond_;
+    unsigned long writes_in_progress_;
+  };
+
+  typedef Gears::IntrusivePtr<CheckpointWriter> CheckpointWriter_var;
+}
+
+#endif /*CHECKPOINT_HPP_*/
@@ -0,0 +1,403 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// BinaryModelTest: text model converted to binary and back should give
+// the same predictions, corrupted binary files should be rejected
+// with BinaryModel::Exception
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <DTree/DTree.hpp>
+#include <DTree/PredictorSet.hpp>
+#include <DTree/BinaryModel.hpp>
+
+#include <Common/RandomModel.hpp>
+
+using namespace Vanga;
+
+typedef Gears::IntrusivePtr<BinaryModel> BinaryModel_var;
+
+const unsigned long FEATURES = 200;
+const unsigned long ROWS = 5000;
+
+// random model in text format (with head)
+std::string
+generate_tree_text(std::mt19937& rnd)
+{
+  DTree_var tree = TestUtils::generate_tree(rnd, FEATURES);
+
+  std::ostringstream tree_ostr;
+  tree->save(tree_ostr);
+  return tree_ostr.str();
+}
+
+std::string
+generate_set(std::mt19937& rnd)
+{
+  PredictorSet_var predictor_set = new PredictorSet();
+
+  for(unsigned long tree_i = 0; tree_i < 3; ++tree_i)
+  {
+    std::istringstream tree_istr(generate_tree_text(rnd));
+    predictor_set->add(DTree::load(tree_istr).in(), 0.2 + 0.3 * tree_i);
+  }
+
+  std::ostringstream set_ostr;
+  predictor_set->save(set_ostr);
+  return set_ostr.str();
+}
+
+void
+write_file(const std::string& file_path, const std::string& content)
+{
+  std::ofstream file(file_path.c_str(), std::ios::binary | std::ios::trunc);
+  file.write(content.data(), content.size());
+}
+
+std::string
+binary_image(const BinaryModel* model)
+{
+  std::ostringstream ostr;
+  model->save(ostr);
+  return ostr.str();
+}
+
+std::string
+text_image(const BinaryModel* model)
+{
+  std::ostringstream ostr;
+  model->save_text(ostr);
+  return ostr.str();
+}
+
+template<typename ValueType>
+void
+patch(std::string& image, uint64_t offset, ValueType value)
+{
+  std::memcpy(&image[offset], &value, sizeof(value));
+}
+
+// text -> binary -> text: binary and restored text models should predict
+// as source model, second conversion should give the same text
+template<typename PredictorType>
+bool
+check_round_trip(
+  const char* name,
+  const std::string& dir,
+  const std::string& text,
+  std::mt19937& rnd)
+{
+  std::istringstream text_istr(text);
+  Gears::IntrusivePtr<PredictorType> predictor = PredictorType::load(text_istr);
+
+  const std::string binary_path = dir + "/" + name + ".bm";
+  const std::string text_path = dir + "/" + name + ".txt";
+
+  {
+    BinaryModel_var source_model = new BinaryModel(predictor.in());
+    write_file(binary_path, binary_image(source_model));
+  }
+
+  BinaryModel_var binary_model = BinaryModel::load(binary_path);
+  const std::string restored_text = text_image(binary_model);
+
+  std::istringstream restored_istr(restored_text);
+  Gears::IntrusivePtr<PredictorType> restored_predictor =
+    PredictorType::load(restored_istr);
+
+  // text model is loaded by BinaryModel::load as is
+  write_file(text_path, restored_text);
+  BinaryModel_var text_model = BinaryModel::load(text_path);
+
+  unsigned long errors = 0;
+
+  if(BinaryModel::is_binary(text_path) || !BinaryModel::is_binary(binary_path))
+  {
+    std::cerr << name << ": is_binary doesn't distinguish formats" << std::endl;
+    ++errors;
+  }
+
+  if(text_image(text_model) != restored_text)
+  {
+    std::cerr << name << ": text changed by second conversion:" << std::endl <<
+      text_image(text_model) << std::endl << "expected:" << std::endl <<
+      restored_text << std::endl;
+    ++errors;
+  }
+
+  std::vector<FeatureArray> rows;
+  rows.reserve(ROWS);
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    rows.push_back(TestUtils::generate_row(rnd, FEATURES));
+  }
+
+  std::vector<const FeatureArray*> row_ptrs;
+  for(auto row_it = rows.begin(); row_it != rows.end(); ++row_it)
+  {
+    row_ptrs.push_back(&*row_it);
+  }
+
+  std::vector<double> block_preds(ROWS);
+  binary_model->predict(block_preds.data(), row_ptrs.data(), ROWS);
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    const double pred = predictor->fpredict(rows[row_i]);
+    const double binary_pred = binary_model->fpredict(rows[row_i]);
+    const double restored_pred = restored_predictor->fpredict(rows[row_i]);
+
+    if(pred != binary_pred || pred != block_preds[row_i] ||
+      pred != restored_pred)
+    {
+      if(errors < 10)
+      {
+        std::cerr << name << ": row #" << row_i << ": " << pred <<
+          ", binary: " << binary_pred <<
+          ", block: " << block_preds[row_i] <<
+          ", restored: " << restored_pred << std::endl;
+      }
+
+      ++errors;
+    }
+  }
+
+  std::cout << name << ": " << (errors ? "FAILED" : "OK") << std::endl;
+  return errors == 0;
+}
+
+// expect that corrupted image is rejected with BinaryModel::Exception
+bool
+check_rejected(
+  const std::string& dir,
+  const char* name,
+  const std::string& image)
+{
+  const std::string file_path = dir + "/" + name + ".bm";
+  write_file(file_path, image);
+
+  bool ok = false;
+
+  try
+  {
+    BinaryModel_var model(new BinaryModel(file_path));
+    std::cerr << name << ": corrupted file is loaded" << std::endl;
+  }
+  catch(const BinaryModel::Exception&)
+  {
+    ok = true;
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << name << ": unexpected exception: " << ex.what() << std::endl;
+  }
+
+  std::cout << "rejected(" << name << "): " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+bool
+check_corrupted(const std::string& dir, const std::string& text)
+{
+  std::istringstream text_istr(text);
+  DTree_var tree = DTree::load(text_istr);
+  BinaryModel_var model = new BinaryModel(tree.in());
+  const std::string image = binary_image(model);
+
+  BinaryModel::TreeHeader tree_header;
+  std::memcpy(
+    &tree_header,
+    image.data() + sizeof(BinaryModel::Header),
+    sizeof(tree_header));
+
+  const uint64_t tree_header_offset = sizeof(BinaryModel::Header);
+  const uint64_t section_end = tree_header.offset +
+    sizeof(CompiledDTree::Node) * tree_header.node_count +
+    sizeof(CompiledDTree::Branch) * tree_header.branch_count +
+    sizeof(uint32_t) * tree_header.feature_count;
+  const uint64_t branches_offset = tree_header.offset +
+    sizeof(CompiledDTree::Node) * tree_header.node_count;
+
+  bool ok = true;
+
+  ok &= check_rejected(dir, "empty", std::string());
+  ok &= check_rejected(dir, "truncated_header", image.substr(0, 12));
+  ok &= check_rejected(
+    dir,
+    "truncated_tree_header",
+    image.substr(0, tree_header_offset + sizeof(tree_header) - 1));
+  ok &= check_rejected(
+    dir, "truncated_section", image.substr(0, section_end - 1));
+
+  {
+    std::string corrupted = image;
+    corrupted[0] = 'X';
+    ok &= check_rejected(dir, "bad_magic", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      offsetof(BinaryModel::Header, version),
+      BinaryModel::VERSION + 1);
+    ok &= check_rejected(dir, "bad_version", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(corrupted, offsetof(BinaryModel::Header, type), PT_SET);
+    patch<uint32_t>(
+      corrupted, offsetof(BinaryModel::Header, tree_count), 0xFFFFFFFF);
+    ok &= check_rejected(dir, "bad_tree_count", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      tree_header_offset + offsetof(BinaryModel::TreeHeader, node_count),
+      0xFFFFFFFF);
+    ok &= check_rejected(dir, "bad_node_count", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint64_t>(
+      corrupted,
+      tree_header_offset + offsetof(BinaryModel::TreeHeader, offset),
+      (image.size() + 8) / 8 * 8);
+    ok &= check_rejected(dir, "offset_after_end", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint64_t>(
+      corrupted,
+      tree_header_offset + offsetof(BinaryModel::TreeHeader, offset),
+      tree_header.offset + 4);
+    ok &= check_rejected(dir, "offset_unaligned", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint64_t>(
+      corrupted,
+      tree_header_offset + offsetof(BinaryModel::TreeHeader, offset),
+      0);
+    ok &= check_rejected(dir, "offset_in_header", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint64_t>(
+      corrupted,
+      tree_header_offset + offsetof(BinaryModel::TreeHeader, offset),
+      tree_header_offset);
+    ok &= check_rejected(dir, "offset_in_tree_header", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      tree_header.offset + offsetof(CompiledDTree::Node, branches_end),
+      tree_header.branch_count + 1);
+    ok &= check_rejected(dir, "node_branches_out_of_range", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      branches_offset + offsetof(CompiledDTree::Branch, yes_node),
+      tree_header.node_count);
+    ok &= check_rejected(dir, "branch_node_out_of_range", corrupted);
+  }
+
+  {
+    // child can't refer to root (cycle)
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      branches_offset + offsetof(CompiledDTree::Branch, no_node),
+      0);
+    ok &= check_rejected(dir, "branch_node_cycle", corrupted);
+  }
+
+  {
+    std::string corrupted = image;
+    patch<uint32_t>(
+      corrupted,
+      branches_offset + offsetof(CompiledDTree::Branch, feature_column),
+      tree_header.feature_count);
+    ok &= check_rejected(dir, "feature_column_out_of_range", corrupted);
+  }
+
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  char dir_template[] = "/tmp/BinaryModelTest.XXXXXX";
+  if(!::mkdtemp(dir_template))
+  {
+    std::cerr << "can't create temporary directory" << std::endl;
+    return 1;
+  }
+
+  const std::string dir(dir_template);
+
+  std::mt19937 rnd(19);
+  bool ok = true;
+
+  try
+  {
+    const std::string tree_text = generate_tree_text(rnd);
+    ok &= check_round_trip<DTree>("dtree_round_trip", dir, tree_text, rnd);
+    ok &= check_round_trip<PredictorSet>(
+      "set_round_trip", dir, generate_set(rnd), rnd);
+    ok &= check_corrupted(dir, tree_text);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  const std::string cleanup_cmd = "rm -rf " + dir;
+  if(::system(cleanup_cmd.c_str()) != 0)
+  {
+    std::cerr << "can't remove " << dir << std::endl;
+  }
+
+  return ok ? 0 : 1;
+}
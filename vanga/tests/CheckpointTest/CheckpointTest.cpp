@@ -0,0 +1,269 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// CheckpointTest: checkpoint writers created and destroyed repeatedly,
+// model trained with resume from checkpoint (DTreeTrainer from
+// the same bin directory) should be equal to uninterrupted model
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <DTree/DTree.hpp>
+#include <DTree/Label.hpp>
+#include <DTree/SVM.hpp>
+#include <DTreeTrainer/Checkpoint.hpp>
+
+using namespace Vanga;
+
+typedef SVM<PredictedBoolLabel> SVMImpl;
+typedef Gears::IntrusivePtr<SVMImpl> SVMImpl_var;
+
+const unsigned long FEATURES = 100;
+const unsigned long WRITERS = 300;
+
+// sparse rows, label defined by hidden weights of row features
+std::string
+generate_svm_text(std::mt19937& rnd, unsigned long rows)
+{
+  std::uniform_real_distribution<double> weight_dist(-1.0, 1.0);
+  std::vector<double> weights(FEATURES + 1);
+
+  for(auto weight_it = weights.begin(); weight_it != weights.end(); ++weight_it)
+  {
+    *weight_it = weight_dist(rnd);
+  }
+
+  std::ostringstream data_ostr;
+
+  for(unsigned long row_i = 0; row_i < rows; ++row_i)
+  {
+    std::ostringstream row_ostr;
+    double score = 0;
+
+    for(unsigned long feature_id = 1; feature_id <= FEATURES; ++feature_id)
+    {
+      if(rnd() % (feature_id + 4) < 4)
+      {
+        row_ostr << ' ' << feature_id << ":1";
+        score += weights[feature_id];
+      }
+    }
+
+    const bool label = score + weight_dist(rnd) > 0;
+    data_ostr << (label ? 1 : 0) << row_ostr.str() << std::endl;
+  }
+
+  return data_ostr.str();
+}
+
+void
+write_file(const std::string& file_path, const std::string& content)
+{
+  std::ofstream file(file_path.c_str(), std::ios::trunc);
+  file << content;
+}
+
+std::string
+read_file(const std::string& file_path)
+{
+  std::ifstream file(file_path.c_str());
+  std::ostringstream ostr;
+  ostr << file.rdbuf();
+  return ostr.str();
+}
+
+// last writer reference can be released while its write task
+// is finishing in writer thread
+bool
+check_writer_lifetime(const std::string& dir, std::mt19937& rnd)
+{
+  std::istringstream svm_istr(generate_svm_text(rnd, 200));
+  SVMImpl_var svm = SVMImpl::load(svm_istr);
+
+  std::istringstream tree_istr("1\t0.25\t3:2:0|5:0:2\n2\t0.5\t\n");
+  DTree_var tree = DTree::load(tree_istr, false);
+
+  const std::string file = dir + "/lifetime.ckpt";
+
+  for(unsigned long writer_i = 0; writer_i < WRITERS; ++writer_i)
+  {
+    CheckpointWriter_var writer = new CheckpointWriter(file, svm);
+
+    TrainCheckpoint_var checkpoint = new TrainCheckpoint();
+    checkpoint->iteration = writer_i + 1;
+    checkpoint->cur_dtree = tree;
+    writer->write(checkpoint);
+
+    if(writer_i % 2)
+    {
+      writer->wait();
+    }
+  }
+
+  TrainCheckpoint_var checkpoint = TrainCheckpoint::load(file);
+
+  bool ok = checkpoint->iteration == WRITERS &&
+    checkpoint->train_checksum == TrainCheckpoint::rows_checksum(svm) &&
+    checkpoint->train_margins.size() == svm->size();
+
+  auto margin_it = checkpoint->train_margins.begin();
+
+  for(auto group_it = svm->grouped_rows.begin();
+    ok && group_it != svm->grouped_rows.end(); ++group_it)
+  {
+    for(auto row_it = (*group_it)->rows.begin();
+      row_it != (*group_it)->rows.end(); ++row_it, ++margin_it)
+    {
+      const PredValue margin = (*group_it)->label.pred +
+        tree->fpredict((*row_it)->features);
+      ok &= *margin_it == margin;
+    }
+  }
+
+  std::cout << "writer_lifetime: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// train-trees with fixed seed: stopped at checkpoint and resumed
+// should give uninterrupted model, checkpoint of other train set rejected
+bool
+check_resume(
+  const std::string& dir,
+  const std::string& trainer,
+  std::mt19937& rnd)
+{
+  const std::string train_text = generate_svm_text(rnd, 2000);
+  write_file(dir + "/train.svm", train_text);
+  write_file(dir + "/test.svm", generate_svm_text(rnd, 500));
+
+  // the same rows in reversed order
+  std::vector<std::string> lines;
+  std::istringstream train_istr(train_text);
+  std::string line;
+
+  while(std::getline(train_istr, line))
+  {
+    lines.push_back(line);
+  }
+
+  std::ostringstream reversed_ostr;
+  for(auto line_it = lines.rbegin(); line_it != lines.rend(); ++line_it)
+  {
+    reversed_ostr << *line_it << std::endl;
+  }
+
+  write_file(dir + "/reversed.svm", reversed_ostr.str());
+
+  const std::string args = " --train-bags=3 --seed=7 --threads=2";
+  const std::string sets = " " + dir + "/train.svm " + dir + "/test.svm";
+
+  const std::string full_cmd = trainer + " train-trees " + dir + "/full.dtf" +
+    sets + args + " -n 4 >" + dir + "/full.out 2>&1";
+  // margins output changes rows collecting only
+  const std::string part_cmd = trainer + " train-trees " + dir + "/part.dtf" +
+    sets + args + " -n 2 --checkpoint=" + dir + "/resume.ckpt" +
+    " --train-pred-out=" + dir + "/part.pred >" + dir + "/part.out 2>&1";
+  const std::string resume_cmd = trainer + " train-trees " + dir + "/resumed.dtf" +
+    sets + args + " -n 4 --resume=" + dir + "/resume.ckpt >" +
+    dir + "/resumed.out 2>&1";
+  const std::string other_cmd = trainer + " train-trees " + dir + "/other.dtf " +
+    dir + "/reversed.svm " + dir + "/test.svm" + args +
+    " -n 4 --resume=" + dir + "/resume.ckpt >" + dir + "/other.out 2>&1";
+
+  bool ok = true;
+
+  if(::system(full_cmd.c_str()) != 0 ||
+    ::system(part_cmd.c_str()) != 0 ||
+    ::system(resume_cmd.c_str()) != 0)
+  {
+    std::cerr << "resume: train-trees failed, see " << dir << "/*.out" << std::endl;
+    ok = false;
+  }
+  else
+  {
+    const std::string full_model = read_file(dir + "/full.dtf");
+    const std::string resumed_model = read_file(dir + "/resumed.dtf");
+
+    if(full_model.empty() || full_model != resumed_model)
+    {
+      std::cerr << "resume: resumed model differs from uninterrupted model:" <<
+        std::endl << resumed_model << std::endl <<
+        "uninterrupted model:" << std::endl << full_model << std::endl;
+      ok = false;
+    }
+
+    if(::system(other_cmd.c_str()) == 0)
+    {
+      std::cerr << "resume: checkpoint applied to reordered train set" << std::endl;
+      ok = false;
+    }
+  }
+
+  std::cout << "resume: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char** argv)
+{
+  char dir_template[] = "/tmp/CheckpointTest.XXXXXX";
+  if(!::mkdtemp(dir_template))
+  {
+    std::cerr << "can't create temporary directory" << std::endl;
+    return 1;
+  }
+
+  const std::string dir(dir_template);
+  const std::string bin_path(argv[0]);
+  const std::string::size_type bin_dir_end = bin_path.rfind('/');
+  const std::string trainer = (bin_dir_end != std::string::npos ?
+    bin_path.substr(0, bin_dir_end + 1) : std::string("./")) + "DTreeTrainer";
+
+  std::mt19937 rnd(23);
+  bool ok = true;
+
+  try
+  {
+    ok &= check_writer_lifetime(dir, rnd);
+    ok &= check_resume(dir, trainer, rnd);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  if(ok)
+  {
+    const std::string cleanup_cmd = "rm -rf " + dir;
+    if(::system(cleanup_cmd.c_str()) != 0)
+    {
+      std::cerr << "can't remove " << dir << std::endl;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
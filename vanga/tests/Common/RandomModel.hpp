@@ -0,0 +1,117 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TESTS_COMMON_RANDOMMODEL_HPP_
+#define TESTS_COMMON_RANDOMMODEL_HPP_
+
+#include <cstring>
+#include <random>
+#include <sstream>
+
+#include <DTree/DTree.hpp>
+#include <DTree/SVM.hpp>
+
+// random models and rows for prediction tests:
+// odd feature ids are numeric (branch thresholds and row values in [0, 1))
+namespace TestUtils
+{
+  // write node and its subtrees (depth < 4) in DTree text format,
+  // returns node id
+  inline unsigned long
+  write_node(
+    std::ostream& out,
+    std::mt19937& rnd,
+    unsigned long features,
+    unsigned long& next_id,
+    unsigned long depth)
+  {
+    const unsigned long id = next_id++;
+    std::ostringstream branches;
+    const unsigned long branch_count = depth < 4 ? rnd() % 5 : 0;
+
+    for(unsigned long branch_i = 0; branch_i < branch_count; ++branch_i)
+    {
+      const unsigned long feature_id = rnd() % features;
+      const unsigned long yes_id = rnd() % 3 ?
+        write_node(out, rnd, features, next_id, depth + 1) : 0;
+      const unsigned long no_id = rnd() % 3 ?
+        write_node(out, rnd, features, next_id, depth + 1) : 0;
+
+      branches << (branch_i ? "|" : "") << feature_id;
+
+      if(feature_id % 2)
+      {
+        // numeric feature
+        branches << ">=" << static_cast<float>(rnd() % 1000) / 1000;
+      }
+
+      branches << ":" << yes_id << ":" << no_id;
+    }
+
+    std::uniform_real_distribution<double> delta_dist(-1.0, 1.0);
+    out << id << '\t' << delta_dist(rnd) << '\t' << branches.str() << std::endl;
+
+    return id;
+  }
+
+  inline Vanga::DTree_var
+  generate_tree(std::mt19937& rnd, unsigned long features)
+  {
+    // root must be first line
+    std::ostringstream nodes;
+    unsigned long next_id = 2;
+    std::ostringstream root_branches;
+
+    for(unsigned long branch_i = 0; branch_i < 8; ++branch_i)
+    {
+      const unsigned long feature_id = rnd() % features;
+      root_branches << (branch_i ? "|" : "") << feature_id << ":" <<
+        write_node(nodes, rnd, features, next_id, 1) << ":" <<
+        write_node(nodes, rnd, features, next_id, 1);
+    }
+
+    std::ostringstream model;
+    model << "1\t0.25\t" << root_branches.str() << std::endl << nodes.str();
+
+    std::istringstream model_istr(model.str());
+    return Vanga::DTree::load(model_istr, false);
+  }
+
+  inline Vanga::FeatureArray
+  generate_row(std::mt19937& rnd, unsigned long features)
+  {
+    Vanga::FeatureArray row;
+
+    for(unsigned long feature_id = 0; feature_id < features; ++feature_id)
+    {
+      if(rnd() % 10 == 0)
+      {
+        const float value = static_cast<float>(rnd() % 1000) / 1000;
+        uint32_t value_bits;
+        std::memcpy(&value_bits, &value, sizeof(value_bits));
+        row.push_back(std::make_pair(feature_id, value_bits));
+      }
+    }
+
+    return row;
+  }
+}
+
+#endif /*TESTS_COMMON_RANDOMMODEL_HPP_*/
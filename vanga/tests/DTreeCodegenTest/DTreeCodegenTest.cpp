@@ -0,0 +1,165 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// DTreeCodegenTest: generate code of random models, compile it
+// as shared library (compiler from CXX environment variable or c++)
+// and compare predictions with fpredict
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <DTree/DTree.hpp>
+#include <DTree/PredictorSet.hpp>
+#include <DTree/CodeGenerator.hpp>
+
+#include <Common/RandomModel.hpp>
+
+using namespace Vanga;
+
+struct vanga_feature
+{
+  uint32_t id;
+  uint32_t value;
+};
+
+typedef double (*PredictFun)(const vanga_feature*, unsigned long);
+
+const unsigned long FEATURES = 200;
+const unsigned long ROWS = 20000;
+
+template<typename PredictorType>
+bool
+check_predictor(
+  const char* name,
+  const std::string& dir,
+  const PredictorType* predictor,
+  std::mt19937& rnd)
+{
+  const std::string source_path = dir + "/" + name + ".cpp";
+  const std::string lib_path = dir + "/" + name + ".so";
+
+  {
+    std::ofstream source(source_path.c_str());
+    CodeGenerator::generate(source, predictor, name);
+  }
+
+  const char* cxx = ::getenv("CXX");
+  const std::string compile_cmd = std::string(cxx ? cxx : "c++") +
+    " -std=c++17 -O2 -shared -fPIC -o " + lib_path + " " + source_path;
+
+  if(::system(compile_cmd.c_str()) != 0)
+  {
+    std::cerr << name << ": can't compile generated code: " << compile_cmd << std::endl;
+    return false;
+  }
+
+  void* lib = ::dlopen(lib_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if(!lib)
+  {
+    std::cerr << name << ": can't load library: " << ::dlerror() << std::endl;
+    return false;
+  }
+
+  PredictFun predict_fun = reinterpret_cast<PredictFun>(::dlsym(lib, name));
+  if(!predict_fun)
+  {
+    std::cerr << name << ": function not found" << std::endl;
+    ::dlclose(lib);
+    return false;
+  }
+
+  unsigned long errors = 0;
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    const FeatureArray features = TestUtils::generate_row(rnd, FEATURES);
+    const double pred = predictor->fpredict(features);
+    const double generated_pred = predict_fun(
+      reinterpret_cast<const vanga_feature*>(features.data()),
+      features.size());
+
+    if(pred != generated_pred)
+    {
+      if(errors < 10)
+      {
+        std::cerr << name << ": row #" << row_i << ": " << pred <<
+          " != " << generated_pred << std::endl;
+      }
+
+      ++errors;
+    }
+  }
+
+  ::dlclose(lib);
+
+  std::cout << name << ": " << (errors ? "FAILED" : "OK") << std::endl;
+  return errors == 0;
+}
+
+int
+main(int, char**)
+{
+  static_assert(
+    sizeof(vanga_feature) == sizeof(FeatureArray::value_type),
+    "vanga_feature must have FeatureArray element layout");
+
+  char dir_template[] = "/tmp/DTreeCodegenTest.XXXXXX";
+  if(!::mkdtemp(dir_template))
+  {
+    std::cerr << "can't create temporary directory" << std::endl;
+    return 1;
+  }
+
+  const std::string dir(dir_template);
+
+  std::mt19937 rnd(17);
+  bool ok = true;
+
+  try
+  {
+    DTree_var tree = TestUtils::generate_tree(rnd, FEATURES);
+    ok &= check_predictor("dtree_predict", dir, tree.in(), rnd);
+
+    PredictorSet_var predictor_set = new PredictorSet();
+    predictor_set->add(tree.in(), 0.3);
+    predictor_set->add(TestUtils::generate_tree(rnd, FEATURES).in(), 0.7);
+    ok &= check_predictor("set_predict", dir, predictor_set.in(), rnd);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  const std::string cleanup_cmd = "rm -rf " + dir;
+  if(::system(cleanup_cmd.c_str()) != 0)
+  {
+    std::cerr << "can't remove " << dir << std::endl;
+  }
+
+  return ok ? 0 : 1;
+}
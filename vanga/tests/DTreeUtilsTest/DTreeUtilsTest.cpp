@@ -31,6 +31,8 @@
 
 #include <DTree/Utils.hpp>
 #include <DTree/Gain.hpp>
+#include <DTree/PredictorSet.hpp>
+#include <DTree/SparseDTree.hpp>
 
 struct Holder
 {
@@ -765,6 +767,44 @@ grad_sqr_min_test2()
   }
 }
 
+// log_reg_* losses of DTree (block prediction) should be equal
+// to losses of other predictor types (fpredict row by row)
+// with the same predictions
+bool
+log_reg_loss_test()
+{
+  std::istringstream svm_istr(
+    "1 3:1\n0 5:1\n0 3:1 5:1\n1\n0 7:1\n1 3:1 7:1\n");
+  Gears::IntrusivePtr<SVM<PredictedBoolLabel> > svm =
+    SVM<PredictedBoolLabel>::load(svm_istr);
+
+  std::istringstream tree_istr("1\t0.25\t3:2:0|5:0:3\n2\t0.5\t\n3\t-0.7\t7:0:0\n");
+  DTree_var tree = DTree::load(tree_istr, false);
+
+  const DTree* const_tree = tree;
+  PredictorSet_var predictor_set = new PredictorSet();
+  predictor_set->add(tree.in(), 1.0);
+  SparseDTree_var sparse_tree = new SparseDTree(tree);
+
+  const double logloss = Utils::log_reg_logloss(tree.in(), svm.in());
+  const double absloss = Utils::log_reg_absloss(tree.in(), svm.in());
+
+  // PredictorSet predictions are rounded to float
+  const bool ok =
+    logloss == Utils::log_reg_logloss(const_tree, svm.in()) &&
+    std::fabs(logloss - Utils::log_reg_logloss(predictor_set.in(), svm.in())) < 1e-6 &&
+    logloss == Utils::log_reg_logloss(sparse_tree.in(), svm.in()) &&
+    absloss == Utils::log_reg_absloss(const_tree, svm.in()) &&
+    std::fabs(absloss - Utils::log_reg_absloss(predictor_set.in(), svm.in())) < 1e-6 &&
+    absloss == Utils::log_reg_absloss(sparse_tree.in(), svm.in()) &&
+    Utils::log_reg_logloss(static_cast<DTree*>(0), svm.in()) ==
+      Utils::log_reg_logloss(static_cast<PredictorSet*>(0), svm.in());
+
+  std::cout << "log_reg_loss(logloss = " << logloss << ", absloss = " << absloss <<
+    "): " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
 // main
 int
 main(int, char**)
@@ -782,7 +822,7 @@ main(int, char**)
   grad_sqr_min_test();
   grad_sqr_min_test2();
 
-  return 0;
+  return log_reg_loss_test() ? 0 : 1;
 }
 
 
@@ -0,0 +1,267 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// FastFeatureSetTest: FastFeatureSet operations compared with std::map:
+// ids that collide under old 0xFFFFF mask, backward shift deletion
+// across table end and random set/rollback/clear sequences
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <DTree/FastFeatureSet.hpp>
+
+using namespace Vanga;
+
+typedef std::map<uint32_t, uint32_t> FeatureMap;
+
+// TestFeatureSet: access to slot index of feature
+class TestFeatureSet: public FastFeatureSet
+{
+public:
+  unsigned long
+  slot_index(uint32_t feature_id) const
+  {
+    return slot_index_(feature_id);
+  }
+
+  unsigned long
+  capacity() const
+  {
+    return slots_.size();
+  }
+};
+
+bool
+equal(const FastFeatureSet& set, const FeatureMap& check_map, uint32_t feature_id)
+{
+  const std::pair<bool, uint32_t> res = set.get(feature_id);
+  auto check_it = check_map.find(feature_id);
+
+  return check_it != check_map.end() ?
+    res.first && res.second == check_it->second :
+    !res.first;
+}
+
+bool
+equal(
+  const FastFeatureSet& set,
+  const FeatureMap& check_map,
+  const std::vector<uint32_t>& feature_ids)
+{
+  if(set.size() != check_map.size() || set.empty() != check_map.empty())
+  {
+    return false;
+  }
+
+  for(auto id_it = feature_ids.begin(); id_it != feature_ids.end(); ++id_it)
+  {
+    if(!equal(set, check_map, *id_it))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// ids with equal low 20 bits
+bool
+check_masked_collisions()
+{
+  const uint32_t LOW_BITS = 0x12345;
+  std::vector<uint32_t> feature_ids;
+
+  for(uint32_t high_i = 0; high_i < 4096; high_i += 37)
+  {
+    feature_ids.push_back(LOW_BITS | (high_i << 20));
+  }
+
+  FastFeatureSet set;
+  FeatureMap check_map;
+  bool ok = true;
+
+  for(unsigned long id_i = 0; id_i < feature_ids.size(); ++id_i)
+  {
+    set.set(feature_ids[id_i], id_i);
+    check_map[feature_ids[id_i]] = id_i;
+  }
+
+  ok &= equal(set, check_map, feature_ids);
+
+  for(unsigned long id_i = 0; id_i < feature_ids.size(); id_i += 2)
+  {
+    set.rollback(feature_ids[id_i]);
+    check_map.erase(feature_ids[id_i]);
+  }
+
+  ok &= equal(set, check_map, feature_ids);
+
+  // overwrite values of left ids
+  for(unsigned long id_i = 1; id_i < feature_ids.size(); id_i += 2)
+  {
+    set.set(feature_ids[id_i], id_i * 10);
+    check_map[feature_ids[id_i]] = id_i * 10;
+  }
+
+  ok &= equal(set, check_map, feature_ids);
+
+  std::cout << "masked_collisions: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// probe chain started at last slot continues from first slot:
+// rollback of its head should shift chain back across table end
+bool
+check_wrap_around()
+{
+  TestFeatureSet set;
+  const unsigned long last_slot = set.capacity() - 1;
+
+  std::vector<uint32_t> last_ids;
+  std::vector<uint32_t> first_ids;
+
+  for(uint32_t feature_id = 1; last_ids.size() < 3 || first_ids.empty();
+    ++feature_id)
+  {
+    const unsigned long slot_i = set.slot_index(feature_id);
+
+    if(slot_i == last_slot && last_ids.size() < 3)
+    {
+      last_ids.push_back(feature_id);
+    }
+    else if(slot_i == 0 && first_ids.empty())
+    {
+      first_ids.push_back(feature_id);
+    }
+  }
+
+  // layout: last_ids at slots last, 0, 1; first_ids[0] (home 0) at 2
+  std::vector<uint32_t> feature_ids(last_ids);
+  feature_ids.push_back(first_ids[0]);
+
+  bool ok = true;
+
+  for(unsigned long remove_i = 0; remove_i < feature_ids.size(); ++remove_i)
+  {
+    FeatureMap check_map;
+    set.clear();
+
+    for(unsigned long id_i = 0; id_i < feature_ids.size(); ++id_i)
+    {
+      set.set(feature_ids[id_i], id_i + 1);
+      check_map[feature_ids[id_i]] = id_i + 1;
+    }
+
+    ok &= equal(set, check_map, feature_ids);
+
+    set.rollback(feature_ids[remove_i]);
+    check_map.erase(feature_ids[remove_i]);
+    ok &= equal(set, check_map, feature_ids);
+
+    // hole left by shift should be reusable
+    set.set(feature_ids[remove_i], 100);
+    check_map[feature_ids[remove_i]] = 100;
+    ok &= equal(set, check_map, feature_ids);
+  }
+
+  ok &= set.capacity() == last_slot + 1;
+
+  std::cout << "wrap_around: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// random operations on colliding ids, table grows while test
+bool
+check_random()
+{
+  const unsigned long OPERATIONS = 300000;
+  const unsigned long CHECK_PERIOD = 1000;
+
+  std::mt19937 rnd(5);
+  std::vector<uint32_t> feature_ids;
+
+  for(unsigned long id_i = 0; id_i < 2000; ++id_i)
+  {
+    // few distinct low parts
+    feature_ids.push_back((rnd() % 8) | (rnd() << 20));
+  }
+
+  FastFeatureSet set;
+  FeatureMap check_map;
+  bool ok = true;
+
+  for(unsigned long op_i = 0; op_i < OPERATIONS && ok; ++op_i)
+  {
+    const uint32_t feature_id = feature_ids[rnd() % feature_ids.size()];
+    const unsigned long op = rnd() % 1000;
+
+    if(op < 600)
+    {
+      const uint32_t value = rnd();
+      set.set(feature_id, value);
+      check_map[feature_id] = value;
+    }
+    else if(op < 999)
+    {
+      set.rollback(feature_id);
+      check_map.erase(feature_id);
+    }
+    else
+    {
+      set.clear();
+      check_map.clear();
+    }
+
+    ok &= equal(set, check_map, feature_id) && set.size() == check_map.size();
+
+    if(op_i % CHECK_PERIOD == 0)
+    {
+      ok &= equal(set, check_map, feature_ids);
+    }
+  }
+
+  ok &= equal(set, check_map, feature_ids);
+
+  std::cout << "random: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    ok &= check_masked_collisions();
+    ok &= check_wrap_around();
+    ok &= check_random();
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
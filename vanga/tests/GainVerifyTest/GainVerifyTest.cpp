@@ -0,0 +1,221 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// GainVerifyTest: gains of best split candidates verified with double preds.
+// with float preds (tree configured with VANGA_FLOAT_PREDS) row pred
+// rounding can drop small deltas: test checks that double preds keep it
+// and that best candidates are rejected and re-ranked by verified gains
+
+#include <cmath>
+#include <iostream>
+
+#include <DTree/Gain.hpp>
+#include <DTree/TreeLearner.hpp>
+
+using namespace Vanga;
+
+typedef TreeLearner<PredictedBoolLabel> TreeLearnerImpl;
+typedef GetBestFeatureResult<TreeLearnerImpl> GetBestFeatureResultImpl;
+typedef Gears::IntrusivePtr<GetBestFeatureResultImpl> GetBestFeatureResultImpl_var;
+
+const bool FLOAT_PREDS = sizeof(PredValue) < sizeof(double);
+
+// gain of delta for rows with label, double_preds as in verification
+double
+delta_gain(
+  const PredictedBoolLabel& label,
+  double delta,
+  unsigned long count,
+  bool double_preds)
+{
+  PredictedLogLossGain gain_calc;
+
+  gain_calc.start_metric_eval();
+  gain_calc.add_metric_eval(label, count);
+  const double old_metric = gain_calc.metric_result();
+
+  gain_calc.start_metric_eval();
+
+  if(double_preds)
+  {
+    gain_calc.add_metric_eval(
+      label.orig(), static_cast<double>(label.pred) + delta, count);
+  }
+  else
+  {
+    gain_calc.add_metric_eval(
+      PredictedLogLossGain::add_delta(label, delta), count);
+  }
+
+  return gain_calc.metric_result() - old_metric;
+}
+
+// delta smaller than half of float ulp at pred = 8:
+// it's lost by float pred rounding, gain sign changes
+bool
+check_double_preds()
+{
+  const PredictedBoolLabel label(true, 8.0);
+  const double DELTA = 2e-7;
+  const unsigned long COUNT = 1000000000;
+
+  const double stored_gain = delta_gain(label, DELTA, COUNT, false);
+  const double verified_gain = delta_gain(label, DELTA, COUNT, true);
+
+  bool ok = verified_gain < 0;
+
+  if(FLOAT_PREDS)
+  {
+    // precondition of verification: stored preds lose the delta
+    ok &= stored_gain == 0;
+  }
+  else
+  {
+    ok &= stored_gain == verified_gain;
+  }
+
+  if(!ok)
+  {
+    std::cerr << "double_preds: stored gain = " << stored_gain <<
+      ", verified gain = " << verified_gain << std::endl;
+  }
+
+  std::cout << "double_preds" << (FLOAT_PREDS ? "(float)" : "(double)") <<
+    ": " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+GetBestFeatureResultImpl_var
+best_features(const double* gains, unsigned long features_number)
+{
+  GetBestFeatureResultImpl_var result = new GetBestFeatureResultImpl(0, false);
+
+  TreeLearnerImpl::FeatureGainArray feature_gains(features_number);
+
+  for(unsigned long feature_i = 0; feature_i < features_number; ++feature_i)
+  {
+    feature_gains[feature_i].feature_id = feature_i + 1;
+    feature_gains[feature_i].gain = gains[feature_i];
+    feature_gains[feature_i].base_bag_i = 0;
+  }
+
+  result->inc();
+  result->set(feature_gains);
+  return result;
+}
+
+bool
+check_features(
+  const GetBestFeatureResultImpl& result,
+  const unsigned long* feature_ids,
+  unsigned long features_number)
+{
+  if(result.best_features.size() != features_number)
+  {
+    return false;
+  }
+
+  for(unsigned long feature_i = 0; feature_i < features_number; ++feature_i)
+  {
+    if(result.best_features[feature_i].feature_id != feature_ids[feature_i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// candidates with verified gain over threshold are rejected,
+// others are selected by verified gains
+bool
+check_reset_gains()
+{
+  bool ok = true;
+
+  // features 1, 2 are close (difference < EPS), 3 is worse
+  const double GAINS[] = { -1.0, -1.0 + 1e-8, -0.5 };
+
+  {
+    // verified gain of feature 1 is positive: reject it
+    GetBestFeatureResultImpl_var result = best_features(GAINS, 3);
+    const unsigned long BEST[] = { 1, 2 };
+    ok &= check_features(*result, BEST, 2);
+
+    std::vector<double> verified_gains;
+    verified_gains.push_back(1e-6);
+    verified_gains.push_back(-1.0);
+    result->reset_gains(verified_gains);
+
+    const unsigned long VERIFIED_BEST[] = { 2 };
+    ok &= check_features(*result, VERIFIED_BEST, 1);
+  }
+
+  {
+    // verified gains change order: feature 2 is better
+    GetBestFeatureResultImpl_var result = best_features(GAINS, 3);
+
+    std::vector<double> verified_gains;
+    verified_gains.push_back(-1.0);
+    verified_gains.push_back(-1.0 - 1e-6);
+    result->reset_gains(verified_gains);
+
+    const unsigned long VERIFIED_BEST[] = { 2 };
+    ok &= check_features(*result, VERIFIED_BEST, 1);
+
+    GetBestFeatureResultImpl::BestChoose best_choose;
+    ok &= result->get_result(best_choose) && best_choose.feature_id == 2 &&
+      best_choose.gain == -1.0 - 1e-6;
+  }
+
+  {
+    // all gains are positive after verification: no split
+    GetBestFeatureResultImpl_var result = best_features(GAINS, 3);
+
+    std::vector<double> verified_gains(2, 1e-6);
+    result->reset_gains(verified_gains);
+
+    GetBestFeatureResultImpl::BestChoose best_choose;
+    ok &= !result->get_result(best_choose);
+  }
+
+  std::cout << "reset_gains: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    ok &= check_double_preds();
+    ok &= check_reset_gains();
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// ModelRegistryTest: readers predict with registry models while
+// other thread replaces them, replaced model should be released
+// only after exit of all readers, that could get it
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include <Gears/Threading/ThreadRunner.hpp>
+
+#include <DTree/DTree.hpp>
+#include <DTree/BinaryModel.hpp>
+#include <DTree/ModelRegistry.hpp>
+
+using namespace Vanga;
+
+const unsigned long MAX_VERSIONS = 1024;
+const unsigned long STRESS_READERS = 2;
+const unsigned long STRESS_READS = 200000;
+const unsigned long STRESS_SETS = 200;
+
+// TrackedModel: marks destroyed flag of its version
+class TrackedModel: public BinaryModel
+{
+public:
+  TrackedModel(const DTree* tree, std::atomic<bool>& destroyed)
+    : BinaryModel(tree),
+      destroyed_(destroyed)
+  {}
+
+protected:
+  virtual
+  ~TrackedModel() throw()
+  {
+    destroyed_ = true;
+  }
+
+protected:
+  std::atomic<bool>& destroyed_;
+};
+
+// TestContext: shared state of test threads
+struct TestContext
+{
+  TestContext()
+    : destroyed(new std::atomic<bool>[MAX_VERSIONS]),
+      entered(false),
+      release(false),
+      exited(false),
+      set_done(false),
+      errors(0)
+  {
+    for(unsigned long version = 0; version < MAX_VERSIONS; ++version)
+    {
+      destroyed[version] = false;
+    }
+
+    std::istringstream tree_istr("1\t0.25\t3:2:0|5>=0.5:0:2\n2\t0.5\t\n");
+    tree = DTree::load(tree_istr, false);
+
+    row.push_back(std::make_pair(3, 1));
+    row.push_back(std::make_pair(5, numeric_feature_value(0.7)));
+    expected_pred = tree->fpredict(row);
+  }
+
+  // publish model with next version
+  void
+  set_next(unsigned long version)
+  {
+    BinaryModel_var model = new TrackedModel(tree, destroyed[version]);
+    registry->set(0, model, "");
+  }
+
+  ModelRegistry_var registry;
+  DTree_var tree;
+  FeatureArray row;
+  double expected_pred;
+
+  std::unique_ptr<std::atomic<bool>[]> destroyed;
+  std::atomic<bool> entered;
+  std::atomic<bool> release;
+  std::atomic<bool> exited;
+  std::atomic<bool> set_done;
+  std::atomic<unsigned long> errors;
+};
+
+void
+wait_flag(const std::atomic<bool>& flag)
+{
+  while(!flag)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// HoldJob: keep read section open until release
+class HoldJob: public Gears::ThreadJob
+{
+public:
+  HoldJob(TestContext& context) throw()
+    : context_(context)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    {
+      ModelRegistry::ReadGuard guard(*context_.registry, 0);
+      const ModelRegistry::Model* model = guard.model(0);
+      const unsigned long version = model->version;
+
+      context_.entered = true;
+      wait_flag(context_.release);
+
+      if(context_.destroyed[version] ||
+        model->model->fpredict(context_.row) != context_.expected_pred)
+      {
+        std::cerr << "hold: model #" << version <<
+          " released in read section" << std::endl;
+        ++context_.errors;
+      }
+    }
+
+    context_.exited = true;
+  }
+
+protected:
+  virtual
+  ~HoldJob() throw()
+  {}
+
+protected:
+  TestContext& context_;
+};
+
+// SetJob: publish one model
+class SetJob: public Gears::ThreadJob
+{
+public:
+  SetJob(TestContext& context, unsigned long version) throw()
+    : context_(context),
+      version_(version)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    context_.set_next(version_);
+    context_.set_done = true;
+  }
+
+protected:
+  virtual
+  ~SetJob() throw()
+  {}
+
+protected:
+  TestContext& context_;
+  const unsigned long version_;
+};
+
+// ReadJob: predict in loop, each thread uses own reader index
+class ReadJob: public Gears::ThreadJob
+{
+public:
+  ReadJob(TestContext& context) throw()
+    : context_(context),
+      next_reader_(0)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    const unsigned long reader_i = next_reader_++;
+
+    for(unsigned long read_i = 0; read_i < STRESS_READS; ++read_i)
+    {
+      ModelRegistry::ReadGuard guard(*context_.registry, reader_i);
+      const ModelRegistry::Model* model = guard.model(0);
+      const unsigned long version = model->version;
+
+      // model should be alive before and after prediction
+      if(context_.destroyed[version] ||
+        model->model->fpredict(context_.row) != context_.expected_pred ||
+        context_.destroyed[version])
+      {
+        std::cerr << "reader #" << reader_i << ": model #" << version <<
+          " released in read section" << std::endl;
+        ++context_.errors;
+      }
+    }
+  }
+
+protected:
+  virtual
+  ~ReadJob() throw()
+  {}
+
+protected:
+  TestContext& context_;
+  std::atomic<unsigned long> next_reader_;
+};
+
+// ReloadJob: replace model in loop
+class ReloadJob: public Gears::ThreadJob
+{
+public:
+  ReloadJob(TestContext& context) throw()
+    : context_(context)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    for(unsigned long set_i = 0; set_i < STRESS_SETS; ++set_i)
+    {
+      const unsigned long version = set_i + 2;
+      context_.set_next(version);
+
+      if(!context_.destroyed[version - 1])
+      {
+        std::cerr << "reload: model #" << (version - 1) <<
+          " isn't released after set" << std::endl;
+        ++context_.errors;
+      }
+    }
+  }
+
+protected:
+  virtual
+  ~ReloadJob() throw()
+  {}
+
+protected:
+  TestContext& context_;
+};
+
+// reader holds model: set should wait it and publish new model at once
+bool
+check_hold()
+{
+  TestContext context;
+  context.registry = new ModelRegistry(1, 2);
+  context.set_next(1);
+
+  Gears::ThreadRunner hold_runner(
+    Gears::ThreadJob_var(new HoldJob(context)), 1);
+  hold_runner.start();
+  wait_flag(context.entered);
+
+  Gears::ThreadRunner set_runner(
+    Gears::ThreadJob_var(new SetJob(context, 2)), 1);
+  set_runner.start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  bool ok = true;
+
+  if(context.set_done || context.destroyed[1])
+  {
+    std::cerr << "hold: model released before reader exit" << std::endl;
+    ok = false;
+  }
+
+  {
+    ModelRegistry::ReadGuard guard(*context.registry, 1);
+    const ModelRegistry::Model* model = guard.model(0);
+
+    if(!model || model->version != 2)
+    {
+      std::cerr << "hold: new model isn't published" << std::endl;
+      ok = false;
+    }
+  }
+
+  context.release = true;
+  hold_runner.wait_for_completion();
+  set_runner.wait_for_completion();
+
+  if(!context.exited || !context.set_done || !context.destroyed[1] ||
+    context.destroyed[2])
+  {
+    std::cerr << "hold: model isn't released after reader exit" << std::endl;
+    ok = false;
+  }
+
+  ok &= context.errors == 0;
+  std::cout << "hold: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// readers and reloader work concurrently
+bool
+check_concurrent()
+{
+  TestContext context;
+  context.registry = new ModelRegistry(1, STRESS_READERS);
+  context.set_next(1);
+
+  Gears::ThreadRunner read_runner(
+    Gears::ThreadJob_var(new ReadJob(context)), STRESS_READERS);
+  Gears::ThreadRunner reload_runner(
+    Gears::ThreadJob_var(new ReloadJob(context)), 1);
+  read_runner.start();
+  reload_runner.start();
+  read_runner.wait_for_completion();
+  reload_runner.wait_for_completion();
+
+  bool ok = context.errors == 0;
+
+  context.registry = ModelRegistry_var();
+
+  for(unsigned long version = 1; version < STRESS_SETS + 2; ++version)
+  {
+    if(!context.destroyed[version])
+    {
+      std::cerr << "concurrent: model #" << version <<
+        " isn't released" << std::endl;
+      ok = false;
+    }
+  }
+
+  std::cout << "concurrent: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    ok &= check_hold();
+    ok &= check_concurrent();
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// PredBufferTest: retained memory accounting of thread buffer pools,
+// pools trimming at evaluation end, retention limits and
+// release of buffers in foreign thread
+
+#include <iostream>
+
+#include <Gears/Threading/ThreadRunner.hpp>
+
+#include <DTree/PredBuffer.hpp>
+
+using namespace Vanga;
+
+struct Value16
+{
+  char data[16];
+};
+
+// retained bytes should include pools of all value types
+bool
+check_all_retained_bytes()
+{
+  const unsigned long base_bytes = BufferPools::all_retained_bytes();
+
+  {
+    Gears::IntrusivePtr<BufferPtr<double> > double_buf =
+      BufferProvider<double>::instance().get(100);
+    Gears::IntrusivePtr<BufferPtr<uint32_t> > uint_buf =
+      BufferProvider<uint32_t>::instance().get(200);
+    Gears::IntrusivePtr<BufferPtr<Value16> > value_buf =
+      BufferProvider<Value16>::instance().get(300);
+  }
+
+  const unsigned long expected_bytes =
+    BufferProvider<double>::instance().retained_size() * sizeof(double) +
+    BufferProvider<uint32_t>::instance().retained_size() * sizeof(uint32_t) +
+    BufferProvider<Value16>::instance().retained_size() * sizeof(Value16);
+
+  bool ok = expected_bytes >= 100 * 8 + 200 * 4 + 300 * 16 &&
+    BufferPools::all_retained_bytes() == base_bytes + expected_bytes;
+
+  // reused buffers aren't retained
+  {
+    Gears::IntrusivePtr<BufferPtr<Value16> > value_buf =
+      BufferProvider<Value16>::instance().get(300);
+
+    ok &= BufferProvider<Value16>::instance().retained_size() == 0 &&
+      BufferPools::all_retained_bytes() ==
+        base_bytes + expected_bytes - value_buf->buf().capacity() * sizeof(Value16);
+  }
+
+  ok &= BufferPools::all_retained_bytes() == base_bytes + expected_bytes;
+
+  std::cout << "all_retained_bytes: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// buffers that wasn't used in evaluation are released at its end
+bool
+check_trim()
+{
+  BufferPools::trim_thread_pools();
+  BufferPools::trim_thread_pools();
+
+  BufferProviderImpl<double>& provider = BufferProvider<double>::instance();
+  const unsigned long base_bytes = BufferPools::thread_retained_bytes();
+  bool ok = provider.retained_size() == 0;
+
+  {
+    BufferPools::EvaluationGuard evaluation_guard;
+    Gears::IntrusivePtr<BufferPtr<double> > buf = provider.get(1000);
+  }
+
+  // buffer used in finished evaluation is retained for next one
+  ok &= provider.retained_size() >= 1000 &&
+    BufferPools::thread_retained_bytes() ==
+      base_bytes + provider.retained_size() * sizeof(double);
+
+  {
+    BufferPools::EvaluationGuard evaluation_guard;
+    Gears::IntrusivePtr<BufferPtr<double> > buf = provider.get(1000);
+  }
+
+  ok &= provider.retained_size() >= 1000;
+
+  // evaluation that didn't use buffer
+  BufferPools::trim_thread_pools();
+
+  ok &= provider.retained_size() == 0 &&
+    BufferPools::thread_retained_bytes() == base_bytes;
+
+  std::cout << "trim: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// summary retained bytes of thread pools are bounded
+bool
+check_thread_limit()
+{
+  // 16 buffers in each of 3 size classes: 112M over limit
+  const unsigned long BUFFER_SIZE = 1024 * 1024;
+  const unsigned long BUFFERS = 48;
+
+  {
+    std::vector<Gears::IntrusivePtr<BufferPtr<char> > > char_bufs;
+    std::vector<Gears::IntrusivePtr<BufferPtr<uint64_t> > > uint_bufs;
+
+    for(unsigned long buf_i = 0; buf_i < BUFFERS; ++buf_i)
+    {
+      char_bufs.push_back(
+        BufferProvider<char>::instance().get(BUFFER_SIZE << (buf_i % 3)));
+
+      if(buf_i % 6 == 0)
+      {
+        uint_bufs.push_back(
+          BufferProvider<uint64_t>::instance().get(BUFFER_SIZE / sizeof(uint64_t)));
+      }
+    }
+  }
+
+  const bool ok =
+    BufferPools::thread_retained_bytes() <= BufferPools::MAX_THREAD_RETAIN_BYTES &&
+    BufferPools::thread_retained_bytes() > BufferPools::MAX_THREAD_RETAIN_BYTES / 2;
+
+  BufferPools::trim_thread_pools();
+  BufferPools::trim_thread_pools();
+
+  std::cout << "thread_limit: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// ReleaseJob: drops buffer got in other thread
+class ReleaseJob: public Gears::ThreadJob
+{
+public:
+  ReleaseJob(Gears::IntrusivePtr<BufferPtr<double> >& buf) throw()
+  {
+    buf_.swap(buf);
+  }
+
+  virtual void
+  work() throw()
+  {
+    buf_ = Gears::IntrusivePtr<BufferPtr<double> >();
+  }
+
+protected:
+  virtual
+  ~ReleaseJob() throw()
+  {}
+
+protected:
+  Gears::IntrusivePtr<BufferPtr<double> > buf_;
+};
+
+// buffer released in other thread isn't returned into pool
+bool
+check_foreign_release()
+{
+  BufferProviderImpl<double>& provider = BufferProvider<double>::instance();
+  const unsigned long base_size = provider.retained_size();
+  const unsigned long base_bytes = BufferPools::all_retained_bytes();
+
+  Gears::IntrusivePtr<BufferPtr<double> > buf = provider.get(1000);
+
+  Gears::ThreadRunner release_runner(
+    Gears::ThreadJob_var(new ReleaseJob(buf)), 1);
+  release_runner.start();
+  release_runner.wait_for_completion();
+
+  const bool ok = !buf && provider.retained_size() == base_size &&
+    BufferPools::all_retained_bytes() == base_bytes;
+
+  std::cout << "foreign_release: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    ok &= check_all_retained_bytes();
+    ok &= check_trim();
+    ok &= check_thread_limit();
+    ok &= check_foreign_release();
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// PredictServerTest: requests served by PredictServer
+// over unix socket, client half close (shutdown of write side)
+// after requests shouldn't lose responses;
+// request bodies with data after rows are rejected
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <Gears/Threading/ThreadRunner.hpp>
+
+#include <DTree/DTree.hpp>
+#include <DTree/BinaryModel.hpp>
+#include <DTree/ModelRegistry.hpp>
+#include <DTree/PredictProtocol.hpp>
+#include <PredictDaemon/PredictServer.hpp>
+
+using namespace Vanga;
+
+const unsigned long THREADS = 2;
+const unsigned long REQUESTS = 20;
+
+// ServerJob: run server until stop requested
+class ServerJob: public Gears::ThreadJob
+{
+public:
+  ServerJob(PredictServer& server, volatile sig_atomic_t& stop_requested) throw()
+    : server_(server),
+      stop_requested_(stop_requested),
+      reload_requested_(0)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    try
+    {
+      server_.run(stop_requested_, reload_requested_);
+    }
+    catch(const Gears::Exception& ex)
+    {
+      std::cerr << "server failed: " << ex.what() << std::endl;
+    }
+  }
+
+protected:
+  virtual
+  ~ServerJob() throw()
+  {}
+
+protected:
+  PredictServer& server_;
+  volatile sig_atomic_t& stop_requested_;
+  volatile sig_atomic_t reload_requested_;
+};
+
+std::string
+svm_request(uint32_t id, uint32_t rows, const std::string& body)
+{
+  PredictProtocol::RequestHead head;
+  head.type = PredictProtocol::RT_SVM;
+  head.id = id;
+  head.model = 0;
+  head.rows = rows;
+  head.size = body.size();
+
+  std::string res(reinterpret_cast<const char*>(&head), sizeof(head));
+  res += body;
+  return res;
+}
+
+// connect when server started listening
+int
+connect_server(const std::string& address)
+{
+  for(unsigned long try_i = 0; ; ++try_i)
+  {
+    try
+    {
+      const int fd = PredictProtocol::connect(address);
+
+      // don't hang on lost responses
+      timeval timeout;
+      timeout.tv_sec = 10;
+      timeout.tv_usec = 0;
+      ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+      return fd;
+    }
+    catch(const PredictProtocol::Exception&)
+    {
+      if(try_i >= 500)
+      {
+        throw;
+      }
+    }
+
+    ::usleep(10000);
+  }
+}
+
+// requests and incomplete request head sent at once, then write side
+// shut down: complete requests (more than max_pending) should be answered,
+// then connection closed by server
+bool
+check_half_close(const std::string& address, const DTree* tree)
+{
+  FeatureArray first_row;
+  first_row.push_back(std::make_pair(3, 1));
+  FeatureArray second_row;
+  second_row.push_back(std::make_pair(3, 1));
+  second_row.push_back(std::make_pair(5, 1));
+
+  const double first_pred = tree->fpredict(first_row);
+  const double second_pred = tree->fpredict(second_row);
+
+  std::string message;
+
+  for(uint32_t request_i = 0; request_i < REQUESTS; ++request_i)
+  {
+    message += svm_request(request_i, 2, "0 3:1\n0 3:1 5:1\n");
+  }
+
+  const std::string tail = svm_request(REQUESTS, 1, "0 3:1\n");
+  message.append(tail, 0, sizeof(PredictProtocol::RequestHead) / 2);
+
+  const int fd = connect_server(address);
+  std::set<uint32_t> answered;
+  unsigned long errors = 0;
+
+  try
+  {
+    PredictProtocol::write(fd, message.data(), message.size());
+    ::shutdown(fd, SHUT_WR);
+
+    PredictProtocol::ResponseHead head;
+
+    while(PredictProtocol::read(fd, &head, sizeof(head)))
+    {
+      std::string body(head.size, 0);
+      if(head.size > 0)
+      {
+        PredictProtocol::read(fd, &body[0], head.size);
+      }
+
+      double preds[2];
+
+      if(head.status != PredictProtocol::S_OK || head.rows != 2 ||
+        head.size != sizeof(preds) ||
+        !answered.insert(head.id).second)
+      {
+        std::cerr << "half_close: unexpected response #" << head.id << std::endl;
+        ++errors;
+        continue;
+      }
+
+      ::memcpy(preds, body.data(), sizeof(preds));
+
+      if(preds[0] != first_pred || preds[1] != second_pred)
+      {
+        std::cerr << "half_close: response #" << head.id << " has predictions " <<
+          preds[0] << ", " << preds[1] << " instead " <<
+          first_pred << ", " << second_pred << std::endl;
+        ++errors;
+      }
+    }
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "half_close: " << ex.what() << std::endl;
+    ++errors;
+  }
+
+  ::close(fd);
+
+  if(answered.size() != REQUESTS)
+  {
+    std::cerr << "half_close: " << answered.size() << " responses instead " <<
+      REQUESTS << std::endl;
+    ++errors;
+  }
+
+  std::cout << "half_close: " << (errors ? "FAILED" : "OK") << std::endl;
+  return errors == 0;
+}
+
+bool
+read_rows_fails(uint32_t type, const std::string& body, unsigned long rows_number)
+{
+  std::vector<FeatureArray> rows;
+
+  try
+  {
+    PredictProtocol::read_rows(rows, type, body, rows_number, NumericFeatureSet());
+  }
+  catch(const PredictProtocol::Exception&)
+  {
+    return true;
+  }
+
+  return false;
+}
+
+// data after rows rejected for both body formats,
+// whitespaces allowed after RT_SVM rows
+bool
+check_extra_data()
+{
+  std::string binary_body;
+  std::vector<std::pair<uint32_t, float> > features;
+  features.push_back(std::make_pair(3, 1.0f));
+  PredictProtocol::write_binary_row(binary_body, features);
+
+  const bool ok =
+    !read_rows_fails(PredictProtocol::RT_SVM, "0 3:1\n \n\t", 1) &&
+    read_rows_fails(PredictProtocol::RT_SVM, "0 3:1\n0 5:1\n", 1) &&
+    read_rows_fails(PredictProtocol::RT_SVM, "0 3:1\nx", 1) &&
+    !read_rows_fails(PredictProtocol::RT_BINARY, binary_body, 1) &&
+    read_rows_fails(PredictProtocol::RT_BINARY, binary_body + '\0', 1);
+
+  std::cout << "extra_data: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  char dir_template[] = "/tmp/PredictServerTest.XXXXXX";
+  if(!::mkdtemp(dir_template))
+  {
+    std::cerr << "can't create temporary directory" << std::endl;
+    return 1;
+  }
+
+  const std::string dir(dir_template);
+  const std::string address = "unix:" + dir + "/predictd.sock";
+
+  ::signal(SIGPIPE, SIG_IGN);
+
+  bool ok = check_extra_data();
+
+  try
+  {
+    std::istringstream tree_istr("1\t0.25\t3:2:0|5:0:2\n2\t0.5\t\n");
+    DTree_var tree = DTree::load(tree_istr, false);
+
+    ModelRegistry_var registry = new ModelRegistry(1, THREADS);
+    registry->set(0, BinaryModel_var(new BinaryModel(tree.in())), "");
+
+    PredictServer::Params params;
+    params.address = address;
+    params.threads = THREADS;
+    // requests delayed by limit should be processed after eof
+    params.max_pending = 2;
+
+    PredictServer server(registry, params);
+    volatile sig_atomic_t stop_requested = 0;
+
+    Gears::ThreadRunner server_runner(
+      Gears::ThreadJob_var(new ServerJob(server, stop_requested)),
+      1);
+    server_runner.start();
+
+    try
+    {
+      ok &= check_half_close(address, tree);
+    }
+    catch(const Gears::Exception& ex)
+    {
+      std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+      ok = false;
+    }
+
+    stop_requested = 1;
+    server_runner.wait_for_completion();
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  const std::string cleanup_cmd = "rm -rf " + dir;
+  if(::system(cleanup_cmd.c_str()) != 0)
+  {
+    std::cerr << "can't remove " << dir << std::endl;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,886 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// TreeLearnerPartsTest: learner structures checked on small hand-made
+// dataset against values evaluated directly by dataset rows
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <DTree/DTree.hpp>
+#include <DTree/Rand.hpp>
+#include <DTree/SVM.hpp>
+#include <DTree/TreeLearner.hpp>
+#include <DTree/Gain.hpp>
+#include <DTree/MemoryUsage.hpp>
+
+using namespace Vanga;
+
+typedef SVM<PredictedBoolLabel> SVMImpl;
+typedef Gears::IntrusivePtr<SVMImpl> SVMImpl_var;
+typedef TreeLearner<PredictedBoolLabel> TreeLearnerImpl;
+typedef TreeLearnerImpl::RowHolder RowHolder;
+typedef TreeLearnerImpl::RowHolder_var RowHolder_var;
+typedef TreeLearnerImpl::BagHolder BagHolder;
+typedef TreeLearnerImpl::BagHolder_var BagHolder_var;
+typedef TreeLearnerImpl::BagPart BagPart;
+typedef TreeLearnerImpl::BagPart_var BagPart_var;
+typedef TreeLearnerImpl::BagView BagView;
+typedef TreeLearnerImpl::BagViewArray BagViewArray;
+typedef TreeLearnerImpl::LearnTreeHolder LearnTreeHolder;
+typedef TreeLearnerImpl::LearnTreeHolder_var LearnTreeHolder_var;
+typedef TreeLearnerImpl::NodeStat NodeStat;
+typedef TreeLearnerImpl::NodeStat_var NodeStat_var;
+
+const unsigned long ROWS = 1000;
+const unsigned long STEPS = 3;
+const unsigned long SEED = 7;
+
+// TestLearner: access to learner steps
+class TestLearner: public TreeLearnerImpl
+{
+public:
+  using TreeLearnerImpl::fill_row_holder_;
+  using TreeLearnerImpl::fill_node_stat_;
+  using TreeLearnerImpl::fill_bundle_yes_counts_;
+  using TreeLearnerImpl::fill_sample_part_;
+  using TreeLearnerImpl::screen_features_;
+};
+
+// rows i: one of features 1, 2, 3 (exclusive group),
+// one of features 4, 5 or none (exclusive group), feature 7 for
+// every fourth row, rare feature 6
+std::string
+generate_svm_text()
+{
+  std::ostringstream data_ostr;
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    const unsigned long group_feature = 1 + row_i % 3;
+    const unsigned long pair_feature = row_i % 5 ? 4 + (row_i / 5) % 2 : 0;
+    const bool label =
+      (group_feature == 2 && row_i % 13 != 0) ||
+      (pair_feature == 5 && row_i % 4 == 0) ||
+      (row_i % 37 == 0 && row_i % 2 == 0);
+
+    data_ostr << (label ? 1 : 0) << ' ' << group_feature << ":1";
+
+    if(pair_feature)
+    {
+      data_ostr << ' ' << pair_feature << ":1";
+    }
+
+    if(row_i % 37 == 0)
+    {
+      data_ostr << " 6:1";
+    }
+
+    if(row_i % 4 == 0)
+    {
+      data_ostr << " 7:1";
+    }
+
+    data_ostr << std::endl;
+  }
+
+  return data_ostr.str();
+}
+
+bool
+row_has_feature(const Row* row, unsigned long feature_id)
+{
+  for(auto feature_it = row->features.begin();
+    feature_it != row->features.end(); ++feature_it)
+  {
+    if(feature_it->first == feature_id)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// multiplicity of row i in test bags
+BagView
+generate_bag(unsigned long rows_number)
+{
+  BagView bag(rows_number);
+
+  for(unsigned long row_i = 0; row_i < rows_number; ++row_i)
+  {
+    bag[row_i] = row_i % 7 % 3;
+  }
+
+  return bag;
+}
+
+RowHolder_var
+create_row_holder(
+  SVMImpl* svm,
+  const TreeLearnerImpl::ContextParams& params = TreeLearnerImpl::ContextParams())
+{
+  RowHolder_var row_holder = new RowHolder();
+  TestLearner::fill_row_holder_(*row_holder, svm, params);
+  return row_holder;
+}
+
+// bag part with rows of bag (as create_context fill it)
+BagPart_var
+create_bag_part(RowHolder* row_holder, const BagView& bag)
+{
+  BagHolder_var bag_holder = new BagHolder();
+  bag_holder->row_holder = Gears::add_ref(row_holder);
+  bag_holder->row_counts = bag;
+
+  BagPart_var bag_part = new BagPart();
+  bag_part->bag_holder = bag_holder;
+  bag_part->permutation = new TreeLearnerImpl::RowPermutation();
+
+  for(uint32_t row_i = 0; row_i < bag.size(); ++row_i)
+  {
+    if(bag[row_i] > 0)
+    {
+      bag_part->permutation->rows.push_back(row_i);
+    }
+  }
+
+  bag_part->begin = 0;
+  bag_part->end = bag_part->permutation->rows.size();
+  return bag_part;
+}
+
+// split of bag part: yes and no parts should be sorted and share
+// one permutation with parent rows (rows with feature first)
+bool
+check_split(
+  BagPart_var& yes_part,
+  BagPart_var& no_part,
+  const BagPart& bag_part,
+  unsigned long feature_id)
+{
+  TreeLearnerImpl::div_rows_(yes_part, no_part, feature_id, bag_part);
+
+  const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+  std::vector<uint32_t> yes_rows;
+  std::vector<uint32_t> no_rows;
+
+  for(const uint32_t* row_it = bag_part.rows_begin();
+    row_it != bag_part.rows_end(); ++row_it)
+  {
+    if(row_has_feature(row_holder.rows[*row_it], feature_id))
+    {
+      yes_rows.push_back(*row_it);
+    }
+    else
+    {
+      no_rows.push_back(*row_it);
+    }
+  }
+
+  bool ok = yes_part->bag_holder == bag_part.bag_holder &&
+    no_part->bag_holder == bag_part.bag_holder &&
+    yes_part->permutation == no_part->permutation &&
+    yes_part->end == no_part->begin &&
+    yes_part->size() + no_part->size() == bag_part.size();
+
+  ok = ok && std::vector<uint32_t>(
+    yes_part->rows_begin(), yes_part->rows_end()) == yes_rows;
+  ok = ok && std::vector<uint32_t>(
+    no_part->rows_begin(), no_part->rows_end()) == no_rows;
+
+  if(row_holder.feature_rows.find(feature_id) == row_holder.feature_rows.end())
+  {
+    // unknown feature: no side shares parent range
+    ok = ok && no_part->permutation == bag_part.permutation &&
+      no_part->begin == bag_part.begin &&
+      no_part->end == bag_part.end;
+  }
+  else
+  {
+    // new permutation contains parent range only
+    ok = ok && yes_part->permutation != bag_part.permutation &&
+      yes_part->begin == 0 &&
+      no_part->end == bag_part.size() &&
+      yes_part->permutation->rows.size() == bag_part.size();
+  }
+
+  if(!ok)
+  {
+    std::cerr << "split by #" << feature_id << " of " << bag_part.size() <<
+      " rows: expected " << yes_rows.size() << " yes rows, " <<
+      no_rows.size() << " no rows, got " << yes_part->size() << " yes rows, " <<
+      no_part->size() << " no rows" << std::endl;
+  }
+
+  return ok;
+}
+
+// train model, returns it in text format
+std::string
+train(
+  SVMImpl* svm,
+  const BagViewArray& bags,
+  const TreeLearnerImpl::ContextParams& params,
+  TreeLearnerImpl::FeatureScreening* screening = 0)
+{
+  ThreadRand::set_seed(SEED);
+
+  TreeLearnerImpl::Context_var context =
+    TreeLearnerImpl::create_context(svm, bags, params);
+  TreeLearnerImpl::LearnContext_var learner = context->create_learner(0, 0);
+
+  DTree_var tree;
+
+  for(unsigned long step_i = 0; step_i < STEPS; ++step_i)
+  {
+    tree = learner->train<PredictedLogLossGain>(
+      2,
+      1,
+      1.0,
+      TreeLearnerImpl::LearnContext::FSS_BEST,
+      false,
+      0,
+      screening);
+  }
+
+  std::ostringstream tree_ostr;
+  tree->save(tree_ostr);
+  return tree_ostr.str();
+}
+
+// node rows splitted by features in depth
+bool
+check_row_partition(SVMImpl* svm)
+{
+  RowHolder_var row_holder = create_row_holder(svm);
+  BagPart_var bag_part = create_bag_part(row_holder, generate_bag(svm->size()));
+
+  BagPart_var yes_part;
+  BagPart_var no_part;
+  bool ok = check_split(yes_part, no_part, *bag_part, 2);
+
+  BagPart_var yes_yes_part;
+  BagPart_var yes_no_part;
+  ok &= check_split(yes_yes_part, yes_no_part, *yes_part, 7);
+
+  BagPart_var no_yes_part;
+  BagPart_var no_no_part;
+  ok &= check_split(no_yes_part, no_no_part, *no_part, 6);
+
+  // parent ranges aren't changed by child splits
+  ok &= check_split(yes_part, no_part, *bag_part, 2);
+
+  // feature that node rows don't contain
+  BagPart_var empty_yes_part;
+  BagPart_var empty_no_part;
+  ok &= check_split(empty_yes_part, empty_no_part, *yes_yes_part, 3);
+
+  // unknown feature
+  BagPart_var unknown_yes_part;
+  BagPart_var unknown_no_part;
+  ok &= check_split(unknown_yes_part, unknown_no_part, *no_no_part, 100);
+
+  std::cout << "row_partition: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// bags share row index: it doesn't grow with bags number,
+// bag with row multiplicities is equal to rows repeated in dataset
+bool
+check_bag_views(const std::string& svm_text)
+{
+  std::istringstream svm_istr(svm_text);
+  SVMImpl_var svm = SVMImpl::load(svm_istr);
+  const BagView bag = generate_bag(svm->size());
+
+  MemoryUsage one_bag_usage;
+  MemoryUsage bags_usage;
+
+  {
+    TreeLearnerImpl::create_context(svm, BagViewArray(1, bag))->memory_usage(
+      one_bag_usage);
+    TreeLearnerImpl::create_context(svm, BagViewArray(6, bag))->memory_usage(
+      bags_usage);
+  }
+
+  bool ok = one_bag_usage.parts["feature_rows"] == bags_usage.parts["feature_rows"] &&
+    one_bag_usage.parts["row_index_data"] == bags_usage.parts["row_index_data"] &&
+    one_bag_usage.parts["feature_bundles"] == bags_usage.parts["feature_bundles"] &&
+    one_bag_usage.parts["bags"] * 6 == bags_usage.parts["bags"];
+
+  if(!ok)
+  {
+    std::cerr << "bag_views: memory usage for one bag:" << std::endl;
+    one_bag_usage.print(std::cerr, "  ");
+    std::cerr << "bag_views: memory usage for 6 bags:" << std::endl;
+    bags_usage.print(std::cerr, "  ");
+  }
+
+  // dataset with rows repeated by bag multiplicities:
+  // bag is indexed by row position in label groups
+  std::vector<unsigned long> line_repeats(svm->size(), 0);
+  unsigned long row_i = 0;
+
+  for(auto group_it = svm->grouped_rows.begin();
+    group_it != svm->grouped_rows.end(); ++group_it)
+  {
+    for(auto row_it = (*group_it)->rows.begin();
+      row_it != (*group_it)->rows.end(); ++row_it, ++row_i)
+    {
+      line_repeats[(*row_it)->index] = bag[row_i];
+    }
+  }
+
+  std::istringstream lines_istr(svm_text);
+  std::ostringstream repeated_ostr;
+  std::string line;
+
+  for(unsigned long line_i = 0; std::getline(lines_istr, line); ++line_i)
+  {
+    for(unsigned long repeat_i = 0; repeat_i < line_repeats[line_i]; ++repeat_i)
+    {
+      repeated_ostr << line << std::endl;
+    }
+  }
+
+  std::istringstream repeated_istr(repeated_ostr.str());
+  SVMImpl_var repeated_svm = SVMImpl::load(repeated_istr);
+
+  const std::string model = train(
+    svm,
+    BagViewArray(1, bag),
+    TreeLearnerImpl::ContextParams());
+  const std::string repeated_model = train(
+    repeated_svm,
+    BagViewArray(1, BagView(repeated_svm->size(), 1)),
+    TreeLearnerImpl::ContextParams());
+
+  if(model != repeated_model)
+  {
+    std::cerr << "bag_views: model differs from model trained on repeated rows:" <<
+      std::endl << model << std::endl << "repeated rows model:" << std::endl <<
+      repeated_model << std::endl;
+    ok = false;
+  }
+
+  std::cout << "bag_views: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// node stat of bag part: every node row placed to cell of its label group
+// and mask of branch features, cell counts are sums of row multiplicities;
+// yes counts collected by bundle rows are equal to multiplicities of node
+// rows with bundle feature summed by (feature index, cell)
+bool
+check_node_stat(
+  const char* name,
+  const BagPart& bag_part,
+  const LearnTreeHolder* cur_tree)
+{
+  typedef std::map<uint64_t, unsigned long> YesCountMap;
+
+  const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+  const BagView& row_counts = bag_part.bag_holder->row_counts;
+
+  NodeStat_var node_stat = new NodeStat();
+
+  {
+    PredictedLogLossGain gain_calc;
+    TestLearner::fill_node_stat_(*node_stat, gain_calc, cur_tree, bag_part);
+  }
+
+  const TreeLearnerImpl::FeatureIdArray& features = node_stat->features;
+
+  bool ok = std::is_sorted(features.begin(), features.end()) &&
+    features.size() == (cur_tree ? cur_tree->branches.size() : 0) &&
+    node_stat->row_cells.size() == bag_part.size();
+
+  std::set<std::pair<unsigned long, uint64_t> > cell_keys;
+
+  for(auto cell_it = node_stat->cells.begin();
+    cell_it != node_stat->cells.end(); ++cell_it)
+  {
+    ok &= cell_keys.insert(std::make_pair(cell_it->group, cell_it->mask)).second;
+  }
+
+  std::vector<unsigned long> cell_counts(node_stat->cells.size(), 0);
+
+  for(unsigned long pos = 0; ok && pos < bag_part.size(); ++pos)
+  {
+    const uint32_t row_i = bag_part.rows_begin()[pos];
+    const uint32_t cell_i = node_stat->row_cells[pos];
+    const unsigned long group_i = std::upper_bound(
+      row_holder.group_ends.begin(),
+      row_holder.group_ends.end(),
+      row_i) - row_holder.group_ends.begin();
+
+    uint64_t mask = 0;
+
+    for(unsigned long feature_index = 0; feature_index < features.size();
+      ++feature_index)
+    {
+      if(row_has_feature(row_holder.rows[row_i], features[feature_index]))
+      {
+        mask |= static_cast<uint64_t>(1) << feature_index;
+      }
+    }
+
+    ok = cell_i < node_stat->cells.size() &&
+      node_stat->cells[cell_i].group == group_i &&
+      node_stat->cells[cell_i].mask == mask;
+
+    if(ok)
+    {
+      cell_counts[cell_i] += row_counts[row_i];
+    }
+  }
+
+  for(unsigned long cell_i = 0; ok && cell_i < cell_counts.size(); ++cell_i)
+  {
+    ok = node_stat->cells[cell_i].count == cell_counts[cell_i];
+  }
+
+  if(!ok)
+  {
+    std::cerr << name << ": node stat cells don't match node rows" << std::endl;
+  }
+
+  for(auto bundle_it = row_holder.feature_bundles.begin();
+    ok && bundle_it != row_holder.feature_bundles.end(); ++bundle_it)
+  {
+    TreeLearnerImpl::YesCountArray yes_counts;
+    TestLearner::fill_bundle_yes_counts_(yes_counts, *bundle_it, bag_part, *node_stat);
+
+    YesCountMap bundle_counts;
+
+    for(auto yes_count_it = yes_counts.begin();
+      yes_count_it != yes_counts.end(); ++yes_count_it)
+    {
+      bundle_counts[yes_count_it->first] += yes_count_it->second;
+    }
+
+    YesCountMap expected_counts;
+
+    for(unsigned long pos = 0; pos < bag_part.size(); ++pos)
+    {
+      const uint32_t row_i = bag_part.rows_begin()[pos];
+
+      for(uint64_t feature_i = 0; feature_i < bundle_it->features.size(); ++feature_i)
+      {
+        if(row_has_feature(row_holder.rows[row_i], bundle_it->features[feature_i]))
+        {
+          expected_counts[(feature_i << 32) | node_stat->row_cells[pos]] +=
+            row_counts[row_i];
+        }
+      }
+    }
+
+    if(bundle_counts != expected_counts)
+    {
+      std::cerr << name << ": yes counts of bundle #" <<
+        (bundle_it - row_holder.feature_bundles.begin()) <<
+        " don't match node rows" << std::endl;
+      ok = false;
+    }
+  }
+
+  std::cout << name << ": " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// node stats of root and split node, with and without branches:
+// bundle with rare feature 6 is checked by search of its rows in node rows,
+// other bundles by merge with node rows
+bool
+check_node_stats(SVMImpl* svm)
+{
+  RowHolder_var row_holder = create_row_holder(svm);
+  BagPart_var bag_part = create_bag_part(row_holder, generate_bag(svm->size()));
+
+  LearnTreeHolder_var cur_tree = new LearnTreeHolder();
+  const unsigned long BRANCH_FEATURES[] = { 7, 2, 6 };
+
+  for(unsigned long branch_i = 0;
+    branch_i < sizeof(BRANCH_FEATURES) / sizeof(BRANCH_FEATURES[0]); ++branch_i)
+  {
+    LearnTreeHolder::Branch branch;
+    branch.feature_id = BRANCH_FEATURES[branch_i];
+    cur_tree->branches.push_back(branch);
+  }
+
+  BagPart_var yes_part;
+  BagPart_var no_part;
+  TreeLearnerImpl::div_rows_(yes_part, no_part, 4, *bag_part);
+
+  bool ok = check_node_stat("node_stat(root)", *bag_part, 0);
+  ok &= check_node_stat("node_stat(root, branches)", *bag_part, cur_tree);
+  ok &= check_node_stat("node_stat(yes part, branches)", *yes_part, cur_tree);
+  ok &= check_node_stat("node_stat(no part, branches)", *no_part, cur_tree);
+  return ok;
+}
+
+// bundle_i: bundle of feature
+bool
+find_bundle(
+  unsigned long& bundle_i,
+  const RowHolder& row_holder,
+  unsigned long feature_id)
+{
+  for(auto bundle_it = row_holder.feature_bundles.begin();
+    bundle_it != row_holder.feature_bundles.end(); ++bundle_it)
+  {
+    if(std::find(bundle_it->features.begin(), bundle_it->features.end(), feature_id) !=
+      bundle_it->features.end())
+    {
+      bundle_i = bundle_it - row_holder.feature_bundles.begin();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// every feature placed to one bundle, bundle contains
+// (row, feature index) pairs of its features sorted by row
+bool
+check_bundle_rows(const char* name, const RowHolder& row_holder)
+{
+  bool ok = true;
+  unsigned long bundled_features = 0;
+
+  for(auto bundle_it = row_holder.feature_bundles.begin();
+    ok && bundle_it != row_holder.feature_bundles.end(); ++bundle_it)
+  {
+    std::vector<std::pair<uint32_t, uint32_t> > expected_rows;
+
+    for(uint32_t feature_i = 0; feature_i < bundle_it->features.size(); ++feature_i)
+    {
+      const TreeLearnerImpl::RowIndexRef& feature_rows =
+        row_holder.feature_rows.find(bundle_it->features[feature_i])->second;
+
+      for(auto row_it = feature_rows.begin(); row_it != feature_rows.end(); ++row_it)
+      {
+        expected_rows.push_back(std::make_pair(*row_it, feature_i));
+      }
+    }
+
+    std::sort(expected_rows.begin(), expected_rows.end());
+
+    std::vector<std::pair<uint32_t, uint32_t> > bundle_rows;
+
+    for(unsigned long row_i = 0; row_i < bundle_it->rows.size(); ++row_i)
+    {
+      bundle_rows.push_back(std::make_pair(
+        bundle_it->rows.begin()[row_i],
+        bundle_it->row_features.begin()[row_i]));
+    }
+
+    ok = !bundle_it->numeric &&
+      bundle_it->row_features.size() == bundle_it->rows.size() &&
+      bundle_rows == expected_rows;
+
+    bundled_features += bundle_it->features.size();
+  }
+
+  for(auto feature_it = row_holder.features.begin();
+    ok && feature_it != row_holder.features.end(); ++feature_it)
+  {
+    unsigned long bundle_i;
+    ok = find_bundle(bundle_i, row_holder, *feature_it);
+  }
+
+  ok = ok && bundled_features == row_holder.features.size();
+
+  if(!ok)
+  {
+    std::cerr << name << ": bundle rows don't match feature rows" << std::endl;
+  }
+
+  return ok;
+}
+
+// exclusive features bundled together, own bundle for every feature
+// if bundling disabled, bundling doesn't change model
+bool
+check_bundles(SVMImpl* svm)
+{
+  TreeLearnerImpl::ContextParams single_params;
+  single_params.bundle_features = false;
+
+  RowHolder_var row_holder = create_row_holder(svm);
+  RowHolder_var single_row_holder = create_row_holder(svm, single_params);
+
+  bool ok = check_bundle_rows("bundles", *row_holder) &&
+    check_bundle_rows("bundles(single)", *single_row_holder);
+
+  unsigned long group_bundles[3];
+  unsigned long pair_bundles[2];
+
+  ok = ok && find_bundle(group_bundles[0], *row_holder, 1) &&
+    find_bundle(group_bundles[1], *row_holder, 2) &&
+    find_bundle(group_bundles[2], *row_holder, 3) &&
+    find_bundle(pair_bundles[0], *row_holder, 4) &&
+    find_bundle(pair_bundles[1], *row_holder, 5) &&
+    group_bundles[0] == group_bundles[1] &&
+    group_bundles[0] == group_bundles[2] &&
+    pair_bundles[0] == pair_bundles[1] &&
+    row_holder->feature_bundles.size() < row_holder->features.size() &&
+    single_row_holder->feature_bundles.size() == single_row_holder->features.size();
+
+  if(!ok)
+  {
+    std::cerr << "bundles: exclusive features aren't bundled" << std::endl;
+  }
+
+  // base bag is selected for every bundle: single bag
+  const BagViewArray bags(1, generate_bag(svm->size()));
+  const std::string model = train(svm, bags, TreeLearnerImpl::ContextParams());
+  const std::string single_model = train(svm, bags, single_params);
+
+  if(model != single_model)
+  {
+    std::cerr << "bundles: model differs from model trained without bundles:" <<
+      std::endl << model << std::endl << "model without bundles:" << std::endl <<
+      single_model << std::endl;
+    ok = false;
+  }
+
+  std::cout << "bundles: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// stratified sample: sorted subset of node rows with rows of
+// every node label group
+bool
+check_sample(const char* name, const BagPart& bag_part, unsigned long rows)
+{
+  const RowHolder& row_holder = *bag_part.bag_holder->row_holder;
+
+  BagPart_var sample_part;
+  TestLearner::fill_sample_part_(sample_part, bag_part, rows);
+
+  const std::vector<uint32_t> node_rows(bag_part.rows_begin(), bag_part.rows_end());
+  const std::vector<uint32_t> sample_rows(
+    sample_part->rows_begin(), sample_part->rows_end());
+
+  std::set<unsigned long> node_groups;
+  std::set<unsigned long> sample_groups;
+
+  for(auto row_it = node_rows.begin(); row_it != node_rows.end(); ++row_it)
+  {
+    node_groups.insert(std::upper_bound(
+      row_holder.group_ends.begin(),
+      row_holder.group_ends.end(),
+      *row_it) - row_holder.group_ends.begin());
+  }
+
+  for(auto row_it = sample_rows.begin(); row_it != sample_rows.end(); ++row_it)
+  {
+    sample_groups.insert(std::upper_bound(
+      row_holder.group_ends.begin(),
+      row_holder.group_ends.end(),
+      *row_it) - row_holder.group_ends.begin());
+  }
+
+  // sample size rounded for every group
+  const bool ok = sample_part->bag_holder == bag_part.bag_holder &&
+    std::adjacent_find(sample_rows.begin(), sample_rows.end(),
+      std::greater_equal<uint32_t>()) == sample_rows.end() &&
+    std::includes(node_rows.begin(), node_rows.end(),
+      sample_rows.begin(), sample_rows.end()) &&
+    sample_groups == node_groups &&
+    sample_rows.size() + node_groups.size() >= rows &&
+    sample_rows.size() <= rows + node_groups.size();
+
+  if(!ok)
+  {
+    std::cerr << name << ": sample of " << sample_rows.size() << " rows from " <<
+      node_rows.size() << " node rows isn't stratified sample of " << rows <<
+      " rows" << std::endl;
+  }
+
+  std::cout << name << ": " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// screening selects top features: first split feature of
+// hand-made dataset (2) is selected on sample and on all rows,
+// features that don't divide node rows aren't selected,
+// screened learner (top 5 of 7 features) doesn't miss exact best
+// features and gives the same model as learner without screening
+bool
+check_screening(SVMImpl* svm)
+{
+  RowHolder_var row_holder = create_row_holder(svm);
+  BagPart_var bag_part = create_bag_part(row_holder, generate_bag(svm->size()));
+
+  bool ok = check_sample("sample", *bag_part, 100);
+
+  BagPart_var yes_part;
+  BagPart_var no_part;
+  TreeLearnerImpl::div_rows_(yes_part, no_part, 7, *bag_part);
+  ok &= check_sample("sample(yes part)", *yes_part, 30);
+
+  const unsigned long SCREEN_ROWS[] = { 0, 200 };
+
+  for(unsigned long rows_i = 0;
+    rows_i < sizeof(SCREEN_ROWS) / sizeof(SCREEN_ROWS[0]); ++rows_i)
+  {
+    TreeLearnerImpl::FeatureScreening screening;
+    screening.top = 3;
+    screening.rows = SCREEN_ROWS[rows_i];
+
+    TreeLearnerImpl::BundleFeaturesArray bundle_features;
+    TestLearner::screen_features_<PredictedLogLossGain>(
+      bundle_features, screening, *bag_part);
+
+    unsigned long screened_features = 0;
+    bool best_screened = false;
+
+    for(unsigned long bundle_i = 0; bundle_i < bundle_features.size(); ++bundle_i)
+    {
+      const TreeLearnerImpl::RowIndexArray& features = bundle_features[bundle_i];
+      screened_features += features.size();
+
+      for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+      {
+        ok &= *feature_it < row_holder->feature_bundles[bundle_i].features.size();
+        best_screened |= *feature_it < row_holder->feature_bundles[bundle_i].features.size() &&
+          row_holder->feature_bundles[bundle_i].features[*feature_it] == 2;
+      }
+    }
+
+    if(bundle_features.size() != row_holder->feature_bundles.size() ||
+      screened_features != screening.top ||
+      !best_screened)
+    {
+      std::cerr << "screening: " << screened_features << " features screened on " <<
+        SCREEN_ROWS[rows_i] << " rows, best feature " <<
+        (best_screened ? "" : "not ") << "screened" << std::endl;
+      ok = false;
+    }
+  }
+
+  // rows with feature 2 don't contain features 1, 3:
+  // all other features should be selected
+  {
+    TreeLearnerImpl::FeatureScreening screening;
+    screening.top = 4;
+
+    BagPart_var feature_part;
+    BagPart_var other_part;
+    TreeLearnerImpl::div_rows_(feature_part, other_part, 2, *bag_part);
+
+    TreeLearnerImpl::BundleFeaturesArray bundle_features;
+    TestLearner::screen_features_<PredictedLogLossGain>(
+      bundle_features, screening, *feature_part);
+
+    std::set<unsigned long> screened_features;
+
+    for(unsigned long bundle_i = 0; bundle_i < bundle_features.size(); ++bundle_i)
+    {
+      const TreeLearnerImpl::RowIndexArray& features = bundle_features[bundle_i];
+
+      for(auto feature_it = features.begin(); feature_it != features.end(); ++feature_it)
+      {
+        screened_features.insert(
+          row_holder->feature_bundles[bundle_i].features[*feature_it]);
+      }
+    }
+
+    const unsigned long DIVIDE_FEATURES[] = { 4, 5, 6, 7 };
+
+    if(screened_features != std::set<unsigned long>(
+         DIVIDE_FEATURES,
+         DIVIDE_FEATURES + sizeof(DIVIDE_FEATURES) / sizeof(DIVIDE_FEATURES[0])))
+    {
+      std::cerr << "screening: features that don't divide node rows screened" <<
+        std::endl;
+      ok = false;
+    }
+  }
+
+  const BagViewArray bags(3, generate_bag(svm->size()));
+  const std::string model = train(svm, bags, TreeLearnerImpl::ContextParams());
+
+  TreeLearnerImpl::FeatureScreening screening;
+  screening.top = 6;
+  screening.rows = 200;
+  screening.validate = true;
+
+  const std::string screened_model = train(
+    svm,
+    bags,
+    TreeLearnerImpl::ContextParams(),
+    &screening);
+
+  if(screening.checks == 0 || screening.misses > 0)
+  {
+    std::cerr << "screening: " << screening.misses << " misses of " <<
+      screening.checks << " checks" << std::endl;
+    ok = false;
+  }
+
+  if(model != screened_model)
+  {
+    std::cerr << "screening: model differs from model trained without screening:" <<
+      std::endl << screened_model << std::endl << "model without screening:" <<
+      std::endl << model << std::endl;
+    ok = false;
+  }
+
+  std::cout << "screening: " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    const std::string svm_text = generate_svm_text();
+    std::istringstream svm_istr(svm_text);
+    SVMImpl_var svm = SVMImpl::load(svm_istr);
+
+    ok &= check_row_partition(svm);
+    ok &= check_bag_views(svm_text);
+    ok &= check_node_stats(svm);
+    ok &= check_bundles(svm);
+    ok &= check_screening(svm);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// TreeLearnerTest: models trained with worker processes
+// should be equal to model trained in one process with the same seed
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <DTree/DTree.hpp>
+#include <DTree/Rand.hpp>
+#include <DTree/SVM.hpp>
+#include <DTree/TreeLearner.hpp>
+#include <DTree/Gain.hpp>
+
+using namespace Vanga;
+
+typedef SVM<PredictedBoolLabel> SVMImpl;
+typedef Gears::IntrusivePtr<SVMImpl> SVMImpl_var;
+typedef TreeLearner<PredictedBoolLabel> TreeLearnerImpl;
+typedef TreeLearnerImpl::BagViewArray BagViewArray;
+
+const unsigned long ROWS = 2000;
+const unsigned long FEATURES = 150;
+const unsigned long BAGS = 3;
+const unsigned long STEPS = 3;
+const unsigned long SEED = 7;
+
+// sparse rows, label defined by hidden weights of row features
+std::string
+generate_svm_text()
+{
+  std::mt19937 rnd(11);
+  std::uniform_real_distribution<double> weight_dist(-1.0, 1.0);
+  std::vector<double> weights(FEATURES + 1);
+
+  for(auto weight_it = weights.begin(); weight_it != weights.end(); ++weight_it)
+  {
+    *weight_it = weight_dist(rnd);
+  }
+
+  std::ostringstream data_ostr;
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    std::ostringstream row_ostr;
+    double score = 0;
+
+    for(unsigned long feature_id = 1; feature_id <= FEATURES; ++feature_id)
+    {
+      // frequent features have small ids
+      if(rnd() % (feature_id + 4) < 4)
+      {
+        row_ostr << ' ' << feature_id << ":1";
+        score += weights[feature_id];
+      }
+    }
+
+    const bool label = score + weight_dist(rnd) > 0;
+    data_ostr << (label ? 1 : 0) << row_ostr.str() << std::endl;
+  }
+
+  return data_ostr.str();
+}
+
+// train model, returns it in text format
+std::string
+train(
+  SVMImpl* svm,
+  const BagViewArray& bags,
+  const TreeLearnerImpl::ContextParams& params)
+{
+  ThreadRand::set_seed(SEED);
+
+  TreeLearnerImpl::Context_var context =
+    TreeLearnerImpl::create_context(svm, bags, params);
+  TreeLearnerImpl::LearnContext_var learner = context->create_learner(0, 0);
+
+  DTree_var tree;
+
+  for(unsigned long step_i = 0; step_i < STEPS; ++step_i)
+  {
+    tree = learner->train<PredictedLogLossGain>(2, 1);
+  }
+
+  std::ostringstream tree_ostr;
+  tree->save(tree_ostr);
+  return tree_ostr.str();
+}
+
+bool
+check_params(
+  const char* name,
+  SVMImpl* svm,
+  const BagViewArray& bags,
+  const std::string& local_model,
+  const TreeLearnerImpl::ContextParams& params)
+{
+  const std::string model = train(svm, bags, params);
+  const bool ok = model == local_model;
+
+  if(!ok)
+  {
+    std::cerr << name << ": model differs from local model:" << std::endl <<
+      model << std::endl << "local model:" << std::endl << local_model << std::endl;
+  }
+
+  std::cout << name << ": " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok;
+}
+
+// yes counts evaluated by row shard processes
+bool
+check_shard_processes(
+  SVMImpl* svm,
+  const BagViewArray& bags,
+  const std::string& local_model)
+{
+  bool ok = true;
+
+  for(unsigned long processes = 1; processes <= 3; ++processes)
+  {
+    TreeLearnerImpl::ContextParams params;
+    params.processes = processes;
+
+    std::ostringstream name_ostr;
+    name_ostr << "shard_processes(" << processes << ")";
+    ok &= check_params(name_ostr.str().c_str(), svm, bags, local_model, params);
+  }
+
+  return ok;
+}
+
+// feature slices checked by worker processes connected over 127.0.0.1
+bool
+check_feature_processes(
+  SVMImpl* svm,
+  const BagViewArray& bags,
+  const std::string& local_model)
+{
+  bool ok = true;
+
+  for(unsigned long processes = 2; processes <= 3; ++processes)
+  {
+    TreeLearnerImpl::ContextParams params;
+    params.feature_processes = processes;
+    params.feature_host = "127.0.0.1";
+
+    std::ostringstream name_ostr;
+    name_ostr << "feature_processes(" << processes << ")";
+    ok &= check_params(name_ostr.str().c_str(), svm, bags, local_model, params);
+  }
+
+  return ok;
+}
+
+// rows order in label groups (and model trained with fixed seed)
+// shouldn't depend on allocations: file rows collecting
+// for margins output changes allocations pattern
+bool
+check_row_order(
+  const std::string& svm_text,
+  const BagViewArray& bags,
+  const std::string& local_model)
+{
+  std::vector<Row_var> holes;
+
+  for(unsigned long row_i = 0; row_i < ROWS; ++row_i)
+  {
+    holes.push_back(new Row());
+  }
+
+  RowArray file_rows;
+  std::istringstream svm_istr(svm_text);
+  SVMImpl_var svm = SVMImpl::load(svm_istr, 0, &file_rows);
+  holes.clear();
+
+  bool ok = file_rows.size() == ROWS;
+
+  for(auto group_it = svm->grouped_rows.begin();
+    group_it != svm->grouped_rows.end(); ++group_it)
+  {
+    const RowArray& rows = (*group_it)->rows;
+
+    for(unsigned long row_i = 1; row_i < rows.size(); ++row_i)
+    {
+      ok &= rows[row_i - 1]->index < rows[row_i]->index;
+    }
+  }
+
+  if(!ok)
+  {
+    std::cerr << "row_order: rows in label groups aren't in file order" << std::endl;
+    std::cout << "row_order: FAILED" << std::endl;
+    return false;
+  }
+
+  return check_params(
+    "row_order",
+    svm,
+    bags,
+    local_model,
+    TreeLearnerImpl::ContextParams());
+}
+
+int
+main(int, char**)
+{
+  bool ok = true;
+
+  try
+  {
+    const std::string svm_text = generate_svm_text();
+    std::istringstream svm_istr(svm_text);
+    SVMImpl_var svm = SVMImpl::load(svm_istr);
+
+    ThreadRand::set_seed(SEED);
+    BagViewArray bags;
+    TreeLearnerImpl::fill_portion_bags(bags, svm->size(), BAGS);
+
+    const std::string local_model = train(
+      svm, bags, TreeLearnerImpl::ContextParams());
+
+    ok &= check_shard_processes(svm, bags, local_model);
+    ok &= check_feature_processes(svm, bags, local_model);
+    ok &= check_row_order(svm_text, bags, local_model);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "caught Gears::Exception: " << ex.what() << std::endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,678 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <sys/resource.h>
+
+#include <Gears/Basic/AppUtils.hpp>
+#include <Gears/Basic/StringManip.hpp>
+#include <Gears/String/Tokenizer.hpp>
+
+#include <DTree/Gain.hpp>
+#include <DTree/Rand.hpp>
+
+#include "DataGenerator.hpp"
+#include "Application.hpp"
+
+namespace
+{
+  const char USAGE[] =
+    "\nUsage: \n"
+    "DTreeBench [generate|run]\n"
+    "  generate <svm file>: write synthetic sparse data\n"
+    "  run [svm file]: benchmark learner on svm file or on generated data,\n"
+    "    results saved as json\n";
+
+  // relative tolerance of predictions sum check
+  const double SPARSE_PRED_EPS = 1e-9;
+
+  class Callback:
+    public Gears::ActiveObjectCallback
+  {
+  public:
+    void report_error(
+      Gears::ActiveObjectCallback::Severity severity,
+      const Gears::SubString& description,
+      const Gears::SubString& error_code = Gears::SubString())
+      throw()
+    {
+      try
+      {
+        std::cerr << severity << "(" << error_code << "): " <<
+          description << std::endl;
+      }
+      catch (...) {}
+    }
+  };
+}
+
+// Application
+Application_::Application_()
+  throw()
+{}
+
+Application_::~Application_() throw()
+{}
+
+void
+Application_::main(int& argc, char** argv)
+  /*throw(Gears::Exception)*/
+{
+  Gears::AppUtils::CheckOption opt_help;
+  Gears::AppUtils::Option<unsigned long> opt_rows(100000);
+  Gears::AppUtils::Option<unsigned long> opt_features(10000);
+  Gears::AppUtils::Option<unsigned long> opt_row_features(20);
+  Gears::AppUtils::Option<double> opt_zipf(1.0);
+  Gears::AppUtils::Option<double> opt_noise(0.05);
+  Gears::AppUtils::Option<unsigned long> opt_seed(0);
+  Gears::AppUtils::StringOption opt_threads("1,8,32");
+  Gears::AppUtils::Option<unsigned long> opt_repeats(3);
+  Gears::AppUtils::Option<unsigned long> opt_steps(5);
+  Gears::AppUtils::Option<unsigned long> opt_bags(3);
+  Gears::AppUtils::StringOption opt_out;
+
+  Gears::AppUtils::Args args(-1);
+
+  args.add(
+    Gears::AppUtils::equal_name("help") ||
+    Gears::AppUtils::short_name("h"),
+    opt_help);
+  args.add(
+    Gears::AppUtils::equal_name("rows"),
+    opt_rows);
+  args.add(
+    Gears::AppUtils::equal_name("features"),
+    opt_features);
+  args.add(
+    Gears::AppUtils::equal_name("row-features"),
+    opt_row_features);
+  args.add(
+    Gears::AppUtils::equal_name("zipf"),
+    opt_zipf);
+  args.add(
+    Gears::AppUtils::equal_name("noise"),
+    opt_noise);
+  args.add(
+    Gears::AppUtils::equal_name("seed"),
+    opt_seed);
+  args.add(
+    Gears::AppUtils::equal_name("threads") ||
+    Gears::AppUtils::short_name("t"),
+    opt_threads);
+  args.add(
+    Gears::AppUtils::equal_name("repeats"),
+    opt_repeats);
+  args.add(
+    Gears::AppUtils::equal_name("steps"),
+    opt_steps);
+  args.add(
+    Gears::AppUtils::equal_name("bags"),
+    opt_bags);
+  args.add(
+    Gears::AppUtils::equal_name("out") ||
+    Gears::AppUtils::short_name("o"),
+    opt_out);
+
+  args.parse(argc - 1, argv + 1);
+
+  const Gears::AppUtils::Args::CommandList& commands = args.commands();
+
+  if(commands.empty() || opt_help.enabled() ||
+     *commands.begin() == "help")
+  {
+    std::cout << USAGE << std::endl;
+    return;
+  }
+
+  if(*opt_features == 0 || *opt_repeats == 0 || *opt_bags == 0)
+  {
+    throw Exception("features, repeats and bags numbers should be positive");
+  }
+
+  DataGeneratorParams generator_params;
+  generator_params.rows = *opt_rows;
+  generator_params.features = *opt_features;
+  generator_params.row_features = *opt_row_features;
+  generator_params.zipf = *opt_zipf;
+  generator_params.noise = *opt_noise;
+  generator_params.seed = *opt_seed;
+
+  auto command_it = commands.begin();
+  std::string command = *command_it;
+  ++command_it;
+
+  if(command == "generate")
+  {
+    if(command_it == commands.end())
+    {
+      std::cerr << "result file not defined" << std::endl;
+      return;
+    }
+
+    std::ofstream out(command_it->c_str());
+    if(!out.is_open())
+    {
+      Gears::ErrorStream ostr;
+      ostr << "can't open '" << *command_it << "'";
+      throw Exception(ostr.str());
+    }
+
+    DataGenerator generator(generator_params);
+    generator.generate(out);
+  }
+  else if(command == "run")
+  {
+    std::vector<unsigned long> threads;
+
+    {
+      Gears::CategoryRepeatableTokenizer<
+        Gears::Ascii::SepComma> tokenizer(*opt_threads);
+      Gears::SubString token;
+      while(tokenizer.get_token(token))
+      {
+        unsigned long val;
+        if(!Gears::StringManip::str_to_int(token, val) || val == 0)
+        {
+          Gears::ErrorStream ostr;
+          ostr << "invalid threads list '" << *opt_threads << "'";
+          throw Exception(ostr.str());
+        }
+        threads.push_back(val);
+      }
+    }
+
+    // data loaded to memory: load bench don't include disk reads
+    std::string data;
+    std::ostringstream dataset_ostr;
+
+    if(command_it != commands.end())
+    {
+      std::ifstream in(command_it->c_str());
+      if(!in.is_open())
+      {
+        Gears::ErrorStream ostr;
+        ostr << "can't open '" << *command_it << "'";
+        throw Exception(ostr.str());
+      }
+
+      data.assign(
+        std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+
+      dataset_ostr << "{\"file\": \"" << *command_it << "\"}";
+    }
+    else
+    {
+      std::ostringstream data_ostr;
+      DataGenerator generator(generator_params);
+      generator.generate(data_ostr);
+      data = data_ostr.str();
+
+      dataset_ostr << "{\"rows\": " << generator_params.rows <<
+        ", \"features\": " << generator_params.features <<
+        ", \"row_features\": " << generator_params.row_features <<
+        ", \"zipf\": " << generator_params.zipf <<
+        ", \"noise\": " << generator_params.noise <<
+        ", \"seed\": " << generator_params.seed << "}";
+    }
+
+    ThreadRand::set_seed(*opt_seed);
+
+    BenchResultArray results;
+
+    SVMImpl_var svm = bench_svm_load_(results, data, *opt_repeats);
+    data.clear();
+
+    TreeLearnerImpl::BagViewArray bags;
+    TreeLearnerImpl::fill_portion_bags(bags, svm->size(), *opt_bags);
+
+    TreeLearnerImpl::Context_var context = bench_fill_feature_rows_(
+      results, svm, bags, *opt_repeats);
+
+    const unsigned long rows = svm->size();
+    DTree_var tree;
+
+    for(auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it)
+    {
+      bench_best_feature_(
+        results, context, rows, *threads_it, *opt_repeats, *opt_seed);
+    }
+
+    for(auto threads_it = threads.begin(); threads_it != threads.end(); ++threads_it)
+    {
+      tree = bench_train_steps_(
+        results, context, rows, *threads_it, *opt_steps, *opt_seed);
+    }
+
+    if(tree)
+    {
+      const double pred_sum = bench_fpredict_(
+        results, "fpredict", tree.in(), svm, *opt_repeats);
+
+      CompiledDTree_var compiled_tree = new CompiledDTree(tree);
+      const double compiled_pred_sum = bench_fpredict_(
+        results, "compiled_fpredict", compiled_tree.in(), svm, *opt_repeats);
+
+      if(compiled_pred_sum != pred_sum)
+      {
+        throw Exception("compiled_fpredict: predictions differ from fpredict");
+      }
+
+      const double block_pred_sum = bench_block_predict_(
+        results, compiled_tree, svm, *opt_repeats);
+
+      if(block_pred_sum != pred_sum)
+      {
+        throw Exception("block_predict: predictions differ from fpredict");
+      }
+
+      // sparse evaluation changes summation order
+      SparseDTree_var sparse_tree = new SparseDTree(tree);
+      const double sparse_pred_sum = bench_fpredict_(
+        results, "sparse_fpredict", sparse_tree.in(), svm, *opt_repeats);
+
+      if(std::fabs(sparse_pred_sum - pred_sum) >
+        SPARSE_PRED_EPS * std::max(std::fabs(pred_sum), 1.0))
+      {
+        Gears::ErrorStream ostr;
+        ostr << "sparse_fpredict: predictions sum " << sparse_pred_sum <<
+          " differ from fpredict sum " << pred_sum;
+        throw Exception(ostr.str());
+      }
+    }
+
+    if(!opt_out->empty())
+    {
+      std::ofstream out(opt_out->c_str());
+      if(!out.is_open())
+      {
+        Gears::ErrorStream ostr;
+        ostr << "can't open '" << *opt_out << "'";
+        throw Exception(ostr.str());
+      }
+
+      save_results_(out, dataset_ostr.str(), results);
+    }
+    else
+    {
+      save_results_(std::cout, dataset_ostr.str(), results);
+    }
+  }
+  else
+  {
+    Gears::ErrorStream ostr;
+    ostr << "unknown command '" << command << "', "
+      "see help for more info" << std::endl;
+    throw Exception(ostr.str());
+  }
+}
+
+void
+Application_::add_time_(
+  BenchResult& result,
+  const std::chrono::steady_clock::time_point& start)
+{
+  const double time = static_cast<double>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count()) / 1000000000;
+
+  result.min_time = result.repeats > 0 ?
+    std::min(result.min_time, time) : time;
+  result.sum_time += time;
+  ++result.repeats;
+}
+
+long
+Application_::peak_rss_()
+{
+  struct rusage usage;
+
+  if(::getrusage(RUSAGE_SELF, &usage) < 0)
+  {
+    return 0;
+  }
+
+  return usage.ru_maxrss;
+}
+
+Gears::TaskRunner_var
+Application_::create_task_runner_(unsigned long threads)
+{
+  Gears::TaskRunner_var task_runner;
+
+  if(threads > 1)
+  {
+    Gears::ActiveObjectCallback_var callback(new Callback());
+
+    task_runner = new Gears::TaskRunner(
+      callback,
+      threads,
+      10*1024*1024 // stack size
+      );
+
+    task_runner->activate_object();
+  }
+
+  return task_runner;
+}
+
+Application_::SVMImpl_var
+Application_::bench_svm_load_(
+  BenchResultArray& results,
+  const std::string& data,
+  unsigned long repeats)
+{
+  BenchResult result;
+  result.name = "svm_load";
+
+  SVMImpl_var svm;
+
+  for(unsigned long repeat_i = 0; repeat_i < repeats; ++repeat_i)
+  {
+    std::istringstream in(data);
+
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    svm = SVMImpl::load(in);
+    add_time_(result, start);
+  }
+
+  result.rows = svm->size();
+  result.peak_rss = peak_rss_();
+  results.push_back(result);
+
+  return svm;
+}
+
+Application_::TreeLearnerImpl::Context_var
+Application_::bench_fill_feature_rows_(
+  BenchResultArray& results,
+  SVMImpl* svm,
+  const TreeLearnerImpl::BagViewArray& bags,
+  unsigned long repeats)
+{
+  BenchResult result;
+  result.name = "fill_feature_rows";
+  result.rows = svm->size();
+
+  TreeLearnerImpl::Context_var context;
+
+  for(unsigned long repeat_i = 0; repeat_i < repeats; ++repeat_i)
+  {
+    // release previous context before fill
+    context = TreeLearnerImpl::Context_var();
+
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    context = TreeLearnerImpl::create_context(svm, bags);
+    add_time_(result, start);
+  }
+
+  result.peak_rss = peak_rss_();
+  results.push_back(result);
+
+  return context;
+}
+
+void
+Application_::bench_best_feature_(
+  BenchResultArray& results,
+  TreeLearnerImpl::Context* context,
+  unsigned long rows,
+  unsigned long threads,
+  unsigned long repeats,
+  unsigned long seed)
+{
+  // one step of depth 1 from empty tree: best feature search on root
+  BenchResult result;
+  result.name = "get_best_feature";
+  result.threads = threads;
+  result.rows = rows;
+
+  Gears::TaskRunner_var task_runner = create_task_runner_(threads);
+
+  for(unsigned long repeat_i = 0; repeat_i < repeats; ++repeat_i)
+  {
+    ThreadRand::set_seed(seed);
+
+    TreeLearnerImpl::LearnContext_var learner =
+      context->create_learner(0, task_runner);
+
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    learner->train<PredictedLogLossGain>(1, 1);
+    add_time_(result, start);
+  }
+
+  if(task_runner)
+  {
+    task_runner->deactivate_object();
+    task_runner->wait_object();
+  }
+
+  result.peak_rss = peak_rss_();
+  results.push_back(result);
+}
+
+DTree_var
+Application_::bench_train_steps_(
+  BenchResultArray& results,
+  TreeLearnerImpl::Context* context,
+  unsigned long rows,
+  unsigned long threads,
+  unsigned long steps,
+  unsigned long seed)
+{
+  // sequential steps of one learner: step time grows with tree
+  BenchResult result;
+  result.name = "train_step";
+  result.threads = threads;
+  result.rows = rows;
+
+  Gears::TaskRunner_var task_runner = create_task_runner_(threads);
+
+  ThreadRand::set_seed(seed);
+
+  TreeLearnerImpl::LearnContext_var learner =
+    context->create_learner(0, task_runner);
+
+  DTree_var tree;
+
+  for(unsigned long step_i = 0; step_i < steps; ++step_i)
+  {
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    tree = learner->train<PredictedLogLossGain>(1, 1);
+    add_time_(result, start);
+  }
+
+  if(task_runner)
+  {
+    task_runner->deactivate_object();
+    task_runner->wait_object();
+  }
+
+  result.peak_rss = peak_rss_();
+
+  if(result.repeats > 0)
+  {
+    results.push_back(result);
+  }
+
+  return tree;
+}
+
+template<typename PredictorType>
+double
+Application_::bench_fpredict_(
+  BenchResultArray& results,
+  const char* name,
+  const PredictorType* predictor,
+  const SVMImpl* svm,
+  unsigned long repeats)
+{
+  BenchResult result;
+  result.name = name;
+  result.rows = svm->size();
+
+  double pred_sum = 0;
+
+  for(unsigned long repeat_i = 0; repeat_i < repeats; ++repeat_i)
+  {
+    pred_sum = 0;
+
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    for(auto group_it = svm->grouped_rows.begin();
+      group_it != svm->grouped_rows.end(); ++group_it)
+    {
+      for(auto row_it = (*group_it)->rows.begin();
+        row_it != (*group_it)->rows.end(); ++row_it)
+      {
+        pred_sum += predictor->fpredict((*row_it)->features);
+      }
+    }
+
+    add_time_(result, start);
+
+    if(std::isnan(pred_sum))
+    {
+      Gears::ErrorStream ostr;
+      ostr << name << ": nan prediction";
+      throw Exception(ostr.str());
+    }
+  }
+
+  result.peak_rss = peak_rss_();
+  results.push_back(result);
+
+  return pred_sum;
+}
+
+double
+Application_::bench_block_predict_(
+  BenchResultArray& results,
+  const CompiledDTree* tree,
+  const SVMImpl* svm,
+  unsigned long repeats)
+{
+  BenchResult result;
+  result.name = "block_predict";
+  result.rows = svm->size();
+
+  double pred_sum = 0;
+
+  for(unsigned long repeat_i = 0; repeat_i < repeats; ++repeat_i)
+  {
+    pred_sum = 0;
+
+    const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+    SVMBlockPredictor<PredictedBoolLabel> block_predictor(tree, svm);
+
+    while(block_predictor.next())
+    {
+      for(unsigned long row_i = 0; row_i < block_predictor.size(); ++row_i)
+      {
+        pred_sum += block_predictor.pred(row_i);
+      }
+    }
+
+    add_time_(result, start);
+
+    if(std::isnan(pred_sum))
+    {
+      throw Exception("block_predict: nan prediction");
+    }
+  }
+
+  result.peak_rss = peak_rss_();
+  results.push_back(result);
+
+  return pred_sum;
+}
+
+void
+Application_::save_results_(
+  std::ostream& out,
+  const std::string& dataset,
+  const BenchResultArray& results)
+{
+  out.setf(std::ios::fixed, std::ios::floatfield);
+  out.precision(6);
+
+  out << "{" << std::endl <<
+    "  \"dataset\": " << dataset << "," << std::endl <<
+    "  \"benchmarks\": [";
+
+  for(auto it = results.begin(); it != results.end(); ++it)
+  {
+    out << (it != results.begin() ? "," : "") << std::endl <<
+      "    {\"name\": \"" << it->name << "\"" <<
+      ", \"threads\": " << it->threads <<
+      ", \"repeats\": " << it->repeats <<
+      ", \"rows\": " << it->rows <<
+      ", \"min_time\": " << it->min_time <<
+      ", \"avg_time\": " << (it->sum_time / it->repeats) <<
+      ", \"rows_per_second\": " <<
+        (it->min_time > 0 ? it->rows / it->min_time : 0.0) <<
+      ", \"peak_rss_kb\": " << it->peak_rss << "}";
+  }
+
+  out << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+// main
+int
+main(int argc, char** argv)
+{
+  Application_* app = 0;
+
+  try
+  {
+    app = &Application::instance();
+  }
+  catch (...)
+  {
+    std::cerr << "main(): Critical: Got exception while "
+      "creating application object.\n";
+    return -1;
+  }
+
+  assert(app);
+
+  try
+  {
+    app->main(argc, argv);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "Caught Gears::Exception: " << ex.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DTREEBENCH_APPLICATION_HPP_
+#define DTREEBENCH_APPLICATION_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/Singleton.hpp>
+#include <Gears/Threading/TaskRunner.hpp>
+
+#include <DTree/TreeLearner.hpp>
+#include <DTree/Label.hpp>
+#include <DTree/CompiledDTree.hpp>
+#include <DTree/SparseDTree.hpp>
+
+using namespace Vanga;
+
+class Application_
+{
+public:
+  Application_() throw();
+
+  virtual
+  ~Application_() throw();
+
+  void
+  main(int& argc, char** argv) /*throw(Gears::Exception)*/;
+
+protected:
+  DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+  typedef SVM<PredictedBoolLabel> SVMImpl;
+  typedef Gears::IntrusivePtr<SVMImpl> SVMImpl_var;
+  typedef TreeLearner<PredictedBoolLabel> TreeLearnerImpl;
+
+  // BenchResult
+  //   time of repeats (seconds), rows: rows processed by one repeat,
+  //   peak_rss: peak resident set size of process after bench (KB)
+  struct BenchResult
+  {
+    BenchResult()
+      : threads(1),
+        repeats(0),
+        min_time(0.0),
+        sum_time(0.0),
+        rows(0),
+        peak_rss(0)
+    {}
+
+    std::string name;
+    unsigned long threads;
+    unsigned long repeats;
+    double min_time;
+    double sum_time;
+    unsigned long rows;
+    long peak_rss;
+  };
+
+  typedef std::vector<BenchResult> BenchResultArray;
+
+protected:
+  // add time passed from start to result
+  static void
+  add_time_(
+    BenchResult& result,
+    const std::chrono::steady_clock::time_point& start);
+
+  static long
+  peak_rss_();
+
+  static Gears::TaskRunner_var
+  create_task_runner_(unsigned long threads);
+
+  SVMImpl_var
+  bench_svm_load_(
+    BenchResultArray& results,
+    const std::string& data,
+    unsigned long repeats);
+
+  TreeLearnerImpl::Context_var
+  bench_fill_feature_rows_(
+    BenchResultArray& results,
+    SVMImpl* svm,
+    const TreeLearnerImpl::BagViewArray& bags,
+    unsigned long repeats);
+
+  void
+  bench_best_feature_(
+    BenchResultArray& results,
+    TreeLearnerImpl::Context* context,
+    unsigned long rows,
+    unsigned long threads,
+    unsigned long repeats,
+    unsigned long seed);
+
+  DTree_var
+  bench_train_steps_(
+    BenchResultArray& results,
+    TreeLearnerImpl::Context* context,
+    unsigned long rows,
+    unsigned long threads,
+    unsigned long steps,
+    unsigned long seed);
+
+  // returns sum of predictions for check that predictors are equal
+  template<typename PredictorType>
+  double
+  bench_fpredict_(
+    BenchResultArray& results,
+    const char* name,
+    const PredictorType* predictor,
+    const SVMImpl* svm,
+    unsigned long repeats);
+
+  double
+  bench_block_predict_(
+    BenchResultArray& results,
+    const CompiledDTree* tree,
+    const SVMImpl* svm,
+    unsigned long repeats);
+
+  // dataset: json object with dataset description
+  void
+  save_results_(
+    std::ostream& out,
+    const std::string& dataset,
+    const BenchResultArray& results);
+};
+
+typedef Gears::Singleton<Application_> Application;
+
+#endif /*DTREEBENCH_APPLICATION_HPP_*/
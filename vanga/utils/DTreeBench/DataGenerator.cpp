@@ -0,0 +1,116 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <algorithm>
+
+#include "DataGenerator.hpp"
+
+DataGenerator::DataGenerator(const DataGeneratorParams& params)
+  : params_(params),
+    rand_(params.seed)
+{
+  cumulative_.resize(params_.features);
+  weights_.resize(params_.features);
+
+  double sum = 0;
+  for(unsigned long feature_i = 0; feature_i < params_.features; ++feature_i)
+  {
+    sum += 1.0 / std::pow(feature_i + 1, params_.zipf);
+    cumulative_[feature_i] = sum;
+  }
+
+  for(auto it = cumulative_.begin(); it != cumulative_.end(); ++it)
+  {
+    *it /= sum;
+  }
+
+  // hidden model weights in [-1, 1]
+  for(auto it = weights_.begin(); it != weights_.end(); ++it)
+  {
+    *it = uniform_() * 2 - 1;
+  }
+}
+
+double
+DataGenerator::uniform_() throw()
+{
+  // 53 random bits
+  return static_cast<double>(rand_.next() >> 11) / (1ull << 53);
+}
+
+unsigned long
+DataGenerator::feature_() throw()
+{
+  const unsigned long feature_i = std::lower_bound(
+    cumulative_.begin(),
+    cumulative_.end(),
+    uniform_()) - cumulative_.begin();
+
+  return std::min(feature_i, params_.features - 1);
+}
+
+void
+DataGenerator::generate(std::ostream& out)
+{
+  std::vector<unsigned long> row_features;
+
+  for(unsigned long row_i = 0; row_i < params_.rows; ++row_i)
+  {
+    // row features number in [1, 2 * row_features - 1]
+    const unsigned long features_number = params_.features > 0 ?
+      1 + rand_(std::max(2 * params_.row_features, 2ul) - 1) :
+      0;
+
+    row_features.clear();
+    for(unsigned long feature_i = 0; feature_i < features_number; ++feature_i)
+    {
+      row_features.push_back(feature_());
+    }
+
+    std::sort(row_features.begin(), row_features.end());
+    row_features.erase(
+      std::unique(row_features.begin(), row_features.end()),
+      row_features.end());
+
+    double margin = 0;
+    for(auto it = row_features.begin(); it != row_features.end(); ++it)
+    {
+      margin += weights_[*it];
+    }
+
+    bool label = uniform_() < 1.0 / (1.0 + std::exp(-margin));
+
+    if(uniform_() < params_.noise)
+    {
+      label = !label;
+    }
+
+    out << (label ? 1 : 0);
+
+    for(auto it = row_features.begin(); it != row_features.end(); ++it)
+    {
+      out << ' ' << (*it + 1) << ":1";
+    }
+
+    out << '\n';
+  }
+}
@@ -0,0 +1,81 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DTREEBENCH_DATAGENERATOR_HPP_
+#define DTREEBENCH_DATAGENERATOR_HPP_
+
+#include <vector>
+#include <iostream>
+
+#include <DTree/Rand.hpp>
+
+// DataGeneratorParams
+//   rows: number of generated rows,
+//   features: number of feature ids (ids in [1, features]),
+//   row_features: average number of features in row,
+//   zipf: feature with rank k selected with probability ~ 1 / k^zipf,
+//   noise: probability of label flip
+struct DataGeneratorParams
+{
+  DataGeneratorParams()
+    : rows(100000),
+      features(10000),
+      row_features(20),
+      zipf(1.0),
+      noise(0.05),
+      seed(0)
+  {}
+
+  unsigned long rows;
+  unsigned long features;
+  unsigned long row_features;
+  double zipf;
+  double noise;
+  unsigned long seed;
+};
+
+// DataGenerator: sparse binary rows in svm format,
+// labels defined by hidden linear model over row features,
+// same params and seed give same data
+class DataGenerator
+{
+public:
+  DataGenerator(const DataGeneratorParams& params);
+
+  void
+  generate(std::ostream& out);
+
+protected:
+  double
+  uniform_() throw();
+
+  unsigned long
+  feature_() throw();
+
+protected:
+  const DataGeneratorParams params_;
+  Vanga::Rand rand_;
+  // cumulative_[k]: probability of features with rank <= k
+  std::vector<double> cumulative_;
+  std::vector<double> weights_;
+};
+
+#endif /*DTREEBENCH_DATAGENERATOR_HPP_*/
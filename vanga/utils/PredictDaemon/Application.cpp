@@ -0,0 +1,190 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <signal.h>
+#include <string.h>
+#include <iostream>
+
+#include <Gears/Basic/AppUtils.hpp>
+
+#include "PredictServer.hpp"
+#include "Application.hpp"
+
+using namespace Vanga;
+
+namespace
+{
+  const char USAGE[] =
+    "\nUsage: \n"
+    "vanga-predictd [options] <model file> [<model file> ...]\n"
+    "  serve predictions of models (text or binary, model index in request\n"
+    "  is model position in command line) until SIGINT or SIGTERM,\n"
+    "  SIGHUP reloads all model files without stopping of prediction\n"
+    "  (new model files should replace old by rename)\n"
+    "Options:\n"
+    "  --listen=unix:<path>|[<host>:]<port>: address (unix:/tmp/vanga-predictd.sock)\n"
+    "  --threads=<number>: prediction threads (4)\n"
+    "  --batch-rows=<number>: max rows of requests predicted together (1024)\n"
+    "  --max-pending=<number>: requests without response, after that\n"
+    "    connection isn't read (1024)\n"
+    "  --stats-period=<seconds>: print stats to stderr with this period (disabled)\n";
+
+  volatile sig_atomic_t stop_requested = 0;
+  volatile sig_atomic_t reload_requested = 0;
+
+  void
+  stop_handler(int)
+  {
+    stop_requested = 1;
+  }
+
+  void
+  reload_handler(int)
+  {
+    reload_requested = 1;
+  }
+}
+
+// Application
+Application_::Application_()
+  throw()
+{}
+
+Application_::~Application_() throw()
+{}
+
+void
+Application_::main(int& argc, char** argv)
+  /*throw(Gears::Exception)*/
+{
+  Gears::AppUtils::CheckOption opt_help;
+  Gears::AppUtils::StringOption opt_listen("unix:/tmp/vanga-predictd.sock");
+  Gears::AppUtils::Option<unsigned long> opt_threads(4);
+  Gears::AppUtils::Option<unsigned long> opt_batch_rows(1024);
+  Gears::AppUtils::Option<unsigned long> opt_max_pending(1024);
+  Gears::AppUtils::Option<unsigned long> opt_stats_period(0);
+
+  Gears::AppUtils::Args args(-1);
+
+  args.add(
+    Gears::AppUtils::equal_name("help") ||
+    Gears::AppUtils::short_name("h"),
+    opt_help);
+  args.add(
+    Gears::AppUtils::equal_name("listen") ||
+    Gears::AppUtils::short_name("l"),
+    opt_listen);
+  args.add(
+    Gears::AppUtils::equal_name("threads") ||
+    Gears::AppUtils::short_name("t"),
+    opt_threads);
+  args.add(
+    Gears::AppUtils::equal_name("batch-rows"),
+    opt_batch_rows);
+  args.add(
+    Gears::AppUtils::equal_name("max-pending"),
+    opt_max_pending);
+  args.add(
+    Gears::AppUtils::equal_name("stats-period"),
+    opt_stats_period);
+
+  args.parse(argc - 1, argv + 1);
+
+  const Gears::AppUtils::Args::CommandList& commands = args.commands();
+
+  if(commands.empty() || opt_help.enabled() ||
+     *commands.begin() == "help")
+  {
+    std::cout << USAGE << std::endl;
+    return;
+  }
+
+  PredictServer::Params params;
+  params.address = *opt_listen;
+  params.threads = *opt_threads;
+  params.batch_rows = *opt_batch_rows;
+  params.max_pending = *opt_max_pending;
+  params.stats_period = *opt_stats_period;
+
+  ModelRegistry_var registry = new ModelRegistry(
+    commands.size(), params.threads);
+  unsigned long model_i = 0;
+
+  for(auto command_it = commands.begin(); command_it != commands.end();
+    ++command_it, ++model_i)
+  {
+    registry->load(model_i, *command_it);
+    std::cerr << "model #" << model_i << ": " << *command_it << std::endl;
+  }
+
+  PredictServer server(registry, params);
+
+  struct sigaction stop_action;
+  ::memset(&stop_action, 0, sizeof(stop_action));
+  stop_action.sa_handler = stop_handler;
+  ::sigaction(SIGINT, &stop_action, 0);
+  ::sigaction(SIGTERM, &stop_action, 0);
+
+  struct sigaction reload_action;
+  ::memset(&reload_action, 0, sizeof(reload_action));
+  reload_action.sa_handler = reload_handler;
+  ::sigaction(SIGHUP, &reload_action, 0);
+  ::signal(SIGPIPE, SIG_IGN);
+
+  std::cerr << "listen " << params.address << std::endl;
+
+  server.run(stop_requested, reload_requested);
+
+  std::cerr << server.stats().report();
+}
+
+// main
+int
+main(int argc, char** argv)
+{
+  Application_* app = 0;
+
+  try
+  {
+    app = &Application::instance();
+  }
+  catch (...)
+  {
+    std::cerr << "main(): Critical: Got exception while "
+      "creating application object.\n";
+    return -1;
+  }
+
+  assert(app);
+
+  try
+  {
+    app->main(argc, argv);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "Caught Gears::Exception: " << ex.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
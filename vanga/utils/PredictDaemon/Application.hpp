@@ -0,0 +1,46 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef PREDICTDAEMON_APPLICATION_HPP_
+#define PREDICTDAEMON_APPLICATION_HPP_
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/Singleton.hpp>
+
+class Application_
+{
+public:
+  Application_() throw();
+
+  virtual
+  ~Application_() throw();
+
+  void
+  main(int& argc, char** argv) /*throw(Gears::Exception)*/;
+
+protected:
+  DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+};
+
+typedef Gears::Singleton<Application_> Application;
+
+#endif /*PREDICTDAEMON_APPLICATION_HPP_*/
@@ -0,0 +1,777 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <iostream>
+
+#include <Gears/Basic/Errno.hpp>
+
+#include <DTree/PredBuffer.hpp>
+
+#include "PredictServer.hpp"
+
+using namespace Vanga;
+
+namespace
+{
+  const int POLL_TIMEOUT_MS = 200;
+  const unsigned long READ_SIZE = 64 * 1024;
+}
+
+// PredictServer::Connection
+// responses are queued by workers (push) and written by poll loop (flush),
+// socket is non blocking: client that don't read responses can't block workers
+class PredictServer::Connection: public Gears::AtomicRefCountable
+{
+public:
+  Connection(int fd, int wake_fd) throw()
+    : read_closed(false),
+      fd_(fd),
+      wake_fd_(wake_fd),
+      pending_(0),
+      out_pos_(0),
+      closed_(false)
+  {}
+
+  int
+  fd() const throw()
+  {
+    return fd_;
+  }
+
+  // called by poll loop for each request, that will get response
+  void
+  add_pending() throw()
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+    ++pending_;
+  }
+
+  // requests without completely written response
+  unsigned long
+  pending() const throw()
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+    return pending_;
+  }
+
+  bool
+  has_output() const throw()
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+    return !out_queue_.empty();
+  }
+
+  // queue response, wake poll loop if queue was empty
+  void
+  push(
+    const PredictProtocol::ResponseHead& head,
+    const void* body)
+    throw()
+  {
+    std::string buf(reinterpret_cast<const char*>(&head), sizeof(head));
+    buf.append(static_cast<const char*>(body), head.size);
+
+    bool wake;
+
+    {
+      Gears::Mutex::WriteGuard guard(lock_);
+
+      if(closed_)
+      {
+        return;
+      }
+
+      wake = out_queue_.empty();
+      out_queue_.push_back(std::string());
+      out_queue_.back().swap(buf);
+    }
+
+    if(wake)
+    {
+      // pipe overflow means that poll loop already woken
+      const char wake_byte = 0;
+      const ssize_t res = ::write(wake_fd_, &wake_byte, 1);
+      (void)res;
+    }
+  }
+
+  // write queued responses while socket accepts data,
+  // returns false on write error
+  bool
+  flush() throw()
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+
+    while(!out_queue_.empty())
+    {
+      const std::string& buf = out_queue_.front();
+      const ssize_t write_size = ::send(
+        fd_, buf.data() + out_pos_, buf.size() - out_pos_, MSG_NOSIGNAL);
+
+      if(write_size < 0)
+      {
+        if(errno == EINTR)
+        {
+          continue;
+        }
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+
+      out_pos_ += write_size;
+
+      if(out_pos_ == buf.size())
+      {
+        out_queue_.pop_front();
+        out_pos_ = 0;
+        --pending_;
+      }
+    }
+
+    return true;
+  }
+
+  // drop queued and following responses
+  void
+  close() throw()
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+    closed_ = true;
+    out_queue_.clear();
+  }
+
+public:
+  // accessed only by poll loop
+  std::string read_buf;
+  // eof got or request stream broken: connection isn't read,
+  // complete requests of read_buf are processed, responses flushed
+  bool read_closed;
+
+protected:
+  virtual
+  ~Connection() throw()
+  {
+    ::close(fd_);
+  }
+
+protected:
+  const int fd_;
+  const int wake_fd_;
+
+  mutable Gears::Mutex lock_;
+  unsigned long pending_;
+  std::deque<std::string> out_queue_;
+  unsigned long out_pos_; // written part of first queued response
+  bool closed_;
+};
+
+// PredictServer::Request
+class PredictServer::Request: public Gears::AtomicRefCountable
+{
+public:
+  Connection_var connection;
+  PredictProtocol::RequestHead head;
+  std::string body;
+  Clock::time_point receive_time;
+
+protected:
+  virtual
+  ~Request() throw()
+  {}
+};
+
+// PredictServer::WorkerJob
+class PredictServer::WorkerJob: public Gears::ThreadJob
+{
+public:
+  WorkerJob(PredictServer& server) throw()
+    : server_(server)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    server_.work_();
+  }
+
+protected:
+  virtual
+  ~WorkerJob() throw()
+  {}
+
+protected:
+  PredictServer& server_;
+};
+
+// PredictServer::ReloadJob
+class PredictServer::ReloadJob: public Gears::ThreadJob
+{
+public:
+  ReloadJob(PredictServer& server) throw()
+    : server_(server)
+  {}
+
+  virtual void
+  work() throw()
+  {
+    server_.reload_();
+  }
+
+protected:
+  virtual
+  ~ReloadJob() throw()
+  {}
+
+protected:
+  PredictServer& server_;
+};
+
+// PredictServer
+PredictServer::PredictServer(ModelRegistry* registry, const Params& params)
+  : params_(params),
+    registry_(Gears::add_ref(registry)),
+    next_reader_(0),
+    stopped_(false),
+    reload_pending_(false),
+    reload_stopped_(false)
+{
+  if(params_.threads == 0 || params_.batch_rows == 0 || params_.max_pending == 0)
+  {
+    throw Exception(
+      "PredictServer: threads, batch rows and max pending should be positive");
+  }
+
+  if(params_.threads > registry_->max_readers())
+  {
+    throw Exception("PredictServer: registry readers number less than threads");
+  }
+}
+
+PredictServer::~PredictServer() throw()
+{}
+
+ServerStats&
+PredictServer::stats() throw()
+{
+  return stats_;
+}
+
+void
+PredictServer::run(
+  const volatile sig_atomic_t& stop_requested,
+  volatile sig_atomic_t& reload_requested)
+{
+  const int listen_fd = PredictProtocol::listen(params_.address);
+
+  // workers write to pipe when connection get responses for write
+  int wake_fds[2];
+  if(::pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC) < 0)
+  {
+    ::close(listen_fd);
+    Gears::throw_errno_exception<Exception>(
+      "PredictServer::run(): can't create pipe");
+  }
+
+  Gears::ThreadRunner workers(
+    Gears::ThreadJob_var(new WorkerJob(*this)),
+    params_.threads);
+  workers.start();
+
+  Gears::ThreadRunner reloader(
+    Gears::ThreadJob_var(new ReloadJob(*this)),
+    1);
+  reloader.start();
+
+  ConnectionArray connections;
+  std::vector<pollfd> poll_fds;
+  Clock::time_point stats_time = Clock::now();
+  int poll_error = 0;
+
+  while(!stop_requested)
+  {
+    if(reload_requested)
+    {
+      reload_requested = 0;
+
+      Gears::ConditionGuard guard(reload_lock_, reload_cond_);
+      reload_pending_ = true;
+      reload_cond_.signal();
+    }
+
+    poll_fds.resize(connections.size() + 2);
+    poll_fds[0].fd = listen_fd;
+    poll_fds[0].events = POLLIN;
+    poll_fds[0].revents = 0;
+    poll_fds[1].fd = wake_fds[0];
+    poll_fds[1].events = POLLIN;
+    poll_fds[1].revents = 0;
+
+    for(unsigned long connection_i = 0; connection_i < connections.size();
+      ++connection_i)
+    {
+      const Connection* connection = connections[connection_i];
+      pollfd& poll_fd = poll_fds[connection_i + 2];
+      poll_fd.fd = connection->fd();
+      // connection with too many pending responses isn't read
+      // until client read them
+      poll_fd.events =
+        (!connection->read_closed &&
+          connection->pending() < params_.max_pending ? POLLIN : 0) |
+        (connection->has_output() ? POLLOUT : 0);
+      poll_fd.revents = 0;
+    }
+
+    const int res = ::poll(poll_fds.data(), poll_fds.size(), POLL_TIMEOUT_MS);
+
+    if(res < 0 && errno != EINTR)
+    {
+      poll_error = errno;
+      break;
+    }
+
+    if(res > 0 && (poll_fds[1].revents & POLLIN))
+    {
+      char buf[256];
+      while(::read(wake_fds[0], buf, sizeof(buf)) > 0)
+      {}
+    }
+
+    // connections are checked without events too: pushed responses and
+    // read requests, that was delayed by pending limit, are processed
+    unsigned long kept_i = 0;
+
+    for(unsigned long connection_i = 0; connection_i < connections.size();
+      ++connection_i)
+    {
+      Connection* connection = connections[connection_i];
+      const short revents = res > 0 ? poll_fds[connection_i + 2].revents : 0;
+      bool keep = true;
+
+      if(!connection->read_closed && (revents & (POLLIN | POLLHUP | POLLERR)) &&
+        !read_(connection))
+      {
+        connection->read_closed = true;
+      }
+
+      if(connection->has_output() && !connection->flush())
+      {
+        keep = false;
+      }
+
+      // requests read before client shutdown (half close) are answered:
+      // pending requests number is positive while read_buf contains
+      // complete requests (they are processed here if limit isn't reached)
+      if(keep)
+      {
+        process_requests_(connection);
+      }
+
+      if(keep && connection->read_closed && connection->pending() == 0)
+      {
+        keep = false;
+      }
+
+      if(keep)
+      {
+        connections[kept_i++] = connections[connection_i];
+      }
+      else
+      {
+        connection->close();
+      }
+    }
+
+    connections.resize(kept_i);
+
+    if(res > 0 && (poll_fds[0].revents & POLLIN))
+    {
+      const int fd = ::accept4(listen_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+      if(fd >= 0)
+      {
+        // fails for unix socket
+        const int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        connections.push_back(Connection_var(new Connection(fd, wake_fds[1])));
+      }
+    }
+
+    if(params_.stats_period > 0)
+    {
+      const Clock::time_point now = Clock::now();
+
+      if(now - stats_time >= std::chrono::seconds(params_.stats_period))
+      {
+        std::cerr << stats_.report() << std::endl;
+        stats_time = now;
+      }
+    }
+  }
+
+  // workers process queued requests before exit
+  {
+    Gears::ConditionGuard guard(lock_, cond_);
+    stopped_ = true;
+    cond_.broadcast();
+  }
+
+  workers.wait_for_completion();
+
+  {
+    Gears::ConditionGuard guard(reload_lock_, reload_cond_);
+    reload_stopped_ = true;
+    reload_cond_.signal();
+  }
+
+  reloader.wait_for_completion();
+
+  for(auto connection_it = connections.begin();
+    connection_it != connections.end(); ++connection_it)
+  {
+    (*connection_it)->close();
+  }
+
+  connections.clear();
+  ::close(wake_fds[0]);
+  ::close(wake_fds[1]);
+  ::close(listen_fd);
+
+  if(poll_error)
+  {
+    Gears::throw_errno_value_exception<Exception>(
+      poll_error, "PredictServer::run(): poll failed");
+  }
+}
+
+bool
+PredictServer::read_(Connection* connection)
+{
+  char buf[READ_SIZE];
+  const ssize_t read_size = ::read(connection->fd(), buf, sizeof(buf));
+
+  if(read_size <= 0)
+  {
+    // eof or error
+    return read_size < 0 &&
+      (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+
+  connection->read_buf.append(buf, read_size);
+
+  return true;
+}
+
+void
+PredictServer::process_requests_(Connection* connection)
+{
+  std::string& read_buf = connection->read_buf;
+  const unsigned long head_size = sizeof(PredictProtocol::RequestHead);
+  unsigned long pos = 0;
+
+  while(read_buf.size() - pos >= head_size &&
+    connection->pending() < params_.max_pending)
+  {
+    Request_var request = new Request();
+    request->connection = Gears::add_ref(connection);
+    ::memcpy(&request->head, read_buf.data() + pos, head_size);
+    request->receive_time = Clock::now();
+
+    if(request->head.size > PredictProtocol::MAX_BODY_SIZE)
+    {
+      // body can't be skipped: send error, drop following data
+      // and close connection after response
+      connection->add_pending();
+      send_error_(request, "request body is too large");
+      connection->read_closed = true;
+      pos = read_buf.size();
+      break;
+    }
+
+    if(read_buf.size() - pos - head_size < request->head.size)
+    {
+      break;
+    }
+
+    request->body.assign(read_buf, pos + head_size, request->head.size);
+    pos += head_size + request->head.size;
+
+    connection->add_pending();
+    process_request_(request);
+  }
+
+  read_buf.erase(0, pos);
+}
+
+void
+PredictServer::process_request_(Request* request)
+{
+  const PredictProtocol::RequestHead& head = request->head;
+
+  if(head.type == PredictProtocol::RT_STATS)
+  {
+    const std::string report = stats_.report();
+
+    PredictProtocol::ResponseHead response_head;
+    response_head.status = PredictProtocol::S_OK;
+    response_head.id = head.id;
+    response_head.rows = 0;
+    response_head.size = report.size();
+    request->connection->push(response_head, report.data());
+    return;
+  }
+
+  if(head.type != PredictProtocol::RT_SVM &&
+    head.type != PredictProtocol::RT_BINARY)
+  {
+    send_error_(request, "unknown request type");
+    return;
+  }
+
+  if(head.model >= registry_->model_count())
+  {
+    send_error_(request, "unknown model");
+    return;
+  }
+
+  Gears::ConditionGuard guard(lock_, cond_);
+  requests_.push_back(Gears::add_ref(request));
+  cond_.signal();
+}
+
+void
+PredictServer::work_() throw()
+{
+  const unsigned long reader_i = next_reader_++;
+  RequestArray batch;
+
+  while(get_batch_(batch))
+  {
+    predict_batch_(batch, reader_i);
+    batch.clear();
+
+    // release prediction buffers that batch didn't use
+    BufferPools::trim_thread_pools();
+  }
+}
+
+bool
+PredictServer::get_batch_(RequestArray& batch) throw()
+{
+  Gears::ConditionGuard guard(lock_, cond_);
+
+  while(requests_.empty() && !stopped_)
+  {
+    guard.wait();
+  }
+
+  if(requests_.empty())
+  {
+    return false;
+  }
+
+  // first request is taken even if it contains more than batch_rows rows
+  const uint32_t model = requests_.front()->head.model;
+  unsigned long rows = 0;
+
+  for(auto request_it = requests_.begin();
+    request_it != requests_.end() && rows < params_.batch_rows; )
+  {
+    const PredictProtocol::RequestHead& head = (*request_it)->head;
+
+    if(head.model == model &&
+      (batch.empty() || rows + head.rows <= params_.batch_rows))
+    {
+      rows += head.rows;
+      batch.push_back(*request_it);
+      request_it = requests_.erase(request_it);
+    }
+    else
+    {
+      ++request_it;
+    }
+  }
+
+  return true;
+}
+
+void
+PredictServer::predict_batch_(
+  const RequestArray& batch,
+  unsigned long reader_i)
+  throw()
+{
+  std::vector<std::vector<FeatureArray> > request_rows(batch.size());
+  std::vector<const FeatureArray*> features;
+  std::vector<double> preds;
+  RequestArray predicted;
+  RequestArray failed;
+  std::vector<std::string> fail_errors;
+
+  {
+    // read section covers only rows decoding (it depends on model
+    // numeric features) and prediction: responses are queued after
+    // guard release, model replacement don't wait for any io
+    ModelRegistry::ReadGuard read_guard(*registry_, reader_i);
+    const ModelRegistry::Model* model = read_guard.model(
+      batch.front()->head.model);
+
+    for(unsigned long request_i = 0; request_i < batch.size(); ++request_i)
+    {
+      Request* request = batch[request_i];
+
+      if(!model)
+      {
+        failed.push_back(batch[request_i]);
+        fail_errors.push_back("model isn't loaded");
+        continue;
+      }
+
+      try
+      {
+        PredictProtocol::read_rows(
+          request_rows[request_i],
+          request->head.type,
+          request->body,
+          request->head.rows,
+          model->numeric_features);
+      }
+      catch(const Gears::Exception& ex)
+      {
+        failed.push_back(batch[request_i]);
+        fail_errors.push_back(ex.what());
+        continue;
+      }
+
+      for(auto row_it = request_rows[request_i].begin();
+        row_it != request_rows[request_i].end(); ++row_it)
+      {
+        features.push_back(&*row_it);
+      }
+
+      predicted.push_back(batch[request_i]);
+    }
+
+    if(!features.empty())
+    {
+      preds.resize(features.size());
+      model->model->predict(preds.data(), features.data(), features.size());
+    }
+  }
+
+  for(unsigned long failed_i = 0; failed_i < failed.size(); ++failed_i)
+  {
+    send_error_(failed[failed_i], fail_errors[failed_i]);
+  }
+
+  if(predicted.empty())
+  {
+    return;
+  }
+
+  stats_.add_batch(predicted.size(), features.size());
+
+  unsigned long row_i = 0;
+
+  for(auto request_it = predicted.begin(); request_it != predicted.end(); ++request_it)
+  {
+    Request* request = *request_it;
+
+    PredictProtocol::ResponseHead response_head;
+    response_head.status = PredictProtocol::S_OK;
+    response_head.id = request->head.id;
+    response_head.rows = request->head.rows;
+    response_head.size = sizeof(double) * request->head.rows;
+    request->connection->push(response_head, preds.data() + row_i);
+    row_i += request->head.rows;
+
+    stats_.add_request(
+      request->head.rows,
+      std::chrono::duration<double>(Clock::now() - request->receive_time).count(),
+      false);
+  }
+}
+
+void
+PredictServer::reload_() throw()
+{
+  while(true)
+  {
+    {
+      Gears::ConditionGuard guard(reload_lock_, reload_cond_);
+
+      while(!reload_pending_ && !reload_stopped_)
+      {
+        guard.wait();
+      }
+
+      if(reload_stopped_)
+      {
+        return;
+      }
+
+      reload_pending_ = false;
+    }
+
+    // model that can't be loaded keeps previous version
+    for(unsigned long model_i = 0; model_i < registry_->model_count(); ++model_i)
+    {
+      try
+      {
+        registry_->reload(model_i);
+        stats_.add_reload(false);
+        std::cerr << "model #" << model_i << " reloaded" << std::endl;
+      }
+      catch(const Gears::Exception& ex)
+      {
+        stats_.add_reload(true);
+        std::cerr << "model #" << model_i << " reload failed: " <<
+          ex.what() << std::endl;
+      }
+    }
+  }
+}
+
+void
+PredictServer::send_error_(Request* request, const std::string& error) throw()
+{
+  PredictProtocol::ResponseHead response_head;
+  response_head.status = PredictProtocol::S_ERROR;
+  response_head.id = request->head.id;
+  response_head.rows = 0;
+  response_head.size = error.size();
+  request->connection->push(response_head, error.data());
+
+  stats_.add_request(
+    0,
+    std::chrono::duration<double>(Clock::now() - request->receive_time).count(),
+    true);
+}
@@ -0,0 +1,152 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef PREDICTDAEMON_PREDICTSERVER_HPP_
+#define PREDICTDAEMON_PREDICTSERVER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include <signal.h>
+
+#include <Gears/Basic/Exception.hpp>
+#include <Gears/Basic/AtomicRefCountable.hpp>
+#include <Gears/Basic/IntrusivePtr.hpp>
+#include <Gears/Basic/Lock.hpp>
+#include <Gears/Threading/Condition.hpp>
+#include <Gears/Threading/ThreadRunner.hpp>
+
+#include <DTree/ModelRegistry.hpp>
+#include <DTree/PredictProtocol.hpp>
+
+#include "ServerStats.hpp"
+
+// PredictServer: serves PredictProtocol requests.
+// Connections are read and written by poll loop of run() (calling thread),
+// prediction requests are queued and processed by worker threads:
+// worker takes all queued requests to the same model (up to batch_rows rows)
+// and predicts them as one block (BinaryModel::predict),
+// responses are queued to connection and written by poll loop.
+// Stats requests are answered by poll loop.
+// Models are taken from registry by worker index (registry reader),
+// reload thread replaces models without blocking of workers
+class PredictServer
+{
+public:
+  DECLARE_GEARS_EXCEPTION(Exception, Gears::DescriptiveException);
+
+  struct Params
+  {
+    Params()
+      : threads(4),
+        batch_rows(1024),
+        max_pending(1024),
+        stats_period(0)
+    {}
+
+    std::string address;
+    unsigned long threads;
+    unsigned long batch_rows;
+    // connection isn't read while it has more requests without response
+    unsigned long max_pending;
+    unsigned long stats_period; // seconds, print stats to stderr if non zero
+  };
+
+public:
+  // registry should have reader slot for each thread
+  PredictServer(Vanga::ModelRegistry* registry, const Params& params);
+
+  ~PredictServer() throw();
+
+  // serve until stop_requested set,
+  // reload all models (in background) when reload_requested set
+  void
+  run(
+    const volatile sig_atomic_t& stop_requested,
+    volatile sig_atomic_t& reload_requested);
+
+  ServerStats&
+  stats() throw();
+
+protected:
+  typedef std::chrono::steady_clock Clock;
+
+  class Connection;
+  typedef Gears::IntrusivePtr<Connection> Connection_var;
+  typedef std::vector<Connection_var> ConnectionArray;
+
+  class Request;
+  typedef Gears::IntrusivePtr<Request> Request_var;
+  typedef std::vector<Request_var> RequestArray;
+
+  class WorkerJob;
+  class ReloadJob;
+
+protected:
+  // read available data of connection, returns false on eof or error
+  bool
+  read_(Connection* connection);
+
+  // process complete requests of read buffer
+  // while connection pending requests number is under limit
+  void
+  process_requests_(Connection* connection);
+
+  void
+  process_request_(Request* request);
+
+  void
+  work_() throw();
+
+  // take requests for next batch, returns false if server stopped
+  bool
+  get_batch_(RequestArray& batch) throw();
+
+  void
+  predict_batch_(const RequestArray& batch, unsigned long reader_i) throw();
+
+  void
+  reload_() throw();
+
+  void
+  send_error_(Request* request, const std::string& error) throw();
+
+protected:
+  const Params params_;
+  Vanga::ModelRegistry_var registry_;
+  ServerStats stats_;
+  std::atomic<unsigned long> next_reader_;
+
+  Gears::Mutex lock_;
+  Gears::Condition cond_;
+  std::deque<Request_var> requests_;
+  bool stopped_;
+
+  Gears::Mutex reload_lock_;
+  Gears::Condition reload_cond_;
+  bool reload_pending_;
+  bool reload_stopped_;
+};
+
+#endif /*PREDICTDAEMON_PREDICTSERVER_HPP_*/
@@ -0,0 +1,142 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <algorithm>
+#include <sstream>
+
+#include "ServerStats.hpp"
+
+ServerStats::ServerStats(unsigned long latency_window)
+  : start_time_(Clock::now()),
+    report_time_(start_time_),
+    requests_(0),
+    rows_(0),
+    errors_(0),
+    batches_(0),
+    batch_requests_(0),
+    batch_rows_(0),
+    reloads_(0),
+    reload_errors_(0),
+    report_requests_(0),
+    report_rows_(0),
+    latency_pos_(0)
+{
+  latencies_.reserve(latency_window);
+}
+
+void
+ServerStats::add_request(unsigned long rows, double latency, bool error) throw()
+{
+  const unsigned long latency_us = static_cast<unsigned long>(latency * 1000000);
+
+  Gears::Mutex::WriteGuard guard(lock_);
+
+  ++requests_;
+  rows_ += rows;
+  errors_ += error ? 1 : 0;
+
+  if(latencies_.size() < latencies_.capacity())
+  {
+    latencies_.push_back(latency_us);
+  }
+  else
+  {
+    latencies_[latency_pos_] = latency_us;
+    latency_pos_ = (latency_pos_ + 1) % latencies_.size();
+  }
+}
+
+void
+ServerStats::add_batch(unsigned long requests, unsigned long rows) throw()
+{
+  Gears::Mutex::WriteGuard guard(lock_);
+
+  ++batches_;
+  batch_requests_ += requests;
+  batch_rows_ += rows;
+}
+
+void
+ServerStats::add_reload(bool error) throw()
+{
+  Gears::Mutex::WriteGuard guard(lock_);
+
+  ++reloads_;
+  reload_errors_ += error ? 1 : 0;
+}
+
+std::string
+ServerStats::report()
+{
+  std::vector<unsigned long> latencies;
+  std::ostringstream ostr;
+
+  {
+    Gears::Mutex::WriteGuard guard(lock_);
+
+    const Clock::time_point now = Clock::now();
+    const double uptime = std::chrono::duration<double>(now - start_time_).count();
+    const double interval = std::chrono::duration<double>(now - report_time_).count();
+
+    ostr << "uptime " << uptime << std::endl <<
+      "requests " << requests_ << std::endl <<
+      "rows " << rows_ << std::endl <<
+      "errors " << errors_ << std::endl <<
+      "batches " << batches_ << std::endl <<
+      "avg_batch_requests " <<
+        (batches_ ? static_cast<double>(batch_requests_) / batches_ : 0.0) << std::endl <<
+      "avg_batch_rows " <<
+        (batches_ ? static_cast<double>(batch_rows_) / batches_ : 0.0) << std::endl <<
+      "reloads " << reloads_ << std::endl <<
+      "reload_errors " << reload_errors_ << std::endl <<
+      "qps " << (interval > 0 ? (requests_ - report_requests_) / interval : 0.0) <<
+        std::endl <<
+      "rows_per_second " << (interval > 0 ? (rows_ - report_rows_) / interval : 0.0) <<
+        std::endl;
+
+    report_time_ = now;
+    report_requests_ = requests_;
+    report_rows_ = rows_;
+    latencies = latencies_;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  ostr << "latency_p50_us " << percentile_(latencies, 0.5) << std::endl <<
+    "latency_p99_us " << percentile_(latencies, 0.99) << std::endl <<
+    "latency_max_us " << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+
+  return ostr.str();
+}
+
+unsigned long
+ServerStats::percentile_(const std::vector<unsigned long>& values, double quantile) throw()
+{
+  if(values.empty())
+  {
+    return 0;
+  }
+
+  return values[std::min(
+    static_cast<unsigned long>(quantile * values.size()),
+    static_cast<unsigned long>(values.size() - 1))];
+}
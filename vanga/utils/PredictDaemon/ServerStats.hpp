@@ -0,0 +1,80 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef PREDICTDAEMON_SERVERSTATS_HPP_
+#define PREDICTDAEMON_SERVERSTATS_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <Gears/Basic/Lock.hpp>
+
+// ServerStats: request counters and latencies of last requests,
+// report contains "name value" lines: totals, rates for interval from
+// previous report (qps, rows_per_second) and latency percentiles (microseconds)
+class ServerStats
+{
+public:
+  ServerStats(unsigned long latency_window = 65536);
+
+  void
+  add_request(unsigned long rows, double latency, bool error) throw();
+
+  void
+  add_batch(unsigned long requests, unsigned long rows) throw();
+
+  void
+  add_reload(bool error) throw();
+
+  std::string
+  report();
+
+protected:
+  typedef std::chrono::steady_clock Clock;
+
+  // value of sorted array at quantile
+  static unsigned long
+  percentile_(const std::vector<unsigned long>& values, double quantile) throw();
+
+protected:
+  Gears::Mutex lock_;
+  const Clock::time_point start_time_;
+  Clock::time_point report_time_;
+
+  unsigned long requests_;
+  unsigned long rows_;
+  unsigned long errors_;
+  unsigned long batches_;
+  unsigned long batch_requests_;
+  unsigned long batch_rows_;
+  unsigned long reloads_;
+  unsigned long reload_errors_;
+  unsigned long report_requests_;
+  unsigned long report_rows_;
+
+  // latencies ring (microseconds)
+  std::vector<unsigned long> latencies_;
+  unsigned long latency_pos_;
+};
+
+#endif /*PREDICTDAEMON_SERVERSTATS_HPP_*/
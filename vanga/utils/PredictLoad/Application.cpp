@@ -0,0 +1,583 @@
+/* 
+ * This file is part of the Vanga distribution (https://github.com/yoori/vanga).
+ * Vanga is library that implement multinode decision tree constructing algorithm
+ * for regression prediction
+ *
+ * Copyright (c) 2014 Yuri Kuznecov <yuri.kuznecov@gmail.com>.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <Gears/Basic/AppUtils.hpp>
+#include <Gears/Basic/Lock.hpp>
+#include <Gears/Basic/OutputMemoryStream.hpp>
+#include <Gears/Threading/ThreadRunner.hpp>
+
+#include <DTree/Label.hpp>
+#include <DTree/BinaryModel.hpp>
+#include <DTree/PredictProtocol.hpp>
+
+#include "Application.hpp"
+
+using namespace Vanga;
+
+namespace
+{
+  const char USAGE[] =
+    "\nUsage: \n"
+    "vanga-predictd-load [options] <svm file>\n"
+    "  send prediction requests with svm file rows to vanga-predictd\n"
+    "  from parallel connections (one request in flight per connection),\n"
+    "  print client side latencies and daemon stats\n"
+    "Options:\n"
+    "  --connect=unix:<path>|[<host>:]<port>: address (unix:/tmp/vanga-predictd.sock)\n"
+    "  --connections=<number>: parallel connections (8)\n"
+    "  --requests=<number>: requests of each connection (10000)\n"
+    "  --rows=<number>: rows in request (1)\n"
+    "  --model=<index>: model index (0)\n"
+    "  --binary: send binary feature lists instead svm lines\n"
+    "  --check=<model file>: compare predictions with local prediction of model\n";
+
+  typedef std::chrono::steady_clock Clock;
+}
+
+// Application_::LoadJob: sends requests over own connection
+class Application_::LoadJob: public Gears::ThreadJob
+{
+public:
+  LoadJob(
+    const std::string& address,
+    const LoadRequestArray& requests,
+    unsigned long requests_per_connection,
+    bool check)
+    throw()
+    : sent_requests(0),
+      rows(0),
+      errors(0),
+      mismatches(0),
+      address_(address),
+      requests_(requests),
+      requests_per_connection_(requests_per_connection),
+      check_(check),
+      next_connection_i_(0)
+  {}
+
+  virtual void
+  work() throw();
+
+public:
+  // results, filled after connection finish
+  unsigned long sent_requests;
+  unsigned long rows;
+  unsigned long errors;
+  unsigned long mismatches;
+  std::string first_error;
+  std::vector<unsigned long> latencies; // microseconds
+
+protected:
+  virtual
+  ~LoadJob() throw()
+  {}
+
+  // returns error, empty if request processed
+  std::string
+  send_request_(
+    int fd,
+    const LoadRequest& request,
+    unsigned long& mismatches);
+
+protected:
+  const std::string address_;
+  const LoadRequestArray& requests_;
+  const unsigned long requests_per_connection_;
+  const bool check_;
+  std::atomic<unsigned long> next_connection_i_;
+  Gears::Mutex lock_;
+};
+
+void
+Application_::LoadJob::work() throw()
+{
+  const unsigned long connection_i = next_connection_i_++;
+
+  unsigned long connection_requests = 0;
+  unsigned long connection_rows = 0;
+  unsigned long connection_errors = 0;
+  unsigned long connection_mismatches = 0;
+  std::string error;
+  std::vector<unsigned long> connection_latencies;
+  connection_latencies.reserve(requests_per_connection_);
+
+  int fd = -1;
+
+  try
+  {
+    fd = PredictProtocol::connect(address_);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    error = ex.what();
+    ++connection_errors;
+  }
+
+  for(unsigned long request_i = 0;
+    fd >= 0 && request_i < requests_per_connection_; ++request_i)
+  {
+    const LoadRequest& request =
+      requests_[(connection_i + request_i) % requests_.size()];
+
+    const Clock::time_point start = Clock::now();
+
+    std::string request_error;
+
+    try
+    {
+      request_error = send_request_(fd, request, connection_mismatches);
+    }
+    catch(const Gears::Exception& ex)
+    {
+      // connection can't be used after protocol error
+      request_error = ex.what();
+      ::close(fd);
+      fd = -1;
+    }
+
+    connection_latencies.push_back(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start).count());
+
+    ++connection_requests;
+
+    if(request_error.empty())
+    {
+      connection_rows += request.rows;
+    }
+    else
+    {
+      ++connection_errors;
+
+      if(error.empty())
+      {
+        error = request_error;
+      }
+    }
+  }
+
+  if(fd >= 0)
+  {
+    ::close(fd);
+  }
+
+  Gears::Mutex::WriteGuard guard(lock_);
+  sent_requests += connection_requests;
+  rows += connection_rows;
+  errors += connection_errors;
+  mismatches += connection_mismatches;
+  latencies.insert(
+    latencies.end(), connection_latencies.begin(), connection_latencies.end());
+
+  if(first_error.empty())
+  {
+    first_error = error;
+  }
+}
+
+std::string
+Application_::LoadJob::send_request_(
+  int fd,
+  const LoadRequest& request,
+  unsigned long& mismatches)
+{
+  PredictProtocol::write(fd, request.message.data(), request.message.size());
+
+  PredictProtocol::ResponseHead head;
+  if(!PredictProtocol::read(fd, &head, sizeof(head)))
+  {
+    throw Exception("connection closed by daemon");
+  }
+
+  if(head.size > PredictProtocol::MAX_BODY_SIZE)
+  {
+    throw Exception("too large response");
+  }
+
+  std::string body(head.size, 0);
+  if(head.size > 0 && !PredictProtocol::read(fd, &body[0], head.size))
+  {
+    throw Exception("connection closed by daemon");
+  }
+
+  if(head.status != PredictProtocol::S_OK)
+  {
+    return body;
+  }
+
+  if(head.rows != request.rows || head.size != sizeof(double) * request.rows)
+  {
+    return "unexpected response size";
+  }
+
+  if(check_)
+  {
+    for(unsigned long row_i = 0; row_i < request.rows; ++row_i)
+    {
+      double pred;
+      ::memcpy(&pred, body.data() + sizeof(double) * row_i, sizeof(pred));
+
+      if(pred != request.expected_preds[row_i])
+      {
+        ++mismatches;
+      }
+    }
+  }
+
+  return std::string();
+}
+
+// Application
+Application_::Application_()
+  throw()
+{}
+
+Application_::~Application_() throw()
+{}
+
+void
+Application_::main(int& argc, char** argv)
+  /*throw(Gears::Exception)*/
+{
+  Gears::AppUtils::CheckOption opt_help;
+  Gears::AppUtils::StringOption opt_connect("unix:/tmp/vanga-predictd.sock");
+  Gears::AppUtils::Option<unsigned long> opt_connections(8);
+  Gears::AppUtils::Option<unsigned long> opt_requests(10000);
+  Gears::AppUtils::Option<unsigned long> opt_rows(1);
+  Gears::AppUtils::Option<unsigned long> opt_model(0);
+  Gears::AppUtils::CheckOption opt_binary;
+  Gears::AppUtils::StringOption opt_check;
+
+  Gears::AppUtils::Args args(-1);
+
+  args.add(
+    Gears::AppUtils::equal_name("help") ||
+    Gears::AppUtils::short_name("h"),
+    opt_help);
+  args.add(
+    Gears::AppUtils::equal_name("connect") ||
+    Gears::AppUtils::short_name("c"),
+    opt_connect);
+  args.add(
+    Gears::AppUtils::equal_name("connections"),
+    opt_connections);
+  args.add(
+    Gears::AppUtils::equal_name("requests"),
+    opt_requests);
+  args.add(
+    Gears::AppUtils::equal_name("rows"),
+    opt_rows);
+  args.add(
+    Gears::AppUtils::equal_name("model"),
+    opt_model);
+  args.add(
+    Gears::AppUtils::equal_name("binary"),
+    opt_binary);
+  args.add(
+    Gears::AppUtils::equal_name("check"),
+    opt_check);
+
+  args.parse(argc - 1, argv + 1);
+
+  const Gears::AppUtils::Args::CommandList& commands = args.commands();
+
+  if(commands.empty() || opt_help.enabled() ||
+     *commands.begin() == "help")
+  {
+    std::cout << USAGE << std::endl;
+    return;
+  }
+
+  if(*opt_connections == 0 || *opt_rows == 0)
+  {
+    throw Exception("connections and rows numbers should be positive");
+  }
+
+  const std::string svm_file_path = *commands.begin();
+
+  std::ifstream svm_file(svm_file_path.c_str());
+  if(!svm_file.is_open())
+  {
+    Gears::ErrorStream ostr;
+    ostr << "can't open '" << svm_file_path << "'";
+    throw Exception(ostr.str());
+  }
+
+  std::vector<std::string> lines;
+
+  while(!svm_file.eof())
+  {
+    std::string line;
+    std::getline(svm_file, line);
+
+    if(!line.empty())
+    {
+      lines.push_back(line);
+    }
+  }
+
+  if(lines.empty())
+  {
+    throw Exception("svm file is empty");
+  }
+
+  // expected predictions of lines
+  const bool check = !opt_check->empty();
+  std::vector<double> line_preds;
+
+  if(check)
+  {
+    BinaryModel_var model = BinaryModel::load(*opt_check);
+    NumericFeatureSet numeric_features;
+    model->numeric_features(numeric_features);
+
+    for(auto line_it = lines.begin(); line_it != lines.end(); ++line_it)
+    {
+      std::istringstream line_istr(*line_it);
+      PredictedBoolLabel label;
+      Row_var row = SVM<PredictedBoolLabel>::load_line(
+        line_istr, label, &numeric_features);
+      line_preds.push_back(model->fpredict(row->features));
+    }
+  }
+
+  // requests cover all lines
+  const unsigned long rows = *opt_rows;
+  LoadRequestArray requests((lines.size() + rows - 1) / rows);
+
+  for(unsigned long request_i = 0; request_i < requests.size(); ++request_i)
+  {
+    LoadRequest& request = requests[request_i];
+    std::string body;
+
+    for(unsigned long row_i = 0; row_i < rows; ++row_i)
+    {
+      const unsigned long line_i = (request_i * rows + row_i) % lines.size();
+
+      if(opt_binary.enabled())
+      {
+        std::vector<std::pair<uint32_t, float> > features;
+        parse_line_(features, lines[line_i]);
+        PredictProtocol::write_binary_row(body, features);
+      }
+      else
+      {
+        body += lines[line_i];
+        body += '\n';
+      }
+
+      if(check)
+      {
+        request.expected_preds.push_back(line_preds[line_i]);
+      }
+    }
+
+    PredictProtocol::RequestHead head;
+    head.type = opt_binary.enabled() ?
+      PredictProtocol::RT_BINARY : PredictProtocol::RT_SVM;
+    head.id = request_i;
+    head.model = *opt_model;
+    head.rows = rows;
+    head.size = body.size();
+
+    request.message.assign(reinterpret_cast<const char*>(&head), sizeof(head));
+    request.message += body;
+    request.rows = rows;
+  }
+
+  Gears::IntrusivePtr<LoadJob> job = new LoadJob(
+    *opt_connect,
+    requests,
+    *opt_requests,
+    check);
+
+  const Clock::time_point start = Clock::now();
+
+  {
+    Gears::ThreadRunner runner(job, *opt_connections);
+    runner.start();
+    runner.wait_for_completion();
+  }
+
+  const double time = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::sort(job->latencies.begin(), job->latencies.end());
+
+  std::cout << "connections " << *opt_connections << std::endl <<
+    "requests " << job->sent_requests << std::endl <<
+    "rows " << job->rows << std::endl <<
+    "errors " << job->errors << std::endl;
+
+  if(check)
+  {
+    std::cout << "mismatches " << job->mismatches << std::endl;
+  }
+
+  std::cout << "time " << time << std::endl <<
+    "qps " << (time > 0 ? job->sent_requests / time : 0.0) << std::endl <<
+    "rows_per_second " << (time > 0 ? job->rows / time : 0.0) << std::endl <<
+    "latency_p50_us " << percentile_(job->latencies, 0.5) << std::endl <<
+    "latency_p99_us " << percentile_(job->latencies, 0.99) << std::endl <<
+    "latency_max_us " <<
+      (job->latencies.empty() ? 0 : job->latencies.back()) << std::endl;
+
+  if(!job->first_error.empty())
+  {
+    std::cout << "first_error " << job->first_error << std::endl;
+  }
+
+  std::cout << std::endl << "daemon stats:" << std::endl <<
+    stats_(*opt_connect);
+}
+
+void
+Application_::parse_line_(
+  std::vector<std::pair<uint32_t, float> >& features,
+  const std::string& line)
+{
+  // label, then <feature id>[:<value>] tokens
+  std::istringstream line_istr(line);
+  std::string token;
+  line_istr >> token;
+
+  while(line_istr >> token)
+  {
+    char* end;
+    const unsigned long feature_id = std::strtoul(token.c_str(), &end, 10);
+    float value = 1.0;
+
+    if(*end == ':')
+    {
+      value = static_cast<float>(std::strtod(end + 1, &end));
+    }
+
+    if(*end != 0 || feature_id > 0xFFFFFFFF)
+    {
+      Gears::ErrorStream ostr;
+      ostr << "invalid feature '" << token << "'";
+      throw Exception(ostr.str());
+    }
+
+    features.push_back(std::make_pair(feature_id, value));
+  }
+}
+
+std::string
+Application_::stats_(const std::string& address)
+{
+  const int fd = PredictProtocol::connect(address);
+
+  PredictProtocol::RequestHead head;
+  head.type = PredictProtocol::RT_STATS;
+  head.id = 0;
+  head.model = 0;
+  head.rows = 0;
+  head.size = 0;
+
+  std::string body;
+
+  try
+  {
+    PredictProtocol::write(fd, &head, sizeof(head));
+
+    PredictProtocol::ResponseHead response_head;
+    if(!PredictProtocol::read(fd, &response_head, sizeof(response_head)) ||
+      response_head.size > PredictProtocol::MAX_BODY_SIZE)
+    {
+      throw Exception("invalid stats response");
+    }
+
+    body.resize(response_head.size);
+    if(response_head.size > 0 &&
+      !PredictProtocol::read(fd, &body[0], response_head.size))
+    {
+      throw Exception("invalid stats response");
+    }
+  }
+  catch(...)
+  {
+    ::close(fd);
+    throw;
+  }
+
+  ::close(fd);
+  return body;
+}
+
+unsigned long
+Application_::percentile_(
+  const std::vector<unsigned long>& values,
+  double quantile)
+  throw()
+{
+  if(values.empty())
+  {
+    return 0;
+  }
+
+  return values[std::min(
+    static_cast<unsigned long>(quantile * values.size()),
+    static_cast<unsigned long>(values.size() - 1))];
+}
+
+// main
+int
+main(int argc, char** argv)
+{
+  Application_* app = 0;
+
+  try
+  {
+    app = &Application::instance();
+  }
+  catch (...)
+  {
+    std::cerr << "main(): Critical: Got exception while "
+      "creating application object.\n";
+    return -1;
+  }
+
+  assert(app);
+
+  try
+  {
+    app->main(argc, argv);
+  }
+  catch(const Gears::Exception& ex)
+  {
+    std::cerr << "Caught Gears::Exception: " << ex.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}